@@ -0,0 +1,172 @@
+/*
+    ArchiveMounts.cpp - Archive mount tracking for MpqFileLister plugin
+*/
+
+#include "ArchiveMounts.h"
+#include "Timing.h"
+#include <filesystem>
+#include <iomanip>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+struct ArchiveMount
+{
+    std::string path;
+    std::string name;           // File name only, as written in the log
+    HANDLE handle;
+    DWORD priority;
+    DWORD flags;
+    bool succeeded;
+    bool beforeHooks;           // Mounted before the hooks were installed; no timings
+    bool closed;
+    uint64_t startTicks;
+    uint64_t stormTicks;
+    uint64_t closeTicks;
+};
+
+// Looked up on every logged open, and only written when archives come and go
+static std::shared_mutex s_archiveMutex;
+static std::vector<ArchiveMount> s_mounts;
+static std::unordered_map<HANDLE, size_t> s_mountedArchives;   // Handle to index in s_mounts
+
+static std::string GetArchiveFileName(const char* path)
+{
+    return std::filesystem::path(path).filename().string();
+}
+
+void RecordArchiveOpened(const char* path, DWORD priority, DWORD flags, HANDLE archive,
+                         bool succeeded, uint64_t startTicks, uint64_t stormTicks)
+{
+    ArchiveMount mount = {};
+    mount.path = path ? path : "";
+    mount.name = GetArchiveFileName(mount.path.c_str());
+    mount.handle = succeeded ? archive : nullptr;
+    mount.priority = priority;
+    mount.flags = flags;
+    mount.succeeded = succeeded;
+    mount.startTicks = startTicks;
+    mount.stormTicks = stormTicks;
+
+    std::unique_lock<std::shared_mutex> lock(s_archiveMutex);
+    s_mounts.push_back(std::move(mount));
+
+    // A handle Storm hands out again belongs to the new archive
+    if (succeeded)
+        s_mountedArchives[archive] = s_mounts.size() - 1;
+}
+
+void RecordArchiveClosed(HANDLE archive, uint64_t startTicks)
+{
+    std::unique_lock<std::shared_mutex> lock(s_archiveMutex);
+
+    auto it = s_mountedArchives.find(archive);
+    if (it == s_mountedArchives.end())
+        return;
+
+    ArchiveMount& mount = s_mounts[it->second];
+    mount.closed = true;
+    mount.closeTicks = startTicks;
+    s_mountedArchives.erase(it);
+}
+
+bool FindArchiveName(HANDLE archive, std::string& name)
+{
+    std::shared_lock<std::shared_mutex> lock(s_archiveMutex);
+
+    auto it = s_mountedArchives.find(archive);
+    if (it == s_mountedArchives.end())
+        return false;
+
+    name = s_mounts[it->second].name;
+    return true;
+}
+
+bool FindArchivePath(HANDLE archive, std::string& path)
+{
+    std::shared_lock<std::shared_mutex> lock(s_archiveMutex);
+
+    auto it = s_mountedArchives.find(archive);
+    if (it == s_mountedArchives.end())
+        return false;
+
+    path = s_mounts[it->second].path;
+    return true;
+}
+
+void RememberArchiveName(HANDLE archive, const char* path)
+{
+    ArchiveMount mount = {};
+    mount.path = path ? path : "";
+    mount.name = GetArchiveFileName(mount.path.c_str());
+    mount.handle = archive;
+    mount.succeeded = true;
+    mount.beforeHooks = true;
+
+    std::unique_lock<std::shared_mutex> lock(s_archiveMutex);
+
+    // Another thread may have added it while the caller asked Storm
+    if (s_mountedArchives.count(archive))
+        return;
+    s_mounts.push_back(std::move(mount));
+    s_mountedArchives[archive] = s_mounts.size() - 1;
+}
+
+// Milliseconds since the session started, or "-" for times not recorded
+static std::string FormatSessionMs(uint64_t ticks, uint64_t sessionStartTicks)
+{
+    if (ticks == 0)
+        return "-";
+    return FormatTicksAsMs(ticks > sessionStartTicks ? ticks - sessionStartTicks : 0);
+}
+
+void WriteArchiveReport(std::ostream& out, uint64_t sessionStartTicks)
+{
+    std::shared_lock<std::shared_mutex> lock(s_archiveMutex);
+
+    unsigned mounted = 0;
+    unsigned failed = 0;
+    uint64_t totalTicks = 0;
+    for (const ArchiveMount& mount : s_mounts)
+    {
+        if (mount.beforeHooks)
+            continue;
+        if (mount.succeeded)
+            mounted++;
+        else
+            failed++;
+        totalTicks += mount.stormTicks;
+    }
+
+    out << "Archives: " << mounted << " mounted, " << failed << " failed, "
+        << FormatTicksAsMs(totalTicks) << " ms in SFileOpenArchive\n\n";
+
+    out << std::setw(12) << "Opened at"
+        << std::setw(12) << "Mount ms"
+        << std::setw(10) << "Priority"
+        << std::setw(10) << "Flags"
+        << std::setw(12) << "Handle"
+        << std::setw(12) << "Closed at"
+        << "  Archive\n";
+
+    for (const ArchiveMount& mount : s_mounts)
+    {
+        std::ostringstream handle;
+        handle << "0x" << std::hex << reinterpret_cast<uintptr_t>(mount.handle);
+
+        out << std::setw(12) << (mount.beforeHooks ? "-" : FormatSessionMs(mount.startTicks, sessionStartTicks))
+            << std::setw(12) << (mount.beforeHooks ? "-" : FormatTicksAsMs(mount.stormTicks));
+        if (mount.beforeHooks)
+            out << std::setw(10) << "-" << std::setw(10) << "-";
+        else
+            out << std::setw(10) << mount.priority << std::setw(10) << mount.flags;
+        out << std::setw(12) << (mount.succeeded ? handle.str() : "failed")
+            << std::setw(12) << (mount.closed ? FormatSessionMs(mount.closeTicks, sessionStartTicks) : "-")
+            << "  " << mount.path;
+        if (mount.beforeHooks)
+            out << " (mounted before the hooks)";
+        out << "\n";
+    }
+}
@@ -0,0 +1,42 @@
+/*
+    ArchiveMounts.h - Archive mount tracking for MpqFileLister plugin
+
+    SFileOpenArchive and SFileCloseArchive are hooked to time every mount
+    and record the archive's path, priority, flags and handle. The same
+    events keep a table from archive handle to file name, so logging which
+    archive a file came from does not need to ask Storm for the archive's
+    name on every open. Archives mounted before the hooks were installed are
+    added to the table the first time a file is opened from them.
+*/
+
+#ifndef ARCHIVEMOUNTS_H
+#define ARCHIVEMOUNTS_H
+
+#include <windows.h>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Record a call to SFileOpenArchive
+void RecordArchiveOpened(const char* path, DWORD priority, DWORD flags, HANDLE archive,
+                         bool succeeded, uint64_t startTicks, uint64_t stormTicks);
+
+// Record a call to SFileCloseArchive, before Storm closes the archive
+void RecordArchiveClosed(HANDLE archive, uint64_t startTicks);
+
+// File name (without directories) of a mounted archive. Returns false if
+// the archive was not seen mounted; the caller can then ask Storm and add
+// it with RememberArchiveName.
+bool FindArchiveName(HANDLE archive, std::string& name);
+
+// Path of a mounted archive, as it was mounted. Returns false if the
+// archive was not seen mounted.
+bool FindArchivePath(HANDLE archive, std::string& path);
+
+// Add an archive mounted before the hooks were installed
+void RememberArchiveName(HANDLE archive, const char* path);
+
+// Write every mount in order, with its time and, if closed, when
+void WriteArchiveReport(std::ostream& out, uint64_t sessionStartTicks);
+
+#endif // ARCHIVEMOUNTS_H
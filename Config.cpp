@@ -11,6 +11,28 @@ bool g_logUniqueOnly = true;
 LogFormat g_logFormat = LogFormat::FILENAME_ONLY;
 TargetGame g_targetGame = TargetGame::LATER;
 std::string g_logFileName = "MpqFileLister_FileLog.txt";
+bool g_logCompress = false;
+unsigned g_logRotateSizeMB = 0;
+unsigned g_logBufferKB = 64;
+bool g_logThreadId = false;
+bool g_writeThreadStats = false;
+bool g_logMisses = false;
+unsigned g_phaseIdleGapMs = 0;
+unsigned g_phaseMinFiles = 1;
+bool g_liveStats = false;
+unsigned g_liveStatsIntervalMs = 250;
+std::string g_prefetchManifest;
+unsigned g_prefetchWindow = 64;
+unsigned g_fileCacheBudgetKB = 0;
+unsigned g_fileCacheMaxFileKB = 64;
+bool g_writeArchiveMounts = false;
+bool g_writeDirectoryTree = false;
+bool g_profileDecompression = false;
+bool g_memProfile = false;
+std::vector<std::string> g_recordSinks;
+unsigned g_recordQueueSize = 4096;
+bool g_pluginHeap = true;
+bool g_writeHeapStats = false;
 
 // Path to the config file (next to the plugin DLL)
 static std::string g_configFilePath;
@@ -46,7 +68,7 @@ void LoadConfig()
         else if (line.rfind("LogFormat=", 0) == 0)
         {
             int formatValue = std::stoi(line.substr(10));
-            if (formatValue >= 0 && formatValue <= 3)
+            if (formatValue >= 0 && formatValue <= 4)
                 g_logFormat = static_cast<LogFormat>(formatValue);
         }
         else if (line.rfind("TargetGame=", 0) == 0)
@@ -59,6 +81,116 @@ void LoadConfig()
         {
             g_logFileName = line.substr(12);
         }
+        else if (line.rfind("LogCompress=", 0) == 0)
+        {
+            g_logCompress = (line.substr(12) == "1");
+        }
+        else if (line.rfind("LogRotateSizeMB=", 0) == 0)
+        {
+            int rotateValue = std::stoi(line.substr(16));
+            if (rotateValue >= 0)
+                g_logRotateSizeMB = static_cast<unsigned>(rotateValue);
+        }
+        else if (line.rfind("LogBufferKB=", 0) == 0)
+        {
+            int bufferValue = std::stoi(line.substr(12));
+            if (bufferValue >= 0 && bufferValue <= 16384)
+                g_logBufferKB = static_cast<unsigned>(bufferValue);
+        }
+        else if (line.rfind("LogThreadId=", 0) == 0)
+        {
+            g_logThreadId = (line.substr(12) == "1");
+        }
+        else if (line.rfind("WriteThreadStats=", 0) == 0)
+        {
+            g_writeThreadStats = (line.substr(17) == "1");
+        }
+        else if (line.rfind("LogMisses=", 0) == 0)
+        {
+            g_logMisses = (line.substr(10) == "1");
+        }
+        else if (line.rfind("PhaseIdleGapMs=", 0) == 0)
+        {
+            int gapValue = std::stoi(line.substr(15));
+            if (gapValue >= 0)
+                g_phaseIdleGapMs = static_cast<unsigned>(gapValue);
+        }
+        else if (line.rfind("PhaseMinFiles=", 0) == 0)
+        {
+            int minValue = std::stoi(line.substr(14));
+            if (minValue >= 1)
+                g_phaseMinFiles = static_cast<unsigned>(minValue);
+        }
+        else if (line.rfind("LiveStats=", 0) == 0)
+        {
+            g_liveStats = (line.substr(10) == "1");
+        }
+        else if (line.rfind("LiveStatsIntervalMs=", 0) == 0)
+        {
+            int intervalValue = std::stoi(line.substr(20));
+            if (intervalValue >= 1)
+                g_liveStatsIntervalMs = static_cast<unsigned>(intervalValue);
+        }
+        else if (line.rfind("PrefetchManifest=", 0) == 0)
+        {
+            g_prefetchManifest = line.substr(17);
+        }
+        else if (line.rfind("PrefetchWindow=", 0) == 0)
+        {
+            int windowValue = std::stoi(line.substr(15));
+            if (windowValue >= 1)
+                g_prefetchWindow = static_cast<unsigned>(windowValue);
+        }
+        else if (line.rfind("FileCacheBudgetKB=", 0) == 0)
+        {
+            int budgetValue = std::stoi(line.substr(18));
+            if (budgetValue >= 0)
+                g_fileCacheBudgetKB = static_cast<unsigned>(budgetValue);
+        }
+        else if (line.rfind("FileCacheMaxFileKB=", 0) == 0)
+        {
+            int maxValue = std::stoi(line.substr(19));
+            if (maxValue >= 1)
+                g_fileCacheMaxFileKB = static_cast<unsigned>(maxValue);
+        }
+        else if (line.rfind("WriteArchiveMounts=", 0) == 0)
+        {
+            g_writeArchiveMounts = (line.substr(19) == "1");
+        }
+        else if (line.rfind("WriteDirectoryTree=", 0) == 0)
+        {
+            g_writeDirectoryTree = (line.substr(19) == "1");
+        }
+        else if (line.rfind("ProfileDecompression=", 0) == 0)
+        {
+            g_profileDecompression = (line.substr(21) == "1");
+        }
+        else if (line.rfind("MemProfile=", 0) == 0)
+        {
+            g_memProfile = (line.substr(11) == "1");
+        }
+        else if (line.rfind("Sink", 0) == 0 && line.size() > 5 && line[4] >= '1' &&
+                 line[4] <= static_cast<char>('0' + MAX_RECORD_SINKS) && line[5] == '=')
+        {
+            size_t index = static_cast<size_t>(line[4] - '1');
+            if (g_recordSinks.size() <= index)
+                g_recordSinks.resize(index + 1);
+            g_recordSinks[index] = line.substr(6);
+        }
+        else if (line.rfind("RecordQueueSize=", 0) == 0)
+        {
+            int queueValue = std::stoi(line.substr(16));
+            if (queueValue >= 64 && queueValue <= 1048576)
+                g_recordQueueSize = static_cast<unsigned>(queueValue);
+        }
+        else if (line.rfind("PluginHeap=", 0) == 0)
+        {
+            g_pluginHeap = (line.substr(11) == "1");
+        }
+        else if (line.rfind("WriteHeapStats=", 0) == 0)
+        {
+            g_writeHeapStats = (line.substr(15) == "1");
+        }
     }
 }
 
@@ -75,4 +207,30 @@ void SaveConfig()
     file << "LogFormat=" << static_cast<int>(g_logFormat) << "\n";
     file << "TargetGame=" << static_cast<int>(g_targetGame) << "\n";
     file << "LogFileName=" << g_logFileName << "\n";
+    file << "LogCompress=" << (g_logCompress ? "1" : "0") << "\n";
+    file << "LogRotateSizeMB=" << g_logRotateSizeMB << "\n";
+    file << "LogBufferKB=" << g_logBufferKB << "\n";
+    file << "LogThreadId=" << (g_logThreadId ? "1" : "0") << "\n";
+    file << "WriteThreadStats=" << (g_writeThreadStats ? "1" : "0") << "\n";
+    file << "LogMisses=" << (g_logMisses ? "1" : "0") << "\n";
+    file << "PhaseIdleGapMs=" << g_phaseIdleGapMs << "\n";
+    file << "PhaseMinFiles=" << g_phaseMinFiles << "\n";
+    file << "LiveStats=" << (g_liveStats ? "1" : "0") << "\n";
+    file << "LiveStatsIntervalMs=" << g_liveStatsIntervalMs << "\n";
+    file << "PrefetchManifest=" << g_prefetchManifest << "\n";
+    file << "PrefetchWindow=" << g_prefetchWindow << "\n";
+    file << "FileCacheBudgetKB=" << g_fileCacheBudgetKB << "\n";
+    file << "FileCacheMaxFileKB=" << g_fileCacheMaxFileKB << "\n";
+    file << "WriteArchiveMounts=" << (g_writeArchiveMounts ? "1" : "0") << "\n";
+    file << "WriteDirectoryTree=" << (g_writeDirectoryTree ? "1" : "0") << "\n";
+    file << "ProfileDecompression=" << (g_profileDecompression ? "1" : "0") << "\n";
+    file << "MemProfile=" << (g_memProfile ? "1" : "0") << "\n";
+    for (size_t i = 0; i < g_recordSinks.size(); i++)
+    {
+        if (!g_recordSinks[i].empty())
+            file << "Sink" << (i + 1) << "=" << g_recordSinks[i] << "\n";
+    }
+    file << "RecordQueueSize=" << g_recordQueueSize << "\n";
+    file << "PluginHeap=" << (g_pluginHeap ? "1" : "0") << "\n";
+    file << "WriteHeapStats=" << (g_writeHeapStats ? "1" : "0") << "\n";
 }
@@ -7,6 +7,7 @@
 
 #include <windows.h>
 #include <string>
+#include <vector>
 
 // === Configuration variables ===
 
@@ -16,9 +17,13 @@ enum class LogFormat
     TIMESTAMP_ARCHIVE_FILENAME = 0,   // Print '<timestamp> <MPQ archive>: <filename>'
     ARCHIVE_FILENAME = 1,             // Print '<MPQ archive>: <filename>'
     TIMESTAMP_FILENAME = 2,           // Print '<timestamp> <filename>'
-    FILENAME_ONLY = 3                 // Print '<filename>'
+    FILENAME_ONLY = 3,                // Print '<filename>'
+    CHROME_TRACE = 4                  // Chrome trace-event JSON, viewable in Perfetto
 };
 
+// Sinks are configured as Sink1 to Sink<MAX_RECORD_SINKS>
+constexpr unsigned MAX_RECORD_SINKS = 8;
+
 // Target game options (determines which Storm.dll ordinals to use)
 enum class TargetGame
 {
@@ -30,6 +35,28 @@ extern bool g_logUniqueOnly;
 extern LogFormat g_logFormat;
 extern TargetGame g_targetGame;
 extern std::string g_logFileName;
+extern bool g_logCompress;         // Compress text logs on a background thread (tools/LzLog.h format)
+extern unsigned g_logRotateSizeMB; // Size at which a text log continues in its next part (0 disables rotation)
+extern unsigned g_logBufferKB;     // Text log buffered before it is written out (0 writes every line through)
+extern bool g_logThreadId;         // Include the ID of the calling thread in each record
+extern bool g_writeThreadStats;    // Write per-thread statistics next to the log on exit
+extern bool g_logMisses;           // Count failed opens and write them next to the log on exit
+extern unsigned g_phaseIdleGapMs;  // Idle time that ends a load phase (0 disables phase detection)
+extern unsigned g_phaseMinFiles;   // Bursts with fewer opens than this are not reported as phases
+extern bool g_liveStats;           // Publish live counters in shared memory for external monitors
+extern unsigned g_liveStatsIntervalMs;  // How often the live counters are published
+extern std::string g_prefetchManifest;  // Log of an earlier session, prefetched in its order (empty disables)
+extern unsigned g_prefetchWindow;  // How many files the prefetcher may run ahead of the game
+extern unsigned g_fileCacheBudgetKB;   // Memory for caching the contents of small files (0 disables the cache)
+extern unsigned g_fileCacheMaxFileKB;  // Largest file the cache holds
+extern bool g_writeArchiveMounts;  // Write the archive mounts and their times next to the log on exit
+extern bool g_writeDirectoryTree;  // Write the opens aggregated by directory next to the log on exit
+extern bool g_profileDecompression;  // Time reads and decompression per file and method, written next to the log on exit
+extern bool g_memProfile;         // Profile Storm allocations per call site and write them next to the log on exit
+extern std::vector<std::string> g_recordSinks;  // Outputs besides the log, "<type>,<file>[,<option>=<value>...]" (see RecordSinks.h)
+extern unsigned g_recordQueueSize; // Accesses the record queue holds, when there are sinks
+extern bool g_pluginHeap;          // Allocate the plugin's memory from its own heap instead of the game's CRT heap
+extern bool g_writeHeapStats;      // Write the plugin heap's footprint next to the log on exit
 
 // === Configuration functions ===
 
@@ -25,6 +25,7 @@ static constexpr int IDC_BROWSE_BUTTON = 112;
 static constexpr int IDC_TARGET_GAME_GROUPBOX = 113;
 static constexpr int IDC_RADIO_DIABLO1 = 114;
 static constexpr int IDC_RADIO_LATER = 115;
+static constexpr int IDC_RADIO_CHROME_TRACE = 116;
 static constexpr int IDC_OK_BUTTON = IDOK;
 static constexpr int IDC_CANCEL_BUTTON = IDCANCEL;
 
@@ -48,6 +49,7 @@ static const char* RADIO_TIMESTAMP_ARCHIVE_FILENAME_TEXT = "<timestamp> <MPQ arc
 static const char* RADIO_ARCHIVE_FILENAME_TEXT = "<MPQ archive>: <filename>";
 static const char* RADIO_TIMESTAMP_FILENAME_TEXT = "<timestamp> <filename>";
 static const char* RADIO_FILENAME_ONLY_TEXT = "<filename>";
+static const char* RADIO_CHROME_TRACE_TEXT = "Chrome trace-event JSON (open in Perfetto)";
 static const char* LOG_FILENAME_GROUPBOX_TEXT = "Log file name";
 static const char* PATH_LABEL_TEXT = "Enter filename only (not full path) to create the file in the game's directory";
 static const char* BROWSE_BUTTON_TEXT = "&Browse...";
@@ -84,7 +86,7 @@ struct DialogSizes
     SIZE desc;
     SIZE uniqueCheckbox;
     SIZE timestampInfo;
-    SIZE radio1, radio2, radio3, radio4;
+    SIZE radio1, radio2, radio3, radio4, radio5;
     SIZE radioDiablo1, radioLater;
     SIZE label;
     SIZE browse;
@@ -157,6 +159,7 @@ static DialogSizes MeasureAllSizes(HDC hdc, int maxDescWidth = 400)
     sizes.radio2 = MeasureText(hdc, RADIO_ARCHIVE_FILENAME_TEXT);
     sizes.radio3 = MeasureText(hdc, RADIO_TIMESTAMP_FILENAME_TEXT);
     sizes.radio4 = MeasureText(hdc, RADIO_FILENAME_ONLY_TEXT);
+    sizes.radio5 = MeasureText(hdc, RADIO_CHROME_TRACE_TEXT);
     sizes.radioDiablo1 = MeasureText(hdc, RADIO_DIABLO1_TEXT);
     sizes.radioLater = MeasureText(hdc, RADIO_LATER_TEXT);
     sizes.label = MeasureText(hdc, PATH_LABEL_TEXT);
@@ -170,6 +173,7 @@ static DialogSizes MeasureAllSizes(HDC hdc, int maxDescWidth = 400)
     AddRadioPadding(sizes.radio2);
     AddRadioPadding(sizes.radio3);
     AddRadioPadding(sizes.radio4);
+    AddRadioPadding(sizes.radio5);
     AddRadioPadding(sizes.radioDiablo1);
     AddRadioPadding(sizes.radioLater);
     AddButtonPadding(sizes.browse, 16);
@@ -184,7 +188,8 @@ static int CalculateLogFormatGroupBoxHeight(const DialogSizes& sizes)
 {
     return GROUPBOX_TITLE_HEIGHT + sizes.timestampInfo.cy + SMALL_SPACING +
            sizes.radio1.cy + SMALL_SPACING + sizes.radio2.cy + SMALL_SPACING +
-           sizes.radio3.cy + SMALL_SPACING + sizes.radio4.cy + GROUPBOX_BOTTOM_PADDING;
+           sizes.radio3.cy + SMALL_SPACING + sizes.radio4.cy + SMALL_SPACING +
+           sizes.radio5.cy + GROUPBOX_BOTTOM_PADDING;
 }
 
 // Calculate height of log filename group box
@@ -235,6 +240,8 @@ static void HandleOkButton(HWND hDlg)
         g_logFormat = LogFormat::TIMESTAMP_FILENAME;
     else if (IsDlgButtonChecked(hDlg, IDC_RADIO_FILENAME_ONLY) == BST_CHECKED)
         g_logFormat = LogFormat::FILENAME_ONLY;
+    else if (IsDlgButtonChecked(hDlg, IDC_RADIO_CHROME_TRACE) == BST_CHECKED)
+        g_logFormat = LogFormat::CHROME_TRACE;
 
     // Save target game radio button state
     if (IsDlgButtonChecked(hDlg, IDC_RADIO_DIABLO1) == BST_CHECKED)
@@ -259,7 +266,7 @@ static void CalculateDialogLayout(HDC hdc)
     // Calculate required width (widest element + margins)
     int contentWidth = MaxWidth({
         sizes.desc.cx, sizes.uniqueCheckbox.cx,
-        sizes.radio1.cx, sizes.radio2.cx, sizes.radio3.cx, sizes.radio4.cx,
+        sizes.radio1.cx, sizes.radio2.cx, sizes.radio3.cx, sizes.radio4.cx, sizes.radio5.cx,
         sizes.radioDiablo1.cx, sizes.radioLater.cx, sizes.label.cx
     });
 
@@ -350,6 +357,12 @@ static HWND CreateDialogControls(HWND hDlg, HMODULE hModule)
                   WS_CHILD | WS_VISIBLE | WS_TABSTOP | BS_AUTORADIOBUTTON,
                   logFormatInnerX, logFormatInnerY, sizes.radio4.cx + SPACING, sizes.radio4.cy,
                   hDlg, IDC_RADIO_FILENAME_ONLY, hModule, hFont);
+    logFormatInnerY += sizes.radio4.cy + SMALL_SPACING;
+
+    CreateControl("BUTTON", RADIO_CHROME_TRACE_TEXT,
+                  WS_CHILD | WS_VISIBLE | WS_TABSTOP | BS_AUTORADIOBUTTON,
+                  logFormatInnerX, logFormatInnerY, sizes.radio5.cx + SPACING, sizes.radio5.cy,
+                  hDlg, IDC_RADIO_CHROME_TRACE, hModule, hFont);
 
     // Set initial radio button selection based on g_logFormat
     int selectedRadio = IDC_RADIO_FILENAME_ONLY;
@@ -367,6 +380,9 @@ static HWND CreateDialogControls(HWND hDlg, HMODULE hModule)
         case LogFormat::FILENAME_ONLY:
             selectedRadio = IDC_RADIO_FILENAME_ONLY;
             break;
+        case LogFormat::CHROME_TRACE:
+            selectedRadio = IDC_RADIO_CHROME_TRACE;
+            break;
     }
     CheckDlgButton(hDlg, selectedRadio, BST_CHECKED);
 
@@ -0,0 +1,86 @@
+/*
+    CrashDrain.cpp - Writing out buffered log data when the game crashes
+*/
+
+#include "CrashDrain.h"
+
+static const size_t MAX_CRASH_DRAINS = 8;
+
+static CrashDrainFunction s_drains[MAX_CRASH_DRAINS];
+static std::atomic<size_t> s_drainCount{0};
+static PVOID s_handler = nullptr;
+
+// Thread running the drains, so an exception inside a drain does not recurse
+static std::atomic<DWORD> s_drainingThread{0};
+
+static bool IsFatalException(DWORD code)
+{
+    switch (code)
+    {
+        case EXCEPTION_ACCESS_VIOLATION:
+        case EXCEPTION_STACK_OVERFLOW:
+        case EXCEPTION_ILLEGAL_INSTRUCTION:
+        case EXCEPTION_PRIV_INSTRUCTION:
+        case EXCEPTION_INT_DIVIDE_BY_ZERO:
+        case EXCEPTION_ARRAY_BOUNDS_EXCEEDED:
+        case EXCEPTION_IN_PAGE_ERROR:
+        case EXCEPTION_NONCONTINUABLE_EXCEPTION:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static LONG WINAPI CrashDrainHandler(PEXCEPTION_POINTERS exceptionInfo)
+{
+    if (exceptionInfo && exceptionInfo->ExceptionRecord &&
+        IsFatalException(exceptionInfo->ExceptionRecord->ExceptionCode))
+        RunCrashDrains();
+
+    // Leave the exception to the game (and to Windows' crash reporting)
+    return EXCEPTION_CONTINUE_SEARCH;
+}
+
+void AddCrashDrain(CrashDrainFunction drain)
+{
+    size_t count = s_drainCount.load();
+    for (size_t i = 0; i < count; i++)
+    {
+        if (s_drains[i] == drain)
+            return;
+    }
+    if (count < MAX_CRASH_DRAINS)
+    {
+        s_drains[count] = drain;
+        s_drainCount.store(count + 1);
+    }
+}
+
+void InstallCrashDrain()
+{
+    // First in the chain, so the drains run before any handler of the game's
+    if (!s_handler)
+        s_handler = AddVectoredExceptionHandler(1, CrashDrainHandler);
+}
+
+void RemoveCrashDrain()
+{
+    if (s_handler)
+    {
+        RemoveVectoredExceptionHandler(s_handler);
+        s_handler = nullptr;
+    }
+}
+
+void RunCrashDrains()
+{
+    DWORD expected = 0;
+    if (!s_drainingThread.compare_exchange_strong(expected, GetCurrentThreadId()))
+        return;
+
+    size_t count = s_drainCount.load();
+    for (size_t i = 0; i < count; i++)
+        s_drains[i]();
+
+    s_drainingThread.store(0);
+}
@@ -0,0 +1,75 @@
+/*
+    CrashDrain.h - Writing out buffered log data when the game crashes
+
+    Modules that keep log data in memory register a drain function, which
+    writes what they hold straight to their file without allocating. The
+    drains are run by a vectored exception handler when an exception that
+    usually ends the process is raised, before the game's own handlers (which
+    may never return). An exception the game goes on to handle only writes the
+    buffers out early.
+
+    A drain may run on a thread that crashed while holding a module's lock,
+    so buffers that drains read are guarded by a DrainLock, which knows its
+    owner and can be taken over by a crash drain.
+*/
+
+#ifndef CRASHDRAIN_H
+#define CRASHDRAIN_H
+
+#include <windows.h>
+#include <atomic>
+
+typedef void (*CrashDrainFunction)();
+
+// Spin lock that records the thread holding it
+class DrainLock
+{
+private:
+    std::atomic<DWORD> m_owner{0};
+
+public:
+    void Lock()
+    {
+        DWORD self = GetCurrentThreadId();
+        DWORD expected = 0;
+        while (!m_owner.compare_exchange_weak(expected, self, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            expected = 0;
+            SwitchToThread();
+        }
+    }
+
+    void Unlock() { m_owner.store(0, std::memory_order_release); }
+
+    // For a crash drain: wait up to timeoutMs for the lock. Returns false if
+    // the calling thread already holds it, or if another thread still does.
+    bool TryLockFor(DWORD timeoutMs)
+    {
+        DWORD self = GetCurrentThreadId();
+        if (m_owner.load(std::memory_order_relaxed) == self)
+            return false;
+
+        DWORD start = GetTickCount();
+        DWORD expected = 0;
+        while (!m_owner.compare_exchange_strong(expected, self, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            if (GetTickCount() - start >= timeoutMs)
+                return false;
+            expected = 0;
+            SwitchToThread();
+        }
+        return true;
+    }
+};
+
+// Register a drain (up to a small fixed number)
+void AddCrashDrain(CrashDrainFunction drain);
+
+// Install and remove the vectored exception handler
+void InstallCrashDrain();
+void RemoveCrashDrain();
+
+// Run every drain once, e.g. from an exception handler
+void RunCrashDrains();
+
+#endif // CRASHDRAIN_H
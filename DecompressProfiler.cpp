@@ -0,0 +1,314 @@
+/*
+    DecompressProfiler.cpp - Decompression cost profiling for MpqFileLister plugin
+*/
+
+#include "DecompressProfiler.h"
+#include "Timing.h"
+#include "tools/MpqArchive.h"
+#include "tools/StormName.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct FileReadStats
+{
+    std::string spelling;           // Name as first opened
+    std::string archivePath;        // Archive it was first opened from
+    uint64_t opens = 0;
+    uint64_t reads = 0;
+    uint64_t bytesRead = 0;
+    uint64_t readTicks = 0;         // Time in SFileReadFile
+
+    // From the archive, when the report is written
+    bool stored = false;            // Found in its archive
+    uint8_t methods = 0;            // Compression masks of its sectors
+    uint32_t storedSize = 0;
+    uint32_t fileSize = 0;
+};
+
+struct MethodStats
+{
+    uint64_t files = 0;
+    uint64_t reads = 0;
+    uint64_t bytesRead = 0;
+    uint64_t readTicks = 0;
+    uint64_t storedBytes = 0;
+    uint64_t fileBytes = 0;
+};
+
+static std::mutex s_decompressMutex;
+static std::unordered_map<std::string, FileReadStats> s_files;     // By normalized name
+static std::unordered_map<HANDLE, FileReadStats*> s_openFiles;
+
+void DecompressFileOpened(HANDLE file, const char* fileName, const std::string& archivePath)
+{
+    if (!fileName)
+        return;
+
+    std::string key = NormalizeStormName(fileName);
+
+    std::lock_guard<std::mutex> lock(s_decompressMutex);
+
+    FileReadStats& stats = s_files[key];
+    if (stats.spelling.empty())
+        stats.spelling = fileName;
+    if (stats.archivePath.empty())
+        stats.archivePath = archivePath;
+    stats.opens++;
+
+    // Storm may hand out the handle of a file the hooks did not see closed
+    s_openFiles[file] = &stats;
+}
+
+void DecompressFileClosed(HANDLE file)
+{
+    std::lock_guard<std::mutex> lock(s_decompressMutex);
+    s_openFiles.erase(file);
+}
+
+void RecordFileRead(HANDLE file, DWORD bytesRead, uint64_t stormTicks)
+{
+    std::lock_guard<std::mutex> lock(s_decompressMutex);
+
+    auto it = s_openFiles.find(file);
+    if (it == s_openFiles.end())
+        return;
+
+    FileReadStats* stats = it->second;
+    stats->reads++;
+    stats->bytesRead += bytesRead;
+    stats->readTicks += stormTicks;
+}
+
+// Compression mask at the start of a compressed sector. Encryption covers
+// whole 32-bit values only, so a shorter sector is stored as is.
+static uint8_t GetSectorMethods(const char* sector, uint32_t length, bool encrypted, uint32_t key)
+{
+    if (length == 0)
+        return 0;
+    if (!encrypted || length < 4)
+        return static_cast<uint8_t>(sector[0]);
+
+    uint32_t value;
+    memcpy(&value, sector, sizeof(value));
+    DecryptStormBlock(&value, 1, key);
+    return static_cast<uint8_t>(value & 0xFF);
+}
+
+// Fill in how a file is stored in its archive. Returns false if the archive
+// does not contain it.
+static bool ReadStoredFile(const MpqArchive& archive, FileReadStats& file)
+{
+    int64_t index = archive.FindHashEntry(HashStormName(file.spelling));
+    if (index < 0)
+        return false;
+
+    const MpqBlockEntry& block = archive.BlockTable()[archive.HashTable()[static_cast<size_t>(index)].blockIndex];
+    file.stored = true;
+    file.storedSize = block.compressedSize;
+    file.fileSize = block.fileSize;
+    file.methods = 0;
+
+    // Imploded files have no mask; every sector is PKWARE data
+    if (block.flags & MPQ_FILE_IMPLODE)
+    {
+        file.methods = 0x08;
+        return true;
+    }
+
+    const char* data = archive.GetBlockData(block);
+    if (!(block.flags & MPQ_FILE_COMPRESS) || !data || block.fileSize == 0)
+        return true;
+
+    bool encrypted = (block.flags & MPQ_FILE_ENCRYPTED) != 0;
+    uint32_t key = encrypted ? MpqArchive::GetFileKey(file.spelling, block) : 0;
+
+    // Data that did not get smaller was stored without compression
+    if (block.flags & MPQ_FILE_SINGLE_UNIT)
+    {
+        if (block.compressedSize < block.fileSize)
+            file.methods = GetSectorMethods(data, block.compressedSize, encrypted, key);
+        return true;
+    }
+
+    // Compressed files start with a table of sector offsets, encrypted with key - 1
+    uint32_t sectorSize = archive.SectorSize();
+    size_t sectors = (block.fileSize + sectorSize - 1) / sectorSize;
+    size_t entries = sectors + 1 + ((block.flags & MPQ_FILE_SECTOR_CRC) ? 1 : 0);
+    if (sectorSize == 0 || entries * 4 > block.compressedSize)
+        return true;
+    std::vector<uint32_t> offsets(entries);
+    memcpy(offsets.data(), data, entries * 4);
+    if (encrypted)
+        DecryptStormBlock(offsets.data(), entries, key - 1);
+
+    for (size_t i = 0; i < sectors; i++)
+    {
+        uint32_t start = offsets[i];
+        uint32_t end = offsets[i + 1];
+        if (start > end || end > block.compressedSize)
+            break;  // Damaged, or a key this reader does not know
+        uint32_t sectorBytes = std::min<uint32_t>(sectorSize, block.fileSize - static_cast<uint32_t>(i) * sectorSize);
+        if (end - start < sectorBytes)
+            file.methods |= GetSectorMethods(data + start, end - start, encrypted, key + static_cast<uint32_t>(i));
+    }
+    return true;
+}
+
+// Names of the compression methods in a mask, such as "huffman+adpcm-stereo"
+static std::string FormatMethods(uint8_t mask)
+{
+    static const struct { uint8_t bit; const char* name; } METHODS[] =
+    {
+        { 0x01, "huffman" },
+        { 0x02, "zlib" },
+        { 0x08, "pkware" },
+        { 0x10, "bzip2" },
+        { 0x40, "adpcm-mono" },
+        { 0x80, "adpcm-stereo" },
+    };
+
+    if (mask == 0)
+        return "stored";
+
+    std::string names;
+    uint8_t known = 0;
+    for (const auto& method : METHODS)
+    {
+        if (!(mask & method.bit))
+            continue;
+        if (!names.empty())
+            names += "+";
+        names += method.name;
+        known |= method.bit;
+    }
+    if (mask & ~known)
+    {
+        char unknown[8];
+        snprintf(unknown, sizeof(unknown), "0x%02X", mask & ~known);
+        if (!names.empty())
+            names += "+";
+        names += unknown;
+    }
+    return names;
+}
+
+void WriteDecompressReport(std::ostream& out)
+{
+    // Copied, so the archives are read without holding up the hooks
+    std::vector<FileReadStats> files;
+    {
+        std::lock_guard<std::mutex> lock(s_decompressMutex);
+        files.reserve(s_files.size());
+        for (const auto& file : s_files)
+        {
+            if (file.second.reads > 0)
+                files.push_back(file.second);
+        }
+    }
+
+    // One archive at a time, so only one is mapped at once
+    std::sort(files.begin(), files.end(), [](const FileReadStats& a, const FileReadStats& b)
+    {
+        return a.archivePath < b.archivePath;
+    });
+    std::vector<std::string> unreadable;
+    for (size_t first = 0; first < files.size(); )
+    {
+        size_t last = first;
+        while (last < files.size() && files[last].archivePath == files[first].archivePath)
+            last++;
+
+        MpqArchive archive;
+        if (files[first].archivePath.empty())
+        {
+            // Not opened from an archive, or from one the hooks could not name
+        }
+        else if (archive.Open(files[first].archivePath))
+        {
+            for (size_t i = first; i < last; i++)
+                ReadStoredFile(archive, files[i]);
+        }
+        else
+        {
+            unreadable.push_back(files[first].archivePath + ": " + archive.Error());
+        }
+        first = last;
+    }
+
+    // Per method: -1 for files whose compression is not known
+    std::map<int, MethodStats> methods;
+    uint64_t reads = 0;
+    uint64_t readTicks = 0;
+    for (const FileReadStats& file : files)
+    {
+        MethodStats& method = methods[file.stored ? file.methods : -1];
+        method.files++;
+        method.reads += file.reads;
+        method.bytesRead += file.bytesRead;
+        method.readTicks += file.readTicks;
+        method.storedBytes += file.storedSize;
+        method.fileBytes += file.fileSize;
+        reads += file.reads;
+        readTicks += file.readTicks;
+    }
+
+    out << "SFileReadFile: " << reads << " reads of " << files.size() << " files, " << FormatTicksAsMs(readTicks)
+        << " ms in Storm, decompression included\n";
+    for (const std::string& archive : unreadable)
+        out << "Cannot read archive " << archive << "\n";
+
+    out << "\nPer method (sizes as stored in the archive):\n"
+        << std::setw(8) << "Files"
+        << std::setw(10) << "Reads"
+        << std::setw(14) << "Bytes read"
+        << std::setw(14) << "Read ms"
+        << std::setw(14) << "Stored"
+        << std::setw(14) << "Size"
+        << "  Method\n";
+    for (const auto& method : methods)
+    {
+        out << std::setw(8) << method.second.files
+            << std::setw(10) << method.second.reads
+            << std::setw(14) << method.second.bytesRead
+            << std::setw(14) << FormatTicksAsMs(method.second.readTicks)
+            << std::setw(14) << method.second.storedBytes
+            << std::setw(14) << method.second.fileBytes
+            << "  " << (method.first < 0 ? "unknown (not found in an archive)" : FormatMethods(static_cast<uint8_t>(method.first)))
+            << "\n";
+    }
+
+    // Most expensive files first
+    std::sort(files.begin(), files.end(), [](const FileReadStats& a, const FileReadStats& b)
+    {
+        if (a.readTicks != b.readTicks)
+            return a.readTicks > b.readTicks;
+        return a.spelling < b.spelling;
+    });
+
+    out << "\nPer file:\n"
+        << std::setw(8) << "Opens"
+        << std::setw(10) << "Reads"
+        << std::setw(14) << "Bytes read"
+        << std::setw(14) << "Read ms"
+        << std::setw(12) << "Stored"
+        << std::setw(12) << "Size"
+        << "  Filename (methods)\n";
+    for (const FileReadStats& file : files)
+    {
+        out << std::setw(8) << file.opens
+            << std::setw(10) << file.reads
+            << std::setw(14) << file.bytesRead
+            << std::setw(14) << FormatTicksAsMs(file.readTicks);
+        if (file.stored)
+            out << std::setw(12) << file.storedSize << std::setw(12) << file.fileSize;
+        else
+            out << std::setw(12) << "-" << std::setw(12) << "-";
+        out << "  " << file.spelling << " (" << (file.stored ? FormatMethods(file.methods) : "unknown") << ")\n";
+    }
+}
@@ -0,0 +1,36 @@
+/*
+    DecompressProfiler.h - Decompression cost profiling for MpqFileLister plugin
+
+    Every SFileReadFile is timed and its bytes counted per file, which is
+    found from the handle the read was made with. Storm decompresses the
+    sectors of a file inside SFileReadFile, without going through its
+    exports, so how a file is compressed is not seen as it is read. It is
+    taken from the archive the file was opened from when the report is
+    written instead: the file's block table entry gives its stored and
+    decompressed sizes, and the first byte of each compressed sector the
+    methods it was compressed with. For compressed files, most of the read
+    time is decompression.
+*/
+
+#ifndef DECOMPRESSPROFILER_H
+#define DECOMPRESSPROFILER_H
+
+#include <windows.h>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Remember the name of a file the game opened, and the path of the archive
+// it came from (empty if not known)
+void DecompressFileOpened(HANDLE file, const char* fileName, const std::string& archivePath);
+
+// Forget a handle the game closed
+void DecompressFileClosed(HANDLE file);
+
+// Record one Storm SFileReadFile
+void RecordFileRead(HANDLE file, DWORD bytesRead, uint64_t stormTicks);
+
+// Write totals per compression method and per file, most expensive first
+void WriteDecompressReport(std::ostream& out);
+
+#endif // DECOMPRESSPROFILER_H
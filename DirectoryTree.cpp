@@ -0,0 +1,231 @@
+/*
+    DirectoryTree.cpp - Directory-tree aggregation for MpqFileLister plugin
+*/
+
+#include "DirectoryTree.h"
+#include "Timing.h"
+#include "tools/StormName.h"
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Arena blocks are allocated this size at a time
+static constexpr size_t ARENA_BLOCK_SIZE = 64 * 1024;
+
+struct TrieNode
+{
+    const char* name;           // Component as first spelled; not NUL-terminated
+    uint32_t nameLength;
+    bool isFile;
+    TrieNode* firstChild;
+    TrieNode* nextSibling;
+    uint64_t opens;             // Opens of this file
+    uint64_t stormTicks;
+};
+
+// Totals of a subtree, computed when the report is written
+struct TreeTotals
+{
+    uint64_t files = 0;
+    uint64_t directories = 0;
+    uint64_t opens = 0;
+    uint64_t stormTicks = 0;
+};
+
+// Bump allocator for nodes and names; nothing is freed until the process exits
+class TrieArena
+{
+private:
+    std::vector<char*> m_blocks;
+    char* m_next = nullptr;
+    size_t m_remaining = 0;
+    size_t m_reservedBytes = 0;     // Blocks for oversized allocations are larger than ARENA_BLOCK_SIZE
+    size_t m_usedBytes = 0;
+
+public:
+    void* Allocate(size_t size, size_t alignment)
+    {
+        size_t padding = (alignment - reinterpret_cast<uintptr_t>(m_next) % alignment) % alignment;
+        if (!m_next || padding + size > m_remaining)
+        {
+            size_t blockSize = std::max(ARENA_BLOCK_SIZE, size + alignment);
+            m_next = new char[blockSize];
+            m_remaining = blockSize;
+            m_blocks.push_back(m_next);
+            m_reservedBytes += blockSize;
+            padding = (alignment - reinterpret_cast<uintptr_t>(m_next) % alignment) % alignment;
+        }
+
+        char* result = m_next + padding;
+        m_next = result + size;
+        m_remaining -= padding + size;
+        m_usedBytes += size;
+        return result;
+    }
+
+    size_t ReservedBytes() const { return m_reservedBytes; }
+    size_t UsedBytes() const { return m_usedBytes; }
+};
+
+static std::mutex s_treeMutex;
+static TrieArena s_arena;
+static TrieNode s_root = {};
+static uint64_t s_nodeCount = 0;
+
+// Storm compares names case-insensitively and treats '/' as '\'
+static bool ComponentEquals(const TrieNode* node, const char* name, size_t length)
+{
+    if (node->nameLength != length)
+        return false;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (NormalizeStormChar(node->name[i]) != NormalizeStormChar(name[i]))
+            return false;
+    }
+    return true;
+}
+
+static TrieNode* FindOrAddChild(TrieNode* parent, const char* name, size_t length)
+{
+    TrieNode* previous = nullptr;
+    for (TrieNode* child = parent->firstChild; child; previous = child, child = child->nextSibling)
+    {
+        if (!ComponentEquals(child, name, length))
+            continue;
+
+        // Move to the front; games open files from the same few directories in bursts
+        if (previous)
+        {
+            previous->nextSibling = child->nextSibling;
+            child->nextSibling = parent->firstChild;
+            parent->firstChild = child;
+        }
+        return child;
+    }
+
+    char* nameCopy = static_cast<char*>(s_arena.Allocate(length, 1));
+    std::copy(name, name + length, nameCopy);
+
+    TrieNode* child = static_cast<TrieNode*>(s_arena.Allocate(sizeof(TrieNode), alignof(TrieNode)));
+    *child = TrieNode{nameCopy, static_cast<uint32_t>(length), false, nullptr, parent->firstChild, 0, 0};
+    parent->firstChild = child;
+    s_nodeCount++;
+    return child;
+}
+
+void RecordTreeAccess(const char* fileName, uint64_t stormTicks)
+{
+    if (!fileName)
+        return;
+
+    std::lock_guard<std::mutex> lock(s_treeMutex);
+
+    TrieNode* node = &s_root;
+    const char* component = fileName;
+    for (;;)
+    {
+        const char* end = component;
+        while (*end && *end != '\\' && *end != '/')
+            end++;
+
+        // Doubled separators do not make an empty directory
+        if (end > component)
+            node = FindOrAddChild(node, component, static_cast<size_t>(end - component));
+        if (!*end)
+            break;
+        component = end + 1;
+    }
+
+    node->isFile = true;
+    node->opens++;
+    node->stormTicks += stormTicks;
+}
+
+static TreeTotals SumTree(const TrieNode* node, std::vector<std::pair<const TrieNode*, TreeTotals>>& directories)
+{
+    TreeTotals totals;
+    if (node->isFile)
+    {
+        totals.files = 1;
+        totals.opens = node->opens;
+        totals.stormTicks = node->stormTicks;
+    }
+
+    size_t position = directories.size();
+    if (node->firstChild)
+        directories.emplace_back(node, TreeTotals());
+
+    for (const TrieNode* child = node->firstChild; child; child = child->nextSibling)
+    {
+        TreeTotals childTotals = SumTree(child, directories);
+        totals.files += childTotals.files;
+        totals.directories += childTotals.directories;
+        totals.opens += childTotals.opens;
+        totals.stormTicks += childTotals.stormTicks;
+    }
+
+    if (node->firstChild)
+    {
+        totals.directories++;
+        directories[position].second = totals;
+    }
+    return totals;
+}
+
+static void WriteDirectory(std::ostream& out, const TrieNode* node, const TreeTotals& totals, int depth,
+                           const std::vector<std::pair<const TrieNode*, TreeTotals>>& directories)
+{
+    out << std::setw(10) << totals.files
+        << std::setw(12) << totals.opens
+        << std::setw(14) << FormatTicksAsMs(totals.stormTicks)
+        << "  " << std::string(static_cast<size_t>(depth) * 2, ' ');
+    if (node == &s_root)
+        out << "(all)\n";
+    else
+        out << std::string(node->name, node->nameLength) << "\\\n";
+
+    // Subdirectories in name order
+    std::vector<const std::pair<const TrieNode*, TreeTotals>*> children;
+    for (const TrieNode* child = node->firstChild; child; child = child->nextSibling)
+    {
+        if (!child->firstChild)
+            continue;
+        auto it = std::lower_bound(directories.begin(), directories.end(), child,
+            [](const std::pair<const TrieNode*, TreeTotals>& entry, const TrieNode* key) { return entry.first < key; });
+        children.push_back(&*it);
+    }
+    std::sort(children.begin(), children.end(), [](const auto* a, const auto* b)
+    {
+        return NormalizeStormName(std::string(a->first->name, a->first->nameLength)) <
+               NormalizeStormName(std::string(b->first->name, b->first->nameLength));
+    });
+
+    for (const auto* child : children)
+        WriteDirectory(out, child->first, child->second, depth + 1, directories);
+}
+
+void WriteDirectoryTreeReport(std::ostream& out)
+{
+    std::lock_guard<std::mutex> lock(s_treeMutex);
+
+    // Totals of every directory, then sorted by node for lookup while writing
+    std::vector<std::pair<const TrieNode*, TreeTotals>> directories;
+    TreeTotals totals = SumTree(&s_root, directories);
+    std::sort(directories.begin(), directories.end(),
+        [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    out << "Files: " << totals.files << " in " << (totals.directories > 0 ? totals.directories - 1 : 0)
+        << " directories, " << totals.opens << " opens, " << FormatTicksAsMs(totals.stormTicks) << " ms in Storm\n";
+    out << "Trie: " << s_nodeCount << " nodes, " << s_arena.UsedBytes() << " bytes used of "
+        << s_arena.ReservedBytes() << " allocated\n\n";
+
+    out << std::setw(10) << "Files"
+        << std::setw(12) << "Opens"
+        << std::setw(14) << "Storm ms"
+        << "  Directory\n";
+
+    if (totals.directories > 0)
+        WriteDirectory(out, &s_root, totals, 0, directories);
+}
@@ -0,0 +1,24 @@
+/*
+    DirectoryTree.h - Directory-tree aggregation for MpqFileLister plugin
+
+    Every successful open is added to a trie of path components ('\' or '/'
+    separated). Nodes and component names are carved out of large arena
+    blocks, and each node keeps its children as a singly linked list, so a
+    shared directory such as "unit\protoss\" is stored once however many
+    files are under it. On exit the trie is written as a tree of directories
+    with the number of files, opens and Storm time below each of them.
+*/
+
+#ifndef DIRECTORYTREE_H
+#define DIRECTORYTREE_H
+
+#include <cstdint>
+#include <ostream>
+
+// Record a successful open of fileName that spent stormTicks in Storm
+void RecordTreeAccess(const char* fileName, uint64_t stormTicks);
+
+// Write the directory tree with per-directory totals
+void WriteDirectoryTreeReport(std::ostream& out);
+
+#endif // DIRECTORYTREE_H
@@ -0,0 +1,318 @@
+/*
+    FileCache.cpp - Hot-file content cache for MpqFileLister plugin
+*/
+
+#include "FileCache.h"
+#include "Timing.h"
+#include "tools/StormName.h"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Most used files listed in the report
+static constexpr size_t REPORT_TOP_FILES = 20;
+
+struct CachedFile
+{
+    std::string name;               // As the game first spelled it
+    std::vector<char> data;
+    uint64_t stormReadTicks = 0;    // Time Storm took to read it when it was cached
+    uint64_t hits = 0;
+};
+
+// A file the game has open, that is cached or may become cached
+struct OpenFileState
+{
+    HANDLE archive = nullptr;
+    std::string key;
+    std::string name;
+    std::shared_ptr<CachedFile> cached;   // Set if reads are served from memory
+    std::vector<char> capture;            // Contents read through Storm so far
+    DWORD fileSize = 0;
+    DWORD position = 0;
+    uint64_t stormReadTicks = 0;
+    bool capturing = false;               // Reads through Storm have been sequential from the start
+};
+
+struct CacheEntry
+{
+    HANDLE archive;
+    std::string key;
+    std::shared_ptr<CachedFile> file;
+};
+
+static std::mutex s_cacheMutex;
+static size_t s_budgetBytes = 0;
+static size_t s_maxFileBytes = 0;
+static size_t s_cachedBytes = 0;
+
+// Most recently used first
+static std::list<CacheEntry> s_lruList;
+static std::unordered_map<std::string, std::list<CacheEntry>::iterator> s_cacheIndex;
+static std::unordered_map<HANDLE, OpenFileState> s_openFiles;
+
+static uint64_t s_hits = 0;
+static uint64_t s_misses = 0;
+static uint64_t s_inserts = 0;
+static uint64_t s_evictions = 0;
+static uint64_t s_purged = 0;
+static uint64_t s_bytesServed = 0;
+static uint64_t s_stormTicksSaved = 0;
+
+// Key of a file: the archive handle and the name as Storm compares it
+static std::string GetCacheKey(HANDLE archive, const char* fileName)
+{
+    return std::to_string(reinterpret_cast<uintptr_t>(archive)) + ":" + NormalizeStormName(fileName);
+}
+
+static void EvictUntilFits(size_t bytes)
+{
+    while (!s_lruList.empty() && s_cachedBytes + bytes > s_budgetBytes)
+    {
+        const CacheEntry& entry = s_lruList.back();
+        s_cachedBytes -= entry.file->data.size();
+        s_cacheIndex.erase(entry.key);
+        s_lruList.pop_back();
+        s_evictions++;
+    }
+}
+
+static void InsertFile(OpenFileState& state)
+{
+    if (s_cacheIndex.count(state.key) || state.capture.size() > s_budgetBytes)
+        return;
+
+    EvictUntilFits(state.capture.size());
+
+    auto file = std::make_shared<CachedFile>();
+    file->name = std::move(state.name);
+    file->data = std::move(state.capture);
+    file->stormReadTicks = state.stormReadTicks;
+
+    s_cachedBytes += file->data.size();
+    s_lruList.push_front(CacheEntry{state.archive, state.key, std::move(file)});
+    s_cacheIndex[state.key] = s_lruList.begin();
+    s_inserts++;
+}
+
+void InitFileCache(size_t budgetBytes, size_t maxFileBytes)
+{
+    std::lock_guard<std::mutex> lock(s_cacheMutex);
+    s_budgetBytes = budgetBytes;
+    s_maxFileBytes = std::min(maxFileBytes, budgetBytes);
+}
+
+void CacheFileOpened(HANDLE file, HANDLE archive, const char* fileName, DWORD fileSize)
+{
+    if (!file || !fileName)
+        return;
+
+    bool cacheable = fileSize > 0 && fileSize <= s_maxFileBytes;
+    std::string key = cacheable ? GetCacheKey(archive, fileName) : std::string();
+
+    std::lock_guard<std::mutex> lock(s_cacheMutex);
+
+    // Storm may reuse the handle of a file closed without going through the hook
+    if (!cacheable)
+    {
+        s_openFiles.erase(file);
+        return;
+    }
+
+    OpenFileState& state = s_openFiles[file];
+    state = OpenFileState();
+    state.fileSize = fileSize;
+
+    auto it = s_cacheIndex.find(key);
+    if (it != s_cacheIndex.end())
+    {
+        // Move to the front of the LRU list
+        s_lruList.splice(s_lruList.begin(), s_lruList, it->second);
+        state.cached = it->second->file;
+        state.cached->hits++;
+        s_hits++;
+        s_stormTicksSaved += state.cached->stormReadTicks;
+        return;
+    }
+
+    s_misses++;
+    state.archive = archive;
+    state.key = std::move(key);
+    state.name = fileName;
+    state.capture.reserve(fileSize);
+    state.capturing = true;
+}
+
+bool ReadCachedFile(HANDLE file, void* buffer, DWORD bytesToRead, DWORD* bytesRead, BOOL* result)
+{
+    std::lock_guard<std::mutex> lock(s_cacheMutex);
+
+    auto it = s_openFiles.find(file);
+    if (it == s_openFiles.end() || !it->second.cached)
+        return false;
+
+    OpenFileState& state = it->second;
+    const std::vector<char>& data = state.cached->data;
+    DWORD available = state.position < data.size() ? static_cast<DWORD>(data.size() - state.position) : 0;
+    DWORD count = std::min(bytesToRead, available);
+    if (count > 0)
+        memcpy(buffer, data.data() + state.position, count);
+    state.position += count;
+    s_bytesServed += count;
+
+    // Like Storm, a short read fails but still reports what it read
+    if (bytesRead)
+        *bytesRead = count;
+    *result = count == bytesToRead;
+    if (!*result)
+        SetLastError(ERROR_HANDLE_EOF);
+    return true;
+}
+
+void CacheStormRead(HANDLE file, const void* buffer, DWORD bytesRead, uint64_t stormTicks)
+{
+    std::lock_guard<std::mutex> lock(s_cacheMutex);
+
+    auto it = s_openFiles.find(file);
+    if (it == s_openFiles.end())
+        return;
+
+    OpenFileState& state = it->second;
+    if (state.capturing && state.position == state.capture.size() &&
+        state.capture.size() + bytesRead <= state.fileSize)
+    {
+        const char* bytes = static_cast<const char*>(buffer);
+        state.capture.insert(state.capture.end(), bytes, bytes + bytesRead);
+        state.stormReadTicks += stormTicks;
+    }
+    else
+    {
+        state.capturing = false;
+    }
+    state.position += bytesRead;
+}
+
+bool SeekCachedFile(HANDLE file, LONG distance, DWORD moveMethod, DWORD* position)
+{
+    std::lock_guard<std::mutex> lock(s_cacheMutex);
+
+    auto it = s_openFiles.find(file);
+    if (it == s_openFiles.end() || !it->second.cached)
+        return false;
+
+    OpenFileState& state = it->second;
+    int64_t origin = 0;
+    if (moveMethod == FILE_CURRENT)
+        origin = state.position;
+    else if (moveMethod == FILE_END)
+        origin = static_cast<int64_t>(state.cached->data.size());
+
+    // Cached files are small, so the high part of the distance is not needed
+    int64_t target = origin + distance;
+    if (target < 0)
+    {
+        *position = 0xFFFFFFFF;
+        return true;
+    }
+    state.position = static_cast<DWORD>(target);
+    *position = state.position;
+    return true;
+}
+
+void CacheFileSeeked(HANDLE file, DWORD position)
+{
+    std::lock_guard<std::mutex> lock(s_cacheMutex);
+
+    auto it = s_openFiles.find(file);
+    if (it != s_openFiles.end())
+        it->second.position = position;
+}
+
+void CacheFileClosed(HANDLE file)
+{
+    std::lock_guard<std::mutex> lock(s_cacheMutex);
+
+    auto it = s_openFiles.find(file);
+    if (it == s_openFiles.end())
+        return;
+
+    OpenFileState& state = it->second;
+    if (state.capturing && state.capture.size() == state.fileSize)
+        InsertFile(state);
+    s_openFiles.erase(it);
+}
+
+void CacheArchiveClosed(HANDLE archive)
+{
+    std::lock_guard<std::mutex> lock(s_cacheMutex);
+
+    for (auto it = s_lruList.begin(); it != s_lruList.end();)
+    {
+        if (it->archive != archive)
+        {
+            ++it;
+            continue;
+        }
+        s_cachedBytes -= it->file->data.size();
+        s_cacheIndex.erase(it->key);
+        it = s_lruList.erase(it);
+        s_purged++;
+    }
+
+    // Files still being read from it must not be added afterwards
+    for (auto& openFile : s_openFiles)
+    {
+        if (openFile.second.archive == archive)
+            openFile.second.capturing = false;
+    }
+}
+
+void WriteFileCacheReport(std::ostream& out)
+{
+    std::lock_guard<std::mutex> lock(s_cacheMutex);
+
+    uint64_t lookups = s_hits + s_misses;
+    out << "Cached opens: " << s_hits << " of " << lookups << " ("
+        << std::fixed << std::setprecision(1) << (lookups ? 100.0 * s_hits / lookups : 0.0) << "%)\n";
+    out << "Bytes served from memory: " << s_bytesServed << "\n";
+    out << "Storm read time saved: " << FormatTicksAsMs(s_stormTicksSaved) << " ms\n";
+    out << "Cached: " << s_lruList.size() << " files, " << s_cachedBytes << " of " << s_budgetBytes
+        << " bytes (" << s_inserts << " added, " << s_evictions << " evicted, " << s_purged
+        << " dropped with their archive)\n\n";
+
+    std::vector<const CachedFile*> files;
+    files.reserve(s_lruList.size());
+    for (const CacheEntry& entry : s_lruList)
+        files.push_back(entry.file.get());
+
+    // Files that saved the most Storm time first; ties broken by name for a stable report
+    std::sort(files.begin(), files.end(), [](const CachedFile* a, const CachedFile* b)
+    {
+        uint64_t savedA = a->hits * a->stormReadTicks;
+        uint64_t savedB = b->hits * b->stormReadTicks;
+        if (savedA != savedB)
+            return savedA > savedB;
+        return a->name < b->name;
+    });
+    if (files.size() > REPORT_TOP_FILES)
+        files.resize(REPORT_TOP_FILES);
+
+    out << std::setw(10) << "Hits"
+        << std::setw(10) << "Bytes"
+        << std::setw(14) << "Saved ms"
+        << "  Filename\n";
+
+    for (const CachedFile* file : files)
+    {
+        out << std::setw(10) << file->hits
+            << std::setw(10) << file->data.size()
+            << std::setw(14) << FormatTicksAsMs(file->hits * file->stormReadTicks)
+            << "  " << file->name << "\n";
+    }
+}
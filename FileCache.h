@@ -0,0 +1,54 @@
+/*
+    FileCache.h - Hot-file content cache for MpqFileLister plugin
+
+    Small files that the game opens over and over (palettes, string tables,
+    sound effects) are decompressed by Storm every time they are read. The
+    cache keeps the contents of files up to a size limit, keyed by archive
+    and normalized name, under a memory budget with least-recently-used
+    eviction. The files of an archive are dropped when it is closed.
+
+    Files are still opened and closed through Storm, so every handle the
+    game holds is a real one; only reads are served from memory. A file is
+    cached when the game has read it from start to end through Storm, so
+    filling the cache costs no extra reads.
+*/
+
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <windows.h>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Set the memory budget and the largest file that is cached
+void InitFileCache(size_t budgetBytes, size_t maxFileBytes);
+
+// Record a file the game opened from archive. Files larger than the limit are ignored.
+void CacheFileOpened(HANDLE file, HANDLE archive, const char* fileName, DWORD fileSize);
+
+// Serve a read from the cache. Returns false if the file is not cached, in
+// which case the read must go to Storm.
+bool ReadCachedFile(HANDLE file, void* buffer, DWORD bytesToRead, DWORD* bytesRead, BOOL* result);
+
+// Record a read that went to Storm, so the file can be cached when it has been read in full
+void CacheStormRead(HANDLE file, const void* buffer, DWORD bytesRead, uint64_t stormTicks);
+
+// Serve a seek on a cached file (whose Storm file pointer never moves).
+// Returns false if the file is not cached, in which case the seek must go to Storm.
+bool SeekCachedFile(HANDLE file, LONG distance, DWORD moveMethod, DWORD* position);
+
+// Record a new file position returned by SFileSetFilePointer
+void CacheFileSeeked(HANDLE file, DWORD position);
+
+// Record a file being closed (before Storm closes it)
+void CacheFileClosed(HANDLE file);
+
+// Drop the files cached from an archive being closed (before Storm closes
+// it), as Storm may hand its handle to the next archive opened
+void CacheArchiveClosed(HANDLE archive);
+
+// Write the hit rate, the Storm read time saved and the most used files
+void WriteFileCacheReport(std::ostream& out);
+
+#endif // FILECACHE_H
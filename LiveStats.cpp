@@ -0,0 +1,203 @@
+/*
+    LiveStats.cpp - Shared-memory live statistics for MpqFileLister plugin
+*/
+
+#include "LiveStats.h"
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+// The mapping handle must stay open for as long as the segment is published
+static HANDLE s_liveStatsMapping = nullptr;
+#endif
+
+size_t GetLiveStatsBucket(uint64_t micros)
+{
+    size_t bucket = 0;
+    while (micros != 0 && bucket < LIVESTATS_HISTOGRAM_BUCKETS - 1)
+    {
+        micros >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void GetLiveStatsName(uint32_t processId, char* buffer, size_t bufferSize)
+{
+#ifdef _WIN32
+    snprintf(buffer, bufferSize, "Local\\MpqFileLister_Stats_%u", static_cast<unsigned>(processId));
+#else
+    snprintf(buffer, bufferSize, "/MpqFileLister_Stats_%u", static_cast<unsigned>(processId));
+#endif
+}
+
+LiveStatsBlock* CreateLiveStatsBlock(uint32_t processId)
+{
+    char name[64];
+    GetLiveStatsName(processId, name, sizeof(name));
+
+    void* memory = nullptr;
+#ifdef _WIN32
+    s_liveStatsMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+        0, sizeof(LiveStatsBlock), name);
+    if (!s_liveStatsMapping)
+        return nullptr;
+
+    memory = MapViewOfFile(s_liveStatsMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(LiveStatsBlock));
+    if (!memory)
+    {
+        CloseHandle(s_liveStatsMapping);
+        s_liveStatsMapping = nullptr;
+        return nullptr;
+    }
+#else
+    int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0)
+        return nullptr;
+
+    if (ftruncate(fd, sizeof(LiveStatsBlock)) != 0)
+    {
+        close(fd);
+        shm_unlink(name);
+        return nullptr;
+    }
+
+    memory = mmap(nullptr, sizeof(LiveStatsBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        shm_unlink(name);
+        return nullptr;
+    }
+#endif
+
+    // Zero the counters, then publish the header last so readers never see a
+    // valid magic in front of uninitialized counters
+    LiveStatsBlock* block = new (memory) LiveStatsBlock();
+    block->version = LIVESTATS_VERSION;
+    block->size = sizeof(LiveStatsBlock);
+    block->processId = processId;
+    block->sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    block->magic = LIVESTATS_MAGIC;
+    return block;
+}
+
+const LiveStatsBlock* OpenLiveStatsBlock(uint32_t processId)
+{
+    char name[64];
+    GetLiveStatsName(processId, name, sizeof(name));
+
+    const void* memory = nullptr;
+#ifdef _WIN32
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if (!mapping)
+        return nullptr;
+
+    memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(LiveStatsBlock));
+    // The view keeps the mapping alive after the handle is closed
+    CloseHandle(mapping);
+    if (!memory)
+        return nullptr;
+#else
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return nullptr;
+
+    memory = mmap(nullptr, sizeof(LiveStatsBlock), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+        return nullptr;
+#endif
+
+    const LiveStatsBlock* block = static_cast<const LiveStatsBlock*>(memory);
+    if (block->magic != LIVESTATS_MAGIC || block->version != LIVESTATS_VERSION ||
+        block->size != sizeof(LiveStatsBlock))
+    {
+        CloseLiveStatsBlock(block, false);
+        return nullptr;
+    }
+    return block;
+}
+
+void CloseLiveStatsBlock(const LiveStatsBlock* block, bool remove)
+{
+    if (!block)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(block);
+    // Windows removes the segment once the last handle and view are gone
+    if (remove && s_liveStatsMapping)
+    {
+        CloseHandle(s_liveStatsMapping);
+        s_liveStatsMapping = nullptr;
+    }
+#else
+    uint32_t processId = block->processId;
+    munmap(const_cast<LiveStatsBlock*>(block), sizeof(LiveStatsBlock));
+    if (remove)
+    {
+        char name[64];
+        GetLiveStatsName(processId, name, sizeof(name));
+        shm_unlink(name);
+    }
+#endif
+}
+
+void PublishLiveStats(LiveStatsBlock* block, const LiveStatsSnapshot& snapshot)
+{
+    if (!block)
+        return;
+
+    uint32_t sequence = block->sequence.load(std::memory_order_relaxed);
+    block->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    block->totalOpens.store(snapshot.totalOpens, std::memory_order_relaxed);
+    block->uniqueNames.store(snapshot.uniqueNames, std::memory_order_relaxed);
+    block->misses.store(snapshot.misses, std::memory_order_relaxed);
+    block->bytesRead.store(snapshot.bytesRead, std::memory_order_relaxed);
+    block->ringFill.store(snapshot.ringFill, std::memory_order_relaxed);
+    block->ringCapacity.store(snapshot.ringCapacity, std::memory_order_relaxed);
+    for (size_t i = 0; i < LIVESTATS_HISTOGRAM_BUCKETS; i++)
+        block->hookTimeHistogram[i].store(snapshot.hookTimeHistogram[i], std::memory_order_relaxed);
+
+    block->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool ReadLiveStats(const LiveStatsBlock* block, LiveStatsSnapshot& snapshot)
+{
+    if (!block)
+        return false;
+
+    for (int attempt = 0; attempt < 1000; attempt++)
+    {
+        uint32_t before = block->sequence.load(std::memory_order_acquire);
+        if (before & 1)
+            continue;
+
+        snapshot.totalOpens = block->totalOpens.load(std::memory_order_relaxed);
+        snapshot.uniqueNames = block->uniqueNames.load(std::memory_order_relaxed);
+        snapshot.misses = block->misses.load(std::memory_order_relaxed);
+        snapshot.bytesRead = block->bytesRead.load(std::memory_order_relaxed);
+        snapshot.ringFill = block->ringFill.load(std::memory_order_relaxed);
+        snapshot.ringCapacity = block->ringCapacity.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < LIVESTATS_HISTOGRAM_BUCKETS; i++)
+            snapshot.hookTimeHistogram[i] = block->hookTimeHistogram[i].load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (block->sequence.load(std::memory_order_relaxed) == before)
+            return true;
+    }
+    return false;
+}
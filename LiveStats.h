@@ -0,0 +1,87 @@
+/*
+    LiveStats.h - Shared-memory live statistics for MpqFileLister plugin
+
+    The plugin publishes a small block of counters in a named shared-memory
+    segment, so external tools can watch it while the game runs. The block is
+    protected by a sequence lock: the single writer makes the sequence number
+    odd while it updates the counters, and readers retry until they see the
+    same even sequence number before and after copying them. Readers never
+    block the writer.
+
+    This file does not depend on the plugin and builds on Windows (named file
+    mappings) and POSIX systems (shm_open), so the monitor tool can be built
+    and exercised on Linux too.
+*/
+
+#ifndef LIVESTATS_H
+#define LIVESTATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+constexpr uint32_t LIVESTATS_MAGIC = 0x5453514d;    // "MQST" in hex
+constexpr uint32_t LIVESTATS_VERSION = 1;
+
+// Hook time histogram: bucket 0 is below 1 microsecond, bucket i (i > 0)
+// covers [2^(i-1), 2^i) microseconds, and the last bucket takes the rest
+constexpr size_t LIVESTATS_HISTOGRAM_BUCKETS = 16;
+
+// Plain copy of the counters, as read from or written to the block
+struct LiveStatsSnapshot
+{
+    uint64_t totalOpens;
+    uint64_t uniqueNames;
+    uint64_t misses;
+    uint64_t bytesRead;
+    uint64_t ringFill;          // Records waiting in the record queue (if any)
+    uint64_t ringCapacity;      // Capacity of the record queue (0 if logging is synchronous)
+    uint64_t hookTimeHistogram[LIVESTATS_HISTOGRAM_BUCKETS];
+};
+
+// Layout of the shared-memory segment. Only fixed-size fields, so 32-bit and
+// 64-bit processes agree on it; readers must check magic, version and size.
+struct LiveStatsBlock
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t processId;
+    std::atomic<uint32_t> sequence;
+    uint32_t reserved;
+    std::atomic<uint64_t> totalOpens;
+    std::atomic<uint64_t> uniqueNames;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> bytesRead;
+    std::atomic<uint64_t> ringFill;
+    std::atomic<uint64_t> ringCapacity;
+    std::atomic<uint64_t> hookTimeHistogram[LIVESTATS_HISTOGRAM_BUCKETS];
+};
+
+static_assert(sizeof(LiveStatsBlock) == 24 + 6 * 8 + LIVESTATS_HISTOGRAM_BUCKETS * 8,
+              "LiveStatsBlock layout must not depend on the compiler");
+
+// Histogram bucket for a hook time in microseconds
+size_t GetLiveStatsBucket(uint64_t micros);
+
+// Name of the segment published by the process with the given ID
+// ("Local\MpqFileLister_Stats_<pid>" on Windows, "/MpqFileLister_Stats_<pid>" elsewhere)
+void GetLiveStatsName(uint32_t processId, char* buffer, size_t bufferSize);
+
+// Create and initialize the segment for the given process. Returns nullptr on failure.
+LiveStatsBlock* CreateLiveStatsBlock(uint32_t processId);
+
+// Open an existing segment read-only. Returns nullptr if it does not exist or is not compatible.
+const LiveStatsBlock* OpenLiveStatsBlock(uint32_t processId);
+
+// Unmap (and, for the creator, remove) a segment
+void CloseLiveStatsBlock(const LiveStatsBlock* block, bool remove);
+
+// Write a new set of counters. Must only be called from one thread at a time.
+void PublishLiveStats(LiveStatsBlock* block, const LiveStatsSnapshot& snapshot);
+
+// Read a consistent set of counters. Returns false if the writer kept the
+// block busy for all retries.
+bool ReadLiveStats(const LiveStatsBlock* block, LiveStatsSnapshot& snapshot);
+
+#endif // LIVESTATS_H
@@ -0,0 +1,96 @@
+/*
+    LiveStatsPublisher.cpp - Publishes the plugin's counters to shared memory
+*/
+
+#include "LiveStatsPublisher.h"
+#include "LiveStats.h"
+#include "RecordPipeline.h"
+#include "ThreadStats.h"
+#include <windows.h>
+#include <atomic>
+
+static LiveStatsBlock* s_liveStatsBlock = nullptr;
+static HANDLE s_publisherThread = nullptr;
+static HANDLE s_publisherStopEvent = nullptr;
+static unsigned s_publishIntervalMs = 250;
+static std::atomic<uint64_t> s_liveUniqueNames{0};
+
+static void PublishSnapshot()
+{
+    ThreadTotals totals;
+    CollectThreadTotals(totals);
+
+    LiveStatsSnapshot snapshot = {};
+    snapshot.totalOpens = totals.opens;
+    snapshot.uniqueNames = s_liveUniqueNames.load(std::memory_order_relaxed);
+    snapshot.misses = totals.failures;
+    snapshot.bytesRead = totals.bytesRead;
+    GetRecordQueueFill(snapshot.ringFill, snapshot.ringCapacity);
+    for (size_t i = 0; i < LIVESTATS_HISTOGRAM_BUCKETS; i++)
+        snapshot.hookTimeHistogram[i] = totals.hookTimeHistogram[i];
+
+    PublishLiveStats(s_liveStatsBlock, snapshot);
+}
+
+static DWORD WINAPI PublisherThreadProc(LPVOID lpParameter)
+{
+    (void)lpParameter;
+
+    while (WaitForSingleObject(s_publisherStopEvent, s_publishIntervalMs) == WAIT_TIMEOUT)
+        PublishSnapshot();
+
+    return 0;
+}
+
+void StartLiveStatsPublisher(unsigned intervalMs)
+{
+    if (s_liveStatsBlock)
+        return;
+
+    s_liveStatsBlock = CreateLiveStatsBlock(GetCurrentProcessId());
+    if (!s_liveStatsBlock)
+        return;
+
+    s_publishIntervalMs = intervalMs > 0 ? intervalMs : 1;
+    s_publisherStopEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    if (s_publisherStopEvent)
+        s_publisherThread = CreateThread(nullptr, 0, PublisherThreadProc, nullptr, 0, nullptr);
+
+    if (s_publisherThread)
+        SetThreadPriority(s_publisherThread, THREAD_PRIORITY_LOWEST);
+}
+
+void StopLiveStatsPublisher()
+{
+    if (!s_liveStatsBlock)
+        return;
+
+    // The thread may already be gone if the process is exiting
+    if (s_publisherThread)
+    {
+        SetEvent(s_publisherStopEvent);
+        if (WaitForSingleObject(s_publisherThread, 1000) != WAIT_OBJECT_0)
+        {
+            // At the lowest priority it may still be publishing, so the event
+            // and the block stay for it
+            return;
+        }
+        CloseHandle(s_publisherThread);
+        s_publisherThread = nullptr;
+    }
+    if (s_publisherStopEvent)
+    {
+        CloseHandle(s_publisherStopEvent);
+        s_publisherStopEvent = nullptr;
+    }
+
+    // Only one thread may write the block at a time
+    PublishSnapshot();
+    CloseLiveStatsBlock(s_liveStatsBlock, true);
+    s_liveStatsBlock = nullptr;
+}
+
+void SetLiveUniqueNames(uint64_t count)
+{
+    s_liveUniqueNames.store(count, std::memory_order_relaxed);
+}
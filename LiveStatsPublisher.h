@@ -0,0 +1,23 @@
+/*
+    LiveStatsPublisher.h - Publishes the plugin's counters to shared memory
+
+    A low-priority background thread periodically sums the per-thread
+    counters and writes them to the live statistics block (see LiveStats.h).
+    The hooks never touch the shared block themselves.
+*/
+
+#ifndef LIVESTATSPUBLISHER_H
+#define LIVESTATSPUBLISHER_H
+
+#include <cstdint>
+
+// Create the shared-memory block and start the publisher thread
+void StartLiveStatsPublisher(unsigned intervalMs);
+
+// Publish a final snapshot, stop the thread and remove the block
+void StopLiveStatsPublisher();
+
+// Update the number of unique names seen so far
+void SetLiveUniqueNames(uint64_t count);
+
+#endif // LIVESTATSPUBLISHER_H
@@ -0,0 +1,132 @@
+/*
+    LoadPhases.cpp - Load phase detection for MpqFileLister plugin
+*/
+
+#include "LoadPhases.h"
+#include "Config.h"
+#include "Timing.h"
+#include "tools/StormName.h"
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+struct LoadPhase
+{
+    uint64_t startTicks = 0;
+    uint64_t endTicks = 0;
+    uint64_t opens = 0;
+    uint64_t stormTicks = 0;
+    std::vector<std::string> newFiles;   // Files first opened in this phase, in order
+};
+
+static std::mutex s_phaseMutex;
+static uint64_t s_phaseSessionStartTicks = 0;
+static std::vector<LoadPhase> s_phases;          // Completed phases
+static LoadPhase s_currentPhase;
+static bool s_hasCurrentPhase = false;
+static std::unordered_set<std::string> s_phaseSeenFiles;
+
+// Opens in bursts smaller than PhaseMinFiles are summed up here instead
+static uint64_t s_backgroundOpens = 0;
+static uint64_t s_backgroundStormTicks = 0;
+static std::vector<std::string> s_backgroundNewFiles;
+
+static void ClosePhase()
+{
+    if (!s_hasCurrentPhase)
+        return;
+
+    if (s_currentPhase.opens >= g_phaseMinFiles)
+    {
+        s_phases.push_back(std::move(s_currentPhase));
+    }
+    else
+    {
+        s_backgroundOpens += s_currentPhase.opens;
+        s_backgroundStormTicks += s_currentPhase.stormTicks;
+        s_backgroundNewFiles.insert(s_backgroundNewFiles.end(),
+            std::make_move_iterator(s_currentPhase.newFiles.begin()),
+            std::make_move_iterator(s_currentPhase.newFiles.end()));
+    }
+
+    s_currentPhase = LoadPhase();
+    s_hasCurrentPhase = false;
+}
+
+void ResetPhases(uint64_t sessionStartTicks)
+{
+    std::lock_guard<std::mutex> lock(s_phaseMutex);
+
+    s_phaseSessionStartTicks = sessionStartTicks;
+    s_phases.clear();
+    s_currentPhase = LoadPhase();
+    s_hasCurrentPhase = false;
+    s_phaseSeenFiles.clear();
+    s_backgroundOpens = 0;
+    s_backgroundStormTicks = 0;
+    s_backgroundNewFiles.clear();
+}
+
+void RecordPhaseAccess(const char* fileName, uint64_t startTicks, uint64_t stormTicks)
+{
+    if (!fileName)
+        return;
+
+    std::lock_guard<std::mutex> lock(s_phaseMutex);
+
+    // An idle gap longer than the threshold ends the current phase
+    uint64_t idleTicks = startTicks > s_currentPhase.endTicks ? startTicks - s_currentPhase.endTicks : 0;
+    if (s_hasCurrentPhase && TicksToMicros(idleTicks) >= static_cast<uint64_t>(g_phaseIdleGapMs) * 1000)
+        ClosePhase();
+
+    if (!s_hasCurrentPhase)
+    {
+        s_currentPhase.startTicks = startTicks;
+        s_hasCurrentPhase = true;
+    }
+
+    s_currentPhase.endTicks = std::max(s_currentPhase.endTicks, startTicks + stormTicks);
+    s_currentPhase.opens++;
+    s_currentPhase.stormTicks += stormTicks;
+
+    if (s_phaseSeenFiles.insert(NormalizeStormName(fileName)).second)
+        s_currentPhase.newFiles.push_back(fileName);
+}
+
+// Helper to format a point in time relative to the start of the session
+static std::string FormatSessionTime(uint64_t ticks)
+{
+    return FormatTicksAsMs(ticks > s_phaseSessionStartTicks ? ticks - s_phaseSessionStartTicks : 0);
+}
+
+void WritePhaseReport(std::ostream& out)
+{
+    std::lock_guard<std::mutex> lock(s_phaseMutex);
+
+    ClosePhase();
+
+    out << "Phases: " << s_phases.size() << " (idle gap " << g_phaseIdleGapMs << " ms, at least "
+        << g_phaseMinFiles << " opens)\n";
+    out << "Opens outside phases: " << s_backgroundOpens << ", "
+        << FormatTicksAsMs(s_backgroundStormTicks) << " ms in Storm, "
+        << s_backgroundNewFiles.size() << " new files\n";
+    for (const std::string& fileName : s_backgroundNewFiles)
+        out << "    " << fileName << "\n";
+
+    for (size_t i = 0; i < s_phases.size(); i++)
+    {
+        const LoadPhase& phase = s_phases[i];
+        out << "\nPhase " << (i + 1) << ": "
+            << FormatSessionTime(phase.startTicks) << " ms - " << FormatSessionTime(phase.endTicks) << " ms ("
+            << FormatTicksAsMs(phase.endTicks - phase.startTicks) << " ms), "
+            << phase.opens << " opens, "
+            << FormatTicksAsMs(phase.stormTicks) << " ms in Storm, "
+            << phase.newFiles.size() << " new files\n";
+
+        for (const std::string& fileName : phase.newFiles)
+            out << "    " << fileName << "\n";
+    }
+}
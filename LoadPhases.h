@@ -0,0 +1,27 @@
+/*
+    LoadPhases.h - Load phase detection for MpqFileLister plugin
+
+    Splits the stream of file opens into phases: bursts of activity separated
+    by idle gaps of at least a configurable length. Phases are detected online
+    as opens arrive, and each one keeps its time span, number of opens, time
+    spent in Storm and the files that were opened for the first time in it.
+    Bursts with too few opens to count as a phase are summed up as opens
+    outside phases, which keep the files first opened in them the same way.
+*/
+
+#ifndef LOADPHASES_H
+#define LOADPHASES_H
+
+#include <cstdint>
+#include <ostream>
+
+// Forget all phases and start measuring from sessionStartTicks
+void ResetPhases(uint64_t sessionStartTicks);
+
+// Record a successful open that started at startTicks and spent stormTicks in Storm
+void RecordPhaseAccess(const char* fileName, uint64_t startTicks, uint64_t stormTicks);
+
+// Close the current phase and write all phases
+void WritePhaseReport(std::ostream& out);
+
+#endif // LOADPHASES_H
@@ -0,0 +1,120 @@
+/*
+    LogBuffer.cpp - Buffered writing of text logs for MpqFileLister plugin
+*/
+
+#include "LogBuffer.h"
+#include "CrashDrain.h"
+#include <windows.h>
+#include <cstring>
+#include <memory>
+
+// How long a crash drain waits for a thread that is appending
+static constexpr DWORD LOGBUFFER_DRAIN_TIMEOUT_MS = 200;
+
+static DrainLock s_bufferLock;
+static HANDLE s_file = INVALID_HANDLE_VALUE;
+static std::unique_ptr<char[]> s_buffer;
+static size_t s_capacity = 0;
+static size_t s_used = 0;
+static uint64_t s_fileSize = 0;
+
+// Write all of data, which WriteFile may split up
+static void WriteAll(const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        DWORD written = 0;
+        if (!WriteFile(s_file, data, static_cast<DWORD>(size), &written, nullptr) || written == 0)
+            return;
+        data += written;
+        size -= written;
+    }
+}
+
+// Write out the buffer (the caller holds s_bufferLock)
+static void FlushBuffer()
+{
+    if (s_file != INVALID_HANDLE_VALUE && s_used > 0)
+        WriteAll(s_buffer.get(), s_used);
+    s_used = 0;
+}
+
+bool OpenLogBuffer(const std::string& path, size_t bufferBytes)
+{
+    CloseLogBuffer();
+
+    s_bufferLock.Lock();
+    s_file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                         CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    // The buffer is kept across the parts of a rotated log
+    if (bufferBytes != s_capacity)
+    {
+        s_buffer.reset(bufferBytes > 0 ? new char[bufferBytes] : nullptr);
+        s_capacity = bufferBytes;
+    }
+    s_used = 0;
+    s_fileSize = 0;
+    bool opened = s_file != INVALID_HANDLE_VALUE;
+    s_bufferLock.Unlock();
+    return opened;
+}
+
+bool IsLogBufferOpen()
+{
+    return s_file != INVALID_HANDLE_VALUE;
+}
+
+void AppendLogBuffer(const char* line, size_t size)
+{
+    static const char LINE_BREAK[] = "\r\n";
+    static const size_t LINE_BREAK_SIZE = sizeof(LINE_BREAK) - 1;
+
+    s_bufferLock.Lock();
+    if (s_file != INVALID_HANDLE_VALUE)
+    {
+        s_fileSize += size + LINE_BREAK_SIZE;
+        if (s_used + size + LINE_BREAK_SIZE > s_capacity)
+            FlushBuffer();
+
+        if (size + LINE_BREAK_SIZE > s_capacity)
+        {
+            // Longer than the buffer (or unbuffered): written through
+            WriteAll(line, size);
+            WriteAll(LINE_BREAK, LINE_BREAK_SIZE);
+        }
+        else
+        {
+            memcpy(s_buffer.get() + s_used, line, size);
+            memcpy(s_buffer.get() + s_used + size, LINE_BREAK, LINE_BREAK_SIZE);
+            s_used += size + LINE_BREAK_SIZE;
+        }
+    }
+    s_bufferLock.Unlock();
+}
+
+uint64_t LogBufferFileSize()
+{
+    return s_fileSize;
+}
+
+void DrainLogBuffer()
+{
+    // A thread that crashed while appending leaves the buffer half-written
+    if (!s_bufferLock.TryLockFor(LOGBUFFER_DRAIN_TIMEOUT_MS))
+        return;
+    FlushBuffer();
+    s_bufferLock.Unlock();
+}
+
+void CloseLogBuffer()
+{
+    s_bufferLock.Lock();
+    FlushBuffer();
+    if (s_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(s_file);
+        s_file = INVALID_HANDLE_VALUE;
+    }
+    s_bufferLock.Unlock();
+}
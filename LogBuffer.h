@@ -0,0 +1,39 @@
+/*
+    LogBuffer.h - Buffered writing of text logs for MpqFileLister plugin
+
+    Lines are copied into a buffer allocated when the log is opened and
+    written out with a single WriteFile call whenever it fills up, instead of
+    flushing the file after every line. The buffer is written out without
+    allocating by DrainLogBuffer, which is registered with CrashDrain.h, so
+    only a process killed from outside can lose what it holds.
+
+    Lines end in "\r\n", like the text-mode stream the logs were written with
+    before.
+*/
+
+#ifndef LOGBUFFER_H
+#define LOGBUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Create (or truncate) the log at path, buffering up to bufferBytes of it
+// (0 writes every line through). Closes a log that is already open.
+bool OpenLogBuffer(const std::string& path, size_t bufferBytes);
+
+bool IsLogBufferOpen();
+
+// Append one line (the line break is added)
+void AppendLogBuffer(const char* line, size_t size);
+
+// Bytes of the log so far, buffered or written
+uint64_t LogBufferFileSize();
+
+// Write out the buffer; safe to call from an exception handler
+void DrainLogBuffer();
+
+// Write out the buffer and close the log
+void CloseLogBuffer();
+
+#endif // LOGBUFFER_H
@@ -0,0 +1,279 @@
+/*
+    LogCompressor.cpp - Background log compression for MpqFileLister plugin
+*/
+
+#include "LogCompressor.h"
+#include "CrashDrain.h"
+#include "tools/LzLog.h"
+#include <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <vector>
+
+// Queued text is compressed at least this often
+static constexpr DWORD LOGCOMPRESS_FLUSH_INTERVAL_MS = 1000;
+
+// How long a crash drain waits for the compressor to finish a block
+static constexpr DWORD LOGCOMPRESS_DRAIN_TIMEOUT_MS = 1000;
+
+// Lock order: s_outputLock, then s_pendingLock
+static DrainLock s_pendingLock;
+static std::string s_pending;
+static DrainLock s_outputLock;
+
+static HANDLE s_compressorThread = nullptr;
+static HANDLE s_compressorStopEvent = nullptr;
+static HANDLE s_compressorWakeEvent = nullptr;
+static std::atomic<bool> s_compressorDrained{false};
+
+// Only touched under s_outputLock
+static HANDLE s_output = INVALID_HANDLE_VALUE;
+static std::string s_pathPattern;
+static uint64_t s_rotateBytes = 0;
+static unsigned s_part = 0;
+static uint64_t s_partBytes = 0;
+static std::vector<uint8_t> s_compressed;
+
+std::string GetLogPartPath(const std::string& pattern, unsigned part)
+{
+    size_t placeholder = pattern.find("{n}");
+    if (placeholder != std::string::npos)
+        return pattern.substr(0, placeholder) + std::to_string(part) + pattern.substr(placeholder + 3);
+
+    if (part <= 1)
+        return pattern;
+
+    std::filesystem::path path(pattern);
+    std::filesystem::path extension = path.extension();
+    path.replace_extension();
+    return path.string() + "." + std::to_string(part) + extension.string();
+}
+
+// Write all of data, which WriteFile may split up
+static void WriteOutput(const void* data, size_t size)
+{
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0)
+    {
+        DWORD written = 0;
+        if (!WriteFile(s_output, bytes, static_cast<DWORD>(size), &written, nullptr) || written == 0)
+            return;
+        bytes += written;
+        size -= written;
+    }
+}
+
+static void CloseOutput()
+{
+    if (s_output != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(s_output);
+        s_output = INVALID_HANDLE_VALUE;
+    }
+}
+
+static bool OpenNextPart()
+{
+    CloseOutput();
+    s_output = CreateFileA(GetLogPartPath(s_pathPattern, ++s_part).c_str(), GENERIC_WRITE, FILE_SHARE_READ,
+                           nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (s_output == INVALID_HANDLE_VALUE)
+        return false;
+
+    LzLogHeader header = {};
+    std::copy(LZLOG_MAGIC, LZLOG_MAGIC + 4, header.magic);
+    header.version = LZLOG_VERSION;
+    WriteOutput(&header, sizeof(header));
+    s_partBytes = sizeof(header);
+    return true;
+}
+
+// Write text as blocks stored without compression, which needs no memory.
+// A crashed log is only ever this much larger.
+static void WriteStoredBlocks(const uint8_t* data, size_t size)
+{
+    while (size > 0 && s_output != INVALID_HANDLE_VALUE)
+    {
+        size_t blockSize = std::min<size_t>(size, LZLOG_BLOCK_SIZE);
+        LzLogBlockHeader header = {};
+        header.rawSize = static_cast<uint32_t>(blockSize);
+        header.storedSize = header.rawSize;
+        header.checksum = LzChecksum(data, blockSize);
+        WriteOutput(&header, sizeof(header));
+        WriteOutput(data, blockSize);
+        s_partBytes += sizeof(header) + blockSize;
+        data += blockSize;
+        size -= blockSize;
+    }
+}
+
+static void WriteBlock(const uint8_t* data, size_t size)
+{
+    if (s_rotateBytes > 0 && s_partBytes >= s_rotateBytes && !OpenNextPart())
+        return;
+    if (s_output == INVALID_HANDLE_VALUE)
+        return;
+
+    LzLogBlockHeader header = {};
+    header.rawSize = static_cast<uint32_t>(size);
+    header.checksum = LzChecksum(data, size);
+
+    size_t compressedSize = LzCompress(data, size, s_compressed.data());
+    const uint8_t* stored = s_compressed.data();
+    if (compressedSize >= size)
+    {
+        stored = data;
+        compressedSize = size;
+    }
+    header.storedSize = static_cast<uint32_t>(compressedSize);
+
+    WriteOutput(&header, sizeof(header));
+    WriteOutput(stored, compressedSize);
+    s_partBytes += sizeof(header) + compressedSize;
+}
+
+// Compress text into blocks. Blocks end at a line break where there is one,
+// so a line is never split between two parts.
+static void CompressText(const std::string& text)
+{
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(text.data());
+    size_t remaining = text.size();
+    while (remaining > 0)
+    {
+        size_t size = remaining;
+        if (size > LZLOG_BLOCK_SIZE)
+        {
+            size = LZLOG_BLOCK_SIZE;
+            while (size > 0 && data[size - 1] != '\n')
+                size--;
+            if (size == 0)
+                size = LZLOG_BLOCK_SIZE;
+        }
+        WriteBlock(data, size);
+        data += size;
+        remaining -= size;
+    }
+}
+
+static DWORD WINAPI CompressorThreadProc(LPVOID lpParameter)
+{
+    (void)lpParameter;
+
+    HANDLE events[2] = { s_compressorStopEvent, s_compressorWakeEvent };
+    std::string work;
+    for (;;)
+    {
+        DWORD wait = WaitForMultipleObjects(2, events, FALSE, LOGCOMPRESS_FLUSH_INTERVAL_MS);
+
+        // Swap buffers, so the game threads keep appending while this one
+        // compresses. The output stays locked until the text is written, so
+        // a crash drain never misses the text being compressed.
+        s_outputLock.Lock();
+        s_pendingLock.Lock();
+        work.swap(s_pending);
+        s_pendingLock.Unlock();
+        CompressText(work);
+        s_outputLock.Unlock();
+        work.clear();
+
+        if (wait == WAIT_OBJECT_0 || wait == WAIT_FAILED)
+            break;
+    }
+
+    s_compressorDrained = true;
+    return 0;
+}
+
+bool StartLogCompressor(const std::string& pathPattern, uint64_t rotateBytes)
+{
+    if (s_compressorThread)
+        return true;
+
+    s_pathPattern = pathPattern;
+    s_rotateBytes = rotateBytes;
+    s_part = 0;
+    s_compressed.resize(LzCompressBound(LZLOG_BLOCK_SIZE));
+    s_compressorDrained = false;
+    if (!OpenNextPart())
+        return false;
+
+    s_compressorStopEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    s_compressorWakeEvent = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+    if (s_compressorStopEvent && s_compressorWakeEvent)
+        s_compressorThread = CreateThread(nullptr, 0, CompressorThreadProc, nullptr, 0, nullptr);
+
+    if (!s_compressorThread)
+    {
+        CloseOutput();
+        return false;
+    }
+
+    SetThreadPriority(s_compressorThread, THREAD_PRIORITY_LOWEST);
+    return true;
+}
+
+void AppendCompressedLog(const std::string& line)
+{
+    s_pendingLock.Lock();
+    s_pending.append(line);
+    s_pending.push_back('\n');
+    bool blockFull = s_pending.size() >= LZLOG_BLOCK_SIZE;
+    s_pendingLock.Unlock();
+
+    if (blockFull)
+        SetEvent(s_compressorWakeEvent);
+}
+
+void StopLogCompressor()
+{
+    if (!s_compressorThread)
+        return;
+
+    SetEvent(s_compressorStopEvent);
+    DWORD wait = WaitForSingleObject(s_compressorThread, 5000);
+    CloseHandle(s_compressorThread);
+    s_compressorThread = nullptr;
+
+    // Still compressing; the log is left to the thread
+    if (wait != WAIT_OBJECT_0)
+        return;
+
+    // When the process exits without the ExitProcess hook (e.g. the plugin
+    // is unloaded by the loader), Windows ends the thread first. The game is
+    // gone by then, so compress the rest here, unless the thread was ended
+    // while it held a lock.
+    if (!s_compressorDrained && s_outputLock.TryLockFor(0))
+    {
+        if (s_pendingLock.TryLockFor(0))
+        {
+            std::string rest;
+            rest.swap(s_pending);
+            s_pendingLock.Unlock();
+            CompressText(rest);
+        }
+        s_outputLock.Unlock();
+    }
+
+    CloseHandle(s_compressorStopEvent);
+    CloseHandle(s_compressorWakeEvent);
+    s_compressorStopEvent = nullptr;
+    s_compressorWakeEvent = nullptr;
+    CloseOutput();
+}
+
+void DrainCompressedLog()
+{
+    if (!s_outputLock.TryLockFor(LOGCOMPRESS_DRAIN_TIMEOUT_MS))
+        return;
+
+    // Appending threads may still be running; this only writes out what is
+    // queued, and leaves the queue empty for the compressor
+    if (s_pendingLock.TryLockFor(LOGCOMPRESS_DRAIN_TIMEOUT_MS))
+    {
+        WriteStoredBlocks(reinterpret_cast<const uint8_t*>(s_pending.data()), s_pending.size());
+        s_pending.clear();
+        s_pendingLock.Unlock();
+    }
+    s_outputLock.Unlock();
+}
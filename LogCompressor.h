@@ -0,0 +1,38 @@
+/*
+    LogCompressor.h - Background log compression for MpqFileLister plugin
+
+    Log lines are appended to a buffer under a short lock, and a low-priority
+    background thread takes the buffer whenever a block's worth has been
+    logged (or a second has passed), compresses it into the block format of
+    tools/LzLog.h and writes it out. The game's threads only ever copy text.
+
+    Logs can be split into parts of a maximum size; see GetLogPartPath.
+*/
+
+#ifndef LOGCOMPRESSOR_H
+#define LOGCOMPRESSOR_H
+
+#include <cstdint>
+#include <string>
+
+// Path of part (1-based) of a log. "{n}" in the pattern is replaced with
+// the part number; without it, parts after the first get ".<part>" before
+// the extension ("FileLog.txt", "FileLog.2.txt", ...).
+std::string GetLogPartPath(const std::string& pattern, unsigned part);
+
+// Start compressing to the parts of pathPattern, each ending at the first
+// block boundary past rotateBytes (0 writes a single file). Returns false
+// if the first part could not be created.
+bool StartLogCompressor(const std::string& pathPattern, uint64_t rotateBytes);
+
+// Queue one line (a newline is added)
+void AppendCompressedLog(const std::string& line);
+
+// Compress whatever is queued, stop the thread and close the log
+void StopLogCompressor();
+
+// Write out what is queued as uncompressed blocks, without allocating; safe
+// to call from an exception handler
+void DrainCompressedLog();
+
+#endif // LOGCOMPRESSOR_H
@@ -0,0 +1,321 @@
+/*
+    MemProfiler.cpp - Storm allocation profiling for MpqFileLister plugin
+*/
+
+#include "MemProfiler.h"
+#include "ThreadStats.h"
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Call sites each thread can count separately; further ones share one entry
+static constexpr size_t MEM_SITE_SLOTS = 1024;
+
+// Size histogram buckets: bucket i holds sizes up to 2^i bytes
+static constexpr size_t MEM_SIZE_BUCKETS = 33;
+
+// Parts of the block table, each with its own lock
+static constexpr size_t MEM_BLOCK_SHARDS = 64;
+
+struct MemCallSite
+{
+    std::atomic<bool> used;
+    const char* sourceFile;
+    uint32_t sourceLine;
+
+    // Only ever written by the owning thread
+    std::atomic<uint64_t> allocs;
+    std::atomic<uint64_t> reallocs;
+    std::atomic<uint64_t> frees;            // Blocks from this site freed with SMemFree
+    std::atomic<uint64_t> bytes;            // Bytes allocated or reallocated here
+    std::atomic<uint64_t> releasedBytes;    // Bytes of blocks from this site freed or moved away
+    std::atomic<uint64_t> largest;
+};
+
+struct alignas(64) MemThreadState
+{
+    MemCallSite sites[MEM_SITE_SLOTS];
+    MemCallSite overflow;                   // Sites that did not fit in the table
+    std::atomic<uint64_t> sizeHistogram[MEM_SIZE_BUCKETS];
+    std::atomic<uint64_t> unknownFrees;     // Frees of blocks the hooks never saw allocated
+
+    MemThreadState* next;
+};
+
+struct MemBlockShard
+{
+    std::mutex mutex;
+    std::unordered_map<void*, MemBlock> blocks;
+};
+
+// Head of the list of all thread states. States are never freed, since the
+// report may be written after the threads that own them have exited.
+static std::atomic<MemThreadState*> s_memThreadHead{nullptr};
+
+static MemBlockShard s_blockShards[MEM_BLOCK_SHARDS];
+
+static std::atomic<int64_t> s_liveBytes{0};
+static std::atomic<int64_t> s_peakLiveBytes{0};
+
+static MemThreadState& GetMemThreadState()
+{
+    static thread_local MemThreadState* t_state = nullptr;
+    if (!t_state)
+    {
+        // Value-initialized, so every counter starts at zero
+        MemThreadState* state = new MemThreadState();
+
+        // Lock-free push onto the global list
+        state->next = s_memThreadHead.load(std::memory_order_relaxed);
+        while (!s_memThreadHead.compare_exchange_weak(state->next, state,
+            std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+        t_state = state;
+    }
+    return *t_state;
+}
+
+// Find or claim the calling thread's entry for a call site
+static MemCallSite& GetCallSite(MemThreadState& state, const char* sourceFile, uint32_t sourceLine)
+{
+    // Sites are identified by the address of the caller's file name string,
+    // which is the same for every call from one source file
+    uintptr_t hash = reinterpret_cast<uintptr_t>(sourceFile) * 0x9E3779B1u ^ sourceLine * 0x85EBCA6Bu;
+    for (size_t probe = 0; probe < MEM_SITE_SLOTS; probe++)
+    {
+        MemCallSite& site = state.sites[(hash + probe) & (MEM_SITE_SLOTS - 1)];
+        if (!site.used.load(std::memory_order_relaxed))
+        {
+            site.sourceFile = sourceFile;
+            site.sourceLine = sourceLine;
+            site.used.store(true, std::memory_order_release);
+            return site;
+        }
+        if (site.sourceFile == sourceFile && site.sourceLine == sourceLine)
+            return site;
+    }
+    return state.overflow;
+}
+
+static MemBlockShard& GetShard(void* block)
+{
+    // Storm's blocks are at least 8-byte aligned, so skip the low bits
+    return s_blockShards[(reinterpret_cast<uintptr_t>(block) >> 4) % MEM_BLOCK_SHARDS];
+}
+
+static size_t GetSizeBucket(uint32_t size)
+{
+    size_t bucket = 0;
+    while (bucket + 1 < MEM_SIZE_BUCKETS && (uint64_t(1) << bucket) < size)
+        bucket++;
+    return bucket;
+}
+
+static void AddLiveBytes(int64_t delta)
+{
+    int64_t live = s_liveBytes.fetch_add(delta, std::memory_order_relaxed) + delta;
+    int64_t peak = s_peakLiveBytes.load(std::memory_order_relaxed);
+    while (live > peak && !s_peakLiveBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+    {
+    }
+}
+
+static void InsertBlock(void* block, const MemBlock& info)
+{
+    MemBlockShard& shard = GetShard(block);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.blocks[block] = info;
+}
+
+// Charge a block that went away to the site that allocated it
+static void ReleaseBlock(MemThreadState& state, const MemBlock& released, bool freed)
+{
+    MemCallSite& site = GetCallSite(state, released.sourceFile, released.sourceLine);
+    if (freed)
+        AddToCounter(site.frees, 1);
+    AddToCounter(site.releasedBytes, released.size);
+    AddLiveBytes(-static_cast<int64_t>(released.size));
+}
+
+static void RecordBlock(MemThreadState& state, MemCallSite& site, void* block, uint32_t size,
+                        const char* sourceFile, uint32_t sourceLine)
+{
+    AddToCounter(site.bytes, size);
+    if (size > site.largest.load(std::memory_order_relaxed))
+        site.largest.store(size, std::memory_order_relaxed);
+    AddToCounter(state.sizeHistogram[GetSizeBucket(size)], 1);
+
+    InsertBlock(block, MemBlock{true, size, sourceFile, sourceLine});
+    AddLiveBytes(size);
+}
+
+void RecordMemAlloc(void* block, uint32_t size, const char* sourceFile, int sourceLine)
+{
+    if (!block)
+        return;
+
+    MemThreadState& state = GetMemThreadState();
+    MemCallSite& site = GetCallSite(state, sourceFile, static_cast<uint32_t>(sourceLine));
+    AddToCounter(site.allocs, 1);
+    RecordBlock(state, site, block, size, sourceFile, static_cast<uint32_t>(sourceLine));
+}
+
+MemBlock TakeMemBlock(void* block)
+{
+    MemBlock taken = {};
+    if (!block)
+        return taken;
+
+    MemBlockShard& shard = GetShard(block);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.blocks.find(block);
+    if (it != shard.blocks.end())
+    {
+        taken = it->second;
+        shard.blocks.erase(it);
+    }
+    return taken;
+}
+
+void RecordMemFree(const MemBlock& freed)
+{
+    MemThreadState& state = GetMemThreadState();
+    if (freed.known)
+        ReleaseBlock(state, freed, true);
+    else
+        AddToCounter(state.unknownFrees, 1);
+}
+
+void RecordMemReAlloc(void* oldBlock, const MemBlock& old, void* newBlock, uint32_t size,
+                      const char* sourceFile, int sourceLine)
+{
+    if (!newBlock)
+    {
+        // The old block is still there
+        if (old.known)
+            InsertBlock(oldBlock, old);
+        return;
+    }
+
+    MemThreadState& state = GetMemThreadState();
+    if (old.known)
+        ReleaseBlock(state, old, false);
+
+    MemCallSite& site = GetCallSite(state, sourceFile, static_cast<uint32_t>(sourceLine));
+    AddToCounter(site.reallocs, 1);
+    RecordBlock(state, site, newBlock, size, sourceFile, static_cast<uint32_t>(sourceLine));
+}
+
+// Totals of one call site over all threads
+struct CallSiteTotals
+{
+    uint64_t allocs = 0;
+    uint64_t reallocs = 0;
+    uint64_t frees = 0;
+    uint64_t bytes = 0;
+    uint64_t releasedBytes = 0;
+    uint64_t largest = 0;
+};
+
+static void AddSite(CallSiteTotals& totals, const MemCallSite& site)
+{
+    totals.allocs += site.allocs.load(std::memory_order_relaxed);
+    totals.reallocs += site.reallocs.load(std::memory_order_relaxed);
+    totals.frees += site.frees.load(std::memory_order_relaxed);
+    totals.bytes += site.bytes.load(std::memory_order_relaxed);
+    totals.releasedBytes += site.releasedBytes.load(std::memory_order_relaxed);
+    totals.largest = std::max(totals.largest, site.largest.load(std::memory_order_relaxed));
+}
+
+void WriteMemoryReport(std::ostream& out)
+{
+    // Sites are merged by name, since a file name string may be spelled at
+    // more than one address (and a site may have been counted by many threads)
+    std::map<std::pair<std::string, uint32_t>, CallSiteTotals> sites;
+    CallSiteTotals overflow;
+    uint64_t sizeHistogram[MEM_SIZE_BUCKETS] = {};
+    uint64_t unknownFrees = 0;
+    unsigned threads = 0;
+
+    for (MemThreadState* state = s_memThreadHead.load(std::memory_order_acquire); state; state = state->next)
+    {
+        threads++;
+        for (const MemCallSite& site : state->sites)
+        {
+            if (!site.used.load(std::memory_order_acquire))
+                continue;
+            std::string file = site.sourceFile ? site.sourceFile : "(unknown)";
+            AddSite(sites[std::make_pair(file, site.sourceLine)], site);
+        }
+        AddSite(overflow, state->overflow);
+        for (size_t i = 0; i < MEM_SIZE_BUCKETS; i++)
+            sizeHistogram[i] += state->sizeHistogram[i].load(std::memory_order_relaxed);
+        unknownFrees += state->unknownFrees.load(std::memory_order_relaxed);
+    }
+
+    CallSiteTotals totals;
+    for (const auto& site : sites)
+    {
+        totals.allocs += site.second.allocs;
+        totals.reallocs += site.second.reallocs;
+        totals.frees += site.second.frees;
+        totals.bytes += site.second.bytes;
+    }
+    totals.allocs += overflow.allocs;
+    totals.reallocs += overflow.reallocs;
+    totals.frees += overflow.frees;
+    totals.bytes += overflow.bytes;
+
+    out << "Threads: " << threads << "\n";
+    out << "Allocations: " << totals.allocs << ", reallocations: " << totals.reallocs
+        << ", frees: " << totals.frees << " (and " << unknownFrees << " of blocks allocated elsewhere)\n";
+    out << "Bytes allocated: " << totals.bytes << "\n";
+    out << "Live bytes: " << s_liveBytes.load() << " at exit, " << s_peakLiveBytes.load() << " at peak\n\n";
+
+    out << "Requested sizes:\n";
+    for (size_t i = 0; i < MEM_SIZE_BUCKETS; i++)
+    {
+        if (sizeHistogram[i] == 0)
+            continue;
+        out << "  <= " << std::setw(10) << (uint64_t(1) << i) << " bytes" << std::setw(12) << sizeHistogram[i] << "\n";
+    }
+
+    std::vector<std::pair<std::pair<std::string, uint32_t>, CallSiteTotals>> sorted(sites.begin(), sites.end());
+    if (overflow.allocs + overflow.reallocs + overflow.frees > 0)
+        sorted.emplace_back(std::make_pair(std::string("(other sites)"), 0u), overflow);
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b)
+    {
+        return a.second.bytes > b.second.bytes;
+    });
+
+    out << "\n"
+        << std::setw(10) << "Allocs"
+        << std::setw(10) << "Reallocs"
+        << std::setw(10) << "Frees"
+        << std::setw(14) << "Bytes"
+        << std::setw(14) << "Live bytes"
+        << std::setw(10) << "Largest"
+        << "  Call site\n";
+
+    for (const auto& site : sorted)
+    {
+        const CallSiteTotals& counts = site.second;
+        out << std::setw(10) << counts.allocs
+            << std::setw(10) << counts.reallocs
+            << std::setw(10) << counts.frees
+            << std::setw(14) << counts.bytes
+            << std::setw(14) << static_cast<int64_t>(counts.bytes - counts.releasedBytes)
+            << std::setw(10) << counts.largest
+            << "  " << site.first.first;
+        if (site.first.second)
+            out << ":" << site.first.second;
+        out << "\n";
+    }
+}
@@ -0,0 +1,51 @@
+/*
+    MemProfiler.h - Storm allocation profiling for MpqFileLister plugin
+
+    The game allocates through Storm's SMemAlloc, SMemReAlloc and SMemFree,
+    which take the source file and line of the caller. Every call is counted
+    against that call site in a table owned by the calling thread, along with
+    a histogram of the requested sizes, so threads never share counters.
+    Blocks are remembered in a table split into many separately locked parts,
+    so a free can be charged to the site that allocated the block without
+    every thread waiting on one lock. The bytes still allocated are kept in
+    a single counter, along with their high-water mark.
+
+    Allocations Storm makes internally do not go through the import table
+    and are not seen, and neither are blocks allocated before the hooks were
+    installed; frees of such blocks are only counted.
+*/
+
+#ifndef MEMPROFILER_H
+#define MEMPROFILER_H
+
+#include <cstdint>
+#include <ostream>
+
+// A block taken out of the profiler's table by a free or reallocation
+struct MemBlock
+{
+    bool known;                 // False if the block was not allocated through the hooks
+    uint32_t size;
+    const char* sourceFile;     // Call site that allocated the block
+    uint32_t sourceLine;
+};
+
+// Record a block returned by SMemAlloc
+void RecordMemAlloc(void* block, uint32_t size, const char* sourceFile, int sourceLine);
+
+// Take a block out of the table. Must be called before Storm frees or moves
+// it, since another thread may be handed the same address right after.
+MemBlock TakeMemBlock(void* block);
+
+// Record a call to SMemFree of a block taken with TakeMemBlock
+void RecordMemFree(const MemBlock& freed);
+
+// Record a call to SMemReAlloc of a block taken with TakeMemBlock. newBlock
+// is nullptr if Storm failed, in which case the old block is put back.
+void RecordMemReAlloc(void* oldBlock, const MemBlock& old, void* newBlock, uint32_t size,
+                      const char* sourceFile, int sourceLine);
+
+// Write the totals, size histogram and call sites, most bytes allocated first
+void WriteMemoryReport(std::ostream& out);
+
+#endif // MEMPROFILER_H
@@ -0,0 +1,84 @@
+/*
+    MissLog.cpp - Failed file lookup tracking for MpqFileLister plugin
+*/
+
+#include "MissLog.h"
+#include "Timing.h"
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct MissStats
+{
+    uint64_t count = 0;
+    uint64_t totalTicks = 0;
+    uint64_t maxTicks = 0;
+};
+
+// Kept apart from the log mutex so misses never wait for log writes
+static std::mutex s_missMutex;
+static std::unordered_map<std::string, MissStats> s_misses;
+
+void RecordMiss(const char* fileName, uint64_t stormTicks)
+{
+    if (!fileName)
+        return;
+
+    std::lock_guard<std::mutex> lock(s_missMutex);
+
+    MissStats& stats = s_misses[fileName];
+    stats.count++;
+    stats.totalTicks += stormTicks;
+    stats.maxTicks = std::max(stats.maxTicks, stormTicks);
+}
+
+void WriteMissReport(std::ostream& out)
+{
+    std::lock_guard<std::mutex> lock(s_missMutex);
+
+    using MissEntry = std::pair<const std::string, MissStats>;
+    std::vector<const MissEntry*> entries;
+    entries.reserve(s_misses.size());
+
+    uint64_t totalCount = 0;
+    uint64_t totalTicks = 0;
+    for (const MissEntry& entry : s_misses)
+    {
+        entries.push_back(&entry);
+        totalCount += entry.second.count;
+        totalTicks += entry.second.totalTicks;
+    }
+
+    // Most expensive names first; ties broken by name for a stable report
+    std::sort(entries.begin(), entries.end(), [](const MissEntry* a, const MissEntry* b)
+    {
+        if (a->second.totalTicks != b->second.totalTicks)
+            return a->second.totalTicks > b->second.totalTicks;
+        return a->first < b->first;
+    });
+
+    out << "Misses: " << totalCount << " (" << entries.size() << " unique names), "
+        << FormatTicksAsMs(totalTicks) << " ms in Storm\n\n";
+
+    out << std::setw(10) << "Count"
+        << std::setw(14) << "Total ms"
+        << std::setw(14) << "Max ms"
+        << "  Filename\n";
+
+    for (const MissEntry* entry : entries)
+    {
+        out << std::setw(10) << entry->second.count
+            << std::setw(14) << FormatTicksAsMs(entry->second.totalTicks)
+            << std::setw(14) << FormatTicksAsMs(entry->second.maxTicks)
+            << "  " << entry->first << "\n";
+    }
+}
+
+void ClearMisses()
+{
+    std::lock_guard<std::mutex> lock(s_missMutex);
+    s_misses.clear();
+}
@@ -0,0 +1,24 @@
+/*
+    MissLog.h - Failed file lookup tracking for MpqFileLister plugin
+
+    Every open that Storm fails costs a search through all archives, but does
+    not show up in the regular log. This keeps a count and the total Storm
+    time for each missing name, and writes them sorted by cost on exit.
+*/
+
+#ifndef MISSLOG_H
+#define MISSLOG_H
+
+#include <cstdint>
+#include <ostream>
+
+// Record a failed open of fileName that spent stormTicks inside Storm
+void RecordMiss(const char* fileName, uint64_t stormTicks);
+
+// Write all recorded misses, most expensive first
+void WriteMissReport(std::ostream& out);
+
+// Forget all recorded misses
+void ClearMisses();
+
+#endif // MISSLOG_H
@@ -5,10 +5,29 @@
 #include "MpqFileLister.h"
 #include "MPQDraftPlugin.h"
 #include "QHookAPI.h"
+#include "ArchiveMounts.h"
 #include "Config.h"
 #include "ConfigDialog.h"
+#include "CrashDrain.h"
+#include "DecompressProfiler.h"
+#include "DirectoryTree.h"
+#include "FileCache.h"
+#include "LiveStatsPublisher.h"
+#include "LoadPhases.h"
+#include "LogBuffer.h"
+#include "LogCompressor.h"
+#include "MemProfiler.h"
+#include "MissLog.h"
+#include "PluginHeap.h"
+#include "Prefetcher.h"
+#include "RecordPipeline.h"
+#include "ThreadStats.h"
+#include "Timing.h"
+#include "TraceWriter.h"
+#include "tools/LogParser.h"
 #include <filesystem>
 #include <cstring>
+#include <unordered_map>
 #include <unordered_set>
 #include <chrono>
 #include <sstream>
@@ -19,10 +38,31 @@ static constexpr uint32_t SFILEOPENFILE_D1_ORDINAL       = 0x4E;    // 78
 static constexpr uint32_t SFILEOPENFILEEX_D1_ORDINAL     = 0x4F;    // 79
 static constexpr uint32_t SFILEGETFILEARCHIVE_D1_ORDINAL = 0x4B;    // 75
 static constexpr uint32_t SFILEGETARCHIVENAME_D1_ORDINAL = 0x56;    // 86
+// The other functions have not been checked against a Diablo I Storm.dll
+// yet, so the features that need them are not available there
+static constexpr uint32_t STORM_ORDINAL_UNKNOWN          = 0;
+static constexpr uint32_t SFILEREADFILE_D1_ORDINAL       = STORM_ORDINAL_UNKNOWN;
+static constexpr uint32_t SFILECLOSEFILE_D1_ORDINAL      = STORM_ORDINAL_UNKNOWN;
+static constexpr uint32_t SFILEGETFILESIZE_D1_ORDINAL    = STORM_ORDINAL_UNKNOWN;
+static constexpr uint32_t SFILESETFILEPOINTER_D1_ORDINAL = STORM_ORDINAL_UNKNOWN;
+static constexpr uint32_t SFILEOPENARCHIVE_D1_ORDINAL    = STORM_ORDINAL_UNKNOWN;
+static constexpr uint32_t SFILECLOSEARCHIVE_D1_ORDINAL   = STORM_ORDINAL_UNKNOWN;
+static constexpr uint32_t SMEMALLOC_D1_ORDINAL           = STORM_ORDINAL_UNKNOWN;
+static constexpr uint32_t SMEMFREE_D1_ORDINAL            = STORM_ORDINAL_UNKNOWN;
+static constexpr uint32_t SMEMREALLOC_D1_ORDINAL         = STORM_ORDINAL_UNKNOWN;
 static constexpr uint32_t SFILEOPENFILE_ORDINAL          = 0x10B;   // 267
 static constexpr uint32_t SFILEOPENFILEEX_ORDINAL        = 0x10C;   // 268
 static constexpr uint32_t SFILEGETFILEARCHIVE_ORDINAL    = 0x108;   // 264
 static constexpr uint32_t SFILEGETARCHIVENAME_ORDINAL    = 0x113;   // 275
+static constexpr uint32_t SFILEREADFILE_ORDINAL          = 0x10D;   // 269
+static constexpr uint32_t SFILECLOSEFILE_ORDINAL         = 0xFD;    // 253
+static constexpr uint32_t SFILEGETFILESIZE_ORDINAL       = 0x109;   // 265
+static constexpr uint32_t SFILESETFILEPOINTER_ORDINAL    = 0x10F;   // 271
+static constexpr uint32_t SFILEOPENARCHIVE_ORDINAL       = 0x10A;   // 266
+static constexpr uint32_t SFILECLOSEARCHIVE_ORDINAL      = 0xFC;    // 252
+static constexpr uint32_t SMEMALLOC_ORDINAL              = 0x191;   // 401
+static constexpr uint32_t SMEMFREE_ORDINAL               = 0x193;   // 403
+static constexpr uint32_t SMEMREALLOC_ORDINAL            = 0x195;   // 405
 
 // Function pointer types for archive name lookup
 // BOOL SFileGetFileArchive(HANDLE hFile, HANDLE* phArchive)
@@ -33,19 +73,77 @@ using SFileGetArchiveNamePtr = BOOL (WINAPI*)(HANDLE, char*, DWORD);
 static SFileGetFileArchivePtr s_SFileGetFileArchive = nullptr;
 static SFileGetArchiveNamePtr s_SFileGetArchiveName = nullptr;
 
+// SFileGetFileSize, for deciding whether a file is small enough to cache
+static SFileGetFileSizePtr s_SFileGetFileSize = nullptr;
+
+// A Storm function by ordinal, or null if the ordinal is not known for the game
+static FARPROC GetStormFunction(HMODULE storm, uint32_t ordinal)
+{
+    if (ordinal == STORM_ORDINAL_UNKNOWN)
+        return nullptr;
+    return GetProcAddress(storm, (LPCSTR)(uintptr_t)ordinal);
+}
+
+// Start of an error for Storm functions that could not be found
+static std::string MissingFromStorm(const char* functions)
+{
+    if (g_targetGame == TargetGame::DIABLO_1)
+        return std::string("ERROR: ") + functions + " not available for Diablo I";
+    return std::string("ERROR: ") + functions + " not found in Storm.dll";
+}
+
+// Path of the archive a file was opened from, as it was mounted, or empty
+static std::string GetFileArchivePath(HANDLE file)
+{
+    std::string path;
+    HANDLE hArchive = nullptr;
+    if (s_SFileGetFileArchive && s_SFileGetFileArchive(file, &hArchive) && hArchive &&
+        !FindArchivePath(hArchive, path) && s_SFileGetArchiveName)
+    {
+        char archivePathBuf[MAX_PATH] = {0};
+        if (s_SFileGetArchiveName(hArchive, archivePathBuf, MAX_PATH))
+            path = archivePathBuf;
+    }
+    return path;
+}
+
 // Global plugin instance
 CMpqFileListerPlugin g_MpqFileLister;
 
 // Static member initialization
 SFileOpenFilePtr CMpqFileListerPlugin::s_OriginalSFileOpenFile = nullptr;
 SFileOpenFileExPtr CMpqFileListerPlugin::s_OriginalSFileOpenFileEx = nullptr;
+SFileReadFilePtr CMpqFileListerPlugin::s_OriginalSFileReadFile = nullptr;
+SFileCloseFilePtr CMpqFileListerPlugin::s_OriginalSFileCloseFile = nullptr;
+SFileSetFilePointerPtr CMpqFileListerPlugin::s_OriginalSFileSetFilePointer = nullptr;
+SFileOpenArchivePtr CMpqFileListerPlugin::s_OriginalSFileOpenArchive = nullptr;
+SFileCloseArchivePtr CMpqFileListerPlugin::s_OriginalSFileCloseArchive = nullptr;
+SMemAllocPtr CMpqFileListerPlugin::s_OriginalSMemAlloc = nullptr;
+SMemFreePtr CMpqFileListerPlugin::s_OriginalSMemFree = nullptr;
+SMemReAllocPtr CMpqFileListerPlugin::s_OriginalSMemReAlloc = nullptr;
+ExitProcessPtr CMpqFileListerPlugin::s_OriginalExitProcess = nullptr;
 std::ofstream CMpqFileListerPlugin::s_logFile;
 std::mutex CMpqFileListerPlugin::s_logMutex;
 std::string CMpqFileListerPlugin::s_logFilePath;
+uint64_t CMpqFileListerPlugin::s_sessionStartTicks = 0;
+
+// Chrome trace-event serializer (used when g_logFormat is CHROME_TRACE)
+static CTraceWriter s_traceWriter;
+
+// Text logs: compressed by a background thread, or buffered by LogBuffer,
+// which is switched to the next part of the log at g_logRotateSizeMB
+static bool s_logCompressed = false;
+static unsigned s_logPart = 1;
+
+// File accesses written to the log, counted in its trailer
+static uint64_t s_loggedAccesses = 0;
 
-// Set to track seen filenames (used when g_logUniqueOnly is true)
+// Set to track seen filenames (used when g_logUniqueOnly or g_liveStats is true)
 static std::unordered_set<std::string> s_seenFiles;
 
+// Names of the open files, for read events in the trace format (guarded by s_logMutex)
+static std::unordered_map<HANDLE, std::string> s_traceFileNames;
+
 // DLL entry point
 BOOL APIENTRY DllMain(HMODULE hModule, DWORD dwReason, LPVOID lpReserved)
 {
@@ -58,6 +156,7 @@ BOOL APIENTRY DllMain(HMODULE hModule, DWORD dwReason, LPVOID lpReserved)
             DisableThreadLibraryCalls(hModule);
             InitConfigPath(hModule);
             LoadConfig();
+            SetPluginHeapEnabled(g_pluginHeap);
             break;
         case DLL_PROCESS_DETACH:
             // Ensure cleanup happens
@@ -166,91 +265,240 @@ BOOL WINAPI CMpqFileListerPlugin::GetModules(void* lpPluginModules, DWORD* lpnNu
 }
 
 // Helper function to get Unix epoch timestamp in milliseconds
-static std::string GetTimestampMs()
+static uint64_t GetTimestampMs()
 {
     auto now = std::chrono::system_clock::now();
-    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
-    return std::to_string(ms);
+    return std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
 }
 
-// Helper function to log file access (shared by both hook functions)
-void CMpqFileListerPlugin::LogFileAccess(const char* fileName, HANDLE fileHandle)
+// Helper function to get the time since the plugin was initialized, in microseconds
+static uint64_t GetSessionMicros(uint64_t ticks, uint64_t sessionStartTicks)
+{
+    return ticks > sessionStartTicks ? TicksToMicros(ticks - sessionStartTicks) : 0;
+}
+
+bool CMpqFileListerPlugin::IsLogOpen()
 {
-    if (!fileName || !s_logFile.is_open())
+    return s_logCompressed || IsLogBufferOpen() || s_logFile.is_open();
+}
+
+// Helper function to write a line of a text log (the caller holds s_logMutex)
+void CMpqFileListerPlugin::WriteLogLine(const std::string& line)
+{
+    if (s_logCompressed)
+    {
+        AppendCompressedLog(line);
+        return;
+    }
+
+    AppendLogBuffer(line.data(), line.size());
+
+    if (g_logRotateSizeMB > 0 &&
+        LogBufferFileSize() >= static_cast<uint64_t>(g_logRotateSizeMB) * 1024 * 1024)
+    {
+        OpenLogBuffer(GetLogPartPath(s_logFilePath, ++s_logPart), static_cast<size_t>(g_logBufferKB) * 1024);
+    }
+}
+
+// Helper function to log errors (the trace format needs them wrapped in an event)
+void CMpqFileListerPlugin::LogError(const char* message)
+{
+    if (!IsLogOpen())
         return;
 
     std::lock_guard<std::mutex> lock(s_logMutex);
 
-    // Build the log entry based on the selected format
-    std::string logEntry;
-    std::string archiveName;
+    if (g_logFormat == LogFormat::CHROME_TRACE)
+    {
+        s_traceWriter.WriteInstantEvent(s_logFile, message,
+            GetSessionMicros(GetTicks(), s_sessionStartTicks), GetCurrentThreadId());
+        return;
+    }
+
+    WriteLogLine(message);
+}
 
-    // Get archive name if needed for the format
+// Helper function to build e.g. "FileLog.threads.txt" from "FileLog.txt"
+// (or from "FileLog{n}.txt", for a log split into parts)
+std::string CMpqFileListerPlugin::GetReportPath(const char* suffix)
+{
+    std::string logPath = s_logFilePath;
+    size_t placeholder = logPath.find("{n}");
+    if (placeholder != std::string::npos)
+        logPath.erase(placeholder, 3);
+
+    std::filesystem::path reportPath(logPath);
+    reportPath.replace_extension();
+    return reportPath.string() + suffix;
+}
+
+// Helper function to log file access (shared by both hook functions)
+void CMpqFileListerPlugin::LogFileAccess(const FileAccess& access)
+{
+    const char* fileName = access.fileName;
+    HANDLE fileHandle = access.fileHandle;
+
+    if (!fileName || !IsLogOpen())
+        return;
+
+    // Get archive name if needed for the format (sinks may all need it)
+    std::string archiveName;
     bool needArchive = (g_logFormat == LogFormat::TIMESTAMP_ARCHIVE_FILENAME ||
-                        g_logFormat == LogFormat::ARCHIVE_FILENAME);
+                        g_logFormat == LogFormat::ARCHIVE_FILENAME ||
+                        g_logFormat == LogFormat::CHROME_TRACE ||
+                        !g_recordSinks.empty());
 
-    if (needArchive && fileHandle && s_SFileGetFileArchive && s_SFileGetArchiveName)
+    if (needArchive && fileHandle && s_SFileGetFileArchive)
     {
         HANDLE hArchive = nullptr;
-        if (s_SFileGetFileArchive(fileHandle, &hArchive) && hArchive)
+        if (s_SFileGetFileArchive(fileHandle, &hArchive) && hArchive &&
+            !FindArchiveName(hArchive, archiveName) && s_SFileGetArchiveName)
         {
+            // Mounted before the hooks were installed; ask Storm once
             char archiveNameBuf[MAX_PATH] = {0};
             if (s_SFileGetArchiveName(hArchive, archiveNameBuf, MAX_PATH) && archiveNameBuf[0])
             {
-                // Extract just the filename from the full path
-                std::filesystem::path archivePath(archiveNameBuf);
-                archiveName = archivePath.filename().string();
+                RememberArchiveName(hArchive, archiveNameBuf);
+                FindArchiveName(hArchive, archiveName);
             }
         }
     }
 
-    // Build the uniqueness key (without timestamp) for duplicate detection
+    // Read events in the trace format are named after the file being read
+    if (g_logFormat == LogFormat::CHROME_TRACE && s_OriginalSFileReadFile && s_OriginalSFileCloseFile && fileHandle)
+    {
+        std::lock_guard<std::mutex> lock(s_logMutex);
+        s_traceFileNames[fileHandle] = fileName;
+    }
+
+    // Capture the access once, into the record pipeline's queue if it runs
+    AccessRecord localRecord;
+    AccessRecord* queuedRecord = BeginQueuedRecord();
+    AccessRecord& record = queuedRecord ? *queuedRecord : localRecord;
+    record.startMicros = GetSessionMicros(access.startTicks, s_sessionStartTicks);
+    record.stormMicros = TicksToMicros(access.stormTicks);
+    record.timestampMs = GetTimestampMs();
+    record.function = access.function;
+    record.threadId = access.threadId;
+    SetRecordNames(record, archiveName.data(), archiveName.size(), fileName);
+
+    if (queuedRecord)
+    {
+        CommitQueuedRecord(queuedRecord);
+        return;
+    }
+
+    // Time spent waiting here shows how contended the hook is across threads
+    uint64_t lockStartTicks = GetTicks();
+    std::lock_guard<std::mutex> lock(s_logMutex);
+    AddToCounter(GetThreadStats().lockWaitTicks, GetTicks() - lockStartTicks);
+
+    WriteAccessRecord(record);
+}
+
+// Helper function to write an access to the log (the caller holds s_logMutex)
+void CMpqFileListerPlugin::WriteAccessRecord(const AccessRecord& record)
+{
+    if (!IsLogOpen())
+        return;
+
+    // Build the uniqueness key (without timestamp) for duplicate detection.
+    // The archive is only part of it in formats that show it.
+    bool showArchive = (g_logFormat == LogFormat::TIMESTAMP_ARCHIVE_FILENAME ||
+                        g_logFormat == LogFormat::ARCHIVE_FILENAME ||
+                        g_logFormat == LogFormat::CHROME_TRACE);
     std::string uniqueKey;
-    if (!archiveName.empty())
-        uniqueKey = archiveName + ": " + fileName;
+    if (showArchive && record.archiveLength > 0)
+        uniqueKey = std::string(record.archive, record.archiveLength) + ": " + record.fileName;
     else
-        uniqueKey = fileName;
+        uniqueKey = record.fileName;
 
-    // Check if we should log this entry
+    // Check if we should log this entry. A trace is a timeline, so it keeps
+    // every open even when only unique names are logged.
+    bool uniqueOnly = g_logUniqueOnly && g_logFormat != LogFormat::CHROME_TRACE;
     bool shouldLog = true;
-    if (g_logUniqueOnly)
+    if (uniqueOnly || g_liveStats)
     {
         // Only log if we haven't seen this entry before (based on uniqueKey, not timestamp)
         auto [it, inserted] = s_seenFiles.insert(uniqueKey);
-        shouldLog = inserted;
+        shouldLog = inserted || !uniqueOnly;
+        if (inserted && g_liveStats)
+            SetLiveUniqueNames(s_seenFiles.size());
     }
 
     if (!shouldLog)
         return;
+    s_loggedAccesses++;
 
-    // Build the log entry according to the selected format
-    switch (g_logFormat)
+    if (g_logFormat == LogFormat::CHROME_TRACE)
     {
-        case LogFormat::TIMESTAMP_ARCHIVE_FILENAME:
-            logEntry = GetTimestampMs() + " ";
-            if (!archiveName.empty())
-                logEntry += archiveName + ": ";
-            logEntry += fileName;
-            break;
+        // Formatted straight into the trace writer's buffer
+        s_traceWriter.WriteCompleteEvent(
+            s_logFile,
+            record.fileName,
+            record.function,
+            record.startMicros,
+            record.stormMicros,
+            record.threadId,
+            record.archive,
+            record.fileName);
+        return;
+    }
 
-        case LogFormat::ARCHIVE_FILENAME:
-            if (!archiveName.empty())
-                logEntry = archiveName + ": " + fileName;
-            else
-                logEntry = fileName;
-            break;
+    // Build the log entry according to the selected format
+    std::string logEntry;
+    FormatTextRecord(record, static_cast<unsigned>(g_logFormat), g_logThreadId, logEntry);
+    WriteLogLine(logEntry);
+}
 
-        case LogFormat::TIMESTAMP_FILENAME:
-            logEntry = GetTimestampMs() + " " + fileName;
-            break;
+// Helper function to write a read served by Storm to the trace
+void CMpqFileListerPlugin::LogFileRead(HANDLE fileHandle, uint64_t startTicks, uint64_t stormTicks)
+{
+    if (!IsLogOpen())
+        return;
 
-        case LogFormat::FILENAME_ONLY:
-            logEntry = fileName;
-            break;
+    std::lock_guard<std::mutex> lock(s_logMutex);
+    auto it = s_traceFileNames.find(fileHandle);
+    if (it == s_traceFileNames.end())
+        return;
+
+    s_traceWriter.WriteCompleteEvent(
+        s_logFile,
+        it->second.c_str(),
+        "SFileReadFile",
+        GetSessionMicros(startTicks, s_sessionStartTicks),
+        TicksToMicros(stormTicks),
+        GetCurrentThreadId(),
+        nullptr,
+        it->second.c_str());
+}
+
+// The log, as the first sink of the record pipeline
+class CPrimaryLogSink : public IRecordSink
+{
+public:
+    void Write(const AccessRecord& record) override
+    {
+        std::lock_guard<std::mutex> lock(CMpqFileListerPlugin::s_logMutex);
+        CMpqFileListerPlugin::WriteAccessRecord(record);
     }
 
-    s_logFile << logEntry << "\n";
-    s_logFile.flush();
+    // The log is written out by LogBuffer and LogCompressor
+    void Flush() override {}
+};
+
+// Helper function to tell the file cache about a file the game opened
+void CMpqFileListerPlugin::TrackCachedOpen(const char* fileName, HANDLE fileHandle)
+{
+    HANDLE hArchive = nullptr;
+    if (s_SFileGetFileArchive)
+        s_SFileGetFileArchive(fileHandle, &hArchive);
+
+    DWORD fileSize = 0;
+    if (s_SFileGetFileSize)
+        fileSize = s_SFileGetFileSize(fileHandle, nullptr);
+
+    CacheFileOpened(fileHandle, hArchive, fileName, fileSize == 0xFFFFFFFF ? 0 : fileSize);
 }
 
 // The hook function - this is called instead of the original SFileOpenFile
@@ -258,14 +506,38 @@ BOOL WINAPI CMpqFileListerPlugin::HookedSFileOpenFile(
     LPCSTR lpFileName,
     HANDLE* hFile)
 {
+    ThreadStats& stats = GetThreadStats();
+
     // Call the original function first to see if the file was found
     BOOL result = FALSE;
+    uint64_t startTicks = GetTicks();
     if (s_OriginalSFileOpenFile)
         result = s_OriginalSFileOpenFile(lpFileName, hFile);
+    uint64_t stormTicks = GetTicks() - startTicks;
 
     // Log the file access
-    if (result && hFile && *hFile)
-        LogFileAccess(lpFileName, *hFile);
+    bool succeeded = result && hFile && *hFile;
+    if (succeeded)
+        LogFileAccess({lpFileName, *hFile, "SFileOpenFile", stats.threadId, startTicks, stormTicks});
+    else if (g_logMisses)
+        RecordMiss(lpFileName, stormTicks);
+
+    if (succeeded && g_phaseIdleGapMs > 0)
+        RecordPhaseAccess(lpFileName, startTicks, stormTicks);
+
+    if (succeeded && !g_prefetchManifest.empty())
+        RecordPrefetchAccess(lpFileName, stormTicks);
+
+    if (succeeded && g_fileCacheBudgetKB > 0)
+        TrackCachedOpen(lpFileName, *hFile);
+
+    if (succeeded && g_writeDirectoryTree)
+        RecordTreeAccess(lpFileName, stormTicks);
+
+    if (succeeded && g_profileDecompression)
+        DecompressFileOpened(*hFile, lpFileName, GetFileArchivePath(*hFile));
+
+    RecordThreadOpen(stats, succeeded, stormTicks, GetTicks() - startTicks - stormTicks);
 
     return result;
 }
@@ -277,18 +549,241 @@ BOOL WINAPI CMpqFileListerPlugin::HookedSFileOpenFileEx(
     DWORD dwSearchScope,
     HANDLE* phFile)
 {
+    ThreadStats& stats = GetThreadStats();
+
     // Call the original function first to see if the file was found
     BOOL result = FALSE;
+    uint64_t startTicks = GetTicks();
     if (s_OriginalSFileOpenFileEx)
         result = s_OriginalSFileOpenFileEx(hMpq, szFileName, dwSearchScope, phFile);
+    uint64_t stormTicks = GetTicks() - startTicks;
 
     // Log the file access
-    if (result && phFile && *phFile)
-        LogFileAccess(szFileName, *phFile);
+    bool succeeded = result && phFile && *phFile;
+    if (succeeded)
+        LogFileAccess({szFileName, *phFile, "SFileOpenFileEx", stats.threadId, startTicks, stormTicks});
+    else if (g_logMisses)
+        RecordMiss(szFileName, stormTicks);
+
+    if (succeeded && g_phaseIdleGapMs > 0)
+        RecordPhaseAccess(szFileName, startTicks, stormTicks);
+
+    if (succeeded && !g_prefetchManifest.empty())
+        RecordPrefetchAccess(szFileName, stormTicks);
+
+    if (succeeded && g_fileCacheBudgetKB > 0)
+        TrackCachedOpen(szFileName, *phFile);
+
+    if (succeeded && g_writeDirectoryTree)
+        RecordTreeAccess(szFileName, stormTicks);
+
+    if (succeeded && g_profileDecompression)
+        DecompressFileOpened(*phFile, szFileName, GetFileArchivePath(*phFile));
+
+    RecordThreadOpen(stats, succeeded, stormTicks, GetTicks() - startTicks - stormTicks);
+
+    return result;
+}
+
+// The hook function - this is called instead of the original SFileReadFile
+BOOL WINAPI CMpqFileListerPlugin::HookedSFileReadFile(
+    HANDLE hFile,
+    void* lpBuffer,
+    DWORD nNumberOfBytesToRead,
+    DWORD* lpNumberOfBytesRead,
+    LPVOID lpOverlapped)
+{
+    // The file cache needs the number of bytes read even if the game does not
+    DWORD bytesRead = 0;
+    if (!lpNumberOfBytesRead)
+        lpNumberOfBytesRead = &bytesRead;
+
+    BOOL result = FALSE;
+    bool cached = g_fileCacheBudgetKB > 0 && !lpOverlapped &&
+        ReadCachedFile(hFile, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, &result);
+
+    if (!cached && s_OriginalSFileReadFile)
+    {
+        uint64_t startTicks = GetTicks();
+        result = s_OriginalSFileReadFile(hFile, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped);
+        uint64_t stormTicks = GetTicks() - startTicks;
+
+        if (g_fileCacheBudgetKB > 0 && !lpOverlapped)
+            CacheStormRead(hFile, lpBuffer, *lpNumberOfBytesRead, stormTicks);
+        if (g_profileDecompression)
+            RecordFileRead(hFile, *lpNumberOfBytesRead, stormTicks);
+        if (g_logFormat == LogFormat::CHROME_TRACE)
+            LogFileRead(hFile, startTicks, stormTicks);
+    }
+
+    // Storm reports the bytes read even when it hits the end of the file and fails
+    AddToCounter(GetThreadStats().bytesRead, *lpNumberOfBytesRead);
+
+    return result;
+}
+
+// The hook function - this is called instead of the original SFileCloseFile
+BOOL WINAPI CMpqFileListerPlugin::HookedSFileCloseFile(HANDLE hFile)
+{
+    // Before Storm closes it, so the handle cannot have been reused yet
+    if (g_fileCacheBudgetKB > 0)
+        CacheFileClosed(hFile);
+    if (g_profileDecompression)
+        DecompressFileClosed(hFile);
+    if (g_logFormat == LogFormat::CHROME_TRACE)
+    {
+        std::lock_guard<std::mutex> lock(s_logMutex);
+        s_traceFileNames.erase(hFile);
+    }
+
+    BOOL result = FALSE;
+    if (s_OriginalSFileCloseFile)
+        result = s_OriginalSFileCloseFile(hFile);
+    return result;
+}
+
+// The hook function - this is called instead of the original SFileSetFilePointer
+DWORD WINAPI CMpqFileListerPlugin::HookedSFileSetFilePointer(
+    HANDLE hFile,
+    LONG lDistanceToMove,
+    LONG* lplDistanceToMoveHigh,
+    DWORD dwMoveMethod)
+{
+    DWORD position = 0xFFFFFFFF;
+    if (SeekCachedFile(hFile, lDistanceToMove, dwMoveMethod, &position))
+    {
+        if (lplDistanceToMoveHigh)
+            *lplDistanceToMoveHigh = 0;
+        return position;
+    }
+
+    if (s_OriginalSFileSetFilePointer)
+        position = s_OriginalSFileSetFilePointer(hFile, lDistanceToMove, lplDistanceToMoveHigh, dwMoveMethod);
+    if (position != 0xFFFFFFFF)
+        CacheFileSeeked(hFile, position);
+    return position;
+}
+
+// The hook function - this is called instead of the original SFileOpenArchive
+BOOL WINAPI CMpqFileListerPlugin::HookedSFileOpenArchive(
+    const char* szMpqName,
+    DWORD dwPriority,
+    DWORD dwFlags,
+    HANDLE* phMpq)
+{
+    BOOL result = FALSE;
+    uint64_t startTicks = GetTicks();
+    if (s_OriginalSFileOpenArchive)
+        result = s_OriginalSFileOpenArchive(szMpqName, dwPriority, dwFlags, phMpq);
+    uint64_t stormTicks = GetTicks() - startTicks;
+
+    bool succeeded = result && phMpq && *phMpq;
+    RecordArchiveOpened(szMpqName, dwPriority, dwFlags, succeeded ? *phMpq : nullptr,
+                        succeeded, startTicks, stormTicks);
+    return result;
+}
+
+// The hook function - this is called instead of the original SFileCloseArchive
+BOOL WINAPI CMpqFileListerPlugin::HookedSFileCloseArchive(HANDLE hMpq)
+{
+    // Before Storm closes it, so the handle cannot have been reused yet
+    RecordArchiveClosed(hMpq, GetTicks());
+    if (g_fileCacheBudgetKB > 0)
+        CacheArchiveClosed(hMpq);
+
+    BOOL result = FALSE;
+    if (s_OriginalSFileCloseArchive)
+        result = s_OriginalSFileCloseArchive(hMpq);
+    return result;
+}
+
+// The hook function - this is called instead of the original SMemAlloc
+void* WINAPI CMpqFileListerPlugin::HookedSMemAlloc(
+    DWORD dwAmount,
+    const char* szSourceFile,
+    int nSourceLine,
+    DWORD dwFlags)
+{
+    void* block = nullptr;
+    if (s_OriginalSMemAlloc)
+        block = s_OriginalSMemAlloc(dwAmount, szSourceFile, nSourceLine, dwFlags);
+    RecordMemAlloc(block, dwAmount, szSourceFile, nSourceLine);
+    return block;
+}
 
+// The hook function - this is called instead of the original SMemFree
+BOOL WINAPI CMpqFileListerPlugin::HookedSMemFree(
+    void* lpLocation,
+    const char* szSourceFile,
+    int nSourceLine,
+    DWORD dwFlags)
+{
+    // Before Storm frees it, so the address cannot have been handed out again yet
+    MemBlock freed = TakeMemBlock(lpLocation);
+
+    BOOL result = FALSE;
+    if (s_OriginalSMemFree)
+        result = s_OriginalSMemFree(lpLocation, szSourceFile, nSourceLine, dwFlags);
+    if (lpLocation)
+        RecordMemFree(freed);
     return result;
 }
 
+// The hook function - this is called instead of the original SMemReAlloc
+void* WINAPI CMpqFileListerPlugin::HookedSMemReAlloc(
+    void* lpLocation,
+    DWORD dwAmount,
+    const char* szSourceFile,
+    int nSourceLine,
+    DWORD dwFlags)
+{
+    MemBlock old = TakeMemBlock(lpLocation);
+
+    void* block = nullptr;
+    if (s_OriginalSMemReAlloc)
+        block = s_OriginalSMemReAlloc(lpLocation, dwAmount, szSourceFile, nSourceLine, dwFlags);
+    RecordMemReAlloc(lpLocation, old, block, dwAmount, szSourceFile, nSourceLine);
+    return block;
+}
+
+// The hook function - this is called instead of the original ExitProcess
+void WINAPI CMpqFileListerPlugin::HookedExitProcess(UINT uExitCode)
+{
+    g_MpqFileLister.TerminatePlugin();
+    s_OriginalExitProcess(uExitCode);
+}
+
+// Helper function to get the file name of the game's executable
+static std::string GetProcessName()
+{
+    std::string exeName(MAX_PATH, '\0');
+    DWORD len = GetModuleFileNameA(nullptr, exeName.data(), MAX_PATH);
+    exeName.resize(len);
+    return std::filesystem::path(exeName).filename().string();
+}
+
+// Helper function to resolve a configured path
+// If fileName is an absolute path, use it directly
+// Otherwise, place it in the game's directory
+static std::string GetGamePath(const std::string& fileName)
+{
+    std::filesystem::path path(fileName);
+    if (path.is_absolute())
+        return fileName;
+
+    std::string exePath(MAX_PATH, '\0');
+    DWORD len = GetModuleFileNameA(nullptr, exePath.data(), MAX_PATH);
+    if (len > 0)
+    {
+        exePath.resize(len);
+        std::filesystem::path gamePath(exePath);
+        return (gamePath.parent_path() / fileName).string();
+    }
+
+    // Fallback to just the filename in the current directory
+    return fileName;
+}
+
 BOOL WINAPI CMpqFileListerPlugin::InitializePlugin(IMPQDraftServer* lpMPQDraftServer)
 {
     (void)lpMPQDraftServer;
@@ -297,32 +792,71 @@ BOOL WINAPI CMpqFileListerPlugin::InitializePlugin(IMPQDraftServer* lpMPQDraftSe
         return TRUE;
 
     // Build log file path
-    // If g_logFileName is an absolute path, use it directly
-    // Otherwise, place it in the game's directory
-    std::filesystem::path logPath(g_logFileName);
-    if (logPath.is_absolute())
+    s_logFilePath = GetGamePath(g_logFileName);
+
+    // Read the prefetch manifest before the log is truncated, so the log of
+    // the previous session can be used as it is
+    size_t manifestNames = 0;
+    if (!g_prefetchManifest.empty())
+        manifestNames = LoadPrefetchManifest(GetGamePath(g_prefetchManifest));
+
+    // Open the log file. The trace format rewrites its closing bracket after
+    // every event, so it needs byte-exact seeking (no newline translation).
+    s_sessionStartTicks = GetTicks();
+    ResetPhases(s_sessionStartTicks);
+    if (g_logFormat == LogFormat::CHROME_TRACE)
     {
-        s_logFilePath = g_logFileName;
+        s_logFile.open(GetLogPartPath(s_logFilePath, 1), std::ios::out | std::ios::trunc | std::ios::binary);
+        if (s_logFile.is_open())
+            s_traceWriter.Begin(s_logFile, GetCurrentProcessId(), GetProcessName().c_str());
+    }
+    else if (g_logCompress)
+    {
+        s_logCompressed = StartLogCompressor(s_logFilePath, static_cast<uint64_t>(g_logRotateSizeMB) * 1024 * 1024);
     }
     else
     {
-        std::string exePath(MAX_PATH, '\0');
-        DWORD len = GetModuleFileNameA(nullptr, exePath.data(), MAX_PATH);
-        if (len > 0)
-        {
-            exePath.resize(len);
-            std::filesystem::path gamePath(exePath);
-            s_logFilePath = (gamePath.parent_path() / g_logFileName).string();
-        }
-        else
+        s_logPart = 1;
+        OpenLogBuffer(GetLogPartPath(s_logFilePath, s_logPart), static_cast<size_t>(g_logBufferKB) * 1024);
+    }
+    s_loggedAccesses = 0;
+
+    // Write out the buffered log if the game crashes
+    AddCrashDrain(DrainLogBuffer);
+    AddCrashDrain(DrainCompressedLog);
+    AddCrashDrain(DrainRecordSinks);
+    InstallCrashDrain();
+
+    // With sinks, the hooks only queue each access, and a background thread
+    // writes it to the log and to every sink
+    if (!g_recordSinks.empty())
+    {
+        AddRecordSink(std::make_unique<CPrimaryLogSink>());
+        for (size_t i = 0; i < g_recordSinks.size(); i++)
         {
-            // Fallback to just the filename in the current directory
-            s_logFilePath = g_logFileName;
+            if (g_recordSinks[i].empty())
+                continue;
+
+            RecordSinkSpec spec;
+            std::string error;
+            std::unique_ptr<IRecordSink> sink;
+            if (ParseRecordSinkSpec(g_recordSinks[i], spec, error))
+            {
+                // A stream's "file" is the name of its pipe
+                if (spec.type != "stream")
+                    spec.path = GetGamePath(spec.path);
+                sink = CreateRecordSink(spec, GetCurrentProcessId(), GetProcessName(), error);
+            }
+
+            if (sink)
+                AddRecordSink(std::move(sink));
+            else
+                LogError(("ERROR: Sink" + std::to_string(i + 1) + ": " + error).c_str());
         }
-    }
 
-    // Open the log file
-    s_logFile.open(s_logFilePath, std::ios::out | std::ios::trunc);
+        if (!StartRecordPipeline(g_recordQueueSize))
+            LogError("ERROR: Could not start the record pipeline, only writing the log");
+    }
 
     // Find Storm.dll
     m_hStorm = GetModuleHandleA("Storm");
@@ -334,10 +868,7 @@ BOOL WINAPI CMpqFileListerPlugin::InitializePlugin(IMPQDraftServer* lpMPQDraftSe
     if (!m_hStorm)
     {
         // Storm is not loaded - can't hook
-        if (s_logFile.is_open())
-        {
-            s_logFile << "ERROR: Storm.dll not found\n";
-        }
+        LogError("ERROR: Storm.dll not found");
         return TRUE;  // Return TRUE to not abort the patch
     }
 
@@ -346,6 +877,15 @@ BOOL WINAPI CMpqFileListerPlugin::InitializePlugin(IMPQDraftServer* lpMPQDraftSe
     uint32_t sFileOpenFileExOrdinal;
     uint32_t sFileGetFileArchiveOrdinal;
     uint32_t sFileGetArchiveNameOrdinal;
+    uint32_t sFileReadFileOrdinal;
+    uint32_t sFileCloseFileOrdinal;
+    uint32_t sFileGetFileSizeOrdinal;
+    uint32_t sFileSetFilePointerOrdinal;
+    uint32_t sFileOpenArchiveOrdinal;
+    uint32_t sFileCloseArchiveOrdinal;
+    uint32_t sMemAllocOrdinal;
+    uint32_t sMemFreeOrdinal;
+    uint32_t sMemReAllocOrdinal;
 
     if (g_targetGame == TargetGame::DIABLO_1)
     {
@@ -353,6 +893,15 @@ BOOL WINAPI CMpqFileListerPlugin::InitializePlugin(IMPQDraftServer* lpMPQDraftSe
         sFileOpenFileExOrdinal = SFILEOPENFILEEX_D1_ORDINAL;
         sFileGetFileArchiveOrdinal = SFILEGETFILEARCHIVE_D1_ORDINAL;
         sFileGetArchiveNameOrdinal = SFILEGETARCHIVENAME_D1_ORDINAL;
+        sFileReadFileOrdinal = SFILEREADFILE_D1_ORDINAL;
+        sFileCloseFileOrdinal = SFILECLOSEFILE_D1_ORDINAL;
+        sFileGetFileSizeOrdinal = SFILEGETFILESIZE_D1_ORDINAL;
+        sFileSetFilePointerOrdinal = SFILESETFILEPOINTER_D1_ORDINAL;
+        sFileOpenArchiveOrdinal = SFILEOPENARCHIVE_D1_ORDINAL;
+        sFileCloseArchiveOrdinal = SFILECLOSEARCHIVE_D1_ORDINAL;
+        sMemAllocOrdinal = SMEMALLOC_D1_ORDINAL;
+        sMemFreeOrdinal = SMEMFREE_D1_ORDINAL;
+        sMemReAllocOrdinal = SMEMREALLOC_D1_ORDINAL;
     }
     else // TargetGame::LATER
     {
@@ -360,30 +909,148 @@ BOOL WINAPI CMpqFileListerPlugin::InitializePlugin(IMPQDraftServer* lpMPQDraftSe
         sFileOpenFileExOrdinal = SFILEOPENFILEEX_ORDINAL;
         sFileGetFileArchiveOrdinal = SFILEGETFILEARCHIVE_ORDINAL;
         sFileGetArchiveNameOrdinal = SFILEGETARCHIVENAME_ORDINAL;
+        sFileReadFileOrdinal = SFILEREADFILE_ORDINAL;
+        sFileCloseFileOrdinal = SFILECLOSEFILE_ORDINAL;
+        sFileGetFileSizeOrdinal = SFILEGETFILESIZE_ORDINAL;
+        sFileSetFilePointerOrdinal = SFILESETFILEPOINTER_ORDINAL;
+        sFileOpenArchiveOrdinal = SFILEOPENARCHIVE_ORDINAL;
+        sFileCloseArchiveOrdinal = SFILECLOSEARCHIVE_ORDINAL;
+        sMemAllocOrdinal = SMEMALLOC_ORDINAL;
+        sMemFreeOrdinal = SMEMFREE_ORDINAL;
+        sMemReAllocOrdinal = SMEMREALLOC_ORDINAL;
     }
 
     // Get the original function pointers using ordinals
     // Use reinterpret_cast via void* to avoid -Wcast-function-type warning
     s_OriginalSFileOpenFile = reinterpret_cast<SFileOpenFilePtr>(
-        reinterpret_cast<void*>(GetProcAddress(m_hStorm, (LPCSTR)sFileOpenFileOrdinal)));
+        reinterpret_cast<void*>(GetStormFunction(m_hStorm, sFileOpenFileOrdinal)));
 
     s_OriginalSFileOpenFileEx = reinterpret_cast<SFileOpenFileExPtr>(
-        reinterpret_cast<void*>(GetProcAddress(m_hStorm, (LPCSTR)sFileOpenFileExOrdinal)));
+        reinterpret_cast<void*>(GetStormFunction(m_hStorm, sFileOpenFileExOrdinal)));
 
     if (!s_OriginalSFileOpenFile && !s_OriginalSFileOpenFileEx)
     {
-        if (s_logFile.is_open())
-        {
-            s_logFile << "ERROR: Neither SFileOpenFile nor SFileOpenFileEx found in Storm.dll\n";
-        }
+        LogError("ERROR: Neither SFileOpenFile nor SFileOpenFileEx found in Storm.dll");
         return TRUE;  // Return TRUE to not abort the patch
     }
 
     // Get SFileGetFileArchive and SFileGetArchiveName for logging which MPQ files come from (optional)
     s_SFileGetFileArchive = reinterpret_cast<SFileGetFileArchivePtr>(
-        reinterpret_cast<void*>(GetProcAddress(m_hStorm, (LPCSTR)sFileGetFileArchiveOrdinal)));
+        reinterpret_cast<void*>(GetStormFunction(m_hStorm, sFileGetFileArchiveOrdinal)));
     s_SFileGetArchiveName = reinterpret_cast<SFileGetArchiveNamePtr>(
-        reinterpret_cast<void*>(GetProcAddress(m_hStorm, (LPCSTR)sFileGetArchiveNameOrdinal)));
+        reinterpret_cast<void*>(GetStormFunction(m_hStorm, sFileGetArchiveNameOrdinal)));
+
+    // Archive mounts keep the handle to name table for the log, so they are always hooked
+    s_OriginalSFileOpenArchive = reinterpret_cast<SFileOpenArchivePtr>(
+        reinterpret_cast<void*>(GetStormFunction(m_hStorm, sFileOpenArchiveOrdinal)));
+    s_OriginalSFileCloseArchive = reinterpret_cast<SFileCloseArchivePtr>(
+        reinterpret_cast<void*>(GetStormFunction(m_hStorm, sFileCloseArchiveOrdinal)));
+
+    // A handle that is reused after an unseen close would get the old name
+    if (!s_OriginalSFileOpenArchive || !s_OriginalSFileCloseArchive)
+    {
+        s_OriginalSFileOpenArchive = nullptr;
+        s_OriginalSFileCloseArchive = nullptr;
+        if (g_writeArchiveMounts)
+            LogError((MissingFromStorm("SFileOpenArchive or SFileCloseArchive") + ", not recording archive mounts").c_str());
+    }
+
+    // SFileReadFile is only hooked when something needs the number of bytes read,
+    // serves reads from memory or traces them
+    if (g_liveStats || g_fileCacheBudgetKB > 0 || g_profileDecompression || g_logFormat == LogFormat::CHROME_TRACE)
+    {
+        s_OriginalSFileReadFile = reinterpret_cast<SFileReadFilePtr>(
+            reinterpret_cast<void*>(GetStormFunction(m_hStorm, sFileReadFileOrdinal)));
+        if (!s_OriginalSFileReadFile)
+            LogError((MissingFromStorm("SFileReadFile") + ", not counting, caching, profiling or tracing reads").c_str());
+    }
+
+    // The file cache has to see every read, seek and close of the files it serves
+    if (g_fileCacheBudgetKB > 0)
+    {
+        s_OriginalSFileCloseFile = reinterpret_cast<SFileCloseFilePtr>(
+            reinterpret_cast<void*>(GetStormFunction(m_hStorm, sFileCloseFileOrdinal)));
+        s_OriginalSFileSetFilePointer = reinterpret_cast<SFileSetFilePointerPtr>(
+            reinterpret_cast<void*>(GetStormFunction(m_hStorm, sFileSetFilePointerOrdinal)));
+        s_SFileGetFileSize = reinterpret_cast<SFileGetFileSizePtr>(
+            reinterpret_cast<void*>(GetStormFunction(m_hStorm, sFileGetFileSizeOrdinal)));
+
+        // Archive handles are reused, so the cache must also see archives being closed
+        if (s_OriginalSFileReadFile && s_OriginalSFileCloseFile && s_OriginalSFileSetFilePointer && s_SFileGetFileSize &&
+            s_OriginalSFileCloseArchive)
+        {
+            InitFileCache(static_cast<size_t>(g_fileCacheBudgetKB) * 1024,
+                          static_cast<size_t>(g_fileCacheMaxFileKB) * 1024);
+        }
+        else
+        {
+            LogError((MissingFromStorm("SFileReadFile, SFileCloseFile, SFileSetFilePointer, SFileGetFileSize or SFileCloseArchive") +
+                      ", not caching").c_str());
+            s_OriginalSFileCloseFile = nullptr;
+            s_OriginalSFileSetFilePointer = nullptr;
+            s_SFileGetFileSize = nullptr;
+        }
+    }
+
+    // Reads are charged to the file opened with their handle, until it is closed
+    if (g_profileDecompression && !s_OriginalSFileCloseFile)
+    {
+        s_OriginalSFileCloseFile = reinterpret_cast<SFileCloseFilePtr>(
+            reinterpret_cast<void*>(GetStormFunction(m_hStorm, sFileCloseFileOrdinal)));
+        if (!s_OriginalSFileCloseFile)
+            LogError((MissingFromStorm("SFileCloseFile") + ", not profiling reads").c_str());
+    }
+
+    // Read events are named after files opened with the handle, until it is closed
+    if (g_logFormat == LogFormat::CHROME_TRACE && s_OriginalSFileReadFile && !s_OriginalSFileCloseFile)
+    {
+        s_OriginalSFileCloseFile = reinterpret_cast<SFileCloseFilePtr>(
+            reinterpret_cast<void*>(GetStormFunction(m_hStorm, sFileCloseFileOrdinal)));
+        if (!s_OriginalSFileCloseFile)
+        {
+            LogError((MissingFromStorm("SFileCloseFile") + ", not tracing reads").c_str());
+            if (!g_liveStats && g_fileCacheBudgetKB == 0 && !g_profileDecompression)
+                s_OriginalSFileReadFile = nullptr;
+        }
+    }
+
+    // The allocation profiler needs all three, or frees cannot be matched to allocations
+    if (g_memProfile)
+    {
+        s_OriginalSMemAlloc = reinterpret_cast<SMemAllocPtr>(
+            reinterpret_cast<void*>(GetStormFunction(m_hStorm, sMemAllocOrdinal)));
+        s_OriginalSMemFree = reinterpret_cast<SMemFreePtr>(
+            reinterpret_cast<void*>(GetStormFunction(m_hStorm, sMemFreeOrdinal)));
+        s_OriginalSMemReAlloc = reinterpret_cast<SMemReAllocPtr>(
+            reinterpret_cast<void*>(GetStormFunction(m_hStorm, sMemReAllocOrdinal)));
+
+        if (!s_OriginalSMemAlloc || !s_OriginalSMemFree || !s_OriginalSMemReAlloc)
+        {
+            LogError((MissingFromStorm("SMemAlloc, SMemFree or SMemReAlloc") + ", not profiling allocations").c_str());
+            s_OriginalSMemAlloc = nullptr;
+            s_OriginalSMemFree = nullptr;
+            s_OriginalSMemReAlloc = nullptr;
+        }
+    }
+
+    // Start reading ahead of the game before any of its opens reach the hooks
+    if (!g_prefetchManifest.empty())
+    {
+        PrefetchFunctions functions = {};
+        functions.openFile = s_OriginalSFileOpenFile;
+        functions.openFileEx = s_OriginalSFileOpenFileEx;
+        functions.readFile = reinterpret_cast<SFileReadFilePtr>(
+            reinterpret_cast<void*>(GetStormFunction(m_hStorm, sFileReadFileOrdinal)));
+        functions.closeFile = reinterpret_cast<SFileCloseFilePtr>(
+            reinterpret_cast<void*>(GetStormFunction(m_hStorm, sFileCloseFileOrdinal)));
+
+        if (manifestNames == 0)
+            LogError("ERROR: Prefetch manifest not found or empty");
+        else if (!functions.closeFile)
+            LogError((MissingFromStorm("SFileCloseFile") + ", not prefetching").c_str());
+        else
+            StartPrefetcher(functions, g_prefetchWindow);
+    }
 
     // Patch the import table to redirect calls to our hooks
     // Use reinterpret_cast via void* to avoid -Wcast-function-type warning
@@ -411,6 +1078,101 @@ BOOL WINAPI CMpqFileListerPlugin::InitializePlugin(IMPQDraftServer* lpMPQDraftSe
         );
     }
 
+    if (s_OriginalSFileOpenArchive)
+    {
+        PatchImportEntry(
+            hHostProcess,
+            "Storm.dll",
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(s_OriginalSFileOpenArchive)),
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(HookedSFileOpenArchive)),
+            TRUE  // Recursive - patch all loaded modules
+        );
+        PatchImportEntry(
+            hHostProcess,
+            "Storm.dll",
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(s_OriginalSFileCloseArchive)),
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(HookedSFileCloseArchive)),
+            TRUE  // Recursive - patch all loaded modules
+        );
+    }
+
+    if (s_OriginalSFileReadFile)
+    {
+        PatchImportEntry(
+            hHostProcess,
+            "Storm.dll",
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(s_OriginalSFileReadFile)),
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(HookedSFileReadFile)),
+            TRUE  // Recursive - patch all loaded modules
+        );
+    }
+
+    if (s_OriginalSFileCloseFile)
+    {
+        PatchImportEntry(
+            hHostProcess,
+            "Storm.dll",
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(s_OriginalSFileCloseFile)),
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(HookedSFileCloseFile)),
+            TRUE  // Recursive - patch all loaded modules
+        );
+    }
+
+    if (s_OriginalSFileSetFilePointer)
+    {
+        PatchImportEntry(
+            hHostProcess,
+            "Storm.dll",
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(s_OriginalSFileSetFilePointer)),
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(HookedSFileSetFilePointer)),
+            TRUE  // Recursive - patch all loaded modules
+        );
+    }
+
+    if (s_OriginalSMemAlloc)
+    {
+        PatchImportEntry(
+            hHostProcess,
+            "Storm.dll",
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(s_OriginalSMemAlloc)),
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(HookedSMemAlloc)),
+            TRUE  // Recursive - patch all loaded modules
+        );
+        PatchImportEntry(
+            hHostProcess,
+            "Storm.dll",
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(s_OriginalSMemFree)),
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(HookedSMemFree)),
+            TRUE  // Recursive - patch all loaded modules
+        );
+        PatchImportEntry(
+            hHostProcess,
+            "Storm.dll",
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(s_OriginalSMemReAlloc)),
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(HookedSMemReAlloc)),
+            TRUE  // Recursive - patch all loaded modules
+        );
+    }
+
+    // Finish the log while the game's threads still run, rather than when the
+    // plugin is unloaded after Windows has ended them
+    s_OriginalExitProcess = reinterpret_cast<ExitProcessPtr>(
+        reinterpret_cast<void*>(GetProcAddress(GetModuleHandleA("kernel32.dll"), "ExitProcess")));
+    if (s_OriginalExitProcess)
+    {
+        PatchImportEntry(
+            hHostProcess,
+            "kernel32.dll",
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(s_OriginalExitProcess)),
+            reinterpret_cast<FARPROC>(reinterpret_cast<void*>(HookedExitProcess)),
+            TRUE  // Recursive - patch all loaded modules
+        );
+    }
+
+    // Publish live statistics for external monitors
+    if (g_liveStats)
+        StartLiveStatsPublisher(g_liveStatsIntervalMs);
+
     m_bInitialized = true;
     return TRUE;
 }
@@ -420,8 +1182,113 @@ BOOL WINAPI CMpqFileListerPlugin::TerminatePlugin()
     if (!m_bInitialized)
         return TRUE;
 
-    // Clear the seen files set
+    StopLiveStatsPublisher();
+    StopPrefetcher();
+
+    // Write out the queued accesses and close the sinks
+    StopRecordPipeline();
+
+    // End the log with its trailer, which tells the tools it is complete,
+    // then write out and close it; lines logged after this are dropped
+    std::string trailer;
+    {
+        std::lock_guard<std::mutex> lock(s_logMutex);
+        trailer = std::string(LOG_TRAILER_PREFIX) + std::to_string(s_loggedAccesses) + " file accesses logged";
+    }
+    LogError(trailer.c_str());
+    RemoveCrashDrain();
+    {
+        std::lock_guard<std::mutex> lock(s_logMutex);
+        StopLogCompressor();
+        s_logCompressed = false;
+        CloseLogBuffer();
+        s_logFile.close();
+    }
+
+    // Write the aggregated per-thread statistics
+    if (g_writeThreadStats && !s_logFilePath.empty())
+    {
+        std::ofstream statsFile(GetReportPath(".threads.txt"), std::ios::out | std::ios::trunc);
+        if (statsFile.is_open())
+            WriteThreadStatsReport(statsFile);
+    }
+
+    // Write the failed lookups, most expensive first
+    if (g_logMisses && !s_logFilePath.empty())
+    {
+        std::ofstream missFile(GetReportPath(".misses.txt"), std::ios::out | std::ios::trunc);
+        if (missFile.is_open())
+            WriteMissReport(missFile);
+    }
+
+    // Write the load phases
+    if (g_phaseIdleGapMs > 0 && !s_logFilePath.empty())
+    {
+        std::ofstream phaseFile(GetReportPath(".phases.txt"), std::ios::out | std::ios::trunc);
+        if (phaseFile.is_open())
+            WritePhaseReport(phaseFile);
+    }
+
+    // Write the opens aggregated by directory
+    if (g_writeDirectoryTree && !s_logFilePath.empty())
+    {
+        std::ofstream treeFile(GetReportPath(".tree.txt"), std::ios::out | std::ios::trunc);
+        if (treeFile.is_open())
+            WriteDirectoryTreeReport(treeFile);
+    }
+
+    // Write the archive mounts in order
+    if (g_writeArchiveMounts && s_OriginalSFileOpenArchive && !s_logFilePath.empty())
+    {
+        std::ofstream archiveFile(GetReportPath(".archives.txt"), std::ios::out | std::ios::trunc);
+        if (archiveFile.is_open())
+            WriteArchiveReport(archiveFile, s_sessionStartTicks);
+    }
+
+    // Write the read and decompression costs per method and file
+    if (g_profileDecompression && !s_logFilePath.empty())
+    {
+        std::ofstream decompressFile(GetReportPath(".decompress.txt"), std::ios::out | std::ios::trunc);
+        if (decompressFile.is_open())
+            WriteDecompressReport(decompressFile);
+    }
+
+    // Write the Storm allocations per call site
+    if (s_OriginalSMemAlloc && !s_logFilePath.empty())
+    {
+        std::ofstream memoryFile(GetReportPath(".memory.txt"), std::ios::out | std::ios::trunc);
+        if (memoryFile.is_open())
+            WriteMemoryReport(memoryFile);
+    }
+
+    // Write the file cache's hit rate
+    if (g_fileCacheBudgetKB > 0 && s_SFileGetFileSize && !s_logFilePath.empty())
+    {
+        std::ofstream cacheFile(GetReportPath(".cache.txt"), std::ios::out | std::ios::trunc);
+        if (cacheFile.is_open())
+            WriteFileCacheReport(cacheFile);
+    }
+
+    // Write what the prefetcher read and how long the game's opens took
+    if (!g_prefetchManifest.empty() && !s_logFilePath.empty())
+    {
+        std::ofstream prefetchFile(GetReportPath(".prefetch.txt"), std::ios::out | std::ios::trunc);
+        if (prefetchFile.is_open())
+            WritePrefetchReport(prefetchFile);
+    }
+
+    // Clear the seen files set and the recorded misses
     s_seenFiles.clear();
+    s_traceFileNames.clear();
+    ClearMisses();
+
+    // Write the plugin heap's footprint, with what the plugin still holds
+    if (g_writeHeapStats && !s_logFilePath.empty())
+    {
+        std::ofstream heapFile(GetReportPath(".heap.txt"), std::ios::out | std::ios::trunc);
+        if (heapFile.is_open())
+            WritePluginHeapReport(heapFile);
+    }
 
     m_bInitialized = false;
     return TRUE;
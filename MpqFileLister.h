@@ -39,9 +39,97 @@ typedef BOOL (WINAPI *SFileOpenFileExPtr)(
     HANDLE* phFile
 );
 
+// SFileReadFile (ordinal 0x10D)
+typedef BOOL (WINAPI *SFileReadFilePtr)(
+    HANDLE hFile,
+    void* lpBuffer,
+    DWORD nNumberOfBytesToRead,
+    DWORD* lpNumberOfBytesRead,
+    LPVOID lpOverlapped
+);
+
+// SFileCloseFile (ordinal 0xFD)
+typedef BOOL (WINAPI *SFileCloseFilePtr)(
+    HANDLE hFile
+);
+
+// SFileGetFileSize (ordinal 0x109)
+typedef DWORD (WINAPI *SFileGetFileSizePtr)(
+    HANDLE hFile,
+    DWORD* lpFileSizeHigh
+);
+
+// SFileSetFilePointer (ordinal 0x10F)
+typedef DWORD (WINAPI *SFileSetFilePointerPtr)(
+    HANDLE hFile,
+    LONG lDistanceToMove,
+    LONG* lplDistanceToMoveHigh,
+    DWORD dwMoveMethod
+);
+
+// SFileOpenArchive (ordinal 0x10A)
+typedef BOOL (WINAPI *SFileOpenArchivePtr)(
+    const char* szMpqName,
+    DWORD dwPriority,
+    DWORD dwFlags,
+    HANDLE* phMpq
+);
+
+// SFileCloseArchive (ordinal 0xFC)
+typedef BOOL (WINAPI *SFileCloseArchivePtr)(
+    HANDLE hMpq
+);
+
+// SMemAlloc (ordinal 0x191)
+typedef void* (WINAPI *SMemAllocPtr)(
+    DWORD dwAmount,
+    const char* szSourceFile,
+    int nSourceLine,
+    DWORD dwFlags
+);
+
+// SMemFree (ordinal 0x193)
+typedef BOOL (WINAPI *SMemFreePtr)(
+    void* lpLocation,
+    const char* szSourceFile,
+    int nSourceLine,
+    DWORD dwFlags
+);
+
+// SMemReAlloc (ordinal 0x195)
+typedef void* (WINAPI *SMemReAllocPtr)(
+    void* lpLocation,
+    DWORD dwAmount,
+    const char* szSourceFile,
+    int nSourceLine,
+    DWORD dwFlags
+);
+
+// ExitProcess (kernel32.dll)
+typedef void (WINAPI *ExitProcessPtr)(
+    UINT uExitCode
+);
+
+// A single file access, passed from the hook functions to the logger
+struct FileAccess
+{
+    const char* fileName;   // Name the game passed to Storm
+    HANDLE fileHandle;      // Handle returned by Storm
+    const char* function;   // Name of the hooked Storm function
+    DWORD threadId;         // Thread that made the call
+    uint64_t startTicks;    // When the Storm call started (see GetTicks)
+    uint64_t stormTicks;    // Time spent inside the original Storm function
+};
+
+// A file access as copied for the log and the sinks (see RecordQueue.h)
+struct AccessRecord;
+
 // The plugin class
 class CMpqFileListerPlugin
 {
+    // Writes the log from the record pipeline's thread
+    friend class CPrimaryLogSink;
+
 private:
     HMODULE m_hThisModule;
     HMODULE m_hStorm;
@@ -50,14 +138,45 @@ private:
     // Original function pointers (static for use in static hook functions)
     static SFileOpenFilePtr s_OriginalSFileOpenFile;
     static SFileOpenFileExPtr s_OriginalSFileOpenFileEx;
+    static SFileReadFilePtr s_OriginalSFileReadFile;
+    static SFileCloseFilePtr s_OriginalSFileCloseFile;
+    static SFileSetFilePointerPtr s_OriginalSFileSetFilePointer;
+    static SFileOpenArchivePtr s_OriginalSFileOpenArchive;
+    static SFileCloseArchivePtr s_OriginalSFileCloseArchive;
+    static SMemAllocPtr s_OriginalSMemAlloc;
+    static SMemFreePtr s_OriginalSMemFree;
+    static SMemReAllocPtr s_OriginalSMemReAlloc;
+    static ExitProcessPtr s_OriginalExitProcess;
 
     // Logging (using standard C++)
     static std::ofstream s_logFile;
     static std::mutex s_logMutex;
     static std::string s_logFilePath;
+    static uint64_t s_sessionStartTicks;
 
     // Helper function for logging file access
-    static void LogFileAccess(const char* fileName, HANDLE fileHandle);
+    static void LogFileAccess(const FileAccess& access);
+
+    // Helper function for writing a captured file access to the log
+    static void WriteAccessRecord(const AccessRecord& record);
+
+    // Helper function for writing a read to the trace
+    static void LogFileRead(HANDLE fileHandle, uint64_t startTicks, uint64_t stormTicks);
+
+    // Helper function for writing a line of a text log, compressed and rotated as configured
+    static void WriteLogLine(const std::string& line);
+
+    // Helper function for checking whether there is a log to write to
+    static bool IsLogOpen();
+
+    // Helper function for logging errors in a way that suits the log format
+    static void LogError(const char* message);
+
+    // Helper function for building the path of a report written next to the log file
+    static std::string GetReportPath(const char* suffix);
+
+    // Helper function for telling the file cache about a file the game opened
+    static void TrackCachedOpen(const char* fileName, HANDLE fileHandle);
 
     // Our hook functions
     static BOOL WINAPI HookedSFileOpenFile(
@@ -72,6 +191,62 @@ private:
         HANDLE* phFile
     );
 
+    static BOOL WINAPI HookedSFileReadFile(
+        HANDLE hFile,
+        void* lpBuffer,
+        DWORD nNumberOfBytesToRead,
+        DWORD* lpNumberOfBytesRead,
+        LPVOID lpOverlapped
+    );
+
+    static BOOL WINAPI HookedSFileCloseFile(
+        HANDLE hFile
+    );
+
+    static DWORD WINAPI HookedSFileSetFilePointer(
+        HANDLE hFile,
+        LONG lDistanceToMove,
+        LONG* lplDistanceToMoveHigh,
+        DWORD dwMoveMethod
+    );
+
+    static BOOL WINAPI HookedSFileOpenArchive(
+        const char* szMpqName,
+        DWORD dwPriority,
+        DWORD dwFlags,
+        HANDLE* phMpq
+    );
+
+    static BOOL WINAPI HookedSFileCloseArchive(
+        HANDLE hMpq
+    );
+
+    static void* WINAPI HookedSMemAlloc(
+        DWORD dwAmount,
+        const char* szSourceFile,
+        int nSourceLine,
+        DWORD dwFlags
+    );
+
+    static BOOL WINAPI HookedSMemFree(
+        void* lpLocation,
+        const char* szSourceFile,
+        int nSourceLine,
+        DWORD dwFlags
+    );
+
+    static void* WINAPI HookedSMemReAlloc(
+        void* lpLocation,
+        DWORD dwAmount,
+        const char* szSourceFile,
+        int nSourceLine,
+        DWORD dwFlags
+    );
+
+    static void WINAPI HookedExitProcess(
+        UINT uExitCode
+    );
+
 public:
     CMpqFileListerPlugin();
     ~CMpqFileListerPlugin();
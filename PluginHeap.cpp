@@ -0,0 +1,535 @@
+/*
+    PluginHeap.cpp - Private heap for MpqFileLister plugin allocations
+
+    All state is constant-initialized and address space is only reserved on
+    the first allocation, since operator new is called by constructors of
+    other translation units before this one could run any of its own.
+*/
+
+#include "PluginHeap.h"
+#include "CrashDrain.h"
+#include <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+
+// Address space reserved at a time for spans and runs
+static constexpr size_t HEAP_REGION_BYTES = 4 * 1024 * 1024;
+
+// Committed at a time, all for blocks of one size class
+static constexpr size_t HEAP_SPAN_BYTES = 64 * 1024;
+
+// Granularity of VirtualAlloc reservations and commits
+static constexpr size_t HEAP_RESERVE_GRANULARITY = 64 * 1024;
+static constexpr size_t HEAP_PAGE_BYTES = 4096;
+
+// Block sizes, header included. Classes are at most a third apart, so less
+// than a quarter of a block is wasted to rounding. Those above 32 KB are
+// whole pages, each block a run committed on its own.
+static constexpr size_t HEAP_CLASS_SIZES[] =
+{
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048,
+    3072, 4096, 6144, 8192, 12288, 16384, 24576, 32768,
+    40960, 49152, 57344, 65536, 81920, 98304, 114688, 131072,
+    163840, 196608, 229376, 262144, 327680, 393216, 458752, 524288,
+    655360, 786432, 917504, 1048576
+};
+static constexpr size_t HEAP_CLASS_COUNT = sizeof(HEAP_CLASS_SIZES) / sizeof(HEAP_CLASS_SIZES[0]);
+static constexpr size_t HEAP_LARGEST_CLASS = HEAP_CLASS_SIZES[HEAP_CLASS_COUNT - 1];
+
+// Largest class carved out of spans
+static constexpr size_t HEAP_LARGEST_SPAN_CLASS = 32768;
+
+// Header in front of every block, keeping the data aligned to twice the size of a pointer
+static constexpr size_t HEAP_HEADER_BYTES = 2 * sizeof(void*);
+static constexpr uint16_t HEAP_BLOCK_MAGIC = 0x4850;
+
+// Where a block came from, besides a size class
+static constexpr uint16_t HEAP_KIND_ALIGNED = 0xfffd;
+static constexpr uint16_t HEAP_KIND_LARGE = 0xfffe;
+static constexpr uint16_t HEAP_KIND_CRT = 0xffff;
+
+struct HeapBlockHeader
+{
+    size_t size;            // Bytes requested; for HEAP_KIND_ALIGNED, the distance back to the block holding it
+    uint16_t magic;
+    uint16_t kind;          // Size class, HEAP_KIND_ALIGNED, HEAP_KIND_LARGE or HEAP_KIND_CRT
+};
+static_assert(sizeof(HeapBlockHeader) <= HEAP_HEADER_BYTES, "block header does not fit");
+static_assert(HEAP_LARGEST_CLASS <= HEAP_REGION_BYTES / 4, "runs must leave room in a region");
+
+struct HeapFreeBlock
+{
+    HeapFreeBlock* next;
+};
+
+struct HeapSizeClass
+{
+    DrainLock lock;
+    HeapFreeBlock* freeList = nullptr;
+    char* bump = nullptr;       // Part of the class's newest span never handed out
+    char* bumpEnd = nullptr;
+
+    // Only changed under the lock
+    uint64_t blocksInUse = 0;
+    uint64_t peakBlocks = 0;
+    uint64_t spans = 0;         // Or runs, for classes above HEAP_LARGEST_SPAN_CLASS
+    uint64_t allocations = 0;
+};
+
+static HeapSizeClass s_classes[HEAP_CLASS_COUNT];
+
+// Unused part of the newest region, and the largest unused end of an older
+// one, left when a run did not fit in it
+static DrainLock s_regionLock;
+static char* s_regionNext = nullptr;
+static char* s_regionEnd = nullptr;
+static char* s_spareNext = nullptr;
+static char* s_spareEnd = nullptr;
+static uint64_t s_regions = 0;
+
+static std::atomic<bool> s_heapEnabled{true};
+static std::atomic<uint64_t> s_reservedBytes{0};
+static std::atomic<uint64_t> s_committedBytes{0};
+static std::atomic<uint64_t> s_peakCommittedBytes{0};
+static std::atomic<uint64_t> s_usedBytes{0};
+static std::atomic<uint64_t> s_peakUsedBytes{0};
+static std::atomic<uint64_t> s_allocations{0};
+static std::atomic<uint64_t> s_blocksInUse{0};
+static std::atomic<uint64_t> s_largeBlocksInUse{0};
+static std::atomic<uint64_t> s_largeAllocations{0};
+static std::atomic<uint64_t> s_crtAllocations{0};
+
+static void RaisePeak(std::atomic<uint64_t>& peak, uint64_t value)
+{
+    uint64_t current = peak.load(std::memory_order_relaxed);
+    while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+static void AddCommitted(size_t bytes)
+{
+    RaisePeak(s_peakCommittedBytes, s_committedBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+}
+
+static size_t RoundUp(size_t size, size_t granularity)
+{
+    return (size + granularity - 1) / granularity * granularity;
+}
+
+static size_t FindSizeClass(size_t total)
+{
+    return std::lower_bound(HEAP_CLASS_SIZES, HEAP_CLASS_SIZES + HEAP_CLASS_COUNT, total) - HEAP_CLASS_SIZES;
+}
+
+// Commit bytes, a whole number of pages, for a span or a run, reserving a
+// region when neither the newest one nor the spare end has room. Returns
+// null when no address space is left.
+static char* CommitRun(size_t bytes)
+{
+    s_regionLock.Lock();
+    char** next = &s_spareNext;
+    if (static_cast<size_t>(s_spareEnd - s_spareNext) < bytes)
+    {
+        next = &s_regionNext;
+        if (static_cast<size_t>(s_regionEnd - s_regionNext) < bytes)
+        {
+            char* region = static_cast<char*>(VirtualAlloc(nullptr, HEAP_REGION_BYTES, MEM_RESERVE, PAGE_NOACCESS));
+            if (!region)
+            {
+                s_regionLock.Unlock();
+                return nullptr;
+            }
+            if (s_regionEnd - s_regionNext > s_spareEnd - s_spareNext)
+            {
+                s_spareNext = s_regionNext;
+                s_spareEnd = s_regionEnd;
+            }
+            s_regionNext = region;
+            s_regionEnd = region + HEAP_REGION_BYTES;
+            s_regions++;
+            s_reservedBytes.fetch_add(HEAP_REGION_BYTES, std::memory_order_relaxed);
+        }
+    }
+
+    char* run = static_cast<char*>(VirtualAlloc(*next, bytes, MEM_COMMIT, PAGE_READWRITE));
+    if (run)
+    {
+        *next += bytes;
+        AddCommitted(bytes);
+    }
+    s_regionLock.Unlock();
+    return run;
+}
+
+// Take a block of a size class. Returns null when no span or run can be committed.
+static char* AllocFromClass(size_t classIndex)
+{
+    HeapSizeClass& sizeClass = s_classes[classIndex];
+    size_t blockSize = HEAP_CLASS_SIZES[classIndex];
+    char* block = nullptr;
+
+    sizeClass.lock.Lock();
+    if (sizeClass.freeList)
+    {
+        block = reinterpret_cast<char*>(sizeClass.freeList);
+        sizeClass.freeList = sizeClass.freeList->next;
+
+        // A free run keeps only its first page committed
+        if (blockSize > HEAP_LARGEST_SPAN_CLASS)
+        {
+            if (VirtualAlloc(block + HEAP_PAGE_BYTES, blockSize - HEAP_PAGE_BYTES, MEM_COMMIT, PAGE_READWRITE))
+            {
+                AddCommitted(blockSize - HEAP_PAGE_BYTES);
+            }
+            else
+            {
+                sizeClass.freeList = reinterpret_cast<HeapFreeBlock*>(block);
+                block = nullptr;
+            }
+        }
+    }
+    else if (blockSize > HEAP_LARGEST_SPAN_CLASS)
+    {
+        block = CommitRun(blockSize);
+        if (block)
+            sizeClass.spans++;
+    }
+    else
+    {
+        // Spans are not always a multiple of the class size; the end of one may be left over
+        if (static_cast<size_t>(sizeClass.bumpEnd - sizeClass.bump) < blockSize)
+        {
+            char* span = CommitRun(HEAP_SPAN_BYTES);
+            if (span)
+            {
+                sizeClass.bump = span;
+                sizeClass.bumpEnd = span + HEAP_SPAN_BYTES;
+                sizeClass.spans++;
+            }
+        }
+        if (static_cast<size_t>(sizeClass.bumpEnd - sizeClass.bump) >= blockSize)
+        {
+            block = sizeClass.bump;
+            sizeClass.bump += blockSize;
+        }
+    }
+    if (block)
+    {
+        sizeClass.allocations++;
+        sizeClass.peakBlocks = std::max(sizeClass.peakBlocks, ++sizeClass.blocksInUse);
+    }
+    sizeClass.lock.Unlock();
+    return block;
+}
+
+static void FreeToClass(size_t classIndex, char* block)
+{
+    HeapSizeClass& sizeClass = s_classes[classIndex];
+    HeapFreeBlock* freeBlock = reinterpret_cast<HeapFreeBlock*>(block);
+    size_t blockSize = HEAP_CLASS_SIZES[classIndex];
+
+    // Give back all of a run but the page holding the free list link
+    if (blockSize > HEAP_LARGEST_SPAN_CLASS &&
+        VirtualFree(block + HEAP_PAGE_BYTES, blockSize - HEAP_PAGE_BYTES, MEM_DECOMMIT))
+    {
+        s_committedBytes.fetch_sub(blockSize - HEAP_PAGE_BYTES, std::memory_order_relaxed);
+    }
+
+    sizeClass.lock.Lock();
+    freeBlock->next = sizeClass.freeList;
+    sizeClass.freeList = freeBlock;
+    sizeClass.blocksInUse--;
+    sizeClass.lock.Unlock();
+}
+
+void* PluginHeapAlloc(size_t size)
+{
+    if (size > SIZE_MAX - HEAP_RESERVE_GRANULARITY)
+        return nullptr;
+    size_t total = size + HEAP_HEADER_BYTES;
+
+    char* block = nullptr;
+    uint16_t kind = HEAP_KIND_CRT;
+    if (s_heapEnabled.load(std::memory_order_relaxed))
+    {
+        if (total <= HEAP_LARGEST_CLASS)
+        {
+            size_t classIndex = FindSizeClass(total);
+            block = AllocFromClass(classIndex);
+            kind = static_cast<uint16_t>(classIndex);
+        }
+        else
+        {
+            block = static_cast<char*>(VirtualAlloc(nullptr, total, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+            kind = HEAP_KIND_LARGE;
+            if (block)
+            {
+                s_reservedBytes.fetch_add(RoundUp(total, HEAP_RESERVE_GRANULARITY), std::memory_order_relaxed);
+                AddCommitted(RoundUp(total, HEAP_PAGE_BYTES));
+                s_largeAllocations.fetch_add(1, std::memory_order_relaxed);
+                s_largeBlocksInUse.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Disabled, or out of address space: leave it to the CRT heap
+    if (!block)
+    {
+        block = static_cast<char*>(malloc(total));
+        if (!block)
+            return nullptr;
+        kind = HEAP_KIND_CRT;
+        s_crtAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    HeapBlockHeader* header = reinterpret_cast<HeapBlockHeader*>(block);
+    header->size = size;
+    header->magic = HEAP_BLOCK_MAGIC;
+    header->kind = kind;
+
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    s_blocksInUse.fetch_add(1, std::memory_order_relaxed);
+    RaisePeak(s_peakUsedBytes, s_usedBytes.fetch_add(size, std::memory_order_relaxed) + size);
+    return block + HEAP_HEADER_BYTES;
+}
+
+void* PluginHeapAllocAligned(size_t size, size_t alignment)
+{
+    if (alignment <= HEAP_HEADER_BYTES)
+        return PluginHeapAlloc(size);
+    if (size > SIZE_MAX - HEAP_RESERVE_GRANULARITY - alignment)
+        return nullptr;
+
+    // Room for the alignment and a second header in front of the aligned data,
+    // pointing back at the block holding it
+    char* outer = static_cast<char*>(PluginHeapAlloc(size + HEAP_HEADER_BYTES + alignment - 1));
+    if (!outer)
+        return nullptr;
+    uintptr_t address = reinterpret_cast<uintptr_t>(outer) + HEAP_HEADER_BYTES;
+    char* pointer = reinterpret_cast<char*>((address + alignment - 1) & ~(uintptr_t(alignment) - 1));
+
+    HeapBlockHeader* header = reinterpret_cast<HeapBlockHeader*>(pointer - HEAP_HEADER_BYTES);
+    header->size = pointer - outer;
+    header->magic = HEAP_BLOCK_MAGIC;
+    header->kind = HEAP_KIND_ALIGNED;
+    return pointer;
+}
+
+void PluginHeapFree(void* pointer)
+{
+    if (!pointer)
+        return;
+
+    char* block = static_cast<char*>(pointer) - HEAP_HEADER_BYTES;
+    HeapBlockHeader* header = reinterpret_cast<HeapBlockHeader*>(block);
+
+    // Not allocated here; with a shared CRT, a library may hand over a block
+    // it got from malloc
+    if (header->magic != HEAP_BLOCK_MAGIC)
+    {
+        free(pointer);
+        return;
+    }
+
+    size_t size = header->size;
+    uint16_t kind = header->kind;
+    header->magic = 0;
+    if (kind == HEAP_KIND_ALIGNED)
+    {
+        PluginHeapFree(static_cast<char*>(pointer) - size);
+        return;
+    }
+    s_usedBytes.fetch_sub(size, std::memory_order_relaxed);
+    s_blocksInUse.fetch_sub(1, std::memory_order_relaxed);
+
+    if (kind == HEAP_KIND_CRT)
+    {
+        free(block);
+    }
+    else if (kind == HEAP_KIND_LARGE)
+    {
+        size_t total = size + HEAP_HEADER_BYTES;
+        VirtualFree(block, 0, MEM_RELEASE);
+        s_reservedBytes.fetch_sub(RoundUp(total, HEAP_RESERVE_GRANULARITY), std::memory_order_relaxed);
+        s_committedBytes.fetch_sub(RoundUp(total, HEAP_PAGE_BYTES), std::memory_order_relaxed);
+        s_largeBlocksInUse.fetch_sub(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        FreeToClass(kind, block);
+    }
+}
+
+void SetPluginHeapEnabled(bool enabled)
+{
+    s_heapEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+PluginHeapStats GetPluginHeapStats()
+{
+    PluginHeapStats stats;
+    stats.reservedBytes = s_reservedBytes.load(std::memory_order_relaxed);
+    stats.committedBytes = s_committedBytes.load(std::memory_order_relaxed);
+    stats.peakCommittedBytes = s_peakCommittedBytes.load(std::memory_order_relaxed);
+    stats.usedBytes = s_usedBytes.load(std::memory_order_relaxed);
+    stats.peakUsedBytes = s_peakUsedBytes.load(std::memory_order_relaxed);
+    stats.allocations = s_allocations.load(std::memory_order_relaxed);
+    stats.blocksInUse = s_blocksInUse.load(std::memory_order_relaxed);
+    stats.crtAllocations = s_crtAllocations.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void WritePluginHeapReport(std::ostream& out)
+{
+    // Taken before writing, since the stream allocates too
+    PluginHeapStats stats = GetPluginHeapStats();
+    HeapSizeClass classes[HEAP_CLASS_COUNT];
+    for (size_t i = 0; i < HEAP_CLASS_COUNT; i++)
+    {
+        s_classes[i].lock.Lock();
+        classes[i].blocksInUse = s_classes[i].blocksInUse;
+        classes[i].peakBlocks = s_classes[i].peakBlocks;
+        classes[i].spans = s_classes[i].spans;
+        classes[i].allocations = s_classes[i].allocations;
+        s_classes[i].lock.Unlock();
+    }
+    s_regionLock.Lock();
+    uint64_t regions = s_regions;
+    s_regionLock.Unlock();
+    uint64_t largeBlocks = s_largeBlocksInUse.load(std::memory_order_relaxed);
+    uint64_t largeAllocations = s_largeAllocations.load(std::memory_order_relaxed);
+
+    out << "Reserved: " << stats.reservedBytes / 1024 << " KB (" << regions << " regions of "
+        << HEAP_REGION_BYTES / (1024 * 1024) << " MB and " << largeBlocks << " large blocks)\n";
+    out << "Committed: " << stats.committedBytes / 1024 << " KB, peak " << stats.peakCommittedBytes / 1024
+        << " KB\n";
+    out << "In use: " << stats.usedBytes / 1024 << " KB in " << stats.blocksInUse << " blocks, peak "
+        << stats.peakUsedBytes / 1024 << " KB\n";
+    out << "Allocations: " << stats.allocations << ", larger than " << HEAP_LARGEST_CLASS / 1024 << " KB: "
+        << largeAllocations << ", from the CRT heap: " << stats.crtAllocations << "\n";
+    if (!s_heapEnabled.load(std::memory_order_relaxed))
+        out << "The private heap was disabled (PluginHeap=0)\n";
+
+    out << "\n" << std::left << std::setw(10) << "Class" << std::right << std::setw(14) << "Blocks in use"
+        << std::setw(13) << "Peak blocks" << std::setw(12) << "Spans/runs" << std::setw(14) << "Allocations" << "\n";
+    for (size_t i = 0; i < HEAP_CLASS_COUNT; i++)
+    {
+        if (classes[i].allocations == 0)
+            continue;
+        out << std::left << std::setw(10) << HEAP_CLASS_SIZES[i] << std::right << std::setw(14)
+            << classes[i].blocksInUse << std::setw(13) << classes[i].peakBlocks << std::setw(12)
+            << classes[i].spans << std::setw(14) << classes[i].allocations << "\n";
+    }
+}
+
+// The plugin's operator new and delete, the aligned forms included
+
+void* operator new(size_t size)
+{
+    void* block = PluginHeapAlloc(size ? size : 1);
+    if (!block)
+        throw std::bad_alloc();
+    return block;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return PluginHeapAlloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return PluginHeapAlloc(size ? size : 1);
+}
+
+void operator delete(void* block) noexcept
+{
+    PluginHeapFree(block);
+}
+
+void operator delete[](void* block) noexcept
+{
+    PluginHeapFree(block);
+}
+
+void operator delete(void* block, size_t) noexcept
+{
+    PluginHeapFree(block);
+}
+
+void operator delete[](void* block, size_t) noexcept
+{
+    PluginHeapFree(block);
+}
+
+void operator delete(void* block, const std::nothrow_t&) noexcept
+{
+    PluginHeapFree(block);
+}
+
+void operator delete[](void* block, const std::nothrow_t&) noexcept
+{
+    PluginHeapFree(block);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    void* block = PluginHeapAllocAligned(size ? size : 1, static_cast<size_t>(alignment));
+    if (!block)
+        throw std::bad_alloc();
+    return block;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return PluginHeapAllocAligned(size ? size : 1, static_cast<size_t>(alignment));
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return PluginHeapAllocAligned(size ? size : 1, static_cast<size_t>(alignment));
+}
+
+void operator delete(void* block, std::align_val_t) noexcept
+{
+    PluginHeapFree(block);
+}
+
+void operator delete[](void* block, std::align_val_t) noexcept
+{
+    PluginHeapFree(block);
+}
+
+void operator delete(void* block, size_t, std::align_val_t) noexcept
+{
+    PluginHeapFree(block);
+}
+
+void operator delete[](void* block, size_t, std::align_val_t) noexcept
+{
+    PluginHeapFree(block);
+}
+
+void operator delete(void* block, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    PluginHeapFree(block);
+}
+
+void operator delete[](void* block, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    PluginHeapFree(block);
+}
@@ -0,0 +1,60 @@
+/*
+    PluginHeap.h - Private heap for MpqFileLister plugin allocations
+
+    The plugin replaces the global operator new and delete, so everything it
+    allocates with them (the seen files set, strings built for log lines,
+    paths, report tables) comes from address space it reserves with
+    VirtualAlloc instead of the game's CRT heap. Blocks are rounded up to a
+    size class. Those up to 32 KB are carved out of 64 KB spans, each serving
+    one class; those up to 1 MB are runs of whole pages. Both are committed
+    out of 4 MB reservations. Freed blocks go on their class's free list and
+    are handed out again; spans are never returned, while a free run keeps
+    only its first page committed. Blocks larger than 1 MB get a VirtualAlloc
+    of their own, released when they are freed. Over-aligned types get a
+    larger block with the data placed at the alignment inside it.
+
+    Every block starts with a small header naming where it came from, so a
+    block allocated before PluginHeap=0 was read, or from the CRT heap when
+    no address space was left, is freed to the right place. Allocations the
+    CRT makes for itself (e.g. stream buffers) still come from its heap.
+*/
+
+#ifndef PLUGINHEAP_H
+#define PLUGINHEAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+struct PluginHeapStats
+{
+    uint64_t reservedBytes;     // Address space reserved, for spans, runs and large blocks
+    uint64_t committedBytes;    // Part of it committed
+    uint64_t peakCommittedBytes;
+    uint64_t usedBytes;         // Bytes requested by blocks not yet freed
+    uint64_t peakUsedBytes;
+    uint64_t allocations;       // Blocks handed out, including from the CRT heap
+    uint64_t blocksInUse;
+    uint64_t crtAllocations;    // Blocks that had to come from the CRT heap
+};
+
+// Allocate size bytes, aligned to twice the size of a pointer. Returns null
+// only if neither the private heap nor the CRT heap has the memory.
+void* PluginHeapAlloc(size_t size);
+
+// Allocate size bytes aligned to alignment, a power of two
+void* PluginHeapAllocAligned(size_t size, size_t alignment);
+
+// Free a block returned by either of the above (null is ignored)
+void PluginHeapFree(void* block);
+
+// With false, new blocks come from the CRT heap (blocks already allocated
+// are still freed correctly). Set from PluginHeap in the config.
+void SetPluginHeapEnabled(bool enabled);
+
+PluginHeapStats GetPluginHeapStats();
+
+// Write the footprint of the heap and its blocks per size class
+void WritePluginHeapReport(std::ostream& out);
+
+#endif // PLUGINHEAP_H
@@ -0,0 +1,338 @@
+/*
+    Prefetcher.cpp - Profile-guided background prefetching for MpqFileLister plugin
+*/
+
+#include "Prefetcher.h"
+#include "LogCompressor.h"
+#include "Timing.h"
+#include "tools/AccessOrder.h"
+#include "tools/LogParser.h"
+#include "tools/LzLog.h"
+#include "tools/StormName.h"
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Bytes read per SFileReadFile call on the prefetch thread
+static constexpr DWORD PREFETCH_READ_SIZE = 64 * 1024;
+
+// Categories of the game's opens
+enum PrefetchCategory
+{
+    CATEGORY_PREFETCHED = 0,       // In the manifest and already read by the prefetch thread
+    CATEGORY_NOT_PREFETCHED = 1,   // In the manifest, but the game got there first
+    CATEGORY_NOT_IN_MANIFEST = 2,
+    CATEGORY_COUNT = 3
+};
+
+struct CategoryStats
+{
+    std::atomic<uint64_t> opens{0};
+    std::atomic<uint64_t> stormTicks{0};
+};
+
+// The manifest; only changed before the prefetch thread starts
+static std::string s_manifestPath;
+static std::vector<std::string> s_manifest;
+static std::unordered_map<std::string, size_t> s_manifestIndex;
+static std::unique_ptr<std::atomic<bool>[]> s_prefetched;
+
+// One past the furthest manifest entry the game has opened
+static std::atomic<size_t> s_gamePosition{0};
+static bool s_prefetcherRunning = false;
+
+static PrefetchFunctions s_functions = {};
+static unsigned s_window = 0;
+static HANDLE s_prefetchThread = nullptr;
+static HANDLE s_prefetchStopEvent = nullptr;
+static HANDLE s_prefetchWakeEvent = nullptr;
+
+// Only written by the prefetch thread, and read after it has stopped
+static bool s_prefetchThreadStopped = true;
+static uint64_t s_prefetchedFiles = 0;
+static uint64_t s_prefetchedBytes = 0;
+static uint64_t s_prefetchTicks = 0;
+static uint64_t s_failedFiles = 0;
+static uint64_t s_skippedFiles = 0;
+
+static CategoryStats s_categories[CATEGORY_COUNT];
+
+// Anything but a timeout stops the thread, including a failed wait
+static bool IsStopRequested()
+{
+    return WaitForSingleObject(s_prefetchStopEvent, 0) != WAIT_TIMEOUT;
+}
+
+// Open a file through Storm and read it to the end (or until asked to stop)
+static void PrefetchFile(size_t index, char* buffer)
+{
+    const char* name = s_manifest[index].c_str();
+    uint64_t startTicks = GetTicks();
+
+    HANDLE file = nullptr;
+    BOOL opened = FALSE;
+    if (s_functions.openFileEx)
+        opened = s_functions.openFileEx(nullptr, name, 0, &file);
+    else if (s_functions.openFile)
+        opened = s_functions.openFile(name, &file);
+
+    if (!opened || !file)
+    {
+        s_failedFiles++;
+        return;
+    }
+
+    if (s_functions.readFile)
+    {
+        for (;;)
+        {
+            // Storm reports the bytes read even when it hits the end of the file and fails
+            DWORD bytesRead = 0;
+            BOOL result = s_functions.readFile(file, buffer, PREFETCH_READ_SIZE, &bytesRead, nullptr);
+            s_prefetchedBytes += bytesRead;
+            if (!result || bytesRead < PREFETCH_READ_SIZE || IsStopRequested())
+                break;
+        }
+    }
+
+    s_functions.closeFile(file);
+    s_prefetchTicks += GetTicks() - startTicks;
+    s_prefetchedFiles++;
+    s_prefetched[index].store(true, std::memory_order_release);
+}
+
+static DWORD WINAPI PrefetchThreadProc(LPVOID lpParameter)
+{
+    (void)lpParameter;
+
+    std::unique_ptr<char[]> buffer(new char[PREFETCH_READ_SIZE]);
+    HANDLE events[2] = { s_prefetchStopEvent, s_prefetchWakeEvent };
+
+    size_t next = 0;
+    while (next < s_manifest.size() && !IsStopRequested())
+    {
+        // Files the game has already passed are not worth reading any more
+        size_t position = s_gamePosition.load(std::memory_order_relaxed);
+        if (next < position)
+        {
+            s_skippedFiles += position - next;
+            next = position;
+            continue;
+        }
+
+        // Far enough ahead; wait for the game to catch up
+        if (next >= position + s_window)
+        {
+            if (WaitForMultipleObjects(2, events, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
+                break;
+            continue;
+        }
+
+        PrefetchFile(next, buffer.get());
+        next++;
+    }
+
+    return 0;
+}
+
+// Append the text of one part of a log to text, unpacking it if it was
+// written with LogCompress. Returns false if the part does not exist.
+static bool ReadManifestPart(const std::string& path, std::string& text)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() < sizeof(LzLogHeader) || memcmp(data.data(), LZLOG_MAGIC, sizeof(LZLOG_MAGIC)) != 0)
+    {
+        text += data;
+        return true;
+    }
+
+    // A log cut short by a crash is read up to its last complete block
+    size_t offset = sizeof(LzLogHeader);
+    LzLogBlockHeader block;
+    while (data.size() - offset >= sizeof(block))
+    {
+        memcpy(&block, data.data() + offset, sizeof(block));
+        offset += sizeof(block);
+        if (block.rawSize > LZLOG_MAX_BLOCK_SIZE || block.storedSize > block.rawSize ||
+            block.storedSize > data.size() - offset)
+            break;
+
+        const uint8_t* stored = reinterpret_cast<const uint8_t*>(data.data() + offset);
+        size_t textSize = text.size();
+        text.resize(textSize + block.rawSize);
+        uint8_t* raw = reinterpret_cast<uint8_t*>(&text[textSize]);
+        bool decoded = block.storedSize == block.rawSize
+            ? (memcpy(raw, stored, block.rawSize), true)
+            : LzDecompress(stored, block.storedSize, raw, block.rawSize);
+        if (!decoded || LzChecksum(raw, block.rawSize) != block.checksum)
+        {
+            text.resize(textSize);
+            break;
+        }
+        offset += block.storedSize;
+    }
+    return true;
+}
+
+size_t LoadPrefetchManifest(const std::string& path)
+{
+    // A rotated log is read part by part, up to the part that ends with the
+    // trailer (parts after it are left over from a longer session)
+    std::string data;
+    size_t trailerSearchFrom = 0;
+    for (unsigned part = 1; ReadManifestPart(GetLogPartPath(path, part), data); part++)
+    {
+        if (data.find(LOG_TRAILER_PREFIX, trailerSearchFrom) != std::string::npos)
+            break;
+        trailerSearchFrom = data.size();
+    }
+    if (data.empty())
+        return 0;
+
+    s_manifestPath = path;
+    s_manifest = GetFirstAccessOrder(data.data(), data.size());
+    s_manifestIndex.clear();
+    s_manifestIndex.reserve(s_manifest.size());
+    for (size_t i = 0; i < s_manifest.size(); i++)
+        s_manifestIndex.emplace(NormalizeStormName(s_manifest[i]), i);
+
+    s_prefetched.reset(new std::atomic<bool>[s_manifest.size()]);
+    for (size_t i = 0; i < s_manifest.size(); i++)
+        s_prefetched[i].store(false, std::memory_order_relaxed);
+
+    return s_manifest.size();
+}
+
+void StartPrefetcher(const PrefetchFunctions& functions, unsigned window)
+{
+    if (s_prefetchThread || s_manifest.empty())
+        return;
+
+    // A file the thread cannot close would stay open in Storm for the whole session
+    if ((!functions.openFile && !functions.openFileEx) || !functions.closeFile)
+        return;
+
+    s_functions = functions;
+    s_window = window > 0 ? window : 1;
+    s_gamePosition.store(0, std::memory_order_relaxed);
+    s_prefetcherRunning = true;
+
+    s_prefetchStopEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    s_prefetchWakeEvent = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+    if (s_prefetchStopEvent && s_prefetchWakeEvent)
+        s_prefetchThread = CreateThread(nullptr, 0, PrefetchThreadProc, nullptr, 0, nullptr);
+
+    if (s_prefetchThread)
+    {
+        s_prefetchThreadStopped = false;
+        SetThreadPriority(s_prefetchThread, THREAD_PRIORITY_LOWEST);
+    }
+}
+
+void StopPrefetcher()
+{
+    if (!s_prefetcherRunning)
+        return;
+
+    s_prefetcherRunning = false;
+
+    // The thread may already be gone if the process is exiting; a large
+    // file is read in chunks, so a running thread stops quickly
+    if (s_prefetchThread)
+    {
+        SetEvent(s_prefetchStopEvent);
+        if (WaitForSingleObject(s_prefetchThread, 1000) != WAIT_OBJECT_0)
+        {
+            // Still inside Storm; it checks the events after every chunk, so
+            // they stay open, and the thread keeps them (and its counters)
+            return;
+        }
+        s_prefetchThreadStopped = true;
+        CloseHandle(s_prefetchThread);
+        s_prefetchThread = nullptr;
+    }
+    if (s_prefetchStopEvent)
+    {
+        CloseHandle(s_prefetchStopEvent);
+        s_prefetchStopEvent = nullptr;
+    }
+    if (s_prefetchWakeEvent)
+    {
+        CloseHandle(s_prefetchWakeEvent);
+        s_prefetchWakeEvent = nullptr;
+    }
+}
+
+void RecordPrefetchAccess(const char* fileName, uint64_t stormTicks)
+{
+    if (!s_prefetcherRunning || !fileName)
+        return;
+
+    // Reused, so the lookup does not allocate once the key has grown
+    thread_local std::string key;
+    key.assign(fileName);
+    for (char& c : key)
+        c = NormalizeStormChar(c);
+
+    PrefetchCategory category = CATEGORY_NOT_IN_MANIFEST;
+    auto it = s_manifestIndex.find(key);
+    if (it != s_manifestIndex.end())
+    {
+        size_t index = it->second;
+        category = s_prefetched[index].load(std::memory_order_acquire) ? CATEGORY_PREFETCHED : CATEGORY_NOT_PREFETCHED;
+
+        size_t position = s_gamePosition.load(std::memory_order_relaxed);
+        while (position < index + 1)
+        {
+            if (s_gamePosition.compare_exchange_weak(position, index + 1, std::memory_order_relaxed))
+            {
+                SetEvent(s_prefetchWakeEvent);
+                break;
+            }
+        }
+    }
+
+    s_categories[category].opens.fetch_add(1, std::memory_order_relaxed);
+    s_categories[category].stormTicks.fetch_add(stormTicks, std::memory_order_relaxed);
+}
+
+void WritePrefetchReport(std::ostream& out)
+{
+    out << "Manifest: " << s_manifestPath << " (" << s_manifest.size() << " names), window "
+        << s_window << " files\n";
+    if (s_prefetchThreadStopped)
+    {
+        out << "Prefetched: " << s_prefetchedFiles << " files, " << s_prefetchedBytes << " bytes in "
+            << FormatTicksAsMs(s_prefetchTicks) << " ms; " << s_failedFiles << " not found, "
+            << s_skippedFiles << " skipped because the game got there first\n\n";
+    }
+    else
+    {
+        out << "Prefetched: unknown, the prefetch thread did not stop in time\n\n";
+    }
+
+    out << std::left << std::setw(20) << "Opens by the game" << std::right
+        << std::setw(10) << "Opens"
+        << std::setw(14) << "Storm ms"
+        << std::setw(14) << "Mean ms" << "\n";
+
+    static const char* const categoryNames[CATEGORY_COUNT] = { "Prefetched", "Not prefetched", "Not in manifest" };
+    for (int i = 0; i < CATEGORY_COUNT; i++)
+    {
+        uint64_t opens = s_categories[i].opens.load(std::memory_order_relaxed);
+        uint64_t ticks = s_categories[i].stormTicks.load(std::memory_order_relaxed);
+        out << std::left << std::setw(20) << categoryNames[i] << std::right
+            << std::setw(10) << opens
+            << std::setw(14) << FormatTicksAsMs(ticks)
+            << std::setw(14) << FormatTicksAsMs(opens > 0 ? ticks / opens : 0) << "\n";
+    }
+}
@@ -0,0 +1,47 @@
+/*
+    Prefetcher.h - Profile-guided background prefetching for MpqFileLister plugin
+
+    Reads the log of an earlier session as a manifest of the order in which
+    the game first opens its files. A low-priority background thread opens
+    and reads those files through the original Storm functions, staying at
+    most a window of files ahead of the game's position in the manifest, so
+    their archive data is in the OS cache by the time the game asks for it.
+
+    The hooks report every successful open, which both moves the game's
+    position forward and splits the Storm time of the game's opens into
+    prefetched, not (yet) prefetched and not in the manifest.
+*/
+
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include "MpqFileLister.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// Storm functions the prefetch thread calls (either open function may be missing)
+struct PrefetchFunctions
+{
+    SFileOpenFilePtr openFile;
+    SFileOpenFileExPtr openFileEx;
+    SFileReadFilePtr readFile;
+    SFileCloseFilePtr closeFile;
+};
+
+// Read the manifest (a log in any LogFormat, compressed or rotated). Returns the number of names in it.
+size_t LoadPrefetchManifest(const std::string& path);
+
+// Start the prefetch thread, at most window files ahead of the game
+void StartPrefetcher(const PrefetchFunctions& functions, unsigned window);
+
+// Stop the prefetch thread and close any file it has open
+void StopPrefetcher();
+
+// Record a successful open by the game that spent stormTicks in Storm
+void RecordPrefetchAccess(const char* fileName, uint64_t stormTicks);
+
+// Write what was prefetched and the game's open times by category
+void WritePrefetchReport(std::ostream& out);
+
+#endif // PREFETCHER_H
@@ -0,0 +1,187 @@
+/*
+    RecordPipeline.cpp - Record queue and sink thread for MpqFileLister plugin
+*/
+
+#include "RecordPipeline.h"
+#include "CrashDrain.h"
+#include <windows.h>
+#include <atomic>
+
+// Polling interval of the thread, which halves while it finds a lot to do
+static constexpr DWORD RECORD_POLL_MIN_MS = 5;
+static constexpr DWORD RECORD_POLL_MAX_MS = 100;
+
+// Batched output is written out at least this often
+static constexpr DWORD RECORD_FLUSH_INTERVAL_MS = 1000;
+
+// How long a crash drain waits for the thread to finish with the sinks
+static constexpr DWORD RECORD_DRAIN_TIMEOUT_MS = 1000;
+
+static std::unique_ptr<RecordQueue> s_queue;
+static CRecordDispatcher s_dispatcher;
+
+// Held while the sinks are written to, so a crash drain never writes out a
+// batch that is half-appended
+static DrainLock s_sinkLock;
+static std::atomic<bool> s_pipelineRunning{false};
+static std::atomic<bool> s_wakePending{false};
+static std::atomic<bool> s_pipelineDrained{false};
+
+static HANDLE s_pipelineThread = nullptr;
+static HANDLE s_pipelineStopEvent = nullptr;
+static HANDLE s_pipelineWakeEvent = nullptr;
+
+// Dispatch everything that has been committed; returns how many records it was
+static size_t DispatchAll()
+{
+    size_t total = 0;
+    size_t dispatched;
+    while ((dispatched = s_dispatcher.Dispatch(*s_queue, s_queue->Capacity())) > 0)
+        total += dispatched;
+    return total;
+}
+
+static DWORD WINAPI PipelineThreadProc(LPVOID lpParameter)
+{
+    (void)lpParameter;
+
+    HANDLE events[2] = { s_pipelineStopEvent, s_pipelineWakeEvent };
+    DWORD pollMs = RECORD_POLL_MAX_MS;
+    DWORD lastFlush = GetTickCount();
+    for (;;)
+    {
+        DWORD wait = WaitForMultipleObjects(2, events, FALSE, pollMs);
+        s_wakePending = false;
+
+        s_sinkLock.Lock();
+        size_t dispatched = DispatchAll();
+        s_dispatcher.Poll();
+        if (GetTickCount() - lastFlush >= RECORD_FLUSH_INTERVAL_MS)
+        {
+            s_dispatcher.Flush();
+            lastFlush = GetTickCount();
+        }
+        s_sinkLock.Unlock();
+
+        if (dispatched >= s_queue->Capacity() / 4)
+            pollMs = pollMs / 2 > RECORD_POLL_MIN_MS ? pollMs / 2 : RECORD_POLL_MIN_MS;
+        else if (dispatched == 0)
+            pollMs = pollMs * 2 < RECORD_POLL_MAX_MS ? pollMs * 2 : RECORD_POLL_MAX_MS;
+
+        if (wait == WAIT_OBJECT_0 || wait == WAIT_FAILED)
+            break;
+    }
+
+    s_sinkLock.Lock();
+    s_dispatcher.Close();
+    s_sinkLock.Unlock();
+    s_pipelineDrained = true;
+    return 0;
+}
+
+void AddRecordSink(std::unique_ptr<IRecordSink> sink)
+{
+    if (!s_pipelineRunning)
+        s_dispatcher.AddSink(std::move(sink));
+}
+
+bool StartRecordPipeline(size_t capacity)
+{
+    if (s_pipelineThread)
+        return true;
+
+    s_queue = std::make_unique<RecordQueue>(capacity > 0 ? capacity : 1);
+    s_pipelineDrained = false;
+    s_pipelineStopEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    s_pipelineWakeEvent = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+    if (s_pipelineStopEvent && s_pipelineWakeEvent)
+        s_pipelineThread = CreateThread(nullptr, 0, PipelineThreadProc, nullptr, 0, nullptr);
+
+    if (!s_pipelineThread)
+    {
+        s_dispatcher.Close();
+        return false;
+    }
+
+    SetThreadPriority(s_pipelineThread, THREAD_PRIORITY_LOWEST);
+    s_pipelineRunning = true;
+    return true;
+}
+
+AccessRecord* BeginQueuedRecord()
+{
+    if (!s_pipelineRunning)
+        return nullptr;
+
+    AccessRecord* record;
+    while (!(record = s_queue->BeginPush()))
+    {
+        // Full: wait for the thread, unless it is being stopped
+        if (!s_pipelineRunning)
+            return nullptr;
+        SetEvent(s_pipelineWakeEvent);
+        SwitchToThread();
+    }
+    return record;
+}
+
+void CommitQueuedRecord(AccessRecord* record)
+{
+    s_queue->CommitPush(record);
+
+    if (s_queue->Size() >= s_queue->Capacity() / 2 && !s_wakePending.exchange(true))
+        SetEvent(s_pipelineWakeEvent);
+}
+
+void StopRecordPipeline()
+{
+    if (!s_pipelineThread)
+        return;
+
+    // Records claimed from here on are not dispatched; the log is closing
+    s_pipelineRunning = false;
+    SetEvent(s_pipelineStopEvent);
+    DWORD wait = WaitForSingleObject(s_pipelineThread, 5000);
+    CloseHandle(s_pipelineThread);
+    s_pipelineThread = nullptr;
+
+    // Still writing; the sinks are left to the thread
+    if (wait != WAIT_OBJECT_0)
+        return;
+
+    // Ended by Windows when the process exits without the ExitProcess hook
+    if (!s_pipelineDrained)
+    {
+        s_sinkLock.Lock();
+        DispatchAll();
+        s_dispatcher.Close();
+        s_sinkLock.Unlock();
+    }
+
+    CloseHandle(s_pipelineStopEvent);
+    CloseHandle(s_pipelineWakeEvent);
+    s_pipelineStopEvent = nullptr;
+    s_pipelineWakeEvent = nullptr;
+}
+
+void DrainRecordSinks()
+{
+    // Records still in the queue are left: the log they also go to cannot
+    // take them without allocating
+    if (!s_sinkLock.TryLockFor(RECORD_DRAIN_TIMEOUT_MS))
+        return;
+    s_dispatcher.Drain();
+    s_sinkLock.Unlock();
+}
+
+void GetRecordQueueFill(uint64_t& fill, uint64_t& capacity)
+{
+    if (!s_pipelineRunning)
+    {
+        fill = 0;
+        capacity = 0;
+        return;
+    }
+    fill = s_queue->Size();
+    capacity = s_queue->Capacity();
+}
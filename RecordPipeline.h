@@ -0,0 +1,43 @@
+/*
+    RecordPipeline.h - Record queue and sink thread for MpqFileLister plugin
+
+    When sinks are configured, the hooks only copy each file access into the
+    record queue (see RecordQueue.h), and a low-priority background thread
+    hands the records to the log and to every sink (see RecordSinks.h). What
+    a hook costs then does not depend on how many outputs there are.
+
+    The thread wakes when the queue is half full, and otherwise polls it, more
+    often while the game is loading files and less often while it is not. Each
+    time it takes every record there is. A full queue makes the hooks wait for
+    the thread rather than lose records.
+*/
+
+#ifndef RECORDPIPELINE_H
+#define RECORDPIPELINE_H
+
+#include "RecordSinks.h"
+#include <cstdint>
+#include <memory>
+
+// Add a sink; only before the pipeline is started
+void AddRecordSink(std::unique_ptr<IRecordSink> sink);
+
+// Start the thread with a queue of (at least) capacity records. Returns false if it could not be started.
+bool StartRecordPipeline(size_t capacity);
+
+// Claim a record to fill in, or nullptr if the pipeline is not running.
+// Every claimed record must be committed.
+AccessRecord* BeginQueuedRecord();
+void CommitQueuedRecord(AccessRecord* record);
+
+// Hand the queued records to the sinks, stop the thread and close the sinks
+void StopRecordPipeline();
+
+// Write out the sinks' batches when the game crashes (registered with CrashDrain.h).
+// Records still in the queue are lost.
+void DrainRecordSinks();
+
+// Records waiting in the queue, and its capacity (0 when not running)
+void GetRecordQueueFill(uint64_t& fill, uint64_t& capacity);
+
+#endif // RECORDPIPELINE_H
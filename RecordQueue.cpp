@@ -0,0 +1,90 @@
+/*
+    RecordQueue.cpp - Queue of file access records for MpqFileLister plugin
+*/
+
+#include "RecordQueue.h"
+#include <cstring>
+
+void SetRecordNames(AccessRecord& record, const char* archive, size_t archiveLength, const char* fileName)
+{
+    if (!archive)
+        archiveLength = 0;
+    if (archiveLength > RECORD_NAME_SIZE - 1)
+        archiveLength = RECORD_NAME_SIZE - 1;
+    if (archiveLength > 0)
+        memcpy(record.archive, archive, archiveLength);
+    record.archive[archiveLength] = '\0';
+    record.archiveLength = static_cast<uint16_t>(archiveLength);
+
+    size_t fileNameLength = strnlen(fileName, RECORD_NAME_SIZE - 1);
+    memcpy(record.fileName, fileName, fileNameLength);
+    record.fileName[fileNameLength] = '\0';
+    record.fileNameLength = static_cast<uint16_t>(fileNameLength);
+}
+
+RecordQueue::RecordQueue(size_t capacity)
+    : m_tail(0)
+    , m_head(0)
+{
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    m_slots.reset(new Slot[size]);
+    m_mask = size - 1;
+    for (size_t i = 0; i < size; i++)
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+AccessRecord* RecordQueue::BeginPush()
+{
+    size_t position = m_tail.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        Slot& slot = m_slots[position & m_mask];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+
+        // A free slot's sequence is the position that may claim it; one a
+        // lap behind still holds a record the consumer has not read
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+        if (difference == 0)
+        {
+            if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                return &slot.record;
+        }
+        else if (difference < 0)
+            return nullptr;
+        else
+            position = m_tail.load(std::memory_order_relaxed);
+    }
+}
+
+void RecordQueue::CommitPush(AccessRecord* record)
+{
+    // A claimed slot's sequence is still its position; one more marks it committed
+    Slot* slot = reinterpret_cast<Slot*>(reinterpret_cast<char*>(record) - offsetof(Slot, record));
+    slot->sequence.store(slot->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+const AccessRecord* RecordQueue::Peek()
+{
+    size_t position = m_head.load(std::memory_order_relaxed);
+    Slot& slot = m_slots[position & m_mask];
+    if (slot.sequence.load(std::memory_order_acquire) != position + 1)
+        return nullptr;
+    return &slot.record;
+}
+
+void RecordQueue::Pop()
+{
+    size_t position = m_head.load(std::memory_order_relaxed);
+    m_slots[position & m_mask].sequence.store(position + m_mask + 1, std::memory_order_release);
+    m_head.store(position + 1, std::memory_order_relaxed);
+}
+
+size_t RecordQueue::Size() const
+{
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t head = m_head.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
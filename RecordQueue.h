@@ -0,0 +1,76 @@
+/*
+    RecordQueue.h - Queue of file access records for MpqFileLister plugin
+
+    The hooks capture every access once, as a fixed-size AccessRecord with
+    copies of its names, and hand it to the record pipeline's thread through
+    a bounded queue. The queue is a ring of slots, each with a sequence
+    number telling whether it is free or holds a record: producers claim the
+    next slot with a single compare-and-swap and fill it in place, and the
+    single consumer reads records in the order they were claimed.
+
+    This file does not depend on the plugin, so the sink benchmark can be
+    built and run on Linux too.
+*/
+
+#ifndef RECORDQUEUE_H
+#define RECORDQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Room for a name and its terminator (MAX_PATH); longer names are cut
+constexpr size_t RECORD_NAME_SIZE = 260;
+
+struct AccessRecord
+{
+    uint64_t startMicros;       // Session time the Storm call started
+    uint64_t stormMicros;       // Time spent inside Storm
+    uint64_t timestampMs;       // Epoch time of the call
+    const char* function;       // Name of the hooked Storm function (a string literal)
+    uint32_t threadId;
+    uint16_t archiveLength;     // 0 if the archive is not known
+    uint16_t fileNameLength;
+    char archive[RECORD_NAME_SIZE];     // Null-terminated
+    char fileName[RECORD_NAME_SIZE];    // Null-terminated
+};
+
+// Copy the names into a record (archive may be null)
+void SetRecordNames(AccessRecord& record, const char* archive, size_t archiveLength, const char* fileName);
+
+class RecordQueue
+{
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        AccessRecord record;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_mask;
+
+    // Next slot to claim and next slot to read, on separate cache lines
+    alignas(64) std::atomic<size_t> m_tail;
+    alignas(64) std::atomic<size_t> m_head;
+
+public:
+    // Capacity is rounded up to a power of two
+    explicit RecordQueue(size_t capacity);
+
+    // Claim a slot to fill in; returns nullptr if the queue is full. Every
+    // claimed slot must be committed, or the consumer stops at it.
+    AccessRecord* BeginPush();
+    void CommitPush(AccessRecord* record);
+
+    // Consumer only: the oldest record, or nullptr if it has not been
+    // committed yet. Pop releases it.
+    const AccessRecord* Peek();
+    void Pop();
+
+    size_t Size() const;
+    size_t Capacity() const { return m_mask + 1; }
+};
+
+#endif // RECORDQUEUE_H
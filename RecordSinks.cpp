@@ -0,0 +1,653 @@
+/*
+    RecordSinks.cpp - Outputs of the record pipeline for MpqFileLister plugin
+*/
+
+#include "RecordSinks.h"
+#include "RecordStream.h"
+#include "TraceWriter.h"
+#include "tools/RecordCodec.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <thread>
+#include <unordered_set>
+
+static const size_t DEFAULT_BATCH_KB = 64;
+static const size_t DEFAULT_STREAM_BATCH_KB = 16;
+static const unsigned DEFAULT_STREAM_LATENCY_MS = 50;
+static const unsigned DEFAULT_STREAM_BACKLOG_KB = 1024;
+
+// Time a closing stream sink gives the reader to take its last frame
+static const unsigned STREAM_CLOSE_TIMEOUT_MS = 1000;
+
+// An option's value, or nullptr if it is not given
+static const std::string* FindOption(const RecordSinkSpec& spec, const char* name)
+{
+    for (const auto& option : spec.options)
+    {
+        if (option.first == name)
+            return &option.second;
+    }
+    return nullptr;
+}
+
+static bool ReadUnsignedOption(const RecordSinkSpec& spec, const char* name, unsigned maximum,
+                               unsigned& value, std::string& error)
+{
+    const std::string* text = FindOption(spec, name);
+    if (!text)
+        return true;
+
+    char* end = nullptr;
+    unsigned long parsed = strtoul(text->c_str(), &end, 10);
+    if (text->empty() || *end != '\0' || parsed > maximum)
+    {
+        error = "bad value for " + std::string(name) + ": " + *text;
+        return false;
+    }
+    value = static_cast<unsigned>(parsed);
+    return true;
+}
+
+void FormatTextRecord(const AccessRecord& record, unsigned format, bool threadId, std::string& out)
+{
+    // TIMESTAMP_ARCHIVE_FILENAME, ARCHIVE_FILENAME, TIMESTAMP_FILENAME, FILENAME_ONLY
+    bool timestamp = format == 0 || format == 2;
+    bool archive = format == 0 || format == 1;
+
+    if (timestamp)
+    {
+        out += std::to_string(record.timestampMs);
+        out += ' ';
+    }
+    if (threadId)
+    {
+        out += '[';
+        out += std::to_string(record.threadId);
+        out += "] ";
+    }
+    if (archive && record.archiveLength > 0)
+    {
+        out.append(record.archive, record.archiveLength);
+        out += ": ";
+    }
+    out.append(record.fileName, record.fileNameLength);
+}
+
+// Output written from a batch, once it holds batchBytes
+class CBatchedSink : public IRecordSink
+{
+protected:
+    std::ofstream m_file;
+    std::string m_batch;
+    size_t m_batchBytes;
+
+    void EndRecord()
+    {
+        if (m_batch.size() >= m_batchBytes)
+            Flush();
+    }
+
+public:
+    CBatchedSink(const std::string& path, std::ios::openmode mode, size_t batchBytes)
+        : m_file(path, mode | std::ios::out | std::ios::trunc)
+        , m_batchBytes(batchBytes)
+    {
+        m_batch.reserve(batchBytes + 2 * RECORD_NAME_SIZE + 64);
+    }
+
+    ~CBatchedSink() override { Flush(); }
+
+    bool IsOpen() const { return m_file.is_open(); }
+
+    void Flush() override
+    {
+        if (m_batch.empty())
+            return;
+        m_file.write(m_batch.data(), static_cast<std::streamsize>(m_batch.size()));
+        m_file.flush();
+        m_batch.clear();
+    }
+
+    // The batch never grows past its reserved size, so writing it out does not allocate
+    void Drain() override { Flush(); }
+};
+
+class CTextRecordSink : public CBatchedSink
+{
+private:
+    unsigned m_format;
+    bool m_threadId;
+
+public:
+    // Lines end in \r\n whatever the CRT does, as in the primary log
+    CTextRecordSink(const std::string& path, size_t batchBytes, unsigned format, bool threadId)
+        : CBatchedSink(path, std::ios::binary, batchBytes)
+        , m_format(format)
+        , m_threadId(threadId)
+    {
+    }
+
+    void Write(const AccessRecord& record) override
+    {
+        FormatTextRecord(record, m_format, m_threadId, m_batch);
+        m_batch += "\r\n";
+        EndRecord();
+    }
+};
+
+// Append a record in the tools/RecordCodec.h format
+static void AppendEncodedRecord(const AccessRecord& record, std::string& out)
+{
+    RecordFields fields;
+    fields.startMicros = record.startMicros;
+    fields.stormMicros = record.stormMicros;
+    fields.timestampMs = record.timestampMs;
+    fields.threadId = record.threadId;
+    fields.function = record.function;
+    fields.archive = std::string_view(record.archive, record.archiveLength);
+    fields.fileName = std::string_view(record.fileName, record.fileNameLength);
+
+    size_t offset = out.size();
+    out.resize(offset + EncodedRecordSize(fields));
+    EncodeRecord(fields, &out[offset]);
+}
+
+static void AppendRecordLogHeader(std::string& out)
+{
+    RecordLogHeader header = {};
+    std::copy(RECORD_MAGIC, RECORD_MAGIC + 4, header.magic);
+    header.version = RECORD_VERSION;
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+class CBinaryRecordSink : public CBatchedSink
+{
+public:
+    CBinaryRecordSink(const std::string& path, size_t batchBytes)
+        : CBatchedSink(path, std::ios::binary, batchBytes)
+    {
+        AppendRecordLogHeader(m_batch);
+    }
+
+    void Write(const AccessRecord& record) override
+    {
+        AppendEncodedRecord(record, m_batch);
+        EndRecord();
+    }
+};
+
+// Every event is written as it comes, as the trace rewrites its closing bracket
+class CTraceRecordSink : public IRecordSink
+{
+private:
+    std::ofstream m_file;
+    CTraceWriter m_writer;
+
+public:
+    CTraceRecordSink(const std::string& path, uint32_t processId, const std::string& processName)
+        : m_file(path, std::ios::out | std::ios::trunc | std::ios::binary)
+    {
+        if (m_file.is_open())
+            m_writer.Begin(m_file, processId, processName.c_str());
+    }
+
+    bool IsOpen() const { return m_file.is_open(); }
+
+    void Write(const AccessRecord& record) override
+    {
+        m_writer.WriteCompleteEvent(m_file, record.fileName, record.function, record.startMicros,
+                                    record.stormMicros, record.threadId, record.archive, record.fileName);
+    }
+
+    void Flush() override {}
+};
+
+class CStatsRecordSink : public IRecordSink
+{
+private:
+    struct Totals
+    {
+        uint64_t opens = 0;
+        uint64_t uniqueNames = 0;
+        uint64_t stormMicros = 0;
+        uint64_t maxStormMicros = 0;
+    };
+
+    std::string m_path;
+    std::map<std::string, Totals> m_archives;
+    std::map<std::string, Totals> m_functions;
+    std::unordered_set<std::string> m_names;                    // archive: name
+    std::unordered_set<std::string> m_functionNames;            // function\narchive: name
+    std::string m_key;
+    std::string m_functionKey;
+
+    static void Add(Totals& totals, const AccessRecord& record, bool newName)
+    {
+        totals.opens++;
+        totals.uniqueNames += newName ? 1 : 0;
+        totals.stormMicros += record.stormMicros;
+        totals.maxStormMicros = std::max(totals.maxStormMicros, record.stormMicros);
+    }
+
+    static void WriteTable(std::ostream& out, const char* heading, const std::map<std::string, Totals>& table)
+    {
+        std::vector<const std::pair<const std::string, Totals>*> rows;
+        for (const auto& row : table)
+            rows.push_back(&row);
+        std::sort(rows.begin(), rows.end(), [](const auto* a, const auto* b)
+        {
+            if (a->second.stormMicros != b->second.stormMicros)
+                return a->second.stormMicros > b->second.stormMicros;
+            return a->first < b->first;
+        });
+
+        out << std::setw(10) << "Opens"
+            << std::setw(10) << "Unique"
+            << std::setw(14) << "Storm ms"
+            << std::setw(14) << "Max ms"
+            << "  " << heading << "\n";
+        for (const auto* row : rows)
+        {
+            out << std::setw(10) << row->second.opens
+                << std::setw(10) << row->second.uniqueNames
+                << std::setw(14) << row->second.stormMicros / 1000.0
+                << std::setw(14) << row->second.maxStormMicros / 1000.0
+                << "  " << (row->first.empty() ? "(unknown archive)" : row->first) << "\n";
+        }
+    }
+
+public:
+    explicit CStatsRecordSink(const std::string& path)
+        : m_path(path)
+    {
+    }
+
+    ~CStatsRecordSink() override
+    {
+        std::ofstream out(m_path, std::ios::out | std::ios::trunc);
+        if (!out.is_open())
+            return;
+
+        Totals total;
+        for (const auto& archive : m_archives)
+        {
+            total.opens += archive.second.opens;
+            total.uniqueNames += archive.second.uniqueNames;
+            total.stormMicros += archive.second.stormMicros;
+        }
+
+        out << std::fixed << std::setprecision(3);
+        out << "Opens: " << total.opens << " (" << total.uniqueNames << " unique names), "
+            << total.stormMicros / 1000.0 << " ms in Storm\n\n";
+        WriteTable(out, "Archive", m_archives);
+        out << "\n";
+        WriteTable(out, "Function", m_functions);
+    }
+
+    void Write(const AccessRecord& record) override
+    {
+        m_key.assign(record.archive, record.archiveLength);
+        m_key += ": ";
+        m_key.append(record.fileName, record.fileNameLength);
+        bool newName = m_names.insert(m_key).second;
+
+        // A name is unique once per function it was opened through
+        m_functionKey.assign(record.function);
+        m_functionKey += '\n';
+        m_functionKey += m_key;
+        bool newFunctionName = m_functionNames.insert(m_functionKey).second;
+
+        Add(m_archives[std::string(record.archive, record.archiveLength)], record, newName);
+        Add(m_functions[record.function], record, newFunctionName);
+    }
+
+    void Flush() override {}
+};
+
+// Frames are sent without ever waiting for the reader. m_outgoing holds the
+// frames not yet taken by the reader, from m_sent on. Records dropped after
+// the newest frame are sent in a frame of no records on Flush and close.
+class CStreamRecordSink : public IRecordSink
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct OutgoingFrame
+    {
+        size_t start;           // Offsets in m_outgoing
+        size_t end;
+        uint32_t records;
+    };
+
+    CRecordStreamServer m_server;
+    bool m_opened;
+    bool m_connected = false;
+    size_t m_batchBytes;
+    Clock::duration m_latency;
+    size_t m_backlogBytes;
+
+    // The frame being filled, starting with room for its RecordStreamFrame
+    std::string m_batch;
+    uint32_t m_batchRecords = 0;
+    Clock::time_point m_batchStart;
+
+    std::string m_outgoing;
+    size_t m_sent = 0;
+    std::deque<OutgoingFrame> m_frames;     // Frames not yet sent in full
+    uint64_t m_dropped = 0;
+    uint64_t m_droppedQueued = 0;           // m_dropped as of the newest frame
+
+    void EndBatch()
+    {
+        if (m_batchRecords == 0)
+            return;
+
+        // Room is kept for the frame that counts the drops
+        if (m_outgoing.size() - m_sent + m_batch.size() + sizeof(RecordStreamFrame) > m_backlogBytes)
+        {
+            m_dropped += m_batchRecords;
+        }
+        else
+        {
+            RecordStreamFrame frame = {};
+            frame.size = static_cast<uint32_t>(m_batch.size() - sizeof(frame));
+            frame.records = m_batchRecords;
+            frame.dropped = m_dropped;
+            memcpy(&m_batch[0], &frame, sizeof(frame));
+            size_t start = m_outgoing.size();
+            m_outgoing += m_batch;
+            m_frames.push_back({ start, m_outgoing.size(), m_batchRecords });
+            m_droppedQueued = m_dropped;
+        }
+        m_batch.clear();
+        m_batchRecords = 0;
+    }
+
+    // Queue a frame of no records, carrying the drops so far
+    void QueueDroppedFrame()
+    {
+        if (!m_connected)
+            return;
+
+        RecordStreamFrame frame = {};
+        frame.dropped = m_dropped;
+        size_t start = m_outgoing.size();
+        m_outgoing.append(reinterpret_cast<const char*>(&frame), sizeof(frame));
+        m_frames.push_back({ start, m_outgoing.size(), 0 });
+        m_droppedQueued = m_dropped;
+    }
+
+    // Records that had not reached the reader when it went away are dropped
+    void Disconnected()
+    {
+        m_connected = false;
+        for (const auto& frame : m_frames)
+            m_dropped += frame.records;
+        m_dropped += m_batchRecords;
+        m_frames.clear();
+        m_outgoing.clear();
+        m_sent = 0;
+        m_batch.clear();
+        m_batchRecords = 0;
+    }
+
+    void Send()
+    {
+        while (m_connected && m_sent < m_outgoing.size())
+        {
+            long written = m_server.TryWrite(m_outgoing.data() + m_sent, m_outgoing.size() - m_sent);
+            if (written < 0)
+            {
+                Disconnected();
+                return;
+            }
+            if (written == 0)
+                break;
+            m_sent += static_cast<size_t>(written);
+        }
+
+        while (!m_frames.empty() && m_frames.front().end <= m_sent)
+            m_frames.pop_front();
+
+        // Drop what has been sent once it outgrows the backlog, up to the
+        // frame being sent
+        if (m_sent == m_outgoing.size() || m_sent >= m_backlogBytes)
+        {
+            size_t erased = m_frames.empty() ? m_sent : std::min(m_sent, m_frames.front().start);
+            m_outgoing.erase(0, erased);
+            for (auto& frame : m_frames)
+            {
+                frame.start -= erased;
+                frame.end -= erased;
+            }
+            m_sent -= erased;
+        }
+    }
+
+public:
+    CStreamRecordSink(const std::string& name, size_t batchBytes, unsigned latencyMs, size_t backlogBytes)
+        : m_batchBytes(batchBytes)
+        , m_latency(std::chrono::milliseconds(latencyMs))
+        , m_backlogBytes(backlogBytes)
+    {
+        m_opened = m_server.Open(name);
+        m_batch.reserve(batchBytes + sizeof(RecordStreamFrame) + 2 * RECORD_NAME_SIZE + 64);
+    }
+
+    // Frames the reader has not started on by now are lost; they are counted
+    // in a last frame, which the reader is given a moment to take
+    ~CStreamRecordSink() override
+    {
+        EndBatch();
+        if (!m_connected)
+            return;
+
+        while (!m_frames.empty() && m_frames.back().start >= m_sent)
+        {
+            m_dropped += m_frames.back().records;
+            m_outgoing.resize(m_frames.back().start);
+            m_frames.pop_back();
+        }
+        QueueDroppedFrame();
+
+        Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(STREAM_CLOSE_TIMEOUT_MS);
+        for (;;)
+        {
+            Send();
+            if (!m_connected || m_sent == m_outgoing.size() || Clock::now() >= deadline)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    bool IsOpen() const { return m_opened; }
+
+    void Write(const AccessRecord& record) override
+    {
+        if (!m_connected)
+        {
+            m_dropped++;
+            return;
+        }
+
+        if (m_batchRecords == 0)
+        {
+            m_batch.resize(sizeof(RecordStreamFrame));
+            m_batchStart = Clock::now();
+        }
+        AppendEncodedRecord(record, m_batch);
+        m_batchRecords++;
+
+        if (m_batch.size() >= m_batchBytes)
+        {
+            EndBatch();
+            Send();
+        }
+    }
+
+    void Flush() override
+    {
+        EndBatch();
+        if (m_dropped != m_droppedQueued)
+            QueueDroppedFrame();
+        Send();
+    }
+
+    void Poll() override
+    {
+        if (!m_connected && m_server.Accept())
+        {
+            // A new reader starts with the header
+            m_connected = true;
+            AppendRecordLogHeader(m_outgoing);
+        }
+
+        if (m_batchRecords > 0 && Clock::now() - m_batchStart >= m_latency)
+            EndBatch();
+        Send();
+    }
+};
+
+bool ParseRecordSinkSpec(const std::string& text, RecordSinkSpec& spec, std::string& error)
+{
+    std::vector<std::string> fields;
+    size_t start = 0;
+    for (;;)
+    {
+        size_t comma = text.find(',', start);
+        fields.push_back(text.substr(start, comma == std::string::npos ? std::string::npos : comma - start));
+        if (comma == std::string::npos)
+            break;
+        start = comma + 1;
+    }
+
+    if (fields.size() < 2 || fields[0].empty() || fields[1].empty())
+    {
+        error = "expected <type>,<file>[,<option>=<value>...]: " + text;
+        return false;
+    }
+
+    spec.type = fields[0];
+    spec.path = fields[1];
+    spec.options.clear();
+    for (size_t i = 2; i < fields.size(); i++)
+    {
+        size_t equals = fields[i].find('=');
+        if (equals == std::string::npos || equals == 0)
+        {
+            error = "expected <option>=<value>: " + fields[i];
+            return false;
+        }
+        spec.options.emplace_back(fields[i].substr(0, equals), fields[i].substr(equals + 1));
+    }
+    return true;
+}
+
+std::unique_ptr<IRecordSink> CreateRecordSink(const RecordSinkSpec& spec, uint32_t processId,
+                                              const std::string& processName, std::string& error)
+{
+    unsigned batchKB = spec.type == "stream" ? DEFAULT_STREAM_BATCH_KB : DEFAULT_BATCH_KB;
+    unsigned format = 0;
+    unsigned threadId = 0;
+    unsigned latencyMs = DEFAULT_STREAM_LATENCY_MS;
+    unsigned backlogKB = DEFAULT_STREAM_BACKLOG_KB;
+    if (!ReadUnsignedOption(spec, "batchKB", 65536, batchKB, error) ||
+        !ReadUnsignedOption(spec, "format", 3, format, error) ||
+        !ReadUnsignedOption(spec, "threadId", 1, threadId, error) ||
+        !ReadUnsignedOption(spec, "latencyMs", 60000, latencyMs, error) ||
+        !ReadUnsignedOption(spec, "backlogKB", 1048576, backlogKB, error))
+        return nullptr;
+    size_t batchBytes = static_cast<size_t>(batchKB) * 1024;
+
+    bool opened = false;
+    std::unique_ptr<IRecordSink> sink;
+    if (spec.type == "text")
+    {
+        auto text = std::make_unique<CTextRecordSink>(spec.path, batchBytes, format, threadId != 0);
+        opened = text->IsOpen();
+        sink = std::move(text);
+    }
+    else if (spec.type == "binary")
+    {
+        auto binary = std::make_unique<CBinaryRecordSink>(spec.path, batchBytes);
+        opened = binary->IsOpen();
+        sink = std::move(binary);
+    }
+    else if (spec.type == "trace")
+    {
+        auto trace = std::make_unique<CTraceRecordSink>(spec.path, processId, processName);
+        opened = trace->IsOpen();
+        sink = std::move(trace);
+    }
+    else if (spec.type == "stats")
+    {
+        // Written when closed; check now that it can be
+        opened = std::ofstream(spec.path, std::ios::out | std::ios::trunc).is_open();
+        sink = std::make_unique<CStatsRecordSink>(spec.path);
+    }
+    else if (spec.type == "stream")
+    {
+        auto stream = std::make_unique<CStreamRecordSink>(spec.path, batchBytes, latencyMs,
+                                                          static_cast<size_t>(backlogKB) * 1024);
+        opened = stream->IsOpen();
+        sink = std::move(stream);
+    }
+    else
+    {
+        error = "unknown sink type: " + spec.type;
+        return nullptr;
+    }
+
+    if (!opened)
+    {
+        error = "cannot create " + spec.path;
+        return nullptr;
+    }
+    return sink;
+}
+
+size_t CRecordDispatcher::Dispatch(RecordQueue& queue, size_t maxRecords)
+{
+    size_t dispatched = 0;
+    while (dispatched < maxRecords)
+    {
+        const AccessRecord* record = queue.Peek();
+        if (!record)
+            break;
+        for (const auto& sink : m_sinks)
+            sink->Write(*record);
+        queue.Pop();
+        dispatched++;
+    }
+    return dispatched;
+}
+
+void CRecordDispatcher::Flush()
+{
+    for (const auto& sink : m_sinks)
+        sink->Flush();
+}
+
+void CRecordDispatcher::Poll()
+{
+    for (const auto& sink : m_sinks)
+        sink->Poll();
+}
+
+void CRecordDispatcher::Drain()
+{
+    for (const auto& sink : m_sinks)
+        sink->Drain();
+}
+
+void CRecordDispatcher::Close()
+{
+    Flush();
+    m_sinks.clear();
+}
@@ -0,0 +1,101 @@
+/*
+    RecordSinks.h - Outputs of the record pipeline for MpqFileLister plugin
+
+    Every sink is given every access record, in order, on the record
+    pipeline's thread, and formats, batches and writes it to its own file.
+    Sinks are configured in MpqFileLister.ini as
+        Sink<n>=<type>,<file>[,<option>=<value>...]
+    with the types
+        text    A text log, with \r\n line breaks like the primary log.
+                format=<LogFormat, 0 to 3> (0), threadId=<0 or 1> (0)
+        binary  Records in the tools/RecordCodec.h format
+        trace   Chrome trace-event JSON, as written by the CHROME_TRACE format
+        stats   Opens, unique names and Storm time per archive and per Storm
+                function, written when the sink is closed. A name is unique
+                once per function it is opened through
+        stream  Records streamed to a local reader (see RecordStream.h); the
+                file is the stream's name. latencyMs=<ms> (50), backlogKB=<KB> (1024)
+    Text and binary sinks write their output in batches of batchKB=<KB> (64).
+    A stream sends a frame when batchKB (16) is filled or latencyMs has
+    passed, so frames grow with the rate of accesses. A reader that falls
+    behind leaves frames waiting, up to backlogKB; past that, and while no
+    reader is connected, records are dropped and counted, and the next frame
+    gives the count.
+
+    This file does not depend on the plugin, so the sink benchmark can be
+    built and run on Linux too.
+*/
+
+#ifndef RECORDSINKS_H
+#define RECORDSINKS_H
+
+#include "RecordQueue.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class IRecordSink
+{
+public:
+    virtual ~IRecordSink() = default;
+
+    virtual void Write(const AccessRecord& record) = 0;
+
+    // Write out whatever is batched
+    virtual void Flush() = 0;
+
+    // Called on every pass of the pipeline thread, with or without records
+    virtual void Poll() {}
+
+    // For a crash drain: write out whatever is batched, without allocating.
+    // Sinks that cannot do so, or that write every record as it comes, leave it.
+    virtual void Drain() {}
+};
+
+struct RecordSinkSpec
+{
+    std::string type;
+    std::string path;
+    std::vector<std::pair<std::string, std::string>> options;
+};
+
+// Parse "<type>,<file>[,<option>=<value>...]". Returns false with a message if it is malformed.
+bool ParseRecordSinkSpec(const std::string& text, RecordSinkSpec& spec, std::string& error);
+
+// Create a sink and its file. The process ID and name go into trace output.
+// Returns nullptr with a message if the type, an option or the file is bad.
+std::unique_ptr<IRecordSink> CreateRecordSink(const RecordSinkSpec& spec, uint32_t processId,
+                                              const std::string& processName, std::string& error);
+
+// Append a record as a line of a text log (without the line break), in a
+// LogFormat from Config.h (0 to 3)
+void FormatTextRecord(const AccessRecord& record, unsigned format, bool threadId, std::string& out);
+
+// Hands the records of a queue to every sink
+class CRecordDispatcher
+{
+private:
+    std::vector<std::unique_ptr<IRecordSink>> m_sinks;
+
+public:
+    void AddSink(std::unique_ptr<IRecordSink> sink) { m_sinks.push_back(std::move(sink)); }
+    size_t SinkCount() const { return m_sinks.size(); }
+
+    // Dispatch up to maxRecords committed records. Returns how many were dispatched.
+    size_t Dispatch(RecordQueue& queue, size_t maxRecords);
+
+    void Flush();
+
+    // Poll every sink
+    void Poll();
+
+    // Drain every sink, from a crash drain
+    void Drain();
+
+    // Flush and close every sink
+    void Close();
+};
+
+#endif // RECORDSINKS_H
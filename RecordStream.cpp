@@ -0,0 +1,256 @@
+/*
+    RecordStream.cpp - Local streaming of access records for MpqFileLister plugin
+*/
+
+#include "RecordStream.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Bytes the pipe buffers before writes stop taking data
+static const unsigned STREAM_PIPE_BUFFER = 64 * 1024;
+
+std::string GetRecordStreamPath(const std::string& name)
+{
+#ifdef _WIN32
+    return "\\\\.\\pipe\\" + name;
+#else
+    return "/tmp/" + name + ".sock";
+#endif
+}
+
+#ifdef _WIN32
+
+CRecordStreamServer::CRecordStreamServer()
+    : m_pipe(INVALID_HANDLE_VALUE)
+    , m_connected(false)
+{
+}
+
+bool CRecordStreamServer::Open(const std::string& name)
+{
+    Close();
+    // PIPE_NOWAIT makes both connecting and writing return at once
+    m_pipe = CreateNamedPipeA(GetRecordStreamPath(name).c_str(), PIPE_ACCESS_OUTBOUND,
+                              PIPE_TYPE_BYTE | PIPE_NOWAIT, 1, STREAM_PIPE_BUFFER, 0, 0, nullptr);
+    return m_pipe != INVALID_HANDLE_VALUE;
+}
+
+void CRecordStreamServer::Close()
+{
+    if (m_pipe != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_pipe);
+        m_pipe = INVALID_HANDLE_VALUE;
+    }
+    m_connected = false;
+}
+
+bool CRecordStreamServer::Accept()
+{
+    if (m_connected || m_pipe == INVALID_HANDLE_VALUE)
+        return m_connected;
+
+    if (ConnectNamedPipe(m_pipe, nullptr) || GetLastError() == ERROR_PIPE_CONNECTED)
+        m_connected = true;
+    else if (GetLastError() == ERROR_NO_DATA)
+        DisconnectNamedPipe(m_pipe);  // A reader came and went; listen again
+    return m_connected;
+}
+
+long CRecordStreamServer::TryWrite(const char* data, size_t size)
+{
+    if (!m_connected)
+        return -1;
+
+    DWORD written = 0;
+    if (!WriteFile(m_pipe, data, static_cast<DWORD>(size), &written, nullptr))
+    {
+        DisconnectNamedPipe(m_pipe);
+        m_connected = false;
+        return -1;
+    }
+    return static_cast<long>(written);
+}
+
+CRecordStreamClient::CRecordStreamClient()
+    : m_pipe(INVALID_HANDLE_VALUE)
+{
+}
+
+bool CRecordStreamClient::Connect(const std::string& name)
+{
+    Close();
+    m_pipe = CreateFileA(GetRecordStreamPath(name).c_str(), GENERIC_READ, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+    return m_pipe != INVALID_HANDLE_VALUE;
+}
+
+void CRecordStreamClient::Close()
+{
+    if (m_pipe != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_pipe);
+        m_pipe = INVALID_HANDLE_VALUE;
+    }
+}
+
+size_t CRecordStreamClient::Read(char* buffer, size_t size)
+{
+    DWORD read = 0;
+    if (!ReadFile(m_pipe, buffer, static_cast<DWORD>(size), &read, nullptr))
+        return 0;
+    return read;
+}
+
+#else
+
+CRecordStreamServer::CRecordStreamServer()
+    : m_listener(-1)
+    , m_client(-1)
+{
+}
+
+static bool MakeSocketAddress(const std::string& path, sockaddr_un& address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        return false;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+bool CRecordStreamServer::Open(const std::string& name)
+{
+    Close();
+
+    sockaddr_un address;
+    m_path = GetRecordStreamPath(name);
+    if (!MakeSocketAddress(m_path, address))
+        return false;
+
+    m_listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_listener < 0)
+        return false;
+
+    // A socket left behind by a process that crashed would fail the bind
+    unlink(m_path.c_str());
+    if (bind(m_listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(m_listener, 1) != 0 ||
+        fcntl(m_listener, F_SETFL, fcntl(m_listener, F_GETFL) | O_NONBLOCK) != 0)
+    {
+        Close();
+        return false;
+    }
+
+    // Keep what a slow reader has not taken yet in the socket, up to the pipe's size
+    int bufferSize = STREAM_PIPE_BUFFER;
+    setsockopt(m_listener, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+    return true;
+}
+
+void CRecordStreamServer::Close()
+{
+    if (m_client >= 0)
+        close(m_client);
+    if (m_listener >= 0)
+    {
+        close(m_listener);
+        unlink(m_path.c_str());
+    }
+    m_client = -1;
+    m_listener = -1;
+}
+
+bool CRecordStreamServer::Accept()
+{
+    if (m_client >= 0 || m_listener < 0)
+        return m_client >= 0;
+
+    m_client = accept(m_listener, nullptr, nullptr);
+    if (m_client >= 0)
+        fcntl(m_client, F_SETFL, fcntl(m_client, F_GETFL) | O_NONBLOCK);
+    return m_client >= 0;
+}
+
+long CRecordStreamServer::TryWrite(const char* data, size_t size)
+{
+    if (m_client < 0)
+        return -1;
+
+    ssize_t written = send(m_client, data, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (written >= 0)
+        return static_cast<long>(written);
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        return 0;
+
+    close(m_client);
+    m_client = -1;
+    return -1;
+}
+
+CRecordStreamClient::CRecordStreamClient()
+    : m_socket(-1)
+{
+}
+
+bool CRecordStreamClient::Connect(const std::string& name)
+{
+    Close();
+
+    sockaddr_un address;
+    if (!MakeSocketAddress(GetRecordStreamPath(name), address))
+        return false;
+
+    m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_socket < 0)
+        return false;
+    if (connect(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void CRecordStreamClient::Close()
+{
+    if (m_socket >= 0)
+        close(m_socket);
+    m_socket = -1;
+}
+
+size_t CRecordStreamClient::Read(char* buffer, size_t size)
+{
+    for (;;)
+    {
+        ssize_t read = recv(m_socket, buffer, size, 0);
+        if (read >= 0)
+            return static_cast<size_t>(read);
+        if (errno != EINTR)
+            return 0;
+    }
+}
+
+#endif
+
+bool CRecordStreamClient::ReadAll(char* buffer, size_t size)
+{
+    while (size > 0)
+    {
+        size_t read = Read(buffer, size);
+        if (read == 0)
+            return false;
+        buffer += read;
+        size -= read;
+    }
+    return true;
+}
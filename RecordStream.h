@@ -0,0 +1,92 @@
+/*
+    RecordStream.h - Local streaming of access records for MpqFileLister plugin
+
+    The stream sink sends access records to a local reader, such as a live
+    dashboard, over a named pipe on Windows (\\.\pipe\<name>) or a Unix
+    domain socket elsewhere (/tmp/<name>.sock), so the transport can be
+    exercised on Linux too. A reader that connects gets a RecordLogHeader
+    and then frames, each a RecordStreamFrame and the records it counts, in
+    the tools/RecordCodec.h format. A frame of no records carries the drops
+    since the last one, on a flush and as the stream closes. One reader is
+    served at a time.
+
+    The writer never waits for the reader: both ends of the transport are
+    used without blocking, and data the reader does not take yet is kept for
+    the next attempt (see CStreamRecordSink in RecordSinks.cpp).
+
+    This file does not depend on the plugin, so the reference reader and its
+    throughput test can be built and run on Linux too.
+*/
+
+#ifndef RECORDSTREAM_H
+#define RECORDSTREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct RecordStreamFrame
+{
+    uint32_t size;              // Bytes of records after this header
+    uint32_t records;
+    uint64_t dropped;           // Records dropped since the stream was opened, before this frame
+};
+
+// Pipe or socket path of a stream name
+std::string GetRecordStreamPath(const std::string& name);
+
+// Writer end: the plugin
+class CRecordStreamServer
+{
+private:
+#ifdef _WIN32
+    void* m_pipe;
+    bool m_connected;
+#else
+    int m_listener;
+    int m_client;
+    std::string m_path;
+#endif
+
+public:
+    CRecordStreamServer();
+    ~CRecordStreamServer() { Close(); }
+
+    // Create the pipe or socket. Returns false if it cannot be created.
+    bool Open(const std::string& name);
+    void Close();
+
+    // Take a waiting reader, if there is none yet. Returns whether one is connected.
+    bool Accept();
+
+    // Write as much of data as the reader takes now. Returns the bytes
+    // written, or -1 if the reader has gone away.
+    long TryWrite(const char* data, size_t size);
+};
+
+// Reader end: blocking reads
+class CRecordStreamClient
+{
+private:
+#ifdef _WIN32
+    void* m_pipe;
+#else
+    int m_socket;
+#endif
+
+public:
+    CRecordStreamClient();
+    ~CRecordStreamClient() { Close(); }
+
+    // Connect to a stream. Returns false if it is not open (or busy).
+    bool Connect(const std::string& name);
+    void Close();
+
+    // Read up to size bytes; returns 0 when the writer has closed the stream
+    size_t Read(char* buffer, size_t size);
+
+    // Read exactly size bytes; returns false if the stream ends first
+    bool ReadAll(char* buffer, size_t size);
+};
+
+#endif // RECORDSTREAM_H
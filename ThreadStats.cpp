@@ -0,0 +1,113 @@
+/*
+    ThreadStats.cpp - Per-thread statistics for MpqFileLister plugin
+*/
+
+#include "ThreadStats.h"
+#include "Timing.h"
+#include <iomanip>
+#include <string>
+
+// Head of the list of all counter blocks. Blocks are never freed, since the
+// report may be written after the threads that own them have exited.
+static std::atomic<ThreadStats*> s_threadStatsHead{nullptr};
+
+static ThreadStats* CreateThreadStats()
+{
+    ThreadStats* stats = new ThreadStats();
+    stats->threadId = GetCurrentThreadId();
+    stats->opens = 0;
+    stats->failures = 0;
+    stats->stormTicks = 0;
+    stats->hookTicks = 0;
+    stats->lockWaitTicks = 0;
+    stats->bytesRead = 0;
+    for (std::atomic<uint64_t>& bucket : stats->hookTimeHistogram)
+        bucket = 0;
+
+    // Lock-free push onto the global list
+    stats->next = s_threadStatsHead.load(std::memory_order_relaxed);
+    while (!s_threadStatsHead.compare_exchange_weak(stats->next, stats,
+        std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+    return stats;
+}
+
+ThreadStats& GetThreadStats()
+{
+    static thread_local ThreadStats* t_stats = nullptr;
+    if (!t_stats)
+        t_stats = CreateThreadStats();
+    return *t_stats;
+}
+
+void RecordThreadOpen(ThreadStats& stats, bool succeeded, uint64_t stormTicks, uint64_t hookTicks)
+{
+    AddToCounter(stats.opens, 1);
+    if (!succeeded)
+        AddToCounter(stats.failures, 1);
+    AddToCounter(stats.stormTicks, stormTicks);
+    AddToCounter(stats.hookTicks, hookTicks);
+    AddToCounter(stats.hookTimeHistogram[GetLiveStatsBucket(TicksToMicros(hookTicks))], 1);
+}
+
+void CollectThreadTotals(ThreadTotals& totals)
+{
+    totals = ThreadTotals();
+
+    for (ThreadStats* stats = s_threadStatsHead.load(std::memory_order_acquire); stats; stats = stats->next)
+    {
+        totals.threads++;
+        totals.opens += stats->opens.load(std::memory_order_relaxed);
+        totals.failures += stats->failures.load(std::memory_order_relaxed);
+        totals.stormTicks += stats->stormTicks.load(std::memory_order_relaxed);
+        totals.hookTicks += stats->hookTicks.load(std::memory_order_relaxed);
+        totals.lockWaitTicks += stats->lockWaitTicks.load(std::memory_order_relaxed);
+        totals.bytesRead += stats->bytesRead.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < LIVESTATS_HISTOGRAM_BUCKETS; i++)
+            totals.hookTimeHistogram[i] += stats->hookTimeHistogram[i].load(std::memory_order_relaxed);
+    }
+}
+
+static void PrintRow(std::ostream& out, const char* label, uint64_t opens, uint64_t totalOpens,
+                     uint64_t failures, uint64_t stormTicks, uint64_t hookTicks, uint64_t lockWaitTicks)
+{
+    unsigned share = totalOpens ? static_cast<unsigned>(opens * 100 / totalOpens) : 0;
+    out << std::left << std::setw(10) << label << std::right
+        << std::setw(12) << opens
+        << std::setw(7) << share << "%"
+        << std::setw(12) << failures
+        << std::setw(14) << FormatTicksAsMs(stormTicks)
+        << std::setw(14) << FormatTicksAsMs(hookTicks)
+        << std::setw(14) << FormatTicksAsMs(lockWaitTicks)
+        << "\n";
+}
+
+void WriteThreadStatsReport(std::ostream& out)
+{
+    ThreadTotals totals;
+    CollectThreadTotals(totals);
+
+    out << "Threads: " << totals.threads << "\n\n";
+    out << std::left << std::setw(10) << "Thread" << std::right
+        << std::setw(12) << "Opens"
+        << std::setw(8) << "Share"
+        << std::setw(12) << "Failures"
+        << std::setw(14) << "Storm ms"
+        << std::setw(14) << "Hook ms"
+        << std::setw(14) << "Lock wait ms"
+        << "\n";
+
+    for (ThreadStats* stats = s_threadStatsHead.load(std::memory_order_acquire); stats; stats = stats->next)
+    {
+        PrintRow(out, std::to_string(stats->threadId).c_str(),
+                 stats->opens.load(std::memory_order_relaxed), totals.opens,
+                 stats->failures.load(std::memory_order_relaxed),
+                 stats->stormTicks.load(std::memory_order_relaxed),
+                 stats->hookTicks.load(std::memory_order_relaxed),
+                 stats->lockWaitTicks.load(std::memory_order_relaxed));
+    }
+
+    PrintRow(out, "Total", totals.opens, totals.opens, totals.failures,
+             totals.stormTicks, totals.hookTicks, totals.lockWaitTicks);
+}
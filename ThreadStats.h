@@ -0,0 +1,66 @@
+/*
+    ThreadStats.h - Per-thread statistics for MpqFileLister plugin
+
+    Each thread that calls a hooked Storm function gets its own counter block,
+    allocated on first use and padded to a cache line, so threads never write
+    to shared memory when updating their counters. The blocks are linked into
+    a global list that is only walked when the statistics are reported.
+*/
+
+#ifndef THREADSTATS_H
+#define THREADSTATS_H
+
+#include <windows.h>
+#include "LiveStats.h"
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+struct alignas(64) ThreadStats
+{
+    DWORD threadId;
+
+    // Only ever written by the owning thread; atomics so the report can read them safely
+    std::atomic<uint64_t> opens;          // Calls to SFileOpenFile/SFileOpenFileEx
+    std::atomic<uint64_t> failures;       // Calls where Storm did not find the file
+    std::atomic<uint64_t> stormTicks;     // Time spent inside the original Storm functions
+    std::atomic<uint64_t> hookTicks;      // Time spent in the hooks, excluding Storm
+    std::atomic<uint64_t> lockWaitTicks;  // Part of hookTicks spent waiting for the log lock
+    std::atomic<uint64_t> bytesRead;      // Bytes returned by SFileReadFile (when hooked)
+    std::atomic<uint64_t> hookTimeHistogram[LIVESTATS_HISTOGRAM_BUCKETS];
+
+    ThreadStats* next;
+};
+
+// Sums of the counters over all threads
+struct ThreadTotals
+{
+    unsigned threads;
+    uint64_t opens;
+    uint64_t failures;
+    uint64_t stormTicks;
+    uint64_t hookTicks;
+    uint64_t lockWaitTicks;
+    uint64_t bytesRead;
+    uint64_t hookTimeHistogram[LIVESTATS_HISTOGRAM_BUCKETS];
+};
+
+// Get the calling thread's counter block, creating it on first use
+ThreadStats& GetThreadStats();
+
+// Add to a counter owned by the calling thread (no locked instruction needed)
+inline void AddToCounter(std::atomic<uint64_t>& counter, uint64_t value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// Record one call to a hooked open function on the calling thread
+void RecordThreadOpen(ThreadStats& stats, bool succeeded, uint64_t stormTicks, uint64_t hookTicks);
+
+// Sum the counters of all threads seen so far
+void CollectThreadTotals(ThreadTotals& totals);
+
+// Write per-thread and aggregated statistics for all threads seen so far
+void WriteThreadStatsReport(std::ostream& out);
+
+#endif // THREADSTATS_H
@@ -0,0 +1,41 @@
+/*
+    Timing.cpp - High-resolution timing helpers for MpqFileLister plugin
+*/
+
+#include "Timing.h"
+#include <windows.h>
+
+static uint64_t GetTickFrequency()
+{
+    static const uint64_t frequency = []()
+    {
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        return static_cast<uint64_t>(freq.QuadPart);
+    }();
+    return frequency;
+}
+
+uint64_t GetTicks()
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return static_cast<uint64_t>(counter.QuadPart);
+}
+
+uint64_t TicksToMicros(uint64_t ticks)
+{
+    uint64_t frequency = GetTickFrequency();
+    if (frequency == 0)
+        return 0;
+
+    // Split the division to avoid overflowing ticks * 1000000 on long sessions
+    return (ticks / frequency) * 1000000 + (ticks % frequency) * 1000000 / frequency;
+}
+
+std::string FormatTicksAsMs(uint64_t ticks)
+{
+    uint64_t micros = TicksToMicros(ticks);
+    std::string fraction = std::to_string(micros % 1000);
+    return std::to_string(micros / 1000) + "." + std::string(3 - fraction.size(), '0') + fraction;
+}
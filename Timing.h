@@ -0,0 +1,20 @@
+/*
+    Timing.h - High-resolution timing helpers for MpqFileLister plugin
+*/
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <cstdint>
+#include <string>
+
+// Current value of the high-resolution performance counter, in ticks
+uint64_t GetTicks();
+
+// Convert a tick count (or a difference between two tick counts) to microseconds
+uint64_t TicksToMicros(uint64_t ticks);
+
+// Format a tick count as milliseconds with microsecond precision, e.g. "12.345"
+std::string FormatTicksAsMs(uint64_t ticks);
+
+#endif // TIMING_H
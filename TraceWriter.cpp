@@ -0,0 +1,174 @@
+/*
+    TraceWriter.cpp - Chrome trace-event JSON output for MpqFileLister plugin
+*/
+
+#include "TraceWriter.h"
+
+// Bytes at the end of the file that close the JSON array. These are
+// overwritten by the next event.
+static const char TRACE_TAIL[] = "\n]";
+static constexpr std::streamoff TRACE_TAIL_LENGTH = sizeof(TRACE_TAIL) - 1;
+
+CTraceWriter::CTraceWriter()
+    : m_length(0)
+    , m_truncated(false)
+    , m_hasEvents(false)
+    , m_processId(0)
+{
+}
+
+void CTraceWriter::AppendChar(char c)
+{
+    // Keep room for the array tail so a truncated event still closes properly
+    if (m_length + TRACE_TAIL_LENGTH + 1 >= BUFFER_SIZE)
+    {
+        m_truncated = true;
+        return;
+    }
+    m_buffer[m_length++] = c;
+}
+
+void CTraceWriter::Append(const char* text)
+{
+    while (*text)
+        AppendChar(*text++);
+}
+
+void CTraceWriter::AppendEscaped(const char* text)
+{
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+
+    for (; *text; text++)
+    {
+        unsigned char c = static_cast<unsigned char>(*text);
+        switch (c)
+        {
+            case '"':  Append("\\\""); break;
+            case '\\': Append("\\\\"); break;
+            case '\n': Append("\\n"); break;
+            case '\r': Append("\\r"); break;
+            case '\t': Append("\\t"); break;
+            default:
+                if (c < 0x20 || c >= 0x80)
+                {
+                    // Storm file names are in the ANSI code page; escape anything
+                    // that is not plain ASCII so the output is always valid UTF-8
+                    Append("\\u00");
+                    AppendChar(HEX_DIGITS[c >> 4]);
+                    AppendChar(HEX_DIGITS[c & 0xF]);
+                }
+                else
+                {
+                    AppendChar(static_cast<char>(c));
+                }
+                break;
+        }
+    }
+}
+
+void CTraceWriter::AppendUInt(uint64_t value)
+{
+    char digits[20];
+    int count = 0;
+    do
+    {
+        digits[count++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    while (count > 0)
+        AppendChar(digits[--count]);
+}
+
+void CTraceWriter::BeginEvent()
+{
+    m_length = 0;
+    m_truncated = false;
+    Append(m_hasEvents ? ",\n" : "[\n");
+}
+
+void CTraceWriter::EndEvent(std::ostream& out)
+{
+    // A truncated event is not valid JSON - drop it rather than corrupt the file
+    if (m_truncated)
+        return;
+
+    for (const char* tail = TRACE_TAIL; *tail; tail++)
+        m_buffer[m_length++] = *tail;
+
+    if (m_hasEvents)
+        out.seekp(-TRACE_TAIL_LENGTH, std::ios::cur);
+
+    out.write(m_buffer, static_cast<std::streamsize>(m_length));
+    out.flush();
+    m_hasEvents = true;
+}
+
+void CTraceWriter::Begin(std::ostream& out, unsigned long processId, const char* processName)
+{
+    m_processId = processId;
+    m_hasEvents = false;
+
+    BeginEvent();
+    Append("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":");
+    AppendUInt(m_processId);
+    Append(",\"tid\":0,\"args\":{\"name\":\"");
+    AppendEscaped(processName ? processName : "");
+    Append("\"}}");
+    EndEvent(out);
+}
+
+void CTraceWriter::WriteCompleteEvent(
+    std::ostream& out,
+    const char* name,
+    const char* category,
+    uint64_t startMicros,
+    uint64_t durationMicros,
+    unsigned long threadId,
+    const char* archiveName,
+    const char* fileName)
+{
+    BeginEvent();
+    Append("{\"name\":\"");
+    AppendEscaped(name);
+    Append("\",\"cat\":\"");
+    AppendEscaped(category);
+    Append("\",\"ph\":\"X\",\"ts\":");
+    AppendUInt(startMicros);
+    Append(",\"dur\":");
+    AppendUInt(durationMicros);
+    Append(",\"pid\":");
+    AppendUInt(m_processId);
+    Append(",\"tid\":");
+    AppendUInt(threadId);
+    Append(",\"args\":{");
+    if (archiveName && archiveName[0])
+    {
+        Append("\"archive\":\"");
+        AppendEscaped(archiveName);
+        Append("\",");
+    }
+    Append("\"file\":\"");
+    AppendEscaped(fileName);
+    Append("\"}}");
+    EndEvent(out);
+}
+
+void CTraceWriter::WriteInstantEvent(
+    std::ostream& out,
+    const char* name,
+    uint64_t timestampMicros,
+    unsigned long threadId)
+{
+    BeginEvent();
+    Append("{\"name\":\"");
+    AppendEscaped(name);
+    Append("\",\"ph\":\"i\",\"s\":\"g\",\"ts\":");
+    AppendUInt(timestampMicros);
+    Append(",\"pid\":");
+    AppendUInt(m_processId);
+    Append(",\"tid\":");
+    AppendUInt(threadId);
+    Append("}");
+    EndEvent(out);
+}
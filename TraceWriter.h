@@ -0,0 +1,67 @@
+/*
+    TraceWriter.h - Chrome trace-event JSON output for MpqFileLister plugin
+
+    Writes events in the Chrome trace-event "JSON Array Format", which can be
+    loaded in Perfetto (ui.perfetto.dev) or chrome://tracing. Every event is
+    formatted into a fixed buffer and written with a single call. The closing
+    bracket is rewritten after each event, so the file is valid JSON at all
+    times, even if the game exits without shutting the plugin down.
+*/
+
+#ifndef TRACEWRITER_H
+#define TRACEWRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+class CTraceWriter
+{
+private:
+    // Large enough for two escaped MAX_PATH strings plus the event framing
+    static constexpr size_t BUFFER_SIZE = 4096;
+
+    char m_buffer[BUFFER_SIZE];
+    size_t m_length;
+    bool m_truncated;
+    bool m_hasEvents;
+    unsigned long m_processId;
+
+    void Append(const char* text);
+    void AppendChar(char c);
+    void AppendEscaped(const char* text);
+    void AppendUInt(uint64_t value);
+
+    // Start a new event in the buffer, continuing the JSON array
+    void BeginEvent();
+    // Terminate the array after the event and write the buffer out
+    void EndEvent(std::ostream& out);
+
+public:
+    CTraceWriter();
+
+    // Write the array opening and a process name metadata event
+    void Begin(std::ostream& out, unsigned long processId, const char* processName);
+
+    // Write a complete ("X") event with a start time and a duration
+    void WriteCompleteEvent(
+        std::ostream& out,
+        const char* name,
+        const char* category,
+        uint64_t startMicros,
+        uint64_t durationMicros,
+        unsigned long threadId,
+        const char* archiveName,
+        const char* fileName
+    );
+
+    // Write an instant ("i") event, e.g. for errors
+    void WriteInstantEvent(
+        std::ostream& out,
+        const char* name,
+        uint64_t timestampMicros,
+        unsigned long threadId
+    );
+};
+
+#endif // TRACEWRITER_H
@@ -0,0 +1,93 @@
+/*
+    AccessOrder.cpp - The order in which a game first opens its files
+*/
+
+#include "AccessOrder.h"
+#include "LogParser.h"
+#include "StormName.h"
+#include "StringTable.h"
+#include <algorithm>
+#include <unordered_map>
+
+std::vector<std::string> GetFirstAccessOrder(const char* data, size_t size)
+{
+    struct Access
+    {
+        uint64_t timestamp;
+        std::string name;
+    };
+
+    StringTable seen;
+    std::vector<Access> accesses;
+    bool allTimestamped = true;
+    bool anyTrace = false;
+    std::string key;
+
+    ForEachLogRecord(data, size, [&](const LogRecord& record)
+    {
+        key = NormalizeStormName(record.fileName);
+        if (!seen.Insert(key, HashBytes(key)).second)
+            return;
+
+        std::string name(record.fileName);
+        std::replace(name.begin(), name.end(), '/', '\\');
+        accesses.push_back(Access{record.timestampMicros, std::move(name)});
+        allTimestamped = allTimestamped && record.hasTimestamp;
+        anyTrace = anyTrace || record.hasDuration;
+    });
+
+    // Text logs are written in order; trace events are written when the
+    // open completes, so overlapping opens can be out of order
+    if (anyTrace && allTimestamped)
+    {
+        std::stable_sort(accesses.begin(), accesses.end(),
+            [](const Access& a, const Access& b) { return a.timestamp < b.timestamp; });
+    }
+
+    std::vector<std::string> order;
+    order.reserve(accesses.size());
+    for (Access& access : accesses)
+        order.push_back(std::move(access.name));
+    return order;
+}
+
+std::vector<std::string> GetConsensusOrder(const std::vector<std::vector<std::string>>& orders)
+{
+    struct Position
+    {
+        double sum = 0;
+        unsigned count = 0;
+        std::string spelling;
+    };
+
+    std::unordered_map<std::string, Position> positions;
+    for (const auto& order : orders)
+    {
+        // Relative position, so long and short sessions weigh the same
+        double scale = order.size() > 1 ? 1.0 / static_cast<double>(order.size() - 1) : 0.0;
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            Position& position = positions[NormalizeStormName(order[i])];
+            position.sum += static_cast<double>(i) * scale;
+            if (position.count++ == 0 || order[i] < position.spelling)
+                position.spelling = order[i];
+        }
+    }
+
+    std::vector<std::pair<double, const Position*>> sorted;
+    sorted.reserve(positions.size());
+    for (const auto& entry : positions)
+        sorted.emplace_back(entry.second.sum / entry.second.count, &entry.second);
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b)
+    {
+        if (a.first != b.first)
+            return a.first < b.first;
+        return a.second->spelling < b.second->spelling;
+    });
+
+    std::vector<std::string> consensus;
+    consensus.reserve(sorted.size());
+    for (const auto& entry : sorted)
+        consensus.push_back(entry.second->spelling);
+    return consensus;
+}
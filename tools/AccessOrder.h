@@ -0,0 +1,25 @@
+/*
+    AccessOrder.h - The order in which a game first opens its files
+
+    A log lists opens in the order they happened (trace events are sorted
+    by their timestamps). The first-access order of several logs - several
+    sessions - is combined into a consensus order by the mean relative
+    position of each name across the logs that contain it.
+*/
+
+#ifndef ACCESSORDER_H
+#define ACCESSORDER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Names of one log, in the order they were first opened. Names are
+// deduplicated the way Storm compares them and spelled with '\'.
+std::vector<std::string> GetFirstAccessOrder(const char* data, size_t size);
+
+// Consensus of several first-access orders. A name early in most sessions
+// comes early; names in only some sessions are placed by those sessions.
+std::vector<std::string> GetConsensusOrder(const std::vector<std::vector<std::string>>& orders);
+
+#endif // ACCESSORDER_H
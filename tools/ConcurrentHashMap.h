@@ -0,0 +1,73 @@
+/*
+    ConcurrentHashMap.h - Sharded hash map for the MpqFileLister tools
+
+    Keys are spread over a fixed number of shards by hash, each with its own
+    mutex, so threads inserting different keys rarely contend. Meant for bulk
+    merging of per-thread results, not for fine-grained shared state.
+*/
+
+#ifndef CONCURRENTHASHMAP_H
+#define CONCURRENTHASHMAP_H
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class ConcurrentHashMap
+{
+private:
+    static constexpr size_t SHARD_COUNT = 64;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<Key, Value, Hash> map;
+    };
+
+    std::array<Shard, SHARD_COUNT> m_shards;
+
+    Shard& ShardFor(const Key& key)
+    {
+        // Mix the hash so maps whose own buckets use the low bits still spread well
+        size_t hash = Hash()(key);
+        return m_shards[(hash ^ (hash >> 17)) % SHARD_COUNT];
+    }
+
+public:
+    // Insert key with value, or, if key is present, call combine(existing, value)
+    template <typename Combine>
+    void Merge(Key key, Value value, Combine&& combine)
+    {
+        Shard& shard = ShardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end())
+            shard.map.emplace(std::move(key), std::move(value));
+        else
+            combine(it->second, std::move(value));
+    }
+
+    // Number of entries. Not synchronized with concurrent inserts.
+    size_t Size() const
+    {
+        size_t size = 0;
+        for (const Shard& shard : m_shards)
+            size += shard.map.size();
+        return size;
+    }
+
+    // Call fn(key, value) for every entry. Not synchronized with concurrent inserts.
+    template <typename Fn>
+    void ForEach(Fn&& fn) const
+    {
+        for (const Shard& shard : m_shards)
+            for (const auto& entry : shard.map)
+                fn(entry.first, entry.second);
+    }
+};
+
+#endif // CONCURRENTHASHMAP_H
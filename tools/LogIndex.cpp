@@ -0,0 +1,207 @@
+/*
+    LogIndex.cpp - On-disk index of the file accesses in many logs
+*/
+
+#include "LogIndex.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+void EncodePostings(const LogIndexRecord* records, size_t count, std::string& out)
+{
+    // Sessions count from -1, so the first delta is never 0
+    uint32_t session = UINT32_MAX;
+    uint64_t timestamp = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const LogIndexRecord& record = records[i];
+        if (record.session != session)
+        {
+            AppendVarint(out, static_cast<uint32_t>(record.session - session));
+            AppendVarint(out, record.timestamp);
+        }
+        else
+        {
+            AppendVarint(out, 0);
+            AppendVarint(out, record.timestamp - timestamp);
+        }
+        session = record.session;
+        timestamp = record.timestamp;
+    }
+}
+
+void EncodeTimeBlock(const LogIndexRecord* records, size_t count, std::string& out)
+{
+    uint64_t timestamp = count > 0 ? records[0].timestamp : 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        AppendVarint(out, records[i].timestamp - timestamp);
+        AppendVarint(out, records[i].name);
+        AppendVarint(out, records[i].session);
+        timestamp = records[i].timestamp;
+    }
+}
+
+bool WriteLogIndex(const std::string& path, const LogIndexContents& contents)
+{
+    // Strings: session paths, then each name's key and spelling
+    std::string strings;
+    std::vector<LogIndexSession> sessions = contents.sessions;
+    for (size_t i = 0; i < sessions.size(); i++)
+    {
+        sessions[i].pathOffset = static_cast<uint32_t>(strings.size());
+        sessions[i].pathLength = static_cast<uint32_t>(contents.sessionPaths[i].size());
+        strings += contents.sessionPaths[i];
+    }
+
+    std::vector<LogIndexName> names(contents.keys.size());
+    uint64_t postingsSize = 0;
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        LogIndexName& name = names[i];
+        name.keyOffset = static_cast<uint32_t>(strings.size());
+        name.keyLength = static_cast<uint32_t>(contents.keys[i].size());
+        strings += contents.keys[i];
+        name.spellingOffset = static_cast<uint32_t>(strings.size());
+        name.spellingLength = static_cast<uint32_t>(contents.spellings[i].size());
+        strings += contents.spellings[i];
+        name.postingsOffset = postingsSize;
+        name.postingCount = contents.postingCounts[i];
+        name.postingBytes = static_cast<uint32_t>(contents.postings[i].size());
+        postingsSize += contents.postings[i].size();
+    }
+
+    LogIndexHeader header = {};
+    memcpy(header.magic, LOGINDEX_MAGIC, sizeof(header.magic));
+    header.version = LOGINDEX_VERSION;
+    header.sessionCount = static_cast<uint32_t>(sessions.size());
+    header.nameCount = static_cast<uint32_t>(names.size());
+    header.recordCount = contents.recordCount;
+    header.sessionsOffset = sizeof(header);
+    header.namesOffset = header.sessionsOffset + sessions.size() * sizeof(LogIndexSession);
+    header.stringsOffset = header.namesOffset + names.size() * sizeof(LogIndexName);
+    header.stringsSize = strings.size();
+    // Keep the tables after the strings aligned for the reader
+    header.timeBlocksOffset = (header.stringsOffset + header.stringsSize + 7) & ~uint64_t(7);
+    header.timeBlockCount = contents.timeBlocks.size();
+    header.postingsOffset = header.timeBlocksOffset + contents.timeBlocks.size() * sizeof(LogIndexTimeBlock);
+    header.postingsSize = postingsSize;
+    header.timeDataOffset = header.postingsOffset + postingsSize;
+    header.timeDataSize = contents.timeData.size();
+
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out)
+        return false;
+
+    static const char padding[8] = {};
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(sessions.data(), sizeof(LogIndexSession), sessions.size(), out);
+    fwrite(names.data(), sizeof(LogIndexName), names.size(), out);
+    fwrite(strings.data(), 1, strings.size(), out);
+    fwrite(padding, 1, header.timeBlocksOffset - header.stringsOffset - header.stringsSize, out);
+    fwrite(contents.timeBlocks.data(), sizeof(LogIndexTimeBlock), contents.timeBlocks.size(), out);
+    for (const std::string& postings : contents.postings)
+        fwrite(postings.data(), 1, postings.size(), out);
+    fwrite(contents.timeData.data(), 1, contents.timeData.size(), out);
+
+    bool ok = ferror(out) == 0;
+    if (fclose(out) != 0)
+        ok = false;
+    if (!ok && errno == 0)
+        errno = EIO;
+    return ok;
+}
+
+LogIndexReader::LogIndexReader()
+    : m_header(nullptr)
+    , m_sessions(nullptr)
+    , m_names(nullptr)
+    , m_strings(nullptr)
+    , m_postings(nullptr)
+    , m_timeBlocks(nullptr)
+    , m_timeData(nullptr)
+{
+}
+
+bool LogIndexReader::Open(const std::string& path)
+{
+    if (!m_file.Open(path, false))
+    {
+        m_error = strerror(errno);
+        return false;
+    }
+
+    size_t size = m_file.Size();
+    const char* data = m_file.Data();
+    const LogIndexHeader* header = reinterpret_cast<const LogIndexHeader*>(data);
+    if (size < sizeof(LogIndexHeader) || memcmp(header->magic, LOGINDEX_MAGIC, sizeof(header->magic)) != 0)
+    {
+        m_error = "not a log index";
+        return false;
+    }
+    if (header->version != LOGINDEX_VERSION)
+    {
+        m_error = "unsupported index version " + std::to_string(header->version);
+        return false;
+    }
+
+    // Every section must lie inside the file
+    auto fits = [size](uint64_t offset, uint64_t count, uint64_t entrySize)
+    {
+        return offset <= size && count <= (size - offset) / entrySize;
+    };
+    if (!fits(header->sessionsOffset, header->sessionCount, sizeof(LogIndexSession)) ||
+        !fits(header->namesOffset, header->nameCount, sizeof(LogIndexName)) ||
+        !fits(header->stringsOffset, header->stringsSize, 1) ||
+        !fits(header->postingsOffset, header->postingsSize, 1) ||
+        !fits(header->timeBlocksOffset, header->timeBlockCount, sizeof(LogIndexTimeBlock)) ||
+        !fits(header->timeDataOffset, header->timeDataSize, 1) ||
+        header->timeBlockCount != (header->recordCount + LOGINDEX_TIME_BLOCK_SIZE - 1) / LOGINDEX_TIME_BLOCK_SIZE)
+    {
+        m_error = "index is truncated or damaged";
+        return false;
+    }
+
+    m_header = header;
+    m_sessions = reinterpret_cast<const LogIndexSession*>(data + header->sessionsOffset);
+    m_names = reinterpret_cast<const LogIndexName*>(data + header->namesOffset);
+    m_strings = data + header->stringsOffset;
+    m_postings = data + header->postingsOffset;
+    m_timeBlocks = reinterpret_cast<const LogIndexTimeBlock*>(data + header->timeBlocksOffset);
+    m_timeData = data + header->timeDataOffset;
+    return true;
+}
+
+std::pair<uint32_t, uint32_t> LogIndexReader::FindPrefix(std::string_view normalizedPrefix) const
+{
+    uint32_t low = 0;
+    uint32_t high = NameCount();
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+        if (NameKey(mid) < normalizedPrefix)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    uint32_t first = low;
+
+    high = NameCount();
+    while (low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+        if (NameKey(mid).substr(0, normalizedPrefix.size()) == normalizedPrefix)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return {first, low};
+}
+
+uint32_t LogIndexReader::FindName(std::string_view normalizedName) const
+{
+    auto range = FindPrefix(normalizedName);
+    if (range.first < range.second && NameKey(range.first) == normalizedName)
+        return range.first;
+    return UINT32_MAX;
+}
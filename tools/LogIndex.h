@@ -0,0 +1,274 @@
+/*
+    LogIndex.h - On-disk index of the file accesses in many logs
+
+    The index holds, for a set of logs (sessions):
+        - a dictionary of every name, sorted by its normalized form, so a
+          name or a prefix is found by binary search
+        - per name, a posting list of (session, timestamp) pairs sorted by
+          session and time, as LEB128 varints: the session delta (from -1,
+          so a new session is never 0), then the timestamp, absolute in a
+          new session and a delta from the previous one otherwise
+        - every access again sorted by time, in blocks of a fixed number of
+          entries with a table of each block's first timestamp, so a time
+          range is found by binary search and decoded a block at a time
+
+    Timestamps are in microseconds: epoch time for text logs, session time
+    for trace logs. Accesses from logs without timestamps are stored at 0.
+
+    The reader maps the index and touches only the pages a query needs.
+*/
+
+#ifndef LOGINDEX_H
+#define LOGINDEX_H
+
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+static const char LOGINDEX_MAGIC[4] = { 'M', 'Q', 'I', 'X' };
+static const uint32_t LOGINDEX_VERSION = 1;
+
+// Accesses per block of the time-sorted section
+static const uint32_t LOGINDEX_TIME_BLOCK_SIZE = 4096;
+
+struct LogIndexHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t sessionCount;
+    uint32_t nameCount;
+    uint64_t recordCount;
+    uint64_t sessionsOffset;        // LogIndexSession[sessionCount]
+    uint64_t namesOffset;           // LogIndexName[nameCount]
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+    uint64_t postingsOffset;
+    uint64_t postingsSize;
+    uint64_t timeBlocksOffset;      // LogIndexTimeBlock[timeBlockCount]
+    uint64_t timeBlockCount;
+    uint64_t timeDataOffset;
+    uint64_t timeDataSize;
+};
+
+struct LogIndexSession
+{
+    uint32_t pathOffset;            // Into the strings section
+    uint32_t pathLength;
+    uint64_t recordCount;
+    uint64_t firstTimestamp;
+    uint64_t lastTimestamp;
+};
+
+struct LogIndexName
+{
+    uint32_t keyOffset;             // Normalized name, into the strings section
+    uint32_t keyLength;
+    uint32_t spellingOffset;        // As first logged, with '\' separators
+    uint32_t spellingLength;
+    uint64_t postingsOffset;        // Into the postings section
+    uint32_t postingCount;
+    uint32_t postingBytes;
+};
+
+struct LogIndexTimeBlock
+{
+    uint64_t firstTimestamp;
+    uint64_t dataOffset;            // Into the time data section
+};
+
+// One access, as the index stores it
+struct LogIndexRecord
+{
+    uint32_t name;
+    uint32_t session;
+    uint64_t timestamp;
+};
+
+inline void AppendVarint(std::string& out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+// Decode a varint at data; returns the position after it, or nullptr if it runs past end
+inline const char* ReadVarint(const char* data, const char* end, uint64_t& value)
+{
+    value = 0;
+    for (unsigned shift = 0; data < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = static_cast<uint8_t>(*data++);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return data;
+    }
+    return nullptr;
+}
+
+// Everything an index is written from. Names must be sorted by key.
+struct LogIndexContents
+{
+    std::vector<std::string> sessionPaths;
+    std::vector<std::string> keys;
+    std::vector<std::string> spellings;
+    std::vector<std::string> postings;              // Encoded posting list per name
+    std::vector<uint32_t> postingCounts;
+    std::vector<LogIndexSession> sessions;          // recordCount and timestamps filled in
+    std::vector<LogIndexTimeBlock> timeBlocks;      // dataOffset relative to timeData
+    std::string timeData;
+    uint64_t recordCount = 0;
+};
+
+// Encode the posting list of one name; records must be sorted by session and time
+void EncodePostings(const LogIndexRecord* records, size_t count, std::string& out);
+
+// Encode one block of the time-sorted section; records must be sorted by time
+void EncodeTimeBlock(const LogIndexRecord* records, size_t count, std::string& out);
+
+// Write an index. On failure, returns false with errno set.
+bool WriteLogIndex(const std::string& path, const LogIndexContents& contents);
+
+class LogIndexReader
+{
+private:
+    MappedFile m_file;
+    const LogIndexHeader* m_header;
+    const LogIndexSession* m_sessions;
+    const LogIndexName* m_names;
+    const char* m_strings;
+    const char* m_postings;
+    const LogIndexTimeBlock* m_timeBlocks;
+    const char* m_timeData;
+    std::string m_error;
+
+    std::string_view GetString(uint32_t offset, uint32_t length) const
+    {
+        if (uint64_t(offset) + length > m_header->stringsSize)
+            return std::string_view();
+        return std::string_view(m_strings + offset, length);
+    }
+
+public:
+    LogIndexReader();
+
+    // Open an index. On failure, returns false and Error() says why.
+    bool Open(const std::string& path);
+
+    const std::string& Error() const { return m_error; }
+
+    uint32_t SessionCount() const { return m_header->sessionCount; }
+    uint32_t NameCount() const { return m_header->nameCount; }
+    uint64_t RecordCount() const { return m_header->recordCount; }
+
+    const LogIndexSession& Session(uint32_t index) const { return m_sessions[index]; }
+    std::string_view SessionPath(uint32_t index) const
+    {
+        return GetString(m_sessions[index].pathOffset, m_sessions[index].pathLength);
+    }
+    std::string_view NameKey(uint32_t index) const
+    {
+        return GetString(m_names[index].keyOffset, m_names[index].keyLength);
+    }
+    std::string_view NameSpelling(uint32_t index) const
+    {
+        return GetString(m_names[index].spellingOffset, m_names[index].spellingLength);
+    }
+    uint32_t PostingCount(uint32_t index) const { return m_names[index].postingCount; }
+
+    // Range [first, last) of the names whose normalized form starts with prefix
+    // (an exact name is a prefix whose range is checked for an equal key)
+    std::pair<uint32_t, uint32_t> FindPrefix(std::string_view normalizedPrefix) const;
+
+    // Index of a name, or UINT32_MAX if no log has it
+    uint32_t FindName(std::string_view normalizedName) const;
+
+    // Call fn(const LogIndexRecord&) for every access of a name
+    template <typename Fn>
+    bool ForEachPosting(uint32_t name, Fn&& fn) const
+    {
+        const LogIndexName& entry = m_names[name];
+        if (entry.postingsOffset > m_header->postingsSize ||
+            entry.postingBytes > m_header->postingsSize - entry.postingsOffset)
+            return false;
+
+        const char* data = m_postings + entry.postingsOffset;
+        const char* end = data + entry.postingBytes;
+        LogIndexRecord record = { name, UINT32_MAX, 0 };
+        for (uint32_t i = 0; i < entry.postingCount; i++)
+        {
+            uint64_t sessionDelta;
+            uint64_t time;
+            if (!(data = ReadVarint(data, end, sessionDelta)) || !(data = ReadVarint(data, end, time)))
+                return false;
+            if (sessionDelta > 0)
+            {
+                record.session += static_cast<uint32_t>(sessionDelta);
+                if (record.session >= SessionCount())
+                    return false;
+                record.timestamp = time;
+            }
+            else
+            {
+                record.timestamp += time;
+            }
+            fn(static_cast<const LogIndexRecord&>(record));
+        }
+        return true;
+    }
+
+    // Call fn(const LogIndexRecord&) for every access in [from, to], in time order
+    template <typename Fn>
+    bool ForEachInTimeRange(uint64_t from, uint64_t to, Fn&& fn) const
+    {
+        uint64_t blocks = m_header->timeBlockCount;
+
+        // The last block that starts at or before from; earlier ones end before it
+        uint64_t low = 0;
+        uint64_t high = blocks;
+        while (low < high)
+        {
+            uint64_t mid = low + (high - low) / 2;
+            if (m_timeBlocks[mid].firstTimestamp <= from)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        uint64_t block = low > 0 ? low - 1 : 0;
+
+        for (; block < blocks && m_timeBlocks[block].firstTimestamp <= to; block++)
+        {
+            const char* data = m_timeData + m_timeBlocks[block].dataOffset;
+            const char* end = block + 1 < blocks ? m_timeData + m_timeBlocks[block + 1].dataOffset
+                                                 : m_timeData + m_header->timeDataSize;
+            uint64_t entries = std::min<uint64_t>(LOGINDEX_TIME_BLOCK_SIZE,
+                                                  m_header->recordCount - block * LOGINDEX_TIME_BLOCK_SIZE);
+            LogIndexRecord record = { 0, 0, m_timeBlocks[block].firstTimestamp };
+            for (uint64_t i = 0; i < entries; i++)
+            {
+                uint64_t delta;
+                uint64_t name;
+                uint64_t session;
+                if (!(data = ReadVarint(data, end, delta)) || !(data = ReadVarint(data, end, name)) ||
+                    !(data = ReadVarint(data, end, session)) || name >= NameCount() || session >= SessionCount())
+                    return false;
+                record.timestamp += delta;
+                if (record.timestamp > to)
+                    return true;
+                record.name = static_cast<uint32_t>(name);
+                record.session = static_cast<uint32_t>(session);
+                if (record.timestamp >= from)
+                    fn(static_cast<const LogIndexRecord&>(record));
+            }
+        }
+        return true;
+    }
+};
+
+#endif // LOGINDEX_H
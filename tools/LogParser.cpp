@@ -0,0 +1,226 @@
+/*
+    LogParser.cpp - Parser for MpqFileLister logs in every LogFormat
+*/
+
+#include "LogParser.h"
+#include <algorithm>
+#include <iterator>
+
+// Epoch milliseconds have 13 digits until the year 2286; anything this long
+// at the start of a line is a timestamp rather than part of a file name
+static constexpr size_t MIN_TIMESTAMP_DIGITS = 12;
+
+static bool IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Parse a run of digits at the start of text; returns the number of digits consumed
+static size_t ParseUInt(std::string_view text, uint64_t& value)
+{
+    size_t i = 0;
+    value = 0;
+    while (i < text.size() && IsDigit(text[i]))
+        value = value * 10 + static_cast<uint64_t>(text[i++] - '0');
+    return i;
+}
+
+bool LogLineParser::Parse(std::string_view line, LogRecord& record)
+{
+    // Logs written in text mode on Windows end lines with CR LF
+    if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+    if (line.empty())
+        return false;
+
+    record = LogRecord();
+
+    if (line[0] == '{' || line[0] == ',')
+        return ParseTraceLine(line, record);
+    if (line[0] == '[' && line.size() == 1)
+        return false;  // Opening bracket of a trace
+    if (line[0] == ']')
+        return false;  // Closing bracket of a trace
+    return ParseTextLine(line, record);
+}
+
+bool LogLineParser::ParseTextLine(std::string_view line, LogRecord& record)
+{
+    // Optional timestamp
+    uint64_t value;
+    size_t digits = ParseUInt(line, value);
+    if (digits >= MIN_TIMESTAMP_DIGITS && digits < line.size() && line[digits] == ' ')
+    {
+        record.timestampMicros = value * 1000;
+        record.hasTimestamp = true;
+        line.remove_prefix(digits + 1);
+    }
+
+    // Optional thread ID
+    if (line.size() > 2 && line[0] == '[')
+    {
+        size_t tidDigits = ParseUInt(line.substr(1), value);
+        if (tidDigits > 0 && line.size() > tidDigits + 2 &&
+            line[tidDigits + 1] == ']' && line[tidDigits + 2] == ' ')
+        {
+            record.threadId = static_cast<uint32_t>(value);
+            record.hasThreadId = true;
+            line.remove_prefix(tidDigits + 3);
+        }
+    }
+
+    // Errors are written by the plugin as "ERROR: <message>", the trailer
+    // as "END: <file accesses> file accesses logged"
+    if (line.rfind("ERROR: ", 0) == 0 || line.rfind(LOG_TRAILER_PREFIX, 0) == 0)
+        return false;
+
+    // Optional archive. MPQ file names never contain ':', so the first ": "
+    // separates the archive from the file name.
+    size_t separator = line.find(": ");
+    if (separator != std::string_view::npos && separator > 0)
+    {
+        record.archive = line.substr(0, separator);
+        line.remove_prefix(separator + 2);
+    }
+
+    if (line.empty())
+        return false;
+
+    record.fileName = line;
+    return true;
+}
+
+// Find "key": in a JSON object and return the text after it, or an empty view
+static std::string_view FindJsonValue(std::string_view json, std::string_view key)
+{
+    size_t pos = 0;
+    while ((pos = json.find(key, pos)) != std::string_view::npos)
+    {
+        size_t after = pos + key.size();
+        if (pos > 0 && json[pos - 1] == '"' && after + 1 < json.size() &&
+            json[after] == '"' && json[after + 1] == ':')
+            return json.substr(after + 2);
+        pos = after;
+    }
+    return std::string_view();
+}
+
+static int HexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Decode a JSON string starting at its opening quote. Code points up to
+// U+00FF become single bytes, which round-trips what the plugin escapes.
+static bool DecodeJsonString(std::string_view text, std::string& out)
+{
+    out.clear();
+    if (text.empty() || text[0] != '"')
+        return false;
+
+    for (size_t i = 1; i < text.size(); i++)
+    {
+        char c = text[i];
+        if (c == '"')
+            return true;
+        if (c != '\\')
+        {
+            out += c;
+            continue;
+        }
+
+        if (++i >= text.size())
+            return false;
+        switch (text[i])
+        {
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'u':
+            {
+                if (i + 4 >= text.size())
+                    return false;
+                int codePoint = 0;
+                for (int digit = 1; digit <= 4; digit++)
+                {
+                    int hex = HexValue(text[i + digit]);
+                    if (hex < 0)
+                        return false;
+                    codePoint = codePoint * 16 + hex;
+                }
+                out += static_cast<char>(codePoint <= 0xFF ? codePoint : '?');
+                i += 4;
+                break;
+            }
+            default: out += text[i]; break;
+        }
+    }
+    return false;
+}
+
+bool LogLineParser::ParseTraceLine(std::string_view line, LogRecord& record)
+{
+    // Only complete events of the open functions are file accesses; reads
+    // are traced as complete events too
+    if (line.find("\"ph\":\"X\"") == std::string_view::npos)
+        return false;
+    static constexpr std::string_view OPEN_CATEGORIES[] = { "\"SFileOpenFile\"", "\"SFileOpenFileEx\"" };
+    std::string_view category = FindJsonValue(line, "cat");
+    if (std::none_of(std::begin(OPEN_CATEGORIES), std::end(OPEN_CATEGORIES),
+                     [&](std::string_view open) { return category.substr(0, open.size()) == open; }))
+        return false;
+
+    std::string_view file = FindJsonValue(line, "file");
+    if (!DecodeJsonString(file, m_fileName) || m_fileName.empty())
+        return false;
+    record.fileName = m_fileName;
+
+    std::string_view archive = FindJsonValue(line, "archive");
+    if (DecodeJsonString(archive, m_archive))
+        record.archive = m_archive;
+
+    uint64_t value;
+    if (ParseUInt(FindJsonValue(line, "ts"), value) > 0)
+    {
+        record.timestampMicros = value;
+        record.hasTimestamp = true;
+    }
+    if (ParseUInt(FindJsonValue(line, "dur"), value) > 0)
+    {
+        record.durationMicros = value;
+        record.hasDuration = true;
+    }
+    if (ParseUInt(FindJsonValue(line, "tid"), value) > 0)
+    {
+        record.threadId = static_cast<uint32_t>(value);
+        record.hasThreadId = true;
+    }
+    return true;
+}
+
+std::vector<std::pair<size_t, size_t>> SplitAtLines(const char* data, size_t size, size_t chunkSize)
+{
+    std::vector<std::pair<size_t, size_t>> chunks;
+    size_t begin = 0;
+    while (begin < size)
+    {
+        size_t end = begin + chunkSize;
+        if (end >= size)
+        {
+            end = size;
+        }
+        else
+        {
+            const char* newline = static_cast<const char*>(memchr(data + end, '\n', size - end));
+            end = newline ? static_cast<size_t>(newline - data) + 1 : size;
+        }
+        chunks.emplace_back(begin, end);
+        begin = end;
+    }
+    return chunks;
+}
@@ -0,0 +1,83 @@
+/*
+    LogParser.h - Parser for MpqFileLister logs in every LogFormat
+
+    Recognizes, line by line:
+        <timestamp> [<thread id>] <MPQ archive>: <filename>
+        [<thread id>] <MPQ archive>: <filename>
+        <timestamp> [<thread id>] <filename>
+        [<thread id>] <filename>
+    where the thread ID is optional, and Chrome trace-event JSON written by
+    the CHROME_TRACE format (one event per line), of which only the events
+    of the open functions count. Error lines, the trailer, trace metadata,
+    read events and anything else that is not a file access are skipped.
+*/
+
+#ifndef LOGPARSER_H
+#define LOGPARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Start of the last line of a log the plugin finished cleanly (a trace has
+// it as the name of its last instant event). A log without it was cut short.
+#define LOG_TRAILER_PREFIX "END: "
+
+// One file access from a log. The views point into the log data or into the
+// parser's scratch buffers, so they are only valid until the next Parse call.
+struct LogRecord
+{
+    std::string_view archive;       // Empty if the format has no archive
+    std::string_view fileName;
+    uint64_t timestampMicros;       // Epoch time for text logs, session time for traces
+    uint64_t durationMicros;        // Time spent in Storm (traces only)
+    uint32_t threadId;
+    bool hasTimestamp;
+    bool hasDuration;
+    bool hasThreadId;
+};
+
+class LogLineParser
+{
+private:
+    // Unescaped JSON strings from trace events
+    std::string m_archive;
+    std::string m_fileName;
+
+    bool ParseTextLine(std::string_view line, LogRecord& record);
+    bool ParseTraceLine(std::string_view line, LogRecord& record);
+
+public:
+    // Parse a single line (without its line terminator)
+    bool Parse(std::string_view line, LogRecord& record);
+};
+
+// Split data into ranges of roughly chunkSize bytes that end at line breaks
+std::vector<std::pair<size_t, size_t>> SplitAtLines(const char* data, size_t size, size_t chunkSize);
+
+// Call fn(const LogRecord&) for every file access in [data, data + size)
+template <typename Fn>
+void ForEachLogRecord(const char* data, size_t size, Fn&& fn)
+{
+    LogLineParser parser;
+    LogRecord record;
+
+    const char* end = data + size;
+    for (const char* line = data; line < end; )
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(line, '\n', static_cast<size_t>(end - line)));
+        if (!lineEnd)
+            lineEnd = end;
+
+        if (parser.Parse(std::string_view(line, static_cast<size_t>(lineEnd - line)), record))
+            fn(static_cast<const LogRecord&>(record));
+
+        line = lineEnd + 1;
+    }
+}
+
+#endif // LOGPARSER_H
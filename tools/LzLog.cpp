@@ -0,0 +1,181 @@
+/*
+    LzLog.cpp - Block-compressed log format, shared by the plugin and the tools
+*/
+
+#include "LzLog.h"
+#include <cstring>
+#include <vector>
+
+// Minimum match length, and the bytes hashed to find one
+static const size_t MIN_MATCH = 4;
+
+// Hash table of the last position of each 4-byte sequence
+static const unsigned HASH_BITS = 14;
+
+static const size_t MAX_OFFSET = 65535;
+
+static uint32_t Read32(const uint8_t* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t HashSequence(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// A length nibble of 15 continues in bytes of 255, ended by a smaller one
+static uint8_t* WriteLengthExtension(uint8_t* out, size_t length)
+{
+    while (length >= 255)
+    {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = static_cast<uint8_t>(length);
+    return out;
+}
+
+static uint8_t* WriteSequence(uint8_t* out, const uint8_t* literals, size_t literalCount,
+                              size_t offset, size_t matchLength)
+{
+    uint8_t* token = out++;
+    size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+
+    *token = static_cast<uint8_t>((literalCount < 15 ? literalCount : 15) << 4);
+    if (literalCount >= 15)
+        out = WriteLengthExtension(out, literalCount - 15);
+    memcpy(out, literals, literalCount);
+    out += literalCount;
+
+    if (matchLength == 0)
+        return out;
+
+    *token |= static_cast<uint8_t>(matchCode < 15 ? matchCode : 15);
+    *out++ = static_cast<uint8_t>(offset);
+    *out++ = static_cast<uint8_t>(offset >> 8);
+    if (matchCode >= 15)
+        out = WriteLengthExtension(out, matchCode - 15);
+    return out;
+}
+
+size_t LzCompress(const uint8_t* src, size_t size, uint8_t* dst)
+{
+    // Positions are only candidates; every match is checked against the data
+    std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+
+    uint8_t* out = dst;
+    size_t anchor = 0;
+    size_t position = 0;
+
+    while (position + MIN_MATCH <= size)
+    {
+        uint32_t sequence = Read32(src + position);
+        uint32_t& slot = table[HashSequence(sequence)];
+        size_t candidate = slot;
+        slot = static_cast<uint32_t>(position);
+
+        if (candidate >= position || position - candidate > MAX_OFFSET || Read32(src + candidate) != sequence)
+        {
+            // Skip ahead faster through data that does not compress
+            position += 1 + ((position - anchor) >> 6);
+            continue;
+        }
+
+        size_t length = MIN_MATCH;
+        while (position + length < size && src[candidate + length] == src[position + length])
+            length++;
+
+        out = WriteSequence(out, src + anchor, position - anchor, position - candidate, length);
+        position += length;
+        anchor = position;
+
+        // Make the end of the match findable, for runs of repeated lines
+        if (position + 2 <= size)
+            table[HashSequence(Read32(src + position - 2))] = static_cast<uint32_t>(position - 2);
+    }
+
+    out = WriteSequence(out, src + anchor, size - anchor, 0, 0);
+    return static_cast<size_t>(out - dst);
+}
+
+// Read a length nibble's continuation bytes; returns false if the input ends
+static bool ReadLengthExtension(const uint8_t*& in, const uint8_t* end, size_t& length)
+{
+    uint8_t byte;
+    do
+    {
+        if (in == end)
+            return false;
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool LzDecompress(const uint8_t* src, size_t size, uint8_t* dst, size_t rawSize)
+{
+    const uint8_t* in = src;
+    const uint8_t* end = src + size;
+    uint8_t* out = dst;
+    uint8_t* outEnd = dst + rawSize;
+
+    while (in < end)
+    {
+        uint8_t token = *in++;
+
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !ReadLengthExtension(in, end, literalCount))
+            return false;
+        if (literalCount > static_cast<size_t>(end - in) || literalCount > static_cast<size_t>(outEnd - out))
+            return false;
+        memcpy(out, in, literalCount);
+        in += literalCount;
+        out += literalCount;
+
+        if (in == end)
+            break;
+
+        if (end - in < 2)
+            return false;
+        size_t offset = in[0] | (size_t(in[1]) << 8);
+        in += 2;
+        if (offset == 0 || offset > static_cast<size_t>(out - dst))
+            return false;
+
+        size_t length = token & 15;
+        if (length == 15 && !ReadLengthExtension(in, end, length))
+            return false;
+        length += MIN_MATCH;
+        if (length > static_cast<size_t>(outEnd - out))
+            return false;
+
+        // A match closer than its length overlaps the output it copies, byte by byte
+        const uint8_t* match = out - offset;
+        if (offset >= length)
+        {
+            memcpy(out, match, length);
+            out += length;
+        }
+        else
+        {
+            for (size_t i = 0; i < length; i++)
+                *out++ = match[i];
+        }
+    }
+
+    return out == outEnd;
+}
+
+uint32_t LzChecksum(const uint8_t* data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,63 @@
+/*
+    LzLog.h - Block-compressed log format, shared by the plugin and the tools
+
+    A compressed log is a file header followed by independent blocks, each
+    with a header giving its raw and stored size and a checksum of the raw
+    text. A block is stored as is when compressing would not make it smaller.
+    Every block decompresses on its own, so a log cut short by a crash can
+    be read up to its last complete block.
+
+    Blocks are compressed with a byte-oriented LZ77 in the style of LZ4,
+    which suits the repetitive text of logs and decompresses at memory
+    speed. A block is a sequence of:
+        token           high nibble: literal count, low nibble: match length - 4
+                        (15 in either continues in 255-valued bytes)
+        literals
+        offset          2 bytes, little endian, 1-65535 back from the output
+    The last sequence has literals only and ends the block.
+*/
+
+#ifndef LZLOG_H
+#define LZLOG_H
+
+#include <cstddef>
+#include <cstdint>
+
+static const char LZLOG_MAGIC[4] = { 'M', 'Q', 'L', 'Z' };
+static const uint32_t LZLOG_VERSION = 1;
+
+// Largest block the plugin writes; readers accept up to LZLOG_MAX_BLOCK_SIZE
+static const uint32_t LZLOG_BLOCK_SIZE = 256 * 1024;
+static const uint32_t LZLOG_MAX_BLOCK_SIZE = 16 * 1024 * 1024;
+
+struct LzLogHeader
+{
+    char magic[4];
+    uint32_t version;
+};
+
+struct LzLogBlockHeader
+{
+    uint32_t rawSize;
+    uint32_t storedSize;        // Equal to rawSize if the block is not compressed
+    uint32_t checksum;          // FNV-1a of the raw bytes
+};
+
+// Worst case size of a compressed block of rawSize bytes
+inline size_t LzCompressBound(size_t rawSize)
+{
+    return rawSize + rawSize / 255 + 16;
+}
+
+// Compress size bytes from src into dst, which must hold LzCompressBound(size)
+// bytes. Returns the compressed size.
+size_t LzCompress(const uint8_t* src, size_t size, uint8_t* dst);
+
+// Decompress a block into exactly rawSize bytes at dst. Returns false if the
+// block is damaged or does not decompress to rawSize bytes.
+bool LzDecompress(const uint8_t* src, size_t size, uint8_t* dst, size_t rawSize);
+
+// Checksum stored in each block header
+uint32_t LzChecksum(const uint8_t* data, size_t size);
+
+#endif // LZLOG_H
@@ -0,0 +1,186 @@
+/*
+    MappedFile.cpp - Read-only memory-mapped files for the MpqFileLister tools
+*/
+
+#include "MappedFile.h"
+#ifdef _WIN32
+#include <windows.h>
+#include <cerrno>
+#include <cstdint>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <utility>
+
+MappedFile::MappedFile()
+    : m_data(nullptr)
+    , m_size(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr))
+    , m_size(std::exchange(other.m_size, 0))
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        Close();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+
+// The plugin reads archives with this too; errno is set from the Windows error
+static void SetErrnoFromLastError()
+{
+    DWORD error = GetLastError();
+    if (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND)
+        errno = ENOENT;
+    else if (error == ERROR_ACCESS_DENIED || error == ERROR_SHARING_VIOLATION)
+        errno = EACCES;
+    else if (error == ERROR_NOT_ENOUGH_MEMORY)
+        errno = ENOMEM;
+    else
+        errno = EIO;
+}
+
+bool MappedFile::Open(const std::string& path, bool sequential)
+{
+    Close();
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                              OPEN_EXISTING, sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS,
+                              nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        SetErrnoFromLastError();
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        SetErrnoFromLastError();
+        CloseHandle(file);
+        return false;
+    }
+    if (static_cast<unsigned long long>(size.QuadPart) > SIZE_MAX)
+    {
+        errno = EFBIG;
+        CloseHandle(file);
+        return false;
+    }
+
+    // An empty file cannot be mapped; an empty mapping is still a valid, empty file
+    if (size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return true;
+    }
+
+    // The view keeps the mapping alive after both handles are closed
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!data)
+        SetErrnoFromLastError();
+    if (mapping)
+        CloseHandle(mapping);
+    CloseHandle(file);
+    if (!data)
+        return false;
+
+    m_data = static_cast<const char*>(data);
+    m_size = static_cast<size_t>(size.QuadPart);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    m_data = nullptr;
+    m_size = 0;
+}
+
+void MappedFile::DontNeed(size_t offset, size_t length) const
+{
+    // A read-only view has no way to drop pages early; the cache manager
+    // trims them under memory pressure
+    (void)offset;
+    (void)length;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& path, bool sequential)
+{
+    Close();
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    // mmap refuses empty files; an empty mapping is still a valid, empty file
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return true;
+    }
+
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    madvise(data, static_cast<size_t>(st.st_size), sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+
+    m_data = static_cast<const char*>(data);
+    m_size = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (m_data)
+        munmap(const_cast<char*>(m_data), m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
+
+void MappedFile::DontNeed(size_t offset, size_t length) const
+{
+    if (!m_data || offset >= m_size)
+        return;
+
+    // madvise needs a page-aligned start; only whole pages inside the range are dropped
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t begin = (offset + pageSize - 1) / pageSize * pageSize;
+    size_t end = std::min(offset + length, m_size) / pageSize * pageSize;
+    if (end > begin)
+        madvise(const_cast<char*>(m_data) + begin, end - begin, MADV_DONTNEED);
+}
+
+#endif
@@ -0,0 +1,39 @@
+/*
+    MappedFile.h - Read-only memory-mapped files for the MpqFileLister tools and plugin
+*/
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+class MappedFile
+{
+private:
+    const char* m_data;
+    size_t m_size;
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // Map the whole file. Returns false (with errno set) on failure.
+    // sequential hints the kernel to read ahead aggressively.
+    bool Open(const std::string& path, bool sequential = true);
+    void Close();
+
+    // Tell the kernel a range will not be read again, so it can drop those
+    // pages early. Useful when streaming through files larger than memory.
+    void DontNeed(size_t offset, size_t length) const;
+
+    const char* Data() const { return m_data; }
+    size_t Size() const { return m_size; }
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,191 @@
+/*
+    MpqArchive.cpp - Read-only access to the hash and block tables of an MPQ
+*/
+
+#include "MpqArchive.h"
+#include <cerrno>
+#include <cstring>
+
+static const uint32_t MPQ_HEADER_ID    = 0x1A51504D;   // "MPQ\x1A"
+static const uint32_t MPQ_USERDATA_ID  = 0x1B51504D;   // "MPQ\x1B"
+static const uint32_t MPQ_HEADER_ALIGN = 0x200;
+
+static const size_t MPQ_HEADER_V0_SIZE = 0x20;
+static const size_t MPQ_HEADER_V1_SIZE = 0x2C;
+
+static_assert(sizeof(MpqHashEntry) == 16, "MpqHashEntry must match the archive layout");
+static_assert(sizeof(MpqBlockEntry) == 16, "MpqBlockEntry must match the archive layout");
+
+static uint16_t ReadUInt16(const char* p)
+{
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint16_t>(b[0] | (b[1] << 8));
+}
+
+static uint32_t ReadUInt32(const char* p)
+{
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint32_t>(b[0]) | (static_cast<uint32_t>(b[1]) << 8) |
+           (static_cast<uint32_t>(b[2]) << 16) | (static_cast<uint32_t>(b[3]) << 24);
+}
+
+MpqArchive::MpqArchive()
+    : m_headerOffset(0), m_headerSize(0), m_hiBlockTablePos(0), m_formatVersion(0), m_sectorSize(0)
+{
+}
+
+void MpqArchive::Close()
+{
+    m_file.Close();
+    m_hashTable.clear();
+    m_blockTable.clear();
+    m_headerOffset = 0;
+    m_headerSize = 0;
+    m_hiBlockTablePos = 0;
+    m_formatVersion = 0;
+    m_sectorSize = 0;
+}
+
+bool MpqArchive::ReadTable(uint64_t position, uint32_t entries, const char* keyName, void* table)
+{
+    // Protected archives sometimes claim tables larger than the file. Reading
+    // past its end would give garbage entries, so such an archive is rejected.
+    uint64_t start = m_headerOffset + position;
+    uint64_t available = start < m_file.Size() ? m_file.Size() - start : 0;
+    uint64_t bytes = static_cast<uint64_t>(entries) * 16;
+    if (bytes > available)
+    {
+        m_error = std::string(keyName) + " extends past the end of the file";
+        return false;
+    }
+
+    memcpy(table, m_file.Data() + start, static_cast<size_t>(bytes));
+    DecryptStormBlock(static_cast<uint32_t*>(table), static_cast<size_t>(bytes / 4),
+                      HashStormString(keyName, StormHashType::FILE_KEY));
+    return true;
+}
+
+bool MpqArchive::Open(const std::string& path)
+{
+    Close();
+
+    // Lookups jump around the tables; readahead would only waste I/O
+    if (!m_file.Open(path, false))
+    {
+        m_error = strerror(errno);
+        return false;
+    }
+
+    const char* data = m_file.Data();
+    size_t size = m_file.Size();
+
+    bool found = false;
+    for (uint64_t offset = 0; offset + MPQ_HEADER_V0_SIZE <= size; offset += MPQ_HEADER_ALIGN)
+    {
+        uint32_t id = ReadUInt32(data + offset);
+        if (id == MPQ_USERDATA_ID && offset + 12 <= size)
+        {
+            uint64_t headerOffset = offset + ReadUInt32(data + offset + 8);
+            if (headerOffset + MPQ_HEADER_V0_SIZE <= size && ReadUInt32(data + headerOffset) == MPQ_HEADER_ID)
+            {
+                m_headerOffset = headerOffset;
+                found = true;
+                break;
+            }
+        }
+        else if (id == MPQ_HEADER_ID)
+        {
+            m_headerOffset = offset;
+            found = true;
+            break;
+        }
+    }
+
+    if (!found)
+    {
+        m_error = "no MPQ header found";
+        Close();
+        return false;
+    }
+
+    const char* header = data + m_headerOffset;
+    uint32_t headerSize = ReadUInt32(header + 4);
+    m_headerSize = headerSize;
+    m_formatVersion = ReadUInt16(header + 0x0C);
+    m_sectorSize = 0x200u << ReadUInt16(header + 0x0E);
+
+    uint64_t hashTablePos = ReadUInt32(header + 0x10);
+    uint64_t blockTablePos = ReadUInt32(header + 0x14);
+    uint32_t hashTableSize = ReadUInt32(header + 0x18);
+    uint32_t blockTableSize = ReadUInt32(header + 0x1C);
+
+    // Version 1 archives (Burning Crusade and later) can exceed 4 GB
+    if (m_formatVersion >= 1 && headerSize >= MPQ_HEADER_V1_SIZE &&
+        m_headerOffset + MPQ_HEADER_V1_SIZE <= size)
+    {
+        m_hiBlockTablePos = static_cast<uint64_t>(ReadUInt32(header + 0x20)) |
+                            (static_cast<uint64_t>(ReadUInt32(header + 0x24)) << 32);
+        hashTablePos |= static_cast<uint64_t>(ReadUInt16(header + 0x28)) << 32;
+        blockTablePos |= static_cast<uint64_t>(ReadUInt16(header + 0x2A)) << 32;
+    }
+
+    // Storm masks the hash table position with the table size, so the size
+    // must be a power of two
+    if (hashTableSize == 0 || (hashTableSize & (hashTableSize - 1)) != 0)
+    {
+        m_error = "hash table size is not a power of two";
+        Close();
+        return false;
+    }
+
+    m_hashTable.resize(hashTableSize);
+    m_blockTable.resize(blockTableSize);
+    if (!ReadTable(hashTablePos, hashTableSize, "(hash table)", m_hashTable.data()) ||
+        !ReadTable(blockTablePos, blockTableSize, "(block table)", m_blockTable.data()))
+    {
+        std::string error = m_error;
+        Close();
+        m_error = error;
+        return false;
+    }
+
+    // The tables are copies; the mapping stays open for reading file data
+    return true;
+}
+
+bool MpqArchive::IsFileEntry(const MpqHashEntry& entry) const
+{
+    return entry.blockIndex < m_blockTable.size() &&
+           (m_blockTable[entry.blockIndex].flags & MPQ_FILE_EXISTS) != 0;
+}
+
+const char* MpqArchive::GetBlockData(const MpqBlockEntry& block) const
+{
+    uint64_t start = m_headerOffset + block.filePos;
+    if (start > m_file.Size() || block.compressedSize > m_file.Size() - start)
+        return nullptr;
+    return m_file.Data() + start;
+}
+
+uint32_t MpqArchive::GetFileKey(std::string_view name, const MpqBlockEntry& block)
+{
+    size_t separator = name.find_last_of("\\/");
+    if (separator != std::string_view::npos)
+        name = name.substr(separator + 1);
+
+    uint32_t key = HashStormString(name, StormHashType::FILE_KEY);
+    if (block.flags & MPQ_FILE_FIX_KEY)
+        key = (key + block.filePos) ^ block.fileSize;
+    return key;
+}
+
+int64_t MpqArchive::FindHashEntry(const StormNameHashes& hashes) const
+{
+    int64_t found = -1;
+    ForEachHashEntry(hashes, [this, &found](size_t index)
+    {
+        if (found < 0 && IsFileEntry(m_hashTable[index]))
+            found = static_cast<int64_t>(index);
+    });
+    return found;
+}
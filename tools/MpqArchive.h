@@ -0,0 +1,122 @@
+/*
+    MpqArchive.h - Read-only access to the hash and block tables of an MPQ
+
+    Maps the archive, finds the MPQ header (at the start of the file or at
+    any 512-byte boundary, following a user data header if present) and
+    decrypts copies of the hash and block tables. File data is not read.
+*/
+
+#ifndef MPQARCHIVE_H
+#define MPQARCHIVE_H
+
+#include "MappedFile.h"
+#include "StormHash.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Hash table entry, as stored in the archive (the tables are little-endian,
+// like every platform the tools build on)
+struct MpqHashEntry
+{
+    uint32_t nameA;
+    uint32_t nameB;
+    uint16_t locale;
+    uint16_t platform;
+    uint32_t blockIndex;
+};
+
+// Block table entry, as stored in the archive
+struct MpqBlockEntry
+{
+    uint32_t filePos;               // Relative to the archive header
+    uint32_t compressedSize;
+    uint32_t fileSize;
+    uint32_t flags;
+};
+
+// blockIndex values of hash entries that hold no file
+static const uint32_t MPQ_HASH_ENTRY_EMPTY   = 0xFFFFFFFF;
+static const uint32_t MPQ_HASH_ENTRY_DELETED = 0xFFFFFFFE;
+
+// Block flags
+static const uint32_t MPQ_FILE_IMPLODE     = 0x00000100;
+static const uint32_t MPQ_FILE_COMPRESS    = 0x00000200;
+static const uint32_t MPQ_FILE_ENCRYPTED   = 0x00010000;
+static const uint32_t MPQ_FILE_FIX_KEY     = 0x00020000;   // Key depends on the file's position
+static const uint32_t MPQ_FILE_SINGLE_UNIT = 0x01000000;
+static const uint32_t MPQ_FILE_SECTOR_CRC  = 0x04000000;
+static const uint32_t MPQ_FILE_EXISTS      = 0x80000000;
+
+class MpqArchive
+{
+private:
+    MappedFile m_file;
+    uint64_t m_headerOffset;
+    uint32_t m_headerSize;
+    uint64_t m_hiBlockTablePos;
+    uint16_t m_formatVersion;
+    uint32_t m_sectorSize;
+    std::vector<MpqHashEntry> m_hashTable;
+    std::vector<MpqBlockEntry> m_blockTable;
+    std::string m_error;
+
+    bool ReadTable(uint64_t position, uint32_t entries, const char* keyName, void* table);
+
+public:
+    MpqArchive();
+
+    // Open an archive. On failure, returns false and Error() says why.
+    bool Open(const std::string& path);
+    void Close();
+
+    const std::string& Error() const { return m_error; }
+
+    uint64_t HeaderOffset() const { return m_headerOffset; }
+    uint32_t HeaderSize() const { return m_headerSize; }
+    uint16_t FormatVersion() const { return m_formatVersion; }
+    uint64_t HiBlockTablePos() const { return m_hiBlockTablePos; }     // 0 if none
+    uint32_t SectorSize() const { return m_sectorSize; }
+    const std::vector<MpqHashEntry>& HashTable() const { return m_hashTable; }
+    const std::vector<MpqBlockEntry>& BlockTable() const { return m_blockTable; }
+
+    // Whether a hash entry refers to an existing file in the block table
+    bool IsFileEntry(const MpqHashEntry& entry) const;
+
+    // The stored data of a block, or nullptr if it lies outside the file
+    const char* GetBlockData(const MpqBlockEntry& block) const;
+
+    // Encryption key of a file. Only the part of the name after the last
+    // '\' counts; files with MPQ_FILE_FIX_KEY also depend on their position.
+    static uint32_t GetFileKey(std::string_view name, const MpqBlockEntry& block);
+
+    // Find a name the way Storm does, for any locale. Returns the index of
+    // its first hash table entry that refers to a file, or -1 if the archive
+    // does not contain it.
+    int64_t FindHashEntry(const StormNameHashes& hashes) const;
+
+    // Call fn(size_t index) for every hash table entry of a name (one per
+    // locale and platform the archive has it in)
+    template <typename Fn>
+    void ForEachHashEntry(const StormNameHashes& hashes, Fn&& fn) const
+    {
+        if (m_hashTable.empty())
+            return;
+
+        size_t mask = m_hashTable.size() - 1;
+        size_t start = hashes.tableOffset & mask;
+        size_t index = start;
+        do
+        {
+            const MpqHashEntry& entry = m_hashTable[index];
+            if (entry.blockIndex == MPQ_HASH_ENTRY_EMPTY)
+                return;
+            if (entry.nameA == hashes.nameA && entry.nameB == hashes.nameB &&
+                entry.blockIndex != MPQ_HASH_ENTRY_DELETED)
+                fn(index);
+            index = (index + 1) & mask;
+        } while (index != start);
+    }
+};
+
+#endif // MPQARCHIVE_H
@@ -0,0 +1,313 @@
+/*
+    NameBreaker.cpp - Pattern-driven search for unknown MPQ file names
+*/
+
+#include "NameBreaker.h"
+#include "StormName.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <map>
+
+// Words of one template searched per task
+static const size_t WORDS_PER_TASK = 8192;
+
+// Filter bits per unknown file; a random name A passes about once in 64
+static const size_t FILTER_BITS_PER_TARGET = 64;
+
+static std::string ToListfileSpelling(std::string_view name)
+{
+    std::string spelling(name);
+    std::replace(spelling.begin(), spelling.end(), '/', '\\');
+    return spelling;
+}
+
+uint32_t NameBreaker::AddWordList(const std::vector<std::string>& words)
+{
+    std::vector<std::pair<std::string, std::string>> entries;
+    entries.reserve(words.size());
+    for (const std::string& word : words)
+    {
+        if (!word.empty())
+            entries.emplace_back(NormalizeStormName(word), ToListfileSpelling(word));
+    }
+
+    // Sorting by (normalized, spelling) leaves the smallest spelling first
+    std::sort(entries.begin(), entries.end());
+    entries.erase(std::unique(entries.begin(), entries.end(),
+        [](const auto& a, const auto& b) { return a.first == b.first; }), entries.end());
+
+    WordList list;
+    list.normalized.reserve(entries.size());
+    list.spellings.reserve(entries.size());
+    list.sharedPrefix.reserve(entries.size());
+    for (auto& entry : entries)
+    {
+        uint32_t shared = 0;
+        if (!list.normalized.empty())
+        {
+            const std::string& previous = list.normalized.back();
+            size_t limit = std::min(previous.size(), entry.first.size());
+            while (shared < limit && previous[shared] == entry.first[shared])
+                shared++;
+        }
+        list.maxLength = std::max(list.maxLength, entry.first.size());
+        list.sharedPrefix.push_back(shared);
+        list.normalized.push_back(std::move(entry.first));
+        list.spellings.push_back(std::move(entry.second));
+    }
+
+    m_wordLists.push_back(std::move(list));
+    return static_cast<uint32_t>(m_wordLists.size() - 1);
+}
+
+uint32_t NameBreaker::GetNumberList(unsigned digits)
+{
+    if (m_numberLists.size() < digits)
+        m_numberLists.resize(digits, UINT32_MAX);
+
+    uint32_t& list = m_numberLists[digits - 1];
+    if (list == UINT32_MAX)
+    {
+        uint32_t count = 1;
+        for (unsigned i = 0; i < digits; i++)
+            count *= 10;
+
+        std::vector<std::string> numbers(count);
+        char buffer[16];
+        for (uint32_t i = 0; i < count; i++)
+        {
+            snprintf(buffer, sizeof(buffer), "%0*u", static_cast<int>(digits), i);
+            numbers[i] = buffer;
+        }
+        list = AddWordList(numbers);
+    }
+    return list;
+}
+
+void NameBreaker::AddTemplate(std::string_view prefix, uint32_t wordList, std::string_view suffix)
+{
+    if (m_templateKeys.emplace(NormalizeStormName(prefix), wordList, NormalizeStormName(suffix)).second)
+        m_templates.push_back(Template{ToListfileSpelling(prefix), wordList, ToListfileSpelling(suffix)});
+}
+
+bool NameBreaker::AddPattern(std::string_view pattern, uint32_t dictionary)
+{
+    size_t star = pattern.find('*');
+    size_t hash = pattern.find('#');
+    if ((star == std::string_view::npos) == (hash == std::string_view::npos))
+        return false;
+
+    if (star != std::string_view::npos)
+    {
+        if (pattern.find('*', star + 1) != std::string_view::npos)
+            return false;
+        AddTemplate(pattern.substr(0, star), dictionary, pattern.substr(star + 1));
+        return true;
+    }
+
+    size_t end = pattern.find_first_not_of('#', hash);
+    if (end == std::string_view::npos)
+        end = pattern.size();
+    if (pattern.find('#', end) != std::string_view::npos || end - hash > 6)
+        return false;
+    AddTemplate(pattern.substr(0, hash), GetNumberList(static_cast<unsigned>(end - hash)), pattern.substr(end));
+    return true;
+}
+
+void NameBreaker::DeriveTemplates(const std::vector<std::string>& knownNames, uint32_t dictionary, unsigned maxDigits)
+{
+    // Directories under each parent (normalized parent, with its trailing
+    // separator), and every place a directory appeared: prefix up to it and
+    // the rest of the name after it
+    std::map<std::string, std::vector<std::string>> children;
+    std::vector<std::tuple<std::string, std::string, std::string>> directoryUses;
+
+    for (const std::string& knownName : knownNames)
+    {
+        std::string name = ToListfileSpelling(knownName);
+        size_t lastSeparator = name.rfind('\\');
+        size_t fileStart = lastSeparator == std::string::npos ? 0 : lastSeparator + 1;
+
+        // Same directory and extension, any word
+        size_t dot = name.rfind('.');
+        std::string extension = dot != std::string::npos && dot >= fileStart ? name.substr(dot) : std::string();
+        AddTemplate(std::string_view(name).substr(0, fileStart), dictionary, extension);
+
+        // Every digit run as a range of numbers of the same width
+        for (size_t i = 0; i < name.size(); )
+        {
+            if (name[i] < '0' || name[i] > '9')
+            {
+                i++;
+                continue;
+            }
+            size_t end = i;
+            while (end < name.size() && name[end] >= '0' && name[end] <= '9')
+                end++;
+            if (end - i <= maxDigits)
+                AddTemplate(std::string_view(name).substr(0, i), GetNumberList(static_cast<unsigned>(end - i)),
+                            std::string_view(name).substr(end));
+            i = end;
+        }
+
+        // Every directory, to be replaced by its siblings
+        for (size_t start = 0; start < fileStart; )
+        {
+            size_t end = name.find('\\', start);
+            std::string parent = name.substr(0, start);
+            children[NormalizeStormName(parent)].push_back(name.substr(start, end - start));
+            directoryUses.emplace_back(parent, NormalizeStormName(parent), name.substr(end));
+            start = end + 1;
+        }
+    }
+
+    std::map<std::string, uint32_t> siblingLists;
+    for (auto& entry : children)
+    {
+        uint32_t list = AddWordList(entry.second);
+        if (m_wordLists[list].normalized.size() > 1)
+            siblingLists[entry.first] = list;
+    }
+    for (const auto& use : directoryUses)
+    {
+        auto it = siblingLists.find(std::get<1>(use));
+        if (it != siblingLists.end())
+            AddTemplate(std::get<0>(use), it->second, std::get<2>(use));
+    }
+}
+
+std::vector<std::string> NameBreaker::Search(const MpqArchive& archive, const std::vector<bool>& resolvedEntries,
+                                             WorkStealingPool& pool, Stats& stats) const
+{
+    const auto& hashTable = archive.HashTable();
+
+    // Bit filter of the name A hashes of the files still to be named
+    auto isTarget = [&](size_t index)
+    {
+        return !resolvedEntries[index] && archive.IsFileEntry(hashTable[index]);
+    };
+
+    size_t targets = 0;
+    for (size_t i = 0; i < hashTable.size(); i++)
+    {
+        if (isTarget(i))
+            targets++;
+    }
+    stats.targets = targets;
+    stats.templates = m_templates.size();
+    if (targets == 0)
+        return {};
+
+    size_t filterBits = size_t(1) << 16;
+    while (filterBits < targets * FILTER_BITS_PER_TARGET)
+        filterBits <<= 1;
+    const uint32_t filterMask = static_cast<uint32_t>(filterBits - 1);
+    std::vector<uint64_t> filter(filterBits / 64);
+    for (size_t i = 0; i < hashTable.size(); i++)
+    {
+        if (isTarget(i))
+        {
+            uint32_t bit = hashTable[i].nameA & filterMask;
+            filter[bit >> 6] |= uint64_t(1) << (bit & 63);
+        }
+    }
+
+    // Per template: the normalized suffix, and the name A state after the prefix
+    const uint32_t* rowA = GetStormCryptTable() + (static_cast<uint32_t>(StormHashType::NAME_A) << 8);
+    std::vector<std::string> prefixes(m_templates.size());
+    std::vector<std::string> suffixes(m_templates.size());
+    std::vector<StormHashSeeds> prefixSeeds(m_templates.size());
+    for (size_t t = 0; t < m_templates.size(); t++)
+    {
+        prefixes[t] = NormalizeStormName(m_templates[t].prefix);
+        suffixes[t] = NormalizeStormName(m_templates[t].suffix);
+        UpdateStormHashSeeds(prefixSeeds[t], rowA, prefixes[t]);
+    }
+
+    // Tasks: a template and a range of its words
+    struct Task
+    {
+        uint32_t templateIndex;
+        size_t firstWord;
+        size_t lastWord;
+    };
+    std::vector<Task> tasks;
+    for (size_t t = 0; t < m_templates.size(); t++)
+    {
+        size_t words = m_wordLists[m_templates[t].wordList].normalized.size();
+        for (size_t first = 0; first < words; first += WORDS_PER_TASK)
+            tasks.push_back(Task{static_cast<uint32_t>(t), first, std::min(first + WORDS_PER_TASK, words)});
+    }
+
+    std::vector<std::vector<std::string>> taskHits(tasks.size());
+    std::atomic<uint64_t> candidates{0};
+    std::atomic<uint64_t> filterPasses{0};
+
+    ParallelFor(pool, tasks.size(), [&](size_t taskIndex)
+    {
+        const Task& task = tasks[taskIndex];
+        const Template& nameTemplate = m_templates[task.templateIndex];
+        const WordList& words = m_wordLists[nameTemplate.wordList];
+        const std::string& suffix = suffixes[task.templateIndex];
+
+        // states[k]: name A state after the prefix and k characters of the current word
+        std::vector<StormHashSeeds> states(words.maxLength + 1);
+        states[0] = prefixSeeds[task.templateIndex];
+        uint64_t passes = 0;
+        std::string candidate;
+
+        for (size_t w = task.firstWord; w < task.lastWord; w++)
+        {
+            const std::string& word = words.normalized[w];
+            size_t shared = w == task.firstWord ? 0 : words.sharedPrefix[w];
+            for (size_t k = shared; k < word.size(); k++)
+            {
+                states[k + 1] = states[k];
+                UpdateStormHashSeeds(states[k + 1], rowA, static_cast<unsigned char>(word[k]));
+            }
+
+            StormHashSeeds seeds = states[word.size()];
+            UpdateStormHashSeeds(seeds, rowA, suffix);
+            uint32_t bit = seeds.seed1 & filterMask;
+            if ((filter[bit >> 6] & (uint64_t(1) << (bit & 63))) == 0)
+                continue;
+
+            passes++;
+            candidate = prefixes[task.templateIndex];
+            candidate += word;
+            candidate += suffix;
+            bool found = false;
+            archive.ForEachHashEntry(HashStormName(candidate), [&](size_t index)
+            {
+                if (isTarget(index))
+                    found = true;
+            });
+            if (found)
+                taskHits[taskIndex].push_back(nameTemplate.prefix + words.spellings[w] + nameTemplate.suffix);
+        }
+
+        candidates.fetch_add(task.lastWord - task.firstWord, std::memory_order_relaxed);
+        filterPasses.fetch_add(passes, std::memory_order_relaxed);
+    });
+
+    stats.candidates = candidates.load();
+    stats.filterPasses = filterPasses.load();
+
+    // Several templates can produce the same name
+    std::vector<std::pair<std::string, std::string>> hits;
+    for (auto& list : taskHits)
+    {
+        for (std::string& hit : list)
+            hits.emplace_back(NormalizeStormName(hit), std::move(hit));
+    }
+    std::sort(hits.begin(), hits.end());
+    hits.erase(std::unique(hits.begin(), hits.end(),
+        [](const auto& a, const auto& b) { return a.first == b.first; }), hits.end());
+
+    std::vector<std::string> names;
+    names.reserve(hits.size());
+    for (auto& hit : hits)
+        names.push_back(std::move(hit.second));
+    return names;
+}
@@ -0,0 +1,96 @@
+/*
+    NameBreaker.h - Pattern-driven search for unknown MPQ file names
+
+    Every candidate name is a template's prefix, one word from a word list
+    and the template's suffix. Templates are derived from names that are
+    already known (typically from MpqFileLister logs):
+
+        unit\protoss\zealot.grp     -> unit\protoss\<word>.grp
+        sound\zerg\drone\zdryes01.wav -> sound\zerg\drone\zdryes<00-99>.wav
+        unit\protoss\zealot.grp     -> unit\<sibling of protoss>\zealot.grp
+
+    or given explicitly, with '*' standing for a dictionary word and a run
+    of '#' for a number of that many digits.
+
+    The search never builds most candidates. Word lists are sorted, so the
+    hash state after the prefix and after each shared word prefix is
+    computed once, and only name hash A is computed per candidate. It is
+    tested against a bit filter of the name hashes of the archive's unknown
+    files; the few candidates that pass are hashed in full and looked up.
+*/
+
+#ifndef NAMEBREAKER_H
+#define NAMEBREAKER_H
+
+#include "MpqArchive.h"
+#include "ThreadPool.h"
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+class NameBreaker
+{
+public:
+    struct Stats
+    {
+        uint64_t candidates = 0;
+        uint64_t filterPasses = 0;
+        size_t templates = 0;
+        size_t targets = 0;             // Files without a known name
+    };
+
+private:
+    struct WordList
+    {
+        std::vector<std::string> normalized;    // Sorted
+        std::vector<std::string> spellings;
+        std::vector<uint32_t> sharedPrefix;     // Characters shared with the previous word
+        size_t maxLength = 0;
+    };
+
+    struct Template
+    {
+        std::string prefix;             // Spellings; hashed normalized
+        uint32_t wordList;
+        std::string suffix;
+    };
+
+    std::vector<WordList> m_wordLists;
+    std::vector<Template> m_templates;
+    std::set<std::tuple<std::string, uint32_t, std::string>> m_templateKeys;
+    std::vector<uint32_t> m_numberLists;    // Word list of each digit count, by width - 1
+
+public:
+    // Add a word list and return its ID. Words are deduplicated the way
+    // Storm compares names.
+    uint32_t AddWordList(const std::vector<std::string>& words);
+
+    // The word list of all numbers with a given number of digits ("00" to "99")
+    uint32_t GetNumberList(unsigned digits);
+
+    // Add a template; duplicates (by normalized prefix and suffix) are ignored
+    void AddTemplate(std::string_view prefix, uint32_t wordList, std::string_view suffix);
+
+    // Add a template from a pattern with a single '*' (a word from
+    // dictionary) or run of '#' (a number). Returns false if the pattern
+    // has no or several placeholders.
+    bool AddPattern(std::string_view pattern, uint32_t dictionary);
+
+    // Derive templates from known names: each name's directory and extension
+    // around a dictionary word, its digit runs (up to maxDigits long) as
+    // number ranges, and each directory replaced by its known siblings
+    void DeriveTemplates(const std::vector<std::string>& knownNames, uint32_t dictionary, unsigned maxDigits);
+
+    size_t TemplateCount() const { return m_templates.size(); }
+
+    // Try every template against the archive's files whose hash table
+    // entries are not in resolvedEntries. Returns the names found, one per
+    // new file name, with the spelling of the template and word.
+    std::vector<std::string> Search(const MpqArchive& archive, const std::vector<bool>& resolvedEntries,
+                                    WorkStealingPool& pool, Stats& stats) const;
+};
+
+#endif // NAMEBREAKER_H
@@ -0,0 +1,64 @@
+/*
+    RecordCodec.cpp - Binary access records, shared by the plugin and the tools
+*/
+
+#include "RecordCodec.h"
+#include <cstring>
+
+static uint16_t ClampLength(size_t length)
+{
+    return static_cast<uint16_t>(length < 0xFFFF ? length : 0xFFFF);
+}
+
+size_t EncodedRecordSize(const RecordFields& fields)
+{
+    return sizeof(RecordHeader) + ClampLength(fields.function.size()) +
+        ClampLength(fields.archive.size()) + ClampLength(fields.fileName.size());
+}
+
+size_t EncodeRecord(const RecordFields& fields, char* out)
+{
+    RecordHeader header = {};
+    header.startMicros = fields.startMicros;
+    header.stormMicros = fields.stormMicros;
+    header.timestampMs = fields.timestampMs;
+    header.threadId = fields.threadId;
+    header.functionLength = ClampLength(fields.function.size());
+    header.archiveLength = ClampLength(fields.archive.size());
+    header.fileNameLength = ClampLength(fields.fileName.size());
+
+    char* p = out;
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    memcpy(p, fields.function.data(), header.functionLength);
+    p += header.functionLength;
+    memcpy(p, fields.archive.data(), header.archiveLength);
+    p += header.archiveLength;
+    memcpy(p, fields.fileName.data(), header.fileNameLength);
+    p += header.fileNameLength;
+    return static_cast<size_t>(p - out);
+}
+
+size_t DecodeRecord(const char* data, size_t size, RecordFields& fields)
+{
+    RecordHeader header;
+    if (size < sizeof(header))
+        return 0;
+    memcpy(&header, data, sizeof(header));
+
+    size_t total = sizeof(header) + header.functionLength + header.archiveLength + header.fileNameLength;
+    if (size < total)
+        return 0;
+
+    const char* p = data + sizeof(header);
+    fields.startMicros = header.startMicros;
+    fields.stormMicros = header.stormMicros;
+    fields.timestampMs = header.timestampMs;
+    fields.threadId = header.threadId;
+    fields.function = std::string_view(p, header.functionLength);
+    p += header.functionLength;
+    fields.archive = std::string_view(p, header.archiveLength);
+    p += header.archiveLength;
+    fields.fileName = std::string_view(p, header.fileNameLength);
+    return total;
+}
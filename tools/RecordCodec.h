@@ -0,0 +1,64 @@
+/*
+    RecordCodec.h - Binary access records, shared by the plugin and the tools
+
+    A binary record log starts with a RecordLogHeader, followed by records.
+    Each record is a RecordHeader and then the bytes of the Storm function,
+    archive and file names it gives the lengths of, without terminators.
+    Fields are little-endian, as written by the x86 game process.
+*/
+
+#ifndef RECORDCODEC_H
+#define RECORDCODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+static const char RECORD_MAGIC[4] = { 'M', 'Q', 'A', 'R' };
+static const uint32_t RECORD_VERSION = 1;
+
+struct RecordLogHeader
+{
+    char magic[4];
+    uint32_t version;
+};
+
+struct RecordHeader
+{
+    uint64_t startMicros;       // Session time the Storm call started
+    uint64_t stormMicros;       // Time spent inside Storm
+    uint64_t timestampMs;       // Epoch time of the call
+    uint32_t threadId;
+    uint16_t functionLength;
+    uint16_t archiveLength;     // 0 if the archive is not known
+    uint16_t fileNameLength;
+    uint16_t reserved;
+    uint32_t reserved2;
+};
+
+static_assert(sizeof(RecordHeader) == 40, "RecordHeader layout must not depend on the compiler");
+
+// A record with its names, which point into the encoded data when decoded
+struct RecordFields
+{
+    uint64_t startMicros;
+    uint64_t stormMicros;
+    uint64_t timestampMs;
+    uint32_t threadId;
+    std::string_view function;
+    std::string_view archive;
+    std::string_view fileName;
+};
+
+// Size of the encoded record (names longer than 65535 bytes are cut)
+size_t EncodedRecordSize(const RecordFields& fields);
+
+// Encode a record into out, which must hold EncodedRecordSize bytes.
+// Returns the encoded size.
+size_t EncodeRecord(const RecordFields& fields, char* out);
+
+// Decode the record at the start of data. Returns its encoded size, or 0 if
+// data holds less than a whole record.
+size_t DecodeRecord(const char* data, size_t size, RecordFields& fields);
+
+#endif // RECORDCODEC_H
@@ -0,0 +1,403 @@
+/*
+    StormHash.cpp - Storm's HashString and table encryption
+*/
+
+#include "StormHash.h"
+#include "StormName.h"
+#include <algorithm>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define STORMHASH_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+static const uint32_t* BuildCryptTable()
+{
+    static uint32_t table[0x500];
+
+    uint32_t seed = 0x00100001;
+    for (uint32_t index1 = 0; index1 < 0x100; index1++)
+    {
+        for (uint32_t index2 = index1, i = 0; i < 5; i++, index2 += 0x100)
+        {
+            seed = (seed * 125 + 3) % 0x2AAAAB;
+            uint32_t high = (seed & 0xFFFF) << 0x10;
+            seed = (seed * 125 + 3) % 0x2AAAAB;
+            uint32_t low = seed & 0xFFFF;
+            table[index2] = high | low;
+        }
+    }
+    return table;
+}
+
+const uint32_t* GetStormCryptTable()
+{
+    static const uint32_t* table = BuildCryptTable();
+    return table;
+}
+
+uint32_t HashStormString(std::string_view name, StormHashType type)
+{
+    const uint32_t* cryptTable = GetStormCryptTable();
+    const uint32_t* row = cryptTable + (static_cast<uint32_t>(type) << 8);
+
+    uint32_t seed1 = 0x7FED7FED;
+    uint32_t seed2 = 0xEEEEEEEE;
+    for (char c : name)
+    {
+        uint32_t ch = static_cast<unsigned char>(NormalizeStormChar(c));
+        seed1 = row[ch] ^ (seed1 + seed2);
+        seed2 = ch + seed1 + seed2 + (seed2 << 5) + 3;
+    }
+    return seed1;
+}
+
+StormNameHashes HashStormName(std::string_view name)
+{
+    const uint32_t* cryptTable = GetStormCryptTable();
+
+    // One pass over the name for all three hash types
+    uint32_t offset1 = 0x7FED7FED, offset2 = 0xEEEEEEEE;
+    uint32_t a1 = 0x7FED7FED, a2 = 0xEEEEEEEE;
+    uint32_t b1 = 0x7FED7FED, b2 = 0xEEEEEEEE;
+    for (char c : name)
+    {
+        uint32_t ch = static_cast<unsigned char>(NormalizeStormChar(c));
+        offset1 = cryptTable[0x000 + ch] ^ (offset1 + offset2);
+        offset2 = ch + offset1 + offset2 + (offset2 << 5) + 3;
+        a1 = cryptTable[0x100 + ch] ^ (a1 + a2);
+        a2 = ch + a1 + a2 + (a2 << 5) + 3;
+        b1 = cryptTable[0x200 + ch] ^ (b1 + b2);
+        b2 = ch + b1 + b2 + (b2 << 5) + 3;
+    }
+    return StormNameHashes{offset1, a1, b1};
+}
+
+static void HashStormNamesScalar(const std::string_view* names, size_t count, StormNameHashes* hashes)
+{
+    for (size_t i = 0; i < count; i++)
+        hashes[i] = HashStormName(names[i]);
+}
+
+#ifdef STORMHASH_X86_KERNELS
+
+// What one input byte contributes to the three hashes: the crypt table
+// values of its normalized character for each hash type, and the character
+// plus the constant 3 that the second seed adds. A lane reads all of it
+// with a single 16-byte load; hardware gathers are slower than that on
+// most CPUs.
+struct alignas(16) StormCharEntry
+{
+    uint32_t tableOffset;
+    uint32_t nameA;
+    uint32_t nameB;
+    uint32_t charPlusThree;
+};
+
+static const StormCharEntry* GetStormCharTable()
+{
+    static const StormCharEntry* table = []()
+    {
+        static StormCharEntry entries[256];
+        const uint32_t* cryptTable = GetStormCryptTable();
+        for (uint32_t byte = 0; byte < 256; byte++)
+        {
+            uint32_t ch = static_cast<unsigned char>(NormalizeStormChar(static_cast<char>(byte)));
+            entries[byte] = StormCharEntry{cryptTable[0x000 + ch], cryptTable[0x100 + ch], cryptTable[0x200 + ch], ch + 3};
+        }
+        return entries;
+    }();
+    return table;
+}
+
+// Rows of four char table entries, transposed into one vector per field
+#define STORMHASH_TRANSPOSE(unpacklo32, unpackhi32, unpacklo64, unpackhi64, r0, r1, r2, r3, offset, a, b, ch) \
+    do { \
+        auto t0 = unpacklo32(r0, r1), t1 = unpacklo32(r2, r3); \
+        auto t2 = unpackhi32(r0, r1), t3 = unpackhi32(r2, r3); \
+        offset = unpacklo64(t0, t1); a = unpackhi64(t0, t1); \
+        b = unpacklo64(t2, t3); ch = unpackhi64(t2, t3); \
+    } while (0)
+
+__attribute__((target("sse4.1")))
+static inline void LoadCharsSse41(const StormCharEntry* table, const unsigned char* chars,
+                                  __m128i& offset, __m128i& a, __m128i& b, __m128i& ch)
+{
+    __m128i r0 = _mm_load_si128(reinterpret_cast<const __m128i*>(table + chars[0]));
+    __m128i r1 = _mm_load_si128(reinterpret_cast<const __m128i*>(table + chars[1]));
+    __m128i r2 = _mm_load_si128(reinterpret_cast<const __m128i*>(table + chars[2]));
+    __m128i r3 = _mm_load_si128(reinterpret_cast<const __m128i*>(table + chars[3]));
+    STORMHASH_TRANSPOSE(_mm_unpacklo_epi32, _mm_unpackhi_epi32, _mm_unpacklo_epi64, _mm_unpackhi_epi64,
+                        r0, r1, r2, r3, offset, a, b, ch);
+}
+
+// seed1 = value ^ (seed1 + seed2); seed2 = ch + seed1 + seed2 + (seed2 << 5) + 3
+__attribute__((target("sse4.1")))
+static inline void MixSse41(__m128i value, __m128i charPlusThree, __m128i& seed1, __m128i& seed2)
+{
+    seed1 = _mm_xor_si128(value, _mm_add_epi32(seed1, seed2));
+    seed2 = _mm_add_epi32(_mm_add_epi32(charPlusThree, seed1), _mm_add_epi32(seed2, _mm_slli_epi32(seed2, 5)));
+}
+
+// Mix only the lanes whose names are not finished
+__attribute__((target("sse4.1")))
+static inline void MixMaskedSse41(__m128i value, __m128i charPlusThree, __m128i active, __m128i& seed1, __m128i& seed2)
+{
+    __m128i new1 = seed1, new2 = seed2;
+    MixSse41(value, charPlusThree, new1, new2);
+    seed1 = _mm_blendv_epi8(seed1, new1, active);
+    seed2 = _mm_blendv_epi8(seed2, new2, active);
+}
+
+__attribute__((target("sse4.1")))
+static void HashStormNamesSse41(const std::string_view* names, size_t count, StormNameHashes* hashes)
+{
+    const StormCharEntry* table = GetStormCharTable();
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const std::string_view* group = names + i;
+        const unsigned char* bytes[4];
+        unsigned char chars[4];
+        alignas(16) int32_t lengths[4];
+        size_t minLength = group[0].size(), maxLength = 0;
+        for (size_t lane = 0; lane < 4; lane++)
+        {
+            bytes[lane] = reinterpret_cast<const unsigned char*>(group[lane].data());
+            lengths[lane] = static_cast<int32_t>(group[lane].size());
+            minLength = std::min(minLength, group[lane].size());
+            maxLength = std::max(maxLength, group[lane].size());
+        }
+
+        __m128i offset1 = _mm_set1_epi32(0x7FED7FED), offset2 = _mm_set1_epi32(static_cast<int>(0xEEEEEEEE));
+        __m128i a1 = offset1, a2 = offset2;
+        __m128i b1 = offset1, b2 = offset2;
+        __m128i offsetValue, aValue, bValue, charPlusThree;
+
+        // All lanes active
+        size_t position = 0;
+        for (; position < minLength; position++)
+        {
+            for (size_t lane = 0; lane < 4; lane++)
+                chars[lane] = bytes[lane][position];
+            LoadCharsSse41(table, chars, offsetValue, aValue, bValue, charPlusThree);
+            MixSse41(offsetValue, charPlusThree, offset1, offset2);
+            MixSse41(aValue, charPlusThree, a1, a2);
+            MixSse41(bValue, charPlusThree, b1, b2);
+        }
+
+        // Lanes drop out as their names end; finished lanes read character 0
+        const __m128i lengthVector = _mm_load_si128(reinterpret_cast<const __m128i*>(lengths));
+        for (; position < maxLength; position++)
+        {
+            for (size_t lane = 0; lane < 4; lane++)
+                chars[lane] = position < static_cast<size_t>(lengths[lane]) ? bytes[lane][position] : 0;
+            __m128i active = _mm_cmpgt_epi32(lengthVector, _mm_set1_epi32(static_cast<int>(position)));
+            LoadCharsSse41(table, chars, offsetValue, aValue, bValue, charPlusThree);
+            MixMaskedSse41(offsetValue, charPlusThree, active, offset1, offset2);
+            MixMaskedSse41(aValue, charPlusThree, active, a1, a2);
+            MixMaskedSse41(bValue, charPlusThree, active, b1, b2);
+        }
+
+        alignas(16) uint32_t offsets[4], nameA[4], nameB[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(offsets), offset1);
+        _mm_store_si128(reinterpret_cast<__m128i*>(nameA), a1);
+        _mm_store_si128(reinterpret_cast<__m128i*>(nameB), b1);
+        for (size_t lane = 0; lane < 4; lane++)
+            hashes[i + lane] = StormNameHashes{offsets[lane], nameA[lane], nameB[lane]};
+    }
+
+    HashStormNamesScalar(names + i, count - i, hashes + i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i LoadCharPairAvx2(const StormCharEntry* low, const StormCharEntry* high)
+{
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(low))),
+                                   _mm_load_si128(reinterpret_cast<const __m128i*>(high)), 1);
+}
+
+// Lanes 0-3 come from the low halves and lanes 4-7 from the high halves,
+// so the in-lane transpose leaves the lanes in order
+__attribute__((target("avx2")))
+static inline void LoadCharsAvx2(const StormCharEntry* table, const unsigned char* chars,
+                                 __m256i& offset, __m256i& a, __m256i& b, __m256i& ch)
+{
+    __m256i r0 = LoadCharPairAvx2(table + chars[0], table + chars[4]);
+    __m256i r1 = LoadCharPairAvx2(table + chars[1], table + chars[5]);
+    __m256i r2 = LoadCharPairAvx2(table + chars[2], table + chars[6]);
+    __m256i r3 = LoadCharPairAvx2(table + chars[3], table + chars[7]);
+    STORMHASH_TRANSPOSE(_mm256_unpacklo_epi32, _mm256_unpackhi_epi32, _mm256_unpacklo_epi64, _mm256_unpackhi_epi64,
+                        r0, r1, r2, r3, offset, a, b, ch);
+}
+
+__attribute__((target("avx2")))
+static inline void MixAvx2(__m256i value, __m256i charPlusThree, __m256i& seed1, __m256i& seed2)
+{
+    seed1 = _mm256_xor_si256(value, _mm256_add_epi32(seed1, seed2));
+    seed2 = _mm256_add_epi32(_mm256_add_epi32(charPlusThree, seed1), _mm256_add_epi32(seed2, _mm256_slli_epi32(seed2, 5)));
+}
+
+__attribute__((target("avx2")))
+static inline void MixMaskedAvx2(__m256i value, __m256i charPlusThree, __m256i active, __m256i& seed1, __m256i& seed2)
+{
+    __m256i new1 = seed1, new2 = seed2;
+    MixAvx2(value, charPlusThree, new1, new2);
+    seed1 = _mm256_blendv_epi8(seed1, new1, active);
+    seed2 = _mm256_blendv_epi8(seed2, new2, active);
+}
+
+__attribute__((target("avx2")))
+static void HashStormNamesAvx2(const std::string_view* names, size_t count, StormNameHashes* hashes)
+{
+    const StormCharEntry* table = GetStormCharTable();
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const std::string_view* group = names + i;
+        const unsigned char* bytes[8];
+        unsigned char chars[8];
+        alignas(32) int32_t lengths[8];
+        size_t minLength = group[0].size(), maxLength = 0;
+        for (size_t lane = 0; lane < 8; lane++)
+        {
+            bytes[lane] = reinterpret_cast<const unsigned char*>(group[lane].data());
+            lengths[lane] = static_cast<int32_t>(group[lane].size());
+            minLength = std::min(minLength, group[lane].size());
+            maxLength = std::max(maxLength, group[lane].size());
+        }
+
+        __m256i offset1 = _mm256_set1_epi32(0x7FED7FED), offset2 = _mm256_set1_epi32(static_cast<int>(0xEEEEEEEE));
+        __m256i a1 = offset1, a2 = offset2;
+        __m256i b1 = offset1, b2 = offset2;
+        __m256i offsetValue, aValue, bValue, charPlusThree;
+
+        size_t position = 0;
+        for (; position < minLength; position++)
+        {
+            for (size_t lane = 0; lane < 8; lane++)
+                chars[lane] = bytes[lane][position];
+            LoadCharsAvx2(table, chars, offsetValue, aValue, bValue, charPlusThree);
+            MixAvx2(offsetValue, charPlusThree, offset1, offset2);
+            MixAvx2(aValue, charPlusThree, a1, a2);
+            MixAvx2(bValue, charPlusThree, b1, b2);
+        }
+
+        const __m256i lengthVector = _mm256_load_si256(reinterpret_cast<const __m256i*>(lengths));
+        for (; position < maxLength; position++)
+        {
+            for (size_t lane = 0; lane < 8; lane++)
+                chars[lane] = position < static_cast<size_t>(lengths[lane]) ? bytes[lane][position] : 0;
+            __m256i active = _mm256_cmpgt_epi32(lengthVector, _mm256_set1_epi32(static_cast<int>(position)));
+            LoadCharsAvx2(table, chars, offsetValue, aValue, bValue, charPlusThree);
+            MixMaskedAvx2(offsetValue, charPlusThree, active, offset1, offset2);
+            MixMaskedAvx2(aValue, charPlusThree, active, a1, a2);
+            MixMaskedAvx2(bValue, charPlusThree, active, b1, b2);
+        }
+
+        alignas(32) uint32_t offsets[8], nameA[8], nameB[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(offsets), offset1);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(nameA), a1);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(nameB), b1);
+        for (size_t lane = 0; lane < 8; lane++)
+            hashes[i + lane] = StormNameHashes{offsets[lane], nameA[lane], nameB[lane]};
+    }
+
+    // Fewer than 8 names left; 4 lanes still beat one
+    HashStormNamesSse41(names + i, count - i, hashes + i);
+}
+
+#endif // STORMHASH_X86_KERNELS
+
+const char* GetStormHashKernelName(StormHashKernel kernel)
+{
+    switch (kernel)
+    {
+        case StormHashKernel::SCALAR: return "scalar";
+        case StormHashKernel::SSE41: return "sse4.1";
+        case StormHashKernel::AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+bool IsStormHashKernelSupported(StormHashKernel kernel)
+{
+    switch (kernel)
+    {
+        case StormHashKernel::SCALAR:
+            return true;
+#ifdef STORMHASH_X86_KERNELS
+        case StormHashKernel::SSE41:
+            return __builtin_cpu_supports("sse4.1");
+        case StormHashKernel::AVX2:
+            // The AVX2 kernel finishes its batches with the SSE4.1 one
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.1");
+#endif
+        default:
+            return false;
+    }
+}
+
+StormHashKernel GetBestStormHashKernel()
+{
+    // Check mpqhashbench before preferring AVX2 here
+    static const StormHashKernel best =
+        IsStormHashKernelSupported(StormHashKernel::SSE41) ? StormHashKernel::SSE41 :
+        StormHashKernel::SCALAR;
+    return best;
+}
+
+void HashStormNames(StormHashKernel kernel, const std::string_view* names, size_t count, StormNameHashes* hashes)
+{
+    switch (kernel)
+    {
+#ifdef STORMHASH_X86_KERNELS
+        case StormHashKernel::SSE41:
+            HashStormNamesSse41(names, count, hashes);
+            return;
+        case StormHashKernel::AVX2:
+            HashStormNamesAvx2(names, count, hashes);
+            return;
+#endif
+        default:
+            HashStormNamesScalar(names, count, hashes);
+            return;
+    }
+}
+
+void HashStormNames(const std::string_view* names, size_t count, StormNameHashes* hashes)
+{
+    HashStormNames(GetBestStormHashKernel(), names, count, hashes);
+}
+
+void DecryptStormBlock(uint32_t* data, size_t count, uint32_t key)
+{
+    const uint32_t* cryptTable = GetStormCryptTable();
+
+    uint32_t seed = 0xEEEEEEEE;
+    for (size_t i = 0; i < count; i++)
+    {
+        seed += cryptTable[0x400 + (key & 0xFF)];
+        uint32_t value = data[i] ^ (key + seed);
+        key = ((~key << 0x15) + 0x11111111) | (key >> 0x0B);
+        seed = value + seed + (seed << 5) + 3;
+        data[i] = value;
+    }
+}
+
+void EncryptStormBlock(uint32_t* data, size_t count, uint32_t key)
+{
+    const uint32_t* cryptTable = GetStormCryptTable();
+
+    uint32_t seed = 0xEEEEEEEE;
+    for (size_t i = 0; i < count; i++)
+    {
+        seed += cryptTable[0x400 + (key & 0xFF)];
+        uint32_t value = data[i];
+        data[i] = value ^ (key + seed);
+        key = ((~key << 0x15) + 0x11111111) | (key >> 0x0B);
+        seed = value + seed + (seed << 5) + 3;
+    }
+}
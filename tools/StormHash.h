@@ -0,0 +1,102 @@
+/*
+    StormHash.h - Storm's HashString and table encryption
+
+    MPQ archives do not store file names. Their hash table holds two 32-bit
+    hashes of each name (name hash A and B), at a slot chosen by a third hash
+    (the table offset hash). All three come from Storm's HashString, which
+    normalizes every character (see StormName.h) and mixes it through a
+    table of 0x500 pseudo-random values that is also used to encrypt the
+    hash and block tables.
+
+    Batches of names can be hashed with SIMD kernels, where each lane hashes
+    a different name and the lanes step through their names in lockstep.
+    The scalar kernel is the reference the others are checked against.
+*/
+
+#ifndef STORMHASH_H
+#define STORMHASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Hash types (row of the crypt table used by HashString)
+enum class StormHashType : uint32_t
+{
+    TABLE_OFFSET = 0,
+    NAME_A = 1,
+    NAME_B = 2,
+    FILE_KEY = 3
+};
+
+// The three hashes Storm needs to look a name up in an MPQ hash table
+struct StormNameHashes
+{
+    uint32_t tableOffset;
+    uint32_t nameA;
+    uint32_t nameB;
+};
+
+// The 0x500-entry table shared by hashing and encryption
+const uint32_t* GetStormCryptTable();
+
+// Storm's HashString for a single hash type
+uint32_t HashStormString(std::string_view name, StormHashType type);
+
+// All three lookup hashes of one name
+StormNameHashes HashStormName(std::string_view name);
+
+// Batch hashing kernels
+enum class StormHashKernel
+{
+    SCALAR,
+    SSE41,                          // 4 lanes
+    AVX2                            // 8 lanes, with gathered table lookups
+};
+
+const char* GetStormHashKernelName(StormHashKernel kernel);
+
+// Whether this build and CPU can run a kernel
+bool IsStormHashKernelSupported(StormHashKernel kernel);
+
+// The kernel used by default: SSE4.1 when supported. AVX2 is not picked,
+// since its gathers measure no faster than the SSE4.1 table lookups
+StormHashKernel GetBestStormHashKernel();
+
+// Hash many names at once (names[i] -> hashes[i]) with a given kernel,
+// which must be supported
+void HashStormNames(StormHashKernel kernel, const std::string_view* names, size_t count, StormNameHashes* hashes);
+
+// Hash many names at once with the default kernel
+void HashStormNames(const std::string_view* names, size_t count, StormNameHashes* hashes);
+
+// Running state of one hash type. Names that share a prefix can continue
+// from the state after the prefix instead of hashing it again.
+struct StormHashSeeds
+{
+    uint32_t seed1 = 0x7FED7FED;
+    uint32_t seed2 = 0xEEEEEEEE;
+};
+
+// Hash one more character, which must already be normalized. cryptRow is
+// the crypt table row of the hash type (GetStormCryptTable() + (type << 8)).
+inline void UpdateStormHashSeeds(StormHashSeeds& seeds, const uint32_t* cryptRow, unsigned char normalizedChar)
+{
+    seeds.seed1 = cryptRow[normalizedChar] ^ (seeds.seed1 + seeds.seed2);
+    seeds.seed2 = normalizedChar + seeds.seed1 + seeds.seed2 + (seeds.seed2 << 5) + 3;
+}
+
+// Hash a normalized string onto a running state
+inline void UpdateStormHashSeeds(StormHashSeeds& seeds, const uint32_t* cryptRow, std::string_view normalized)
+{
+    for (char c : normalized)
+        UpdateStormHashSeeds(seeds, cryptRow, static_cast<unsigned char>(c));
+}
+
+// Decrypt a block of little-endian 32-bit values in place
+void DecryptStormBlock(uint32_t* data, size_t count, uint32_t key);
+
+// Encrypt a block of little-endian 32-bit values in place
+void EncryptStormBlock(uint32_t* data, size_t count, uint32_t key);
+
+#endif // STORMHASH_H
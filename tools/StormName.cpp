@@ -0,0 +1,24 @@
+/*
+    StormName.cpp - File name normalization the way Storm does it
+*/
+
+#include "StormName.h"
+
+std::string NormalizeStormName(std::string_view name)
+{
+    std::string normalized(name);
+    for (char& c : normalized)
+        c = NormalizeStormChar(c);
+    return normalized;
+}
+
+std::string NormalizeArchiveName(std::string_view archive)
+{
+    std::string normalized(archive);
+    for (char& c : normalized)
+    {
+        if (c >= 'A' && c <= 'Z')
+            c = static_cast<char>(c - 'A' + 'a');
+    }
+    return normalized;
+}
@@ -0,0 +1,31 @@
+/*
+    StormName.h - File name normalization the way Storm does it
+
+    Storm looks up names case-insensitively and treats '/' as '\', by running
+    every character through a table before hashing. Two names that normalize
+    to the same string refer to the same file.
+*/
+
+#ifndef STORMNAME_H
+#define STORMNAME_H
+
+#include <string>
+#include <string_view>
+
+// Normalize a single character (upper case, '/' becomes '\')
+inline char NormalizeStormChar(char c)
+{
+    if (c >= 'a' && c <= 'z')
+        return static_cast<char>(c - 'a' + 'A');
+    if (c == '/')
+        return '\\';
+    return c;
+}
+
+// Normalize a whole name
+std::string NormalizeStormName(std::string_view name);
+
+// Normalize an archive name for grouping (archive names are case-insensitive on Windows)
+std::string NormalizeArchiveName(std::string_view archive);
+
+#endif // STORMNAME_H
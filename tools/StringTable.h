@@ -0,0 +1,130 @@
+/*
+    StringTable.h - Flat open-addressing string table for the MpqFileLister tools
+
+    Interns strings into one contiguous arena and indexes them with a probe
+    array of (hash, index) slots. Lookups of known strings touch one slot and
+    one arena location instead of chasing list nodes, which matters when a
+    tool checks millions of log lines against a few hundred thousand names.
+*/
+
+#ifndef STRINGTABLE_H
+#define STRINGTABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// 64-bit FNV-1a; good enough spread for file names, and cheap to compute
+// while normalizing a name byte by byte
+constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+inline uint64_t HashBytes(std::string_view text, uint64_t hash = FNV_OFFSET_BASIS)
+{
+    for (char c : text)
+        hash = (hash ^ static_cast<unsigned char>(c)) * FNV_PRIME;
+    return hash;
+}
+
+class StringTable
+{
+private:
+    struct Slot
+    {
+        uint64_t hash;
+        uint32_t index;     // Index + 1; 0 marks an empty slot
+    };
+
+    std::vector<Slot> m_slots;
+    std::vector<uint64_t> m_hashes;
+    std::vector<std::pair<uint32_t, uint32_t>> m_spans;  // (offset, length) into m_arena
+    std::string m_arena;
+
+    static uint64_t Mix(uint64_t hash)
+    {
+        // FNV's low bits are weak; fold the high bits in before masking
+        return hash ^ (hash >> 29) ^ (hash >> 47);
+    }
+
+    void Grow()
+    {
+        std::vector<Slot> slots(m_slots.empty() ? 1024 : m_slots.size() * 2, Slot{0, 0});
+        size_t mask = slots.size() - 1;
+        for (uint32_t i = 0; i < m_hashes.size(); i++)
+        {
+            size_t pos = Mix(m_hashes[i]) & mask;
+            while (slots[pos].index != 0)
+                pos = (pos + 1) & mask;
+            slots[pos] = Slot{m_hashes[i], i + 1};
+        }
+        m_slots.swap(slots);
+    }
+
+public:
+    size_t Size() const { return m_spans.size(); }
+
+    std::string_view Get(uint32_t index) const
+    {
+        return std::string_view(m_arena.data() + m_spans[index].first, m_spans[index].second);
+    }
+
+    uint64_t HashOf(uint32_t index) const { return m_hashes[index]; }
+
+    // Find a string; returns its index or UINT32_MAX
+    uint32_t Find(std::string_view text, uint64_t hash) const
+    {
+        if (m_slots.empty())
+            return UINT32_MAX;
+
+        size_t mask = m_slots.size() - 1;
+        for (size_t pos = Mix(hash) & mask; m_slots[pos].index != 0; pos = (pos + 1) & mask)
+        {
+            const Slot& slot = m_slots[pos];
+            if (slot.hash == hash && Get(slot.index - 1) == text)
+                return slot.index - 1;
+        }
+        return UINT32_MAX;
+    }
+
+    uint32_t Find(std::string_view text) const { return Find(text, HashBytes(text)); }
+
+    // Add a string unless present; returns its index and whether it was added
+    std::pair<uint32_t, bool> Insert(std::string_view text, uint64_t hash)
+    {
+        // Keep the load factor at or below one half
+        if ((m_spans.size() + 1) * 2 > m_slots.size())
+            Grow();
+
+        size_t mask = m_slots.size() - 1;
+        size_t pos = Mix(hash) & mask;
+        for (; m_slots[pos].index != 0; pos = (pos + 1) & mask)
+        {
+            const Slot& slot = m_slots[pos];
+            if (slot.hash == hash && Get(slot.index - 1) == text)
+                return {slot.index - 1, false};
+        }
+
+        uint32_t index = static_cast<uint32_t>(m_spans.size());
+        m_spans.emplace_back(static_cast<uint32_t>(m_arena.size()), static_cast<uint32_t>(text.size()));
+        m_arena.append(text.data(), text.size());
+        m_hashes.push_back(hash);
+        m_slots[pos] = Slot{hash, index + 1};
+        return {index, true};
+    }
+
+    std::pair<uint32_t, bool> Insert(std::string_view text) { return Insert(text, HashBytes(text)); }
+
+    void Clear()
+    {
+        m_slots.clear();
+        m_hashes.clear();
+        m_spans.clear();
+        m_arena.clear();
+    }
+};
+
+#endif // STRINGTABLE_H
@@ -0,0 +1,135 @@
+/*
+    ThreadPool.cpp - Work-stealing thread pool for the MpqFileLister tools
+*/
+
+#include "ThreadPool.h"
+
+// Index of the worker running on the current thread, or SIZE_MAX elsewhere
+static thread_local const WorkStealingPool* t_pool = nullptr;
+static thread_local size_t t_workerIndex = SIZE_MAX;
+
+WorkStealingPool::WorkStealingPool(unsigned threadCount)
+    : m_nextWorker(0)
+    , m_pendingTasks(0)
+    , m_queuedTasks(0)
+    , m_stopping(false)
+{
+    if (threadCount == 0)
+        threadCount = std::thread::hardware_concurrency();
+    if (threadCount == 0)
+        threadCount = 1;
+
+    for (unsigned i = 0; i < threadCount; i++)
+        m_workers.push_back(std::make_unique<Worker>());
+    for (unsigned i = 0; i < threadCount; i++)
+        m_threads.emplace_back(&WorkStealingPool::WorkerLoop, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        m_stopping = true;
+    }
+    m_workAvailable.notify_all();
+    for (std::thread& thread : m_threads)
+        thread.join();
+}
+
+void WorkStealingPool::Submit(std::function<void()> task)
+{
+    // Tasks submitted from a worker go to its own deque; others are spread round-robin
+    size_t target = (t_pool == this) ? t_workerIndex
+                                     : m_nextWorker.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+
+    // Counted before the task can be seen, so a thief that runs it at once can
+    // neither end a Wait() early nor take m_queuedTasks below zero. A worker
+    // woken in between finds no task and tries again.
+    {
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        m_pendingTasks++;
+        m_queuedTasks++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_workers[target]->mutex);
+        m_workers[target]->tasks.push_back(std::move(task));
+    }
+    m_workAvailable.notify_one();
+}
+
+bool WorkStealingPool::TryTake(size_t self, std::function<void()>& task)
+{
+    // Own deque, newest first
+    {
+        Worker& own = *m_workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Steal the oldest task from the others
+    for (size_t offset = 1; offset < m_workers.size(); offset++)
+    {
+        Worker& victim = *m_workers[(self + offset) % m_workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::WorkerLoop(size_t self)
+{
+    t_pool = this;
+    t_workerIndex = self;
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_stateMutex);
+            m_workAvailable.wait(lock, [this]() { return m_stopping || m_queuedTasks > 0; });
+            if (m_stopping && m_queuedTasks == 0)
+                return;
+        }
+
+        std::function<void()> task;
+        if (!TryTake(self, task))
+            continue;  // Another worker got there first
+
+        {
+            std::lock_guard<std::mutex> lock(m_stateMutex);
+            m_queuedTasks--;
+        }
+
+        task();
+
+        bool allDone;
+        {
+            std::lock_guard<std::mutex> lock(m_stateMutex);
+            allDone = (--m_pendingTasks == 0);
+        }
+        if (allDone)
+            m_allDone.notify_all();
+    }
+}
+
+void WorkStealingPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(m_stateMutex);
+    m_allDone.wait(lock, [this]() { return m_pendingTasks == 0; });
+}
+
+void ParallelFor(WorkStealingPool& pool, size_t count, const std::function<void(size_t)>& fn)
+{
+    for (size_t i = 0; i < count; i++)
+        pool.Submit([&fn, i]() { fn(i); });
+    pool.Wait();
+}
@@ -0,0 +1,69 @@
+/*
+    ThreadPool.h - Work-stealing thread pool for the MpqFileLister tools
+
+    Every worker owns a task deque. Workers take their own newest task first
+    (good cache locality for tasks that spawn tasks) and steal the oldest
+    task from other workers when they run out, so uneven work - such as one
+    huge log among many small ones - spreads across all cores.
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool
+{
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_nextWorker;
+
+    // Tasks submitted but not yet finished, and the signalling around it
+    std::mutex m_stateMutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_allDone;
+    size_t m_pendingTasks;
+    size_t m_queuedTasks;
+    bool m_stopping;
+
+    bool TryTake(size_t self, std::function<void()>& task);
+    void WorkerLoop(size_t self);
+
+public:
+    // threadCount 0 uses one thread per hardware thread
+    explicit WorkStealingPool(unsigned threadCount = 0);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    size_t ThreadCount() const { return m_threads.size(); }
+
+    // Queue a task. Tasks may submit further tasks.
+    void Submit(std::function<void()> task);
+
+    // Block until every submitted task (including tasks they submitted) has
+    // finished. Must not be called from a task running on this pool.
+    void Wait();
+};
+
+// Run fn(i) for i in [0, count) on the pool and wait for all of them.
+// Must not be called from a task running on the same pool.
+void ParallelFor(WorkStealingPool& pool, size_t count, const std::function<void(size_t)>& fn);
+
+#endif // THREADPOOL_H
@@ -0,0 +1,260 @@
+/*
+    mpqbreak - Find unknown file names in an MPQ from names that are known
+
+    Known names come from MpqFileLister logs (in any LogFormat) and from the
+    archive's listfile. Templates are derived from them (see NameBreaker.h),
+    combined with a dictionary and tested against the archive's hash table.
+    Every name found is appended to the listfile, so the next run starts
+    from it.
+
+    Usage:
+        mpqbreak [-j threads] [-l listfile] [-d dictionary] [-p pattern]
+                 [--max-digits n] [--no-derive] <archive> [-- <log> ...]
+
+    -l  Listfile to read known names from and append hits to
+        (default: <archive file name>.txt, as written by mpqlog-merge)
+    -d  File with one word per line; may be given several times. The file
+        names and directories of the known names are always in the dictionary.
+    -p  Extra template, such as "unit\zerg\*.grp" or "sound\misc\button##.wav";
+        may be given several times
+*/
+
+#include "LogParser.h"
+#include "MappedFile.h"
+#include "MpqArchive.h"
+#include "NameBreaker.h"
+#include "StormHash.h"
+#include "StormName.h"
+#include "StringTable.h"
+#include "ThreadPool.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+static void PrintUsage()
+{
+    fprintf(stderr,
+        "Usage: mpqbreak [-j threads] [-l listfile] [-d dictionary] [-p pattern]\n"
+        "                [--max-digits n] [--no-derive] <archive> [-- <log> ...]\n");
+}
+
+// Add the names in a log or listfile to names, once per normalized name.
+// Unless mustExist, a file that does not exist adds nothing.
+static bool ReadKnownNames(const std::string& path, bool mustExist, StringTable& seen, std::vector<std::string>& names)
+{
+    MappedFile file;
+    if (!file.Open(path))
+        return !mustExist && errno == ENOENT;
+
+    std::string key;
+    ForEachLogRecord(file.Data(), file.Size(), [&](const LogRecord& record)
+    {
+        key = NormalizeStormName(record.fileName);
+        if (seen.Insert(key, HashBytes(key)).second)
+            names.emplace_back(record.fileName);
+    });
+    return true;
+}
+
+static bool ReadWords(const std::string& path, std::vector<std::string>& words)
+{
+    MappedFile file;
+    if (!file.Open(path))
+        return false;
+
+    const char* data = file.Data();
+    const char* end = data + file.Size();
+    while (data < end)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(data, '\n', static_cast<size_t>(end - data)));
+        if (!lineEnd)
+            lineEnd = end;
+        const char* wordEnd = lineEnd;
+        if (wordEnd > data && wordEnd[-1] == '\r')
+            wordEnd--;
+        if (wordEnd > data)
+            words.emplace_back(data, wordEnd);
+        data = lineEnd + 1;
+    }
+    return true;
+}
+
+// File names without extension, and directory names, of the known names
+static void AddWordsFromNames(const std::vector<std::string>& names, std::vector<std::string>& words)
+{
+    for (const std::string& name : names)
+    {
+        size_t start = 0;
+        while (start < name.size())
+        {
+            size_t end = name.find_first_of("\\/", start);
+            if (end == std::string::npos)
+            {
+                size_t dot = name.rfind('.');
+                end = dot != std::string::npos && dot > start ? dot : name.size();
+                words.push_back(name.substr(start, end - start));
+                break;
+            }
+            words.push_back(name.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+}
+
+static bool AppendToListfile(const std::string& path, const std::vector<std::string>& names)
+{
+    // Do not glue the first name onto an unterminated last line
+    bool needsNewline = false;
+    {
+        MappedFile existing;
+        if (existing.Open(path, false) && existing.Size() > 0)
+            needsNewline = existing.Data()[existing.Size() - 1] != '\n';
+    }
+
+    FILE* out = fopen(path.c_str(), "ab");
+    if (!out)
+        return false;
+    if (needsNewline)
+        fputc('\n', out);
+    for (const std::string& name : names)
+        fprintf(out, "%s\n", name.c_str());
+    bool ok = ferror(out) == 0;
+    return fclose(out) == 0 && ok;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned threads = 0;
+    unsigned maxDigits = 3;
+    bool derive = true;
+    std::string listfile;
+    std::string archivePath;
+    std::vector<std::string> dictionaries;
+    std::vector<std::string> patterns;
+    std::vector<std::string> logs;
+    bool readingLogs = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (readingLogs)
+            logs.push_back(arg);
+        else if (arg == "--")
+            readingLogs = true;
+        else if (arg == "-j" && i + 1 < argc)
+            threads = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "-l" && i + 1 < argc)
+            listfile = argv[++i];
+        else if (arg == "-d" && i + 1 < argc)
+            dictionaries.push_back(argv[++i]);
+        else if (arg == "-p" && i + 1 < argc)
+            patterns.push_back(argv[++i]);
+        else if (arg == "--max-digits" && i + 1 < argc)
+            maxDigits = std::min<unsigned>(6, static_cast<unsigned>(strtoul(argv[++i], nullptr, 10)));
+        else if (arg == "--no-derive")
+            derive = false;
+        else if (arg == "-h" || arg == "--help")
+        {
+            PrintUsage();
+            return 0;
+        }
+        else if (archivePath.empty())
+            archivePath = arg;
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    if (archivePath.empty())
+    {
+        PrintUsage();
+        return 2;
+    }
+    if (listfile.empty())
+        listfile = std::filesystem::path(archivePath).filename().string() + ".txt";
+
+    MpqArchive archive;
+    if (!archive.Open(archivePath))
+    {
+        fprintf(stderr, "mpqbreak: cannot read %s: %s\n", archivePath.c_str(), archive.Error().c_str());
+        return 1;
+    }
+
+    StringTable seen;
+    std::vector<std::string> knownNames;
+    if (!ReadKnownNames(listfile, false, seen, knownNames))
+    {
+        fprintf(stderr, "mpqbreak: cannot read %s: %s\n", listfile.c_str(), strerror(errno));
+        return 1;
+    }
+    for (const std::string& log : logs)
+    {
+        if (!ReadKnownNames(log, true, seen, knownNames))
+        {
+            fprintf(stderr, "mpqbreak: cannot read %s: %s\n", log.c_str(), strerror(errno));
+            return 1;
+        }
+    }
+
+    // Entries already named are not searched for
+    std::vector<std::string_view> views(knownNames.begin(), knownNames.end());
+    std::vector<StormNameHashes> hashes(views.size());
+    HashStormNames(views.data(), views.size(), hashes.data());
+    std::vector<bool> resolved(archive.HashTable().size());
+    for (const StormNameHashes& nameHashes : hashes)
+        archive.ForEachHashEntry(nameHashes, [&resolved](size_t index) { resolved[index] = true; });
+
+    std::vector<std::string> words;
+    for (const std::string& dictionary : dictionaries)
+    {
+        if (!ReadWords(dictionary, words))
+        {
+            fprintf(stderr, "mpqbreak: cannot read %s: %s\n", dictionary.c_str(), strerror(errno));
+            return 1;
+        }
+    }
+    AddWordsFromNames(knownNames, words);
+
+    NameBreaker breaker;
+    uint32_t dictionary = breaker.AddWordList(words);
+    for (const std::string& pattern : patterns)
+    {
+        if (!breaker.AddPattern(pattern, dictionary))
+        {
+            fprintf(stderr, "mpqbreak: pattern needs exactly one '*' or run of '#': %s\n", pattern.c_str());
+            return 2;
+        }
+    }
+    if (derive)
+        breaker.DeriveTemplates(knownNames, dictionary, maxDigits);
+
+    WorkStealingPool pool(threads);
+    NameBreaker::Stats stats;
+    auto startTime = std::chrono::steady_clock::now();
+    std::vector<std::string> hits = breaker.Search(archive, resolved, pool, stats);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    for (const std::string& hit : hits)
+        printf("%s\n", hit.c_str());
+
+    fprintf(stderr,
+        "%zu known names, %zu files without a name, %zu templates, %zu dictionary words\n"
+        "%llu candidates in %.2f s (%.1f M/s on %zu threads), %llu passed the filter, %zu new names\n",
+        knownNames.size(), stats.targets, stats.templates, words.size(),
+        (unsigned long long)stats.candidates, seconds, seconds > 0 ? stats.candidates / 1e6 / seconds : 0.0,
+        pool.ThreadCount(), (unsigned long long)stats.filterPasses, hits.size());
+
+    if (!hits.empty() && !AppendToListfile(listfile, hits))
+    {
+        fprintf(stderr, "mpqbreak: cannot write %s\n", listfile.c_str());
+        return 1;
+    }
+    return 0;
+}
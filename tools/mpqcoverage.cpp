@@ -0,0 +1,317 @@
+/*
+    mpqcoverage - Report how much of an MPQ's hash table a set of logs names
+
+    Reads the hash and block tables of one or more archives, hashes every
+    name found in the given logs (in any LogFormat, or plain listfiles) with
+    Storm's HashString and reports, per archive, how many file entries are
+    resolved by a known name and how many are still unknown.
+
+    Usage:
+        mpqcoverage [-j threads] [-o output directory] <archive> [<archive> ...] -- <log> [<log> ...]
+
+    With -o, two files are written per archive:
+        <archive>.resolved.txt      Listfile of the names found in the archive
+        <archive>.unresolved.txt    Hash table entries without a known name:
+                                    index, name hash A, name hash B, locale,
+                                    block index and file size
+
+    Every name is checked against every archive, whichever archive it was
+    logged from, since files are often duplicated between archives.
+*/
+
+#include "LogParser.h"
+#include "MappedFile.h"
+#include "MpqArchive.h"
+#include "StormHash.h"
+#include "StormName.h"
+#include "StringTable.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Names hashed per call to HashStormNames
+static const size_t NAMES_PER_BATCH = 4096;
+
+// Unique names of one log chunk, with their Storm hashes
+struct ChunkNames
+{
+    std::string spellingData;                               // Spellings, back to back
+    std::vector<std::pair<uint32_t, uint32_t>> spellings;   // Offset and length in spellingData
+    std::vector<StormNameHashes> hashes;
+
+    std::string_view Spelling(size_t i) const
+    {
+        return std::string_view(spellingData).substr(spellings[i].first, spellings[i].second);
+    }
+};
+
+static void PrintUsage()
+{
+    fprintf(stderr,
+        "Usage: mpqcoverage [-j threads] [-o output directory] <archive> [<archive> ...] -- <log> [<log> ...]\n");
+}
+
+static bool WriteResolved(const std::string& path, const MpqArchive& archive,
+                          const std::vector<std::string_view>& entryNames)
+{
+    std::vector<std::string_view> found;
+    for (size_t i = 0; i < entryNames.size(); i++)
+    {
+        if (!entryNames[i].empty() && archive.IsFileEntry(archive.HashTable()[i]))
+            found.push_back(entryNames[i]);
+    }
+
+    // One line per name, even if the archive has it in several locales
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+
+    std::ofstream out(path, std::ios::out | std::ios::trunc | std::ios::binary);
+    for (std::string_view name : found)
+        out << name << "\n";
+    return static_cast<bool>(out);
+}
+
+static bool WriteUnresolved(const std::string& path, const MpqArchive& archive,
+                            const std::vector<std::string_view>& entryNames)
+{
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out)
+        return false;
+
+    const auto& hashTable = archive.HashTable();
+    for (size_t i = 0; i < hashTable.size(); i++)
+    {
+        const MpqHashEntry& entry = hashTable[i];
+        if (!entryNames[i].empty() || !archive.IsFileEntry(entry))
+            continue;
+        fprintf(out, "%zu %08" PRIX32 " %08" PRIX32 " %04X %" PRIu32 " %" PRIu32 "\n",
+                i, entry.nameA, entry.nameB, entry.locale, entry.blockIndex,
+                archive.BlockTable()[entry.blockIndex].fileSize);
+    }
+
+    bool ok = ferror(out) == 0;
+    return fclose(out) == 0 && ok;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned threads = 0;
+    std::string outputDirectory;
+    std::vector<std::string> archivePaths;
+    std::vector<std::string> logPaths;
+    bool readingLogs = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (readingLogs)
+            logPaths.push_back(arg);
+        else if (arg == "--")
+            readingLogs = true;
+        else if (arg == "-j" && i + 1 < argc)
+            threads = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "-o" && i + 1 < argc)
+            outputDirectory = argv[++i];
+        else if (arg == "-h" || arg == "--help")
+        {
+            PrintUsage();
+            return 0;
+        }
+        else
+            archivePaths.push_back(arg);
+    }
+
+    if (archivePaths.empty() || logPaths.empty())
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    std::vector<MpqArchive> archives(archivePaths.size());
+    for (size_t i = 0; i < archivePaths.size(); i++)
+    {
+        if (!archives[i].Open(archivePaths[i]))
+        {
+            fprintf(stderr, "mpqcoverage: cannot read %s: %s\n",
+                    archivePaths[i].c_str(), archives[i].Error().c_str());
+            return 1;
+        }
+    }
+
+    std::vector<MappedFile> logs(logPaths.size());
+    for (size_t i = 0; i < logPaths.size(); i++)
+    {
+        if (!logs[i].Open(logPaths[i]))
+        {
+            fprintf(stderr, "mpqcoverage: cannot read %s: %s\n", logPaths[i].c_str(), strerror(errno));
+            return 1;
+        }
+    }
+
+    WorkStealingPool pool(threads);
+    auto startTime = std::chrono::steady_clock::now();
+
+    // Every chunk deduplicates and hashes its own names. Names repeated
+    // across chunks are hashed again, which is cheaper than sharing a map;
+    // they simply resolve the same entries twice.
+    std::vector<std::pair<const MappedFile*, std::pair<size_t, size_t>>> chunks;
+    for (const MappedFile& log : logs)
+    {
+        for (const auto& chunk : SplitAtLines(log.Data(), log.Size(), 32u << 20))
+            chunks.emplace_back(&log, chunk);
+    }
+
+    std::vector<ChunkNames> chunkNames(chunks.size());
+    std::atomic<uint64_t> hashNanoseconds{0};
+    ParallelFor(pool, chunks.size(), [&](size_t c)
+    {
+        const MappedFile& log = *chunks[c].first;
+        size_t begin = chunks[c].second.first;
+        size_t end = chunks[c].second.second;
+        ChunkNames& names = chunkNames[c];
+        StringTable localNames;
+        std::string key;
+
+        ForEachLogRecord(log.Data() + begin, end - begin, [&](const LogRecord& record)
+        {
+            key.resize(record.fileName.size());
+            for (size_t i = 0; i < record.fileName.size(); i++)
+                key[i] = NormalizeStormChar(record.fileName[i]);
+
+            auto [index, inserted] = localNames.Insert(key, HashBytes(key));
+            if (!inserted && names.Spelling(index) == record.fileName)
+                return;
+
+            // Listfiles use '\' as the separator; keep the smallest spelling
+            size_t offset = names.spellingData.size();
+            names.spellingData.append(record.fileName);
+            std::replace(names.spellingData.begin() + offset, names.spellingData.end(), '/', '\\');
+            std::pair<uint32_t, uint32_t> spelling(static_cast<uint32_t>(offset),
+                                                   static_cast<uint32_t>(record.fileName.size()));
+            if (inserted)
+                names.spellings.push_back(spelling);
+            else if (std::string_view(names.spellingData).substr(offset) < names.Spelling(index))
+                names.spellings[index] = spelling;
+            else
+                names.spellingData.resize(offset);
+        });
+
+        auto hashStart = std::chrono::steady_clock::now();
+        size_t count = localNames.Size();
+        std::vector<std::string_view> views(count);
+        for (size_t i = 0; i < count; i++)
+            views[i] = localNames.Get(static_cast<uint32_t>(i));
+        names.hashes.resize(count);
+        for (size_t first = 0; first < count; first += NAMES_PER_BATCH)
+            HashStormNames(views.data() + first, std::min(NAMES_PER_BATCH, count - first), names.hashes.data() + first);
+        hashNanoseconds.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - hashStart).count()), std::memory_order_relaxed);
+
+        // Parsed pages will not be needed again
+        log.DontNeed(begin, end - begin);
+    });
+
+    size_t nameCount = 0;
+    for (const ChunkNames& names : chunkNames)
+        nameCount += names.hashes.size();
+
+    auto parseTime = std::chrono::steady_clock::now();
+
+    if (!outputDirectory.empty())
+    {
+        std::error_code error;
+        std::filesystem::create_directories(outputDirectory, error);
+    }
+
+    bool writeFailed = false;
+    for (size_t a = 0; a < archives.size(); a++)
+    {
+        const MpqArchive& archive = archives[a];
+        const auto& hashTable = archive.HashTable();
+
+        // Look the names up in parallel: (hash table index, name index) per chunk
+        std::vector<std::vector<std::pair<size_t, size_t>>> matches(chunkNames.size());
+        ParallelFor(pool, chunkNames.size(), [&](size_t c)
+        {
+            const auto& hashes = chunkNames[c].hashes;
+            for (size_t i = 0; i < hashes.size(); i++)
+            {
+                // Every entry of the name, including other locales
+                archive.ForEachHashEntry(hashes[i], [&matches, c, i](size_t index)
+                {
+                    matches[c].emplace_back(index, i);
+                });
+            }
+        });
+
+        // Name the entries, with the smallest spelling when chunks disagree
+        std::vector<std::string_view> entryNames(hashTable.size());
+        for (size_t c = 0; c < matches.size(); c++)
+        {
+            for (const auto& match : matches[c])
+            {
+                std::string_view spelling = chunkNames[c].Spelling(match.second);
+                std::string_view& name = entryNames[match.first];
+                if (name.empty() || spelling < name)
+                    name = spelling;
+            }
+        }
+
+        size_t files = 0;
+        size_t resolved = 0;
+        for (size_t i = 0; i < hashTable.size(); i++)
+        {
+            if (!archive.IsFileEntry(hashTable[i]))
+                continue;
+            files++;
+            if (!entryNames[i].empty())
+                resolved++;
+        }
+
+        std::string archiveName = std::filesystem::path(archivePaths[a]).filename().string();
+        printf("%s: %zu hash table entries, %zu files, %zu resolved (%.1f%%), %zu unresolved\n",
+               archiveName.c_str(), hashTable.size(), files, resolved,
+               files ? 100.0 * resolved / files : 100.0, files - resolved);
+
+        if (!outputDirectory.empty())
+        {
+            std::filesystem::path base = std::filesystem::path(outputDirectory) / archiveName;
+            std::string resolvedPath = base.string() + ".resolved.txt";
+            std::string unresolvedPath = base.string() + ".unresolved.txt";
+            if (!WriteResolved(resolvedPath, archive, entryNames))
+            {
+                fprintf(stderr, "mpqcoverage: cannot write %s\n", resolvedPath.c_str());
+                writeFailed = true;
+            }
+            if (!WriteUnresolved(unresolvedPath, archive, entryNames))
+            {
+                fprintf(stderr, "mpqcoverage: cannot write %s\n", unresolvedPath.c_str());
+                writeFailed = true;
+            }
+        }
+    }
+
+    auto endTime = std::chrono::steady_clock::now();
+    double parseSeconds = std::chrono::duration<double>(parseTime - startTime).count();
+    double hashSeconds = hashNanoseconds.load() / 1e9;
+    double lookupSeconds = std::chrono::duration<double>(endTime - parseTime).count();
+
+    fprintf(stderr,
+        "%zu names from %zu logs: parse and hash %.2f s (hashing %.3f s, %.1f M names/s), "
+        "check against %zu archives %.3f s, %zu threads\n",
+        nameCount, logs.size(), parseSeconds, hashSeconds,
+        hashSeconds > 0 ? nameCount / 1e6 / hashSeconds : 0.0,
+        archives.size(), lookupSeconds, pool.ThreadCount());
+
+    return writeFailed ? 1 : 0;
+}
@@ -0,0 +1,589 @@
+/*
+    mpqdiff - Compare the load performance of two sets of sessions
+
+    Usage:
+        mpqdiff [-j threads] [--gap ms] [--top n] [-o report] <log> [<log> ...] -- <log> [<log> ...]
+
+    The logs before "--" are the baseline sessions (say, the previous mod
+    build), those after it the candidate sessions. Each log is one session,
+    in any format with timestamps; Chrome traces also give the time every
+    open spent in Storm (its latency).
+
+    Accesses are aligned by name and occurrence: the third open of a file in
+    a baseline session is compared with its third open in a candidate
+    session. Within a set, every aligned access takes the median of its
+    sessions' load offset (time since the session's first open) and latency.
+    The report ranks the files that got slower (total latency of their opens)
+    and the files first loaded later or earlier, and compares the load
+    phases - bursts of opens separated by --gap milliseconds (1000) of idle
+    time, aligned by their position in the session. Names only one set opens
+    are counted. With -o, one line per file is written as well:
+        <name> <tab> <opens> <tab> <opens> <tab> <first ms> <tab> <first ms> <tab> <latency ms> <tab> <latency ms>
+    baseline before candidate, with "-" for values a set does not have.
+
+    Logs are memory-mapped and cut into chunks that are parsed in parallel,
+    like mpqindex does, and sessions are aligned in parallel.
+*/
+
+#include "LogParser.h"
+#include "MappedFile.h"
+#include "StormName.h"
+#include "StringTable.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const size_t CHUNK_SIZE = 16u << 20;
+static const uint64_t NO_VALUE = UINT64_MAX;
+
+// An access as parsed, with a name local to its chunk
+struct ParsedAccess
+{
+    uint32_t name;
+    bool hasLatency;
+    uint64_t time;              // Microseconds
+    uint64_t latency;
+};
+
+struct ChunkResult
+{
+    uint32_t log = 0;
+    StringTable names;                      // Normalized
+    std::vector<std::string> spellings;     // First spelling of each name
+    std::vector<ParsedAccess> accesses;
+    std::vector<uint32_t> globalNames;
+    bool sorted = true;
+};
+
+// An access of a session, placed in the session
+struct SessionAccess
+{
+    uint32_t name;
+    uint32_t occurrence;        // 0 for the first open of the name in the session
+    bool hasLatency;
+    uint64_t offset;            // Since the session's first open
+    uint64_t latency;
+};
+
+struct Phase
+{
+    uint64_t start = 0;
+    uint64_t end = 0;
+    uint64_t opens = 0;
+    uint64_t latency = 0;
+};
+
+struct Session
+{
+    std::vector<SessionAccess> accesses;
+    std::vector<Phase> phases;
+    bool hasLatency = false;
+};
+
+// An access aligned across the sessions of a set, with the medians of its sessions
+struct AlignedAccess
+{
+    uint32_t name;
+    uint32_t occurrence;
+    uint64_t offset;
+    uint64_t latency;           // NO_VALUE without latencies
+};
+
+// Phase medians across the sessions of a set
+struct PhaseSummary
+{
+    uint64_t start = 0;
+    uint64_t duration = 0;
+    uint64_t opens = 0;
+    uint64_t latency = 0;
+};
+
+struct FileDiff
+{
+    uint32_t opens[2] = {0, 0};
+    uint64_t first[2] = {NO_VALUE, NO_VALUE};
+    uint64_t latency[2] = {NO_VALUE, NO_VALUE};
+};
+
+static void PrintUsage()
+{
+    fprintf(stderr, "Usage: mpqdiff [-j threads] [--gap ms] [--top n] [-o report] <log> [<log> ...] -- <log> [<log> ...]\n");
+}
+
+static uint64_t Median(std::vector<uint64_t>& values)
+{
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+static double Ms(uint64_t micros)
+{
+    return micros / 1000.0;
+}
+
+static double DeltaMs(uint64_t a, uint64_t b)
+{
+    return (static_cast<double>(b) - static_cast<double>(a)) / 1000.0;
+}
+
+// Order a session's accesses by time, number the opens of every name and split them into phases
+static void BuildSession(std::vector<ParsedAccess>& parsed, bool sorted, size_t nameCount, uint64_t gapMicros,
+                         Session& session)
+{
+    if (!sorted)
+    {
+        std::stable_sort(parsed.begin(), parsed.end(), [](const ParsedAccess& a, const ParsedAccess& b)
+        {
+            return a.time < b.time;
+        });
+    }
+
+    std::vector<uint32_t> occurrences(nameCount, 0);
+    uint64_t start = parsed.empty() ? 0 : parsed.front().time;
+    session.accesses.reserve(parsed.size());
+    for (const ParsedAccess& access : parsed)
+    {
+        uint64_t offset = access.time - start;
+        uint64_t end = offset + (access.hasLatency ? access.latency : 0);
+        if (session.phases.empty() || offset > session.phases.back().end + gapMicros)
+        {
+            session.phases.emplace_back();
+            session.phases.back().start = offset;
+        }
+        Phase& phase = session.phases.back();
+        phase.end = std::max(phase.end, end);
+        phase.opens++;
+        phase.latency += access.hasLatency ? access.latency : 0;
+
+        session.accesses.push_back(SessionAccess{access.name, occurrences[access.name]++, access.hasLatency,
+                                                 offset, access.latency});
+        session.hasLatency = session.hasLatency || access.hasLatency;
+    }
+}
+
+// Align the accesses of a set's sessions by name and occurrence
+static std::vector<AlignedAccess> AlignSet(const std::vector<Session>& sessions, size_t first, size_t last)
+{
+    std::vector<SessionAccess> all;
+    for (size_t s = first; s < last; s++)
+        all.insert(all.end(), sessions[s].accesses.begin(), sessions[s].accesses.end());
+    std::sort(all.begin(), all.end(), [](const SessionAccess& a, const SessionAccess& b)
+    {
+        return a.name != b.name ? a.name < b.name : a.occurrence < b.occurrence;
+    });
+
+    std::vector<AlignedAccess> aligned;
+    std::vector<uint64_t> offsets;
+    std::vector<uint64_t> latencies;
+    for (size_t i = 0; i < all.size(); )
+    {
+        size_t j = i;
+        offsets.clear();
+        latencies.clear();
+        for (; j < all.size() && all[j].name == all[i].name && all[j].occurrence == all[i].occurrence; j++)
+        {
+            offsets.push_back(all[j].offset);
+            if (all[j].hasLatency)
+                latencies.push_back(all[j].latency);
+        }
+        aligned.push_back(AlignedAccess{all[i].name, all[i].occurrence, Median(offsets),
+                                        latencies.empty() ? NO_VALUE : Median(latencies)});
+        i = j;
+    }
+    return aligned;
+}
+
+static std::vector<PhaseSummary> SummarizePhases(const std::vector<Session>& sessions, size_t first, size_t last)
+{
+    size_t phaseCount = 0;
+    for (size_t s = first; s < last; s++)
+        phaseCount = std::max(phaseCount, sessions[s].phases.size());
+
+    std::vector<PhaseSummary> summaries(phaseCount);
+    std::vector<uint64_t> starts, durations, opens, latencies;
+    for (size_t p = 0; p < phaseCount; p++)
+    {
+        starts.clear();
+        durations.clear();
+        opens.clear();
+        latencies.clear();
+        for (size_t s = first; s < last; s++)
+        {
+            if (p >= sessions[s].phases.size())
+                continue;
+            const Phase& phase = sessions[s].phases[p];
+            starts.push_back(phase.start);
+            durations.push_back(phase.end - phase.start);
+            opens.push_back(phase.opens);
+            latencies.push_back(phase.latency);
+        }
+        summaries[p].start = Median(starts);
+        summaries[p].duration = Median(durations);
+        summaries[p].opens = Median(opens);
+        summaries[p].latency = Median(latencies);
+    }
+    return summaries;
+}
+
+static void PrintValue(FILE* out, uint64_t micros)
+{
+    if (micros == NO_VALUE)
+        fprintf(out, "%12s", "-");
+    else
+        fprintf(out, "%12.3f", Ms(micros));
+}
+
+static void PrintPhases(const std::vector<PhaseSummary>& baseline, const std::vector<PhaseSummary>& candidate,
+                        bool hasLatency)
+{
+    printf("Load phases (median across sessions, ms; baseline -> candidate)\n");
+    printf("%-6s %21s %10s %21s %10s %15s %10s", "Phase", "Start", "Delta", "Duration", "Delta", "Opens", "Delta");
+    if (hasLatency)
+        printf(" %21s %10s", "Storm", "Delta");
+    printf("\n");
+
+    size_t count = std::max(baseline.size(), candidate.size());
+    for (size_t p = 0; p < count; p++)
+    {
+        printf("%-6zu", p + 1);
+        if (p < baseline.size() && p < candidate.size())
+        {
+            const PhaseSummary& a = baseline[p];
+            const PhaseSummary& b = candidate[p];
+            printf(" %10.1f %10.1f %+10.1f %10.1f %10.1f %+10.1f %7llu %7llu %+10lld", Ms(a.start), Ms(b.start),
+                   DeltaMs(a.start, b.start), Ms(a.duration), Ms(b.duration), DeltaMs(a.duration, b.duration),
+                   (unsigned long long)a.opens, (unsigned long long)b.opens,
+                   (long long)b.opens - (long long)a.opens);
+            if (hasLatency)
+                printf(" %10.1f %10.1f %+10.1f", Ms(a.latency), Ms(b.latency), DeltaMs(a.latency, b.latency));
+        }
+        else
+        {
+            const PhaseSummary& only = p < baseline.size() ? baseline[p] : candidate[p];
+            printf("  only in %s: starts at %.1f ms, %.1f ms long, %llu opens",
+                   p < baseline.size() ? "baseline" : "candidate", Ms(only.start), Ms(only.duration),
+                   (unsigned long long)only.opens);
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+    unsigned threads = 0;
+    uint64_t gapMs = 1000;
+    size_t top = 20;
+    std::string reportPath;
+    std::vector<std::string> inputs;
+    size_t baselineCount = SIZE_MAX;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc)
+            threads = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--gap" && i + 1 < argc)
+            gapMs = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--top" && i + 1 < argc)
+            top = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "-o" && i + 1 < argc)
+            reportPath = argv[++i];
+        else if (arg == "--" && baselineCount == SIZE_MAX)
+            baselineCount = inputs.size();
+        else if (arg == "-h" || arg == "--help")
+        {
+            PrintUsage();
+            return 0;
+        }
+        else
+            inputs.push_back(arg);
+    }
+
+    if (baselineCount == SIZE_MAX || baselineCount == 0 || baselineCount == inputs.size())
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    std::vector<MappedFile> files(inputs.size());
+    size_t totalBytes = 0;
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        if (!files[i].Open(inputs[i]))
+        {
+            fprintf(stderr, "mpqdiff: cannot read %s: %s\n", inputs[i].c_str(), strerror(errno));
+            return 1;
+        }
+        totalBytes += files[i].Size();
+    }
+
+    // Chunks in log order, so the accesses of a session stay in log order
+    std::vector<ChunkResult> chunks;
+    std::vector<std::pair<size_t, size_t>> chunkRanges;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        for (const auto& range : SplitAtLines(files[i].Data(), files[i].Size(), CHUNK_SIZE))
+        {
+            chunks.emplace_back();
+            chunks.back().log = static_cast<uint32_t>(i);
+            chunkRanges.push_back(range);
+        }
+    }
+
+    WorkStealingPool pool(threads);
+    std::vector<char> hasTimestamps(inputs.size(), 0);
+
+    ParallelFor(pool, chunks.size(), [&](size_t c)
+    {
+        ChunkResult& chunk = chunks[c];
+        const MappedFile& file = files[chunk.log];
+        const auto& range = chunkRanges[c];
+        std::string key;
+        uint64_t previous = 0;
+
+        ForEachLogRecord(file.Data() + range.first, range.second - range.first, [&](const LogRecord& record)
+        {
+            if (!record.hasTimestamp)
+                return;
+
+            key.resize(record.fileName.size());
+            for (size_t i = 0; i < record.fileName.size(); i++)
+                key[i] = NormalizeStormChar(record.fileName[i]);
+
+            auto [index, inserted] = chunk.names.Insert(key, HashBytes(key));
+            if (inserted)
+            {
+                chunk.spellings.emplace_back(record.fileName);
+                std::replace(chunk.spellings.back().begin(), chunk.spellings.back().end(), '/', '\\');
+            }
+
+            chunk.accesses.push_back(ParsedAccess{index, record.hasDuration, record.timestampMicros,
+                                                  record.durationMicros});
+            chunk.sorted = chunk.sorted && record.timestampMicros >= previous;
+            previous = record.timestampMicros;
+        });
+
+        if (!chunk.accesses.empty())
+            hasTimestamps[chunk.log] = 1;
+        file.DontNeed(range.first, range.second - range.first);
+    });
+
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        if (!hasTimestamps[i])
+        {
+            fprintf(stderr, "mpqdiff: %s has no timestamped accesses; log with a timestamped LogFormat or a trace\n",
+                    inputs[i].c_str());
+            return 1;
+        }
+    }
+
+    // Merge the local dictionaries
+    StringTable names;
+    std::vector<std::string> spellings;
+    for (ChunkResult& chunk : chunks)
+    {
+        chunk.globalNames.resize(chunk.names.Size());
+        for (uint32_t i = 0; i < chunk.names.Size(); i++)
+        {
+            auto [index, inserted] = names.Insert(chunk.names.Get(i), chunk.names.HashOf(i));
+            if (inserted)
+                spellings.push_back(std::move(chunk.spellings[i]));
+            chunk.globalNames[i] = index;
+        }
+        chunk.names.Clear();
+        chunk.spellings.clear();
+    }
+    size_t nameCount = names.Size();
+
+    auto parseTime = std::chrono::steady_clock::now();
+
+    // Build the sessions
+    std::vector<Session> sessions(inputs.size());
+    std::vector<std::vector<size_t>> sessionChunks(inputs.size());
+    for (size_t c = 0; c < chunks.size(); c++)
+        sessionChunks[chunks[c].log].push_back(c);
+
+    ParallelFor(pool, sessions.size(), [&](size_t s)
+    {
+        std::vector<ParsedAccess> parsed;
+        bool sorted = true;
+        uint64_t previous = 0;
+        for (size_t c : sessionChunks[s])
+        {
+            ChunkResult& chunk = chunks[c];
+            for (ParsedAccess& access : chunk.accesses)
+            {
+                access.name = chunk.globalNames[access.name];
+                sorted = sorted && access.time >= previous;
+                previous = access.time;
+                parsed.push_back(access);
+            }
+            std::vector<ParsedAccess>().swap(chunk.accesses);
+        }
+        BuildSession(parsed, sorted, nameCount, gapMs * 1000, sessions[s]);
+    });
+
+    // Align each set, then the sets by name and occurrence
+    std::vector<AlignedAccess> aligned[2];
+    std::vector<PhaseSummary> phases[2];
+    ParallelFor(pool, 2, [&](size_t set)
+    {
+        size_t first = set == 0 ? 0 : baselineCount;
+        size_t last = set == 0 ? baselineCount : sessions.size();
+        aligned[set] = AlignSet(sessions, first, last);
+        phases[set] = SummarizePhases(sessions, first, last);
+    });
+
+    bool hasLatency[2] = {false, false};
+    for (size_t s = 0; s < sessions.size(); s++)
+        hasLatency[s < baselineCount ? 0 : 1] |= sessions[s].hasLatency;
+    bool compareLatency = hasLatency[0] && hasLatency[1];
+
+    std::vector<FileDiff> diffs(nameCount);
+    for (size_t set = 0; set < 2; set++)
+    {
+        for (const AlignedAccess& access : aligned[set])
+        {
+            FileDiff& diff = diffs[access.name];
+            diff.opens[set]++;
+            if (access.occurrence == 0)
+                diff.first[set] = access.offset;
+            if (access.latency != NO_VALUE)
+                diff.latency[set] = (diff.latency[set] == NO_VALUE ? 0 : diff.latency[set]) + access.latency;
+        }
+    }
+
+    auto alignTime = std::chrono::steady_clock::now();
+
+    // Rank the files both sets open
+    std::vector<uint32_t> common;
+    size_t onlyBaseline = 0;
+    size_t onlyCandidate = 0;
+    for (uint32_t n = 0; n < nameCount; n++)
+    {
+        if (diffs[n].opens[0] && diffs[n].opens[1])
+            common.push_back(n);
+        else if (diffs[n].opens[0])
+            onlyBaseline++;
+        else
+            onlyCandidate++;
+    }
+
+    printf("Baseline: %zu sessions, candidate: %zu sessions, %zu files in both, %zu only in baseline, "
+           "%zu only in candidate\n\n", baselineCount, sessions.size() - baselineCount, common.size(),
+           onlyBaseline, onlyCandidate);
+
+    PrintPhases(phases[0], phases[1], compareLatency);
+
+    auto printRanking = [&](const char* title, auto&& delta, bool increasing, bool latency)
+    {
+        std::vector<std::pair<double, uint32_t>> ranked;
+        for (uint32_t n : common)
+        {
+            double value = delta(diffs[n]);
+            if (increasing ? value > 0 : value < 0)
+                ranked.emplace_back(increasing ? -value : value, n);
+        }
+        size_t count = std::min(top, ranked.size());
+        std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end());
+
+        printf("%s (%zu files)\n", title, ranked.size());
+        printf("%12s %12s %12s %7s %7s  %s\n", "Baseline", "Candidate", "Delta", "Opens", "Opens", "File");
+        for (size_t i = 0; i < count; i++)
+        {
+            const FileDiff& diff = diffs[ranked[i].second];
+            PrintValue(stdout, latency ? diff.latency[0] : diff.first[0]);
+            printf(" ");
+            PrintValue(stdout, latency ? diff.latency[1] : diff.first[1]);
+            printf(" %+12.3f %7u %7u  %s\n", delta(diff), diff.opens[0], diff.opens[1],
+                   spellings[ranked[i].second].c_str());
+        }
+        printf("\n");
+    };
+
+    auto latencyDelta = [](const FileDiff& diff)
+    {
+        if (diff.latency[0] == NO_VALUE || diff.latency[1] == NO_VALUE)
+            return 0.0;
+        return DeltaMs(diff.latency[0], diff.latency[1]);
+    };
+    auto offsetDelta = [](const FileDiff& diff)
+    {
+        return DeltaMs(diff.first[0], diff.first[1]);
+    };
+
+    if (compareLatency)
+    {
+        printRanking("Slower, by total Storm ms of the file's opens", latencyDelta, true, true);
+        printRanking("Faster, by total Storm ms of the file's opens", latencyDelta, false, true);
+    }
+    else
+    {
+        printf("Latency is not compared: only Chrome traces (LogFormat=4) record the time in Storm, "
+               "and %s has none.\n\n", hasLatency[0] ? "the candidate" : "the baseline");
+    }
+    printRanking("Loaded later, by ms from the session's first open to the file's", offsetDelta, true, false);
+    printRanking("Loaded earlier, by ms from the session's first open to the file's", offsetDelta, false, false);
+
+    if (!reportPath.empty())
+    {
+        FILE* report = fopen(reportPath.c_str(), "w");
+        if (!report)
+        {
+            fprintf(stderr, "mpqdiff: cannot write %s: %s\n", reportPath.c_str(), strerror(errno));
+            return 1;
+        }
+
+        std::vector<uint32_t> order(nameCount);
+        for (uint32_t n = 0; n < nameCount; n++)
+            order[n] = n;
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return spellings[a] < spellings[b]; });
+
+        auto writeValue = [report](uint64_t micros)
+        {
+            if (micros == NO_VALUE)
+                fprintf(report, "\t-");
+            else
+                fprintf(report, "\t%.3f", Ms(micros));
+        };
+        for (uint32_t n : order)
+        {
+            const FileDiff& diff = diffs[n];
+            fprintf(report, "%s\t%u\t%u", spellings[n].c_str(), diff.opens[0], diff.opens[1]);
+            writeValue(diff.first[0]);
+            writeValue(diff.first[1]);
+            writeValue(diff.latency[0]);
+            writeValue(diff.latency[1]);
+            fprintf(report, "\n");
+        }
+        if (fclose(report) != 0)
+        {
+            fprintf(stderr, "mpqdiff: cannot write %s: %s\n", reportPath.c_str(), strerror(errno));
+            return 1;
+        }
+    }
+
+    auto endTime = std::chrono::steady_clock::now();
+    size_t accessCount = 0;
+    for (const Session& session : sessions)
+        accessCount += session.accesses.size();
+
+    double parseSeconds = std::chrono::duration<double>(parseTime - startTime).count();
+    fprintf(stderr, "%zu logs, %.1f MB, %zu accesses, %zu names\n"
+                    "parse %.2f s (%.1f MB/s), align %.2f s, total %.2f s on %zu threads\n",
+            files.size(), totalBytes / 1e6, accessCount, nameCount, parseSeconds,
+            parseSeconds > 0 ? totalBytes / 1e6 / parseSeconds : 0.0,
+            std::chrono::duration<double>(alignTime - parseTime).count(),
+            std::chrono::duration<double>(endTime - startTime).count(), pool.ThreadCount());
+    return 0;
+}
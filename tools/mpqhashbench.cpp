@@ -0,0 +1,250 @@
+/*
+    mpqhashbench - Cross-check and benchmark the HashString kernels
+
+    Usage:
+        mpqhashbench --verify
+        mpqhashbench [--names listfile] [--seconds duration]
+
+    --verify compares every supported batch kernel against the scalar
+    reference: exhaustively for all names of up to two bytes and all names
+    of three bytes over the characters that appear in MPQ file names, and
+    for random batches of mixed lengths and sizes, which exercise the lane
+    masking and the tails that do not fill a whole vector.
+
+    Without --verify, each supported kernel hashes a set of names (from a
+    listfile, or synthetic ones of typical length) on a single thread, and
+    the names per second per core are reported.
+*/
+
+#include "MappedFile.h"
+#include "StormHash.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+static const StormHashKernel KERNELS[] =
+{
+    StormHashKernel::SCALAR,
+    StormHashKernel::SSE41,
+    StormHashKernel::AVX2
+};
+
+static void PrintUsage()
+{
+    fprintf(stderr,
+        "Usage: mpqhashbench --verify\n"
+        "       mpqhashbench [--names listfile] [--seconds duration]\n");
+}
+
+static bool SameHashes(const StormNameHashes& a, const StormNameHashes& b)
+{
+    return a.tableOffset == b.tableOffset && a.nameA == b.nameA && a.nameB == b.nameB;
+}
+
+// Hash names with every supported kernel and compare against the reference.
+// Returns the number of mismatches.
+static size_t CheckNames(const std::vector<std::string>& strings)
+{
+    std::vector<std::string_view> names(strings.begin(), strings.end());
+    std::vector<StormNameHashes> expected(names.size());
+    std::vector<StormNameHashes> actual(names.size());
+    HashStormNames(StormHashKernel::SCALAR, names.data(), names.size(), expected.data());
+
+    // The reference itself against the single-name function
+    size_t mismatches = 0;
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        StormNameHashes single{HashStormString(names[i], StormHashType::TABLE_OFFSET),
+                               HashStormString(names[i], StormHashType::NAME_A),
+                               HashStormString(names[i], StormHashType::NAME_B)};
+        if (!SameHashes(single, expected[i]) && mismatches++ < 10)
+            fprintf(stderr, "scalar batch differs from HashStormString for \"%s\"\n", strings[i].c_str());
+    }
+
+    for (StormHashKernel kernel : KERNELS)
+    {
+        if (kernel == StormHashKernel::SCALAR || !IsStormHashKernelSupported(kernel))
+            continue;
+
+        HashStormNames(kernel, names.data(), names.size(), actual.data());
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            if (!SameHashes(expected[i], actual[i]) && mismatches++ < 10)
+                fprintf(stderr, "%s differs from scalar for name %zu of %zu (length %zu)\n",
+                        GetStormHashKernelName(kernel), i, names.size(), names[i].size());
+        }
+    }
+    return mismatches;
+}
+
+static int Verify()
+{
+    size_t checked = 0;
+    size_t mismatches = 0;
+
+    // Every name of up to two bytes, including the empty name
+    std::vector<std::string> names;
+    names.emplace_back();
+    for (int c1 = 0; c1 < 256; c1++)
+    {
+        names.emplace_back(1, static_cast<char>(c1));
+        for (int c2 = 0; c2 < 256; c2++)
+            names.push_back(std::string{static_cast<char>(c1), static_cast<char>(c2)});
+    }
+    mismatches += CheckNames(names);
+    checked += names.size();
+
+    // Every three-byte name over the characters of MPQ file names
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-.\\/ ()";
+    size_t alphabetSize = sizeof(alphabet) - 1;
+    names.clear();
+    for (size_t c1 = 0; c1 < alphabetSize; c1++)
+        for (size_t c2 = 0; c2 < alphabetSize; c2++)
+            for (size_t c3 = 0; c3 < alphabetSize; c3++)
+                names.push_back(std::string{alphabet[c1], alphabet[c2], alphabet[c3]});
+    mismatches += CheckNames(names);
+    checked += names.size();
+
+    // Random batches: every batch size up to a few vectors, mixed lengths
+    // (so lanes finish at different steps) and arbitrary bytes
+    std::mt19937 random(12345);
+    for (size_t round = 0; round < 2000; round++)
+    {
+        names.assign(round % 37, std::string());
+        for (std::string& name : names)
+        {
+            size_t length = random() % (round % 3 == 0 ? 300 : 48);
+            name.resize(length);
+            for (char& c : name)
+                c = static_cast<char>(random());
+        }
+        mismatches += CheckNames(names);
+        checked += names.size();
+    }
+
+    for (StormHashKernel kernel : KERNELS)
+        printf("%-8s %s\n", GetStormHashKernelName(kernel),
+               IsStormHashKernelSupported(kernel) ? "checked" : "not supported");
+    printf("%zu names, %zu mismatches\n", checked, mismatches);
+    return mismatches == 0 ? 0 : 1;
+}
+
+static std::vector<std::string> MakeSyntheticNames(size_t count)
+{
+    static const char* directories[] = { "unit\\protoss\\", "unit\\terran\\", "unit\\zerg\\", "sound\\misc\\",
+                                         "tileset\\", "game\\", "arr\\", "glue\\palmm\\", "rez\\" };
+    static const char* extensions[] = { ".grp", ".wav", ".dat", ".pcx", ".tbl", ".bin" };
+
+    std::mt19937 random(4711);
+    std::vector<std::string> names(count);
+    for (std::string& name : names)
+    {
+        name = directories[random() % (sizeof(directories) / sizeof(directories[0]))];
+        size_t length = 4 + random() % 12;
+        for (size_t i = 0; i < length; i++)
+            name += static_cast<char>('a' + random() % 26);
+        name += extensions[random() % (sizeof(extensions) / sizeof(extensions[0]))];
+    }
+    return names;
+}
+
+static std::vector<std::string> ReadListfile(const std::string& path)
+{
+    std::vector<std::string> names;
+    MappedFile file;
+    if (!file.Open(path))
+    {
+        fprintf(stderr, "mpqhashbench: cannot read %s: %s\n", path.c_str(), strerror(errno));
+        return names;
+    }
+
+    const char* data = file.Data();
+    const char* end = data + file.Size();
+    while (data < end)
+    {
+        const char* lineEnd = static_cast<const char*>(memchr(data, '\n', static_cast<size_t>(end - data)));
+        if (!lineEnd)
+            lineEnd = end;
+        const char* nameEnd = lineEnd;
+        if (nameEnd > data && nameEnd[-1] == '\r')
+            nameEnd--;
+        if (nameEnd > data)
+            names.emplace_back(data, nameEnd);
+        data = lineEnd + 1;
+    }
+    return names;
+}
+
+static int Benchmark(const std::vector<std::string>& strings, double seconds)
+{
+    std::vector<std::string_view> names(strings.begin(), strings.end());
+    std::vector<StormNameHashes> hashes(names.size());
+
+    size_t totalLength = 0;
+    for (std::string_view name : names)
+        totalLength += name.size();
+    printf("%zu names, average length %.1f\n", names.size(), names.empty() ? 0.0 : double(totalLength) / names.size());
+
+    double scalarRate = 0;
+    for (StormHashKernel kernel : KERNELS)
+    {
+        if (!IsStormHashKernelSupported(kernel))
+        {
+            printf("%-8s not supported\n", GetStormHashKernelName(kernel));
+            continue;
+        }
+
+        uint64_t hashed = 0;
+        auto start = std::chrono::steady_clock::now();
+        double elapsed = 0;
+        do
+        {
+            HashStormNames(kernel, names.data(), names.size(), hashes.data());
+            hashed += names.size();
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        } while (elapsed < seconds);
+
+        double rate = hashed / elapsed;
+        if (kernel == StormHashKernel::SCALAR)
+            scalarRate = rate;
+        printf("%-8s %8.2f M names/s per core (%.2fx scalar)\n",
+               GetStormHashKernelName(kernel), rate / 1e6, scalarRate > 0 ? rate / scalarRate : 0.0);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    std::string listfile;
+    double seconds = 1.0;
+    bool verify = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--verify")
+            verify = true;
+        else if (arg == "--names" && i + 1 < argc)
+            listfile = argv[++i];
+        else if (arg == "--seconds" && i + 1 < argc)
+            seconds = atof(argv[++i]);
+        else
+        {
+            PrintUsage();
+            return arg == "-h" || arg == "--help" ? 0 : 2;
+        }
+    }
+
+    if (verify)
+        return Verify();
+
+    std::vector<std::string> names = listfile.empty() ? MakeSyntheticNames(1 << 20) : ReadListfile(listfile);
+    if (names.empty())
+        return 1;
+    return Benchmark(names, seconds);
+}
@@ -0,0 +1,347 @@
+/*
+    mpqindex - Build a queryable index of the file accesses in many logs
+
+    Every log is a session. The index (see LogIndex.h) holds a sorted
+    dictionary of all names, a delta-encoded posting list of (session,
+    timestamp) per name and every access again in time order, so mpqquery
+    can answer by name, by prefix and by time range without reading the logs.
+
+    Usage:
+        mpqindex [-j threads] [--chunk-mb size] -o <index> <log> [<log> ...]
+
+    Logs are memory-mapped and cut into chunks at line breaks. Chunks are
+    parsed in parallel, each into a local dictionary; only the local
+    dictionaries are merged, and the posting lists and time blocks are
+    sorted and encoded in parallel as well.
+*/
+
+#include "LogIndex.h"
+#include "LogParser.h"
+#include "MappedFile.h"
+#include "StormName.h"
+#include "StringTable.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Names sorted and encoded per task
+static const size_t NAMES_PER_TASK = 4096;
+
+// Accesses of one chunk of a log, with names local to the chunk
+struct ChunkResult
+{
+    uint32_t session = 0;
+    StringTable names;                      // Normalized
+    std::vector<std::string> spellings;     // Smallest spelling of each name
+    std::vector<std::pair<uint32_t, uint64_t>> records;     // (local name, timestamp)
+    std::vector<uint32_t> globalNames;      // Local name -> position in the sorted dictionary
+    uint64_t firstTimestamp = UINT64_MAX;
+    uint64_t lastTimestamp = 0;
+    size_t firstRecord = 0;                 // Position of the chunk's records among all records
+};
+
+static void PrintUsage()
+{
+    fprintf(stderr, "Usage: mpqindex [-j threads] [--chunk-mb size] -o <index> <log> [<log> ...]\n");
+}
+
+static bool ByTime(const LogIndexRecord& a, const LogIndexRecord& b)
+{
+    if (a.timestamp != b.timestamp)
+        return a.timestamp < b.timestamp;
+    if (a.session != b.session)
+        return a.session < b.session;
+    return a.name < b.name;
+}
+
+static bool BySessionAndTime(const LogIndexRecord& a, const LogIndexRecord& b)
+{
+    if (a.session != b.session)
+        return a.session < b.session;
+    return a.timestamp < b.timestamp;
+}
+
+// Sort runs in parallel, then merge neighbouring runs in parallel rounds
+static void ParallelSort(WorkStealingPool& pool, std::vector<LogIndexRecord>& records,
+                         bool (*less)(const LogIndexRecord&, const LogIndexRecord&))
+{
+    size_t runs = std::max<size_t>(1, std::min(pool.ThreadCount() * 4, records.size() / 65536));
+    std::vector<size_t> bounds(runs + 1);
+    for (size_t i = 0; i <= runs; i++)
+        bounds[i] = records.size() * i / runs;
+
+    ParallelFor(pool, runs, [&](size_t i)
+    {
+        std::sort(records.begin() + bounds[i], records.begin() + bounds[i + 1], less);
+    });
+
+    for (size_t width = 1; width < runs; width *= 2)
+    {
+        size_t merges = (runs + 2 * width - 1) / (2 * width);
+        ParallelFor(pool, merges, [&](size_t m)
+        {
+            size_t first = m * 2 * width;
+            size_t middle = std::min(first + width, runs);
+            size_t last = std::min(first + 2 * width, runs);
+            if (middle < last)
+                std::inplace_merge(records.begin() + bounds[first], records.begin() + bounds[middle],
+                                   records.begin() + bounds[last], less);
+        });
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned threads = 0;
+    size_t chunkSize = 16u << 20;
+    std::string outputPath;
+    std::vector<std::string> inputs;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc)
+            threads = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "-o" && i + 1 < argc)
+            outputPath = argv[++i];
+        else if (arg == "--chunk-mb" && i + 1 < argc)
+            chunkSize = std::max<size_t>(1, strtoull(argv[++i], nullptr, 10)) << 20;
+        else if (arg == "-h" || arg == "--help")
+        {
+            PrintUsage();
+            return 0;
+        }
+        else
+            inputs.push_back(arg);
+    }
+
+    if (inputs.empty() || outputPath.empty())
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    std::vector<MappedFile> files(inputs.size());
+    size_t totalBytes = 0;
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        if (!files[i].Open(inputs[i]))
+        {
+            fprintf(stderr, "mpqindex: cannot read %s: %s\n", inputs[i].c_str(), strerror(errno));
+            return 1;
+        }
+        totalBytes += files[i].Size();
+    }
+
+    // Chunks in session order, so records of a session stay in log order
+    std::vector<ChunkResult> chunks;
+    std::vector<std::pair<size_t, size_t>> chunkRanges;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        for (const auto& range : SplitAtLines(files[i].Data(), files[i].Size(), chunkSize))
+        {
+            chunks.emplace_back();
+            chunks.back().session = static_cast<uint32_t>(i);
+            chunkRanges.push_back(range);
+        }
+    }
+
+    WorkStealingPool pool(threads);
+
+    ParallelFor(pool, chunks.size(), [&](size_t c)
+    {
+        ChunkResult& chunk = chunks[c];
+        const MappedFile& file = files[chunk.session];
+        const auto& range = chunkRanges[c];
+        std::string key;
+
+        ForEachLogRecord(file.Data() + range.first, range.second - range.first, [&](const LogRecord& record)
+        {
+            key.resize(record.fileName.size());
+            for (size_t i = 0; i < record.fileName.size(); i++)
+                key[i] = NormalizeStormChar(record.fileName[i]);
+
+            auto [index, inserted] = chunk.names.Insert(key, HashBytes(key));
+            if (inserted || record.fileName < chunk.spellings[index])
+            {
+                std::string spelling(record.fileName);
+                std::replace(spelling.begin(), spelling.end(), '/', '\\');
+                if (inserted)
+                    chunk.spellings.push_back(std::move(spelling));
+                else if (spelling < chunk.spellings[index])
+                    chunk.spellings[index] = std::move(spelling);
+            }
+
+            uint64_t timestamp = record.hasTimestamp ? record.timestampMicros : 0;
+            chunk.records.emplace_back(index, timestamp);
+            chunk.firstTimestamp = std::min(chunk.firstTimestamp, timestamp);
+            chunk.lastTimestamp = std::max(chunk.lastTimestamp, timestamp);
+        });
+
+        file.DontNeed(range.first, range.second - range.first);
+    });
+
+    auto parseTime = std::chrono::steady_clock::now();
+
+    // Merge the local dictionaries, keeping the smallest spelling
+    StringTable names;
+    std::vector<std::string> spellings;
+    for (ChunkResult& chunk : chunks)
+    {
+        chunk.globalNames.resize(chunk.names.Size());
+        for (uint32_t i = 0; i < chunk.names.Size(); i++)
+        {
+            auto [index, inserted] = names.Insert(chunk.names.Get(i), chunk.names.HashOf(i));
+            if (inserted)
+                spellings.push_back(std::move(chunk.spellings[i]));
+            else if (chunk.spellings[i] < spellings[index])
+                spellings[index] = std::move(chunk.spellings[i]);
+            chunk.globalNames[i] = index;
+        }
+        chunk.names.Clear();
+        chunk.spellings.clear();
+    }
+
+    // Sort the dictionary, and map every chunk's names to sorted positions
+    std::vector<uint32_t> order(names.Size());
+    for (uint32_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&names](uint32_t a, uint32_t b) { return names.Get(a) < names.Get(b); });
+    std::vector<uint32_t> rank(order.size());
+    for (uint32_t i = 0; i < order.size(); i++)
+        rank[order[i]] = i;
+
+    LogIndexContents contents;
+    contents.sessionPaths = inputs;
+    contents.sessions.assign(inputs.size(), LogIndexSession());
+    for (LogIndexSession& session : contents.sessions)
+        session.firstTimestamp = UINT64_MAX;
+
+    size_t recordCount = 0;
+    for (ChunkResult& chunk : chunks)
+    {
+        chunk.firstRecord = recordCount;
+        recordCount += chunk.records.size();
+
+        LogIndexSession& session = contents.sessions[chunk.session];
+        session.recordCount += chunk.records.size();
+        session.firstTimestamp = std::min(session.firstTimestamp, chunk.firstTimestamp);
+        session.lastTimestamp = std::max(session.lastTimestamp, chunk.lastTimestamp);
+    }
+    for (LogIndexSession& session : contents.sessions)
+    {
+        if (session.recordCount == 0)
+            session.firstTimestamp = 0;
+    }
+
+    std::vector<LogIndexRecord> records(recordCount);
+    ParallelFor(pool, chunks.size(), [&](size_t c)
+    {
+        ChunkResult& chunk = chunks[c];
+        for (uint32_t& name : chunk.globalNames)
+            name = rank[name];
+        LogIndexRecord* out = records.data() + chunk.firstRecord;
+        for (const auto& record : chunk.records)
+            *out++ = LogIndexRecord{chunk.globalNames[record.first], chunk.session, record.second};
+        std::vector<std::pair<uint32_t, uint64_t>>().swap(chunk.records);
+    });
+
+    // Posting lists: group the records by name, then sort and encode each group
+    size_t nameCount = order.size();
+    std::vector<size_t> nameStart(nameCount + 1);
+    for (const LogIndexRecord& record : records)
+        nameStart[record.name + 1]++;
+    for (size_t i = 0; i < nameCount; i++)
+        nameStart[i + 1] += nameStart[i];
+
+    std::vector<LogIndexRecord> byName(recordCount);
+    {
+        std::vector<size_t> next(nameStart.begin(), nameStart.end() - 1);
+        for (const LogIndexRecord& record : records)
+            byName[next[record.name]++] = record;
+    }
+
+    contents.keys.resize(nameCount);
+    contents.spellings.resize(nameCount);
+    contents.postings.resize(nameCount);
+    contents.postingCounts.resize(nameCount);
+    size_t nameTasks = (nameCount + NAMES_PER_TASK - 1) / NAMES_PER_TASK;
+    ParallelFor(pool, nameTasks, [&](size_t task)
+    {
+        size_t first = task * NAMES_PER_TASK;
+        size_t last = std::min(first + NAMES_PER_TASK, nameCount);
+        for (size_t n = first; n < last; n++)
+        {
+            contents.keys[n] = std::string(names.Get(order[n]));
+            contents.spellings[n] = std::move(spellings[order[n]]);
+
+            // Chunks of a session are in order, so this is usually sorted already
+            LogIndexRecord* begin = byName.data() + nameStart[n];
+            LogIndexRecord* end = byName.data() + nameStart[n + 1];
+            if (!std::is_sorted(begin, end, BySessionAndTime))
+                std::sort(begin, end, BySessionAndTime);
+            EncodePostings(begin, static_cast<size_t>(end - begin), contents.postings[n]);
+            contents.postingCounts[n] = static_cast<uint32_t>(end - begin);
+        }
+    });
+    std::vector<LogIndexRecord>().swap(byName);
+
+    // Time blocks
+    ParallelSort(pool, records, ByTime);
+    size_t blockCount = (recordCount + LOGINDEX_TIME_BLOCK_SIZE - 1) / LOGINDEX_TIME_BLOCK_SIZE;
+    std::vector<std::string> blocks(blockCount);
+    ParallelFor(pool, blockCount, [&](size_t b)
+    {
+        size_t first = b * LOGINDEX_TIME_BLOCK_SIZE;
+        size_t count = std::min<size_t>(LOGINDEX_TIME_BLOCK_SIZE, recordCount - first);
+        EncodeTimeBlock(records.data() + first, count, blocks[b]);
+    });
+
+    contents.timeBlocks.resize(blockCount);
+    size_t timeDataSize = 0;
+    for (const std::string& block : blocks)
+        timeDataSize += block.size();
+    contents.timeData.reserve(timeDataSize);
+    for (size_t b = 0; b < blockCount; b++)
+    {
+        contents.timeBlocks[b] = LogIndexTimeBlock{records[b * LOGINDEX_TIME_BLOCK_SIZE].timestamp, contents.timeData.size()};
+        contents.timeData += blocks[b];
+    }
+    contents.recordCount = recordCount;
+
+    auto buildTime = std::chrono::steady_clock::now();
+
+    if (!WriteLogIndex(outputPath, contents))
+    {
+        fprintf(stderr, "mpqindex: cannot write %s: %s\n", outputPath.c_str(), strerror(errno));
+        return 1;
+    }
+
+    auto endTime = std::chrono::steady_clock::now();
+
+    size_t postingBytes = 0;
+    for (const std::string& postings : contents.postings)
+        postingBytes += postings.size();
+
+    double parseSeconds = std::chrono::duration<double>(parseTime - startTime).count();
+    double buildSeconds = std::chrono::duration<double>(buildTime - parseTime).count();
+    double totalSeconds = std::chrono::duration<double>(endTime - startTime).count();
+    fprintf(stderr,
+        "%zu logs, %.1f MB, %zu records, %zu names\n"
+        "postings %.2f bytes/record, time blocks %.2f bytes/record\n"
+        "parse %.2f s (%.1f MB/s), build %.2f s, total %.2f s on %zu threads\n",
+        files.size(), totalBytes / 1e6, recordCount, nameCount,
+        recordCount ? double(postingBytes) / recordCount : 0.0,
+        recordCount ? double(contents.timeData.size()) / recordCount : 0.0,
+        parseSeconds, parseSeconds > 0 ? totalBytes / 1e6 / parseSeconds : 0.0,
+        buildSeconds, totalSeconds, pool.ThreadCount());
+    return 0;
+}
@@ -0,0 +1,249 @@
+/*
+    mpqlog-merge - Merge many MpqFileLister logs into one listfile per archive
+
+    Parses logs in any LogFormat in parallel, normalizes names the way Storm
+    does, removes duplicates and writes one sorted listfile per archive.
+    Names from logs without archive information go to (listfile).
+
+    Usage:
+        mpqlog-merge [-j threads] [-o output directory] [--chunk-mb size] <log> [<log> ...]
+
+    Every log is memory-mapped and cut into chunks at line breaks. Chunks are
+    parsed by a work-stealing pool; each task deduplicates locally before
+    merging into a sharded concurrent map, so the shared map sees each name
+    about once per chunk rather than once per line.
+*/
+
+#include "ConcurrentHashMap.h"
+#include "LogParser.h"
+#include "MappedFile.h"
+#include "StormName.h"
+#include "StringTable.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Name used for accesses that were logged without an archive. Listfiles of
+// archives always end in .txt, so no archive name can produce this one.
+static const char* NO_ARCHIVE_LISTFILE = "(listfile)";
+
+// Spelling to keep when the same file is logged with different case. The
+// smallest one wins, so the output does not depend on the order
+// in which threads happen to merge.
+static void KeepSmallestSpelling(std::string& existing, std::string candidate)
+{
+    if (candidate < existing)
+        existing = std::move(candidate);
+}
+
+static void PrintUsage()
+{
+    fprintf(stderr,
+        "Usage: mpqlog-merge [-j threads] [-o output directory] [--chunk-mb size] <log> [<log> ...]\n");
+}
+
+// Archive names become file names; keep them inside the output directory
+static std::string ListfileNameForArchive(const std::string& archive)
+{
+    if (archive.empty())
+        return NO_ARCHIVE_LISTFILE;
+
+    std::string name = archive;
+    for (char& c : name)
+    {
+        // A NUL would cut the path short, and with it the .txt
+        if (c == '/' || c == '\\' || c == ':' || static_cast<unsigned char>(c) < 0x20)
+            c = '_';
+    }
+    return name + ".txt";
+}
+
+int main(int argc, char** argv)
+{
+    unsigned threads = 0;
+    std::string outputDirectory = ".";
+    size_t chunkSize = 32u << 20;
+    std::vector<std::string> inputs;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc)
+            threads = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "-o" && i + 1 < argc)
+            outputDirectory = argv[++i];
+        else if (arg == "--chunk-mb" && i + 1 < argc)
+            chunkSize = std::max<size_t>(1, strtoull(argv[++i], nullptr, 10)) << 20;
+        else if (arg == "-h" || arg == "--help")
+        {
+            PrintUsage();
+            return 0;
+        }
+        else
+            inputs.push_back(arg);
+    }
+
+    if (inputs.empty())
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    std::vector<MappedFile> files(inputs.size());
+    size_t totalBytes = 0;
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        if (!files[i].Open(inputs[i]))
+        {
+            fprintf(stderr, "mpqlog-merge: cannot read %s: %s\n", inputs[i].c_str(), strerror(errno));
+            return 1;
+        }
+        totalBytes += files[i].Size();
+    }
+
+    // Key: normalized archive name, '\n', normalized file name. Value: spelling of the file name.
+    ConcurrentHashMap<std::string, std::string> names;
+    // Key: normalized archive name. Value: spelling of the archive name.
+    ConcurrentHashMap<std::string, std::string> archives;
+    std::atomic<uint64_t> totalRecords{0};
+
+    WorkStealingPool pool(threads);
+
+    for (const MappedFile& file : files)
+    {
+        for (const auto& chunk : SplitAtLines(file.Data(), file.Size(), chunkSize))
+        {
+            pool.Submit([&file, chunk, &names, &archives, &totalRecords]()
+            {
+                StringTable localNames;
+                std::vector<std::string> localSpellings;
+                std::unordered_map<std::string, std::string> localArchives;
+                std::string key;
+                std::string spelling;
+                std::string lastArchive;
+                std::string lastArchiveKey;
+                bool hasLastArchive = false;
+                uint64_t records = 0;
+
+                ForEachLogRecord(file.Data() + chunk.first, chunk.second - chunk.first,
+                    [&](const LogRecord& record)
+                {
+                    records++;
+
+                    // Logs tend to repeat the same few archives; avoid renormalizing them
+                    if (!hasLastArchive || record.archive != lastArchive)
+                    {
+                        lastArchiveKey = NormalizeArchiveName(record.archive);
+                        lastArchive.assign(record.archive);
+                        hasLastArchive = true;
+                        auto [it, inserted] = localArchives.try_emplace(lastArchiveKey, record.archive);
+                        if (!inserted)
+                            KeepSmallestSpelling(it->second, std::string(record.archive));
+                    }
+
+                    key.resize(lastArchiveKey.size() + 1 + record.fileName.size());
+                    char* keyChars = key.data();
+                    memcpy(keyChars, lastArchiveKey.data(), lastArchiveKey.size());
+                    keyChars += lastArchiveKey.size();
+                    *keyChars++ = '\n';
+                    for (char c : record.fileName)
+                        *keyChars++ = NormalizeStormChar(c);
+
+                    // Repeats of a known spelling are by far the common case;
+                    // check them without building anything
+                    auto [index, inserted] = localNames.Insert(key, HashBytes(key));
+                    if (!inserted && localSpellings[index] == record.fileName)
+                        return;
+
+                    // Listfiles use '\' as the separator, whatever the game passed
+                    spelling.assign(record.fileName);
+                    std::replace(spelling.begin(), spelling.end(), '/', '\\');
+
+                    if (inserted)
+                        localSpellings.push_back(spelling);
+                    else if (spelling < localSpellings[index])
+                        localSpellings[index] = spelling;
+                });
+
+                for (auto& entry : localArchives)
+                    archives.Merge(entry.first, std::move(entry.second), KeepSmallestSpelling);
+                for (uint32_t i = 0; i < localNames.Size(); i++)
+                    names.Merge(std::string(localNames.Get(i)), std::move(localSpellings[i]), KeepSmallestSpelling);
+
+                totalRecords.fetch_add(records, std::memory_order_relaxed);
+
+                // Parsed pages will not be needed again
+                file.DontNeed(chunk.first, chunk.second - chunk.first);
+            });
+        }
+    }
+    pool.Wait();
+
+    auto parseTime = std::chrono::steady_clock::now();
+
+    // Group the names by archive: normalized archive -> (normalized name, spelling)
+    std::map<std::string, std::vector<std::pair<std::string_view, const std::string*>>> byArchive;
+    names.ForEach([&byArchive](const std::string& key, const std::string& spelling)
+    {
+        size_t separator = key.find('\n');
+        std::string_view view(key);
+        byArchive[key.substr(0, separator)].emplace_back(view.substr(separator + 1), &spelling);
+    });
+
+    std::unordered_map<std::string, std::string> archiveSpellings;
+    archives.ForEach([&archiveSpellings](const std::string& key, const std::string& spelling)
+    {
+        archiveSpellings[key] = spelling;
+    });
+
+    std::error_code error;
+    std::filesystem::create_directories(outputDirectory, error);
+
+    std::vector<std::pair<const std::string*, std::vector<std::pair<std::string_view, const std::string*>>*>> work;
+    for (auto& entry : byArchive)
+        work.emplace_back(&entry.first, &entry.second);
+
+    std::atomic<bool> writeFailed{false};
+    ParallelFor(pool, work.size(), [&](size_t i)
+    {
+        auto& entries = *work[i].second;
+        std::sort(entries.begin(), entries.end());
+
+        std::string path = (std::filesystem::path(outputDirectory) /
+                            ListfileNameForArchive(archiveSpellings.at(*work[i].first))).string();
+        std::ofstream out(path, std::ios::out | std::ios::trunc | std::ios::binary);
+        for (const auto& entry : entries)
+            out << *entry.second << "\n";
+        if (!out)
+        {
+            fprintf(stderr, "mpqlog-merge: cannot write %s\n", path.c_str());
+            writeFailed = true;
+        }
+    });
+
+    auto endTime = std::chrono::steady_clock::now();
+    double parseSeconds = std::chrono::duration<double>(parseTime - startTime).count();
+    double totalSeconds = std::chrono::duration<double>(endTime - startTime).count();
+
+    fprintf(stderr,
+        "%zu logs, %.1f MB, %llu records -> %zu unique names in %zu listfiles\n"
+        "parse %.2f s (%.1f MB/s on %zu threads), total %.2f s\n",
+        files.size(), totalBytes / 1e6, (unsigned long long)totalRecords.load(),
+        names.Size(), byArchive.size(),
+        parseSeconds, parseSeconds > 0 ? totalBytes / 1e6 / parseSeconds : 0.0,
+        pool.ThreadCount(), totalSeconds);
+
+    return writeFailed ? 1 : 0;
+}
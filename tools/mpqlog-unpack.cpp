@@ -0,0 +1,290 @@
+/*
+    mpqlog-unpack - Decompress logs written with LogCompress=1
+
+    Usage:
+        mpqlog-unpack [-o output] [--stats] <log> [<log> ...]
+        mpqlog-unpack --pack [-o output] <text log>
+
+    Streams the blocks of each compressed log (in the tools/LzLog.h format)
+    back out as text, one block at a time, to the output file or stdout.
+    Give the parts of a rotated log in order to get the whole session. Every
+    block's checksum is verified; a log cut short by a crash is unpacked up
+    to its last complete block, and reported as truncated. A log whose last
+    part does not end with the plugin's trailer is reported as not ended
+    cleanly.
+
+    --stats prints the blocks, raw and stored sizes of each log instead, and
+    whether it ends with the trailer.
+    --pack compresses a text log into the same format, for archiving logs
+    written without LogCompress.
+*/
+
+#include "LogParser.h"
+#include "LzLog.h"
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static void PrintUsage()
+{
+    fprintf(stderr,
+        "Usage: mpqlog-unpack [-o output] [--stats] <log> [<log> ...]\n"
+        "       mpqlog-unpack --pack [-o output] <text log>\n");
+}
+
+struct UnpackTotals
+{
+    uint64_t blocks = 0;
+    uint64_t rawBytes = 0;
+    uint64_t storedBytes = 0;
+    bool hasTrailer = false;
+};
+
+// Whether the last line of a block of text is the trailer. Blocks end at line
+// breaks, so the last block's last line is the log's.
+static bool EndsWithTrailer(const std::vector<uint8_t>& text)
+{
+    size_t end = text.size();
+    while (end > 0 && (text[end - 1] == '\n' || text[end - 1] == '\r'))
+        end--;
+    size_t begin = end;
+    while (begin > 0 && text[begin - 1] != '\n')
+        begin--;
+
+    size_t prefixLength = strlen(LOG_TRAILER_PREFIX);
+    return end - begin >= prefixLength && memcmp(text.data() + begin, LOG_TRAILER_PREFIX, prefixLength) == 0;
+}
+
+// Unpack one log into out (or only count it, if out is null). Returns false on errors.
+static bool UnpackLog(const char* path, FILE* out, UnpackTotals& totals)
+{
+    FILE* in = fopen(path, "rb");
+    if (!in)
+    {
+        fprintf(stderr, "mpqlog-unpack: cannot read %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    LzLogHeader header;
+    if (fread(&header, sizeof(header), 1, in) != 1 ||
+        memcmp(header.magic, LZLOG_MAGIC, sizeof(header.magic)) != 0)
+    {
+        fprintf(stderr, "mpqlog-unpack: %s is not a compressed log\n", path);
+        fclose(in);
+        return false;
+    }
+    if (header.version != LZLOG_VERSION)
+    {
+        fprintf(stderr, "mpqlog-unpack: %s has unsupported version %u\n", path, header.version);
+        fclose(in);
+        return false;
+    }
+
+    std::vector<uint8_t> stored;
+    std::vector<uint8_t> raw;
+    bool intact = true;
+    uint64_t blocks = 0;
+
+    for (;;)
+    {
+        LzLogBlockHeader block;
+        size_t headerRead = fread(&block, 1, sizeof(block), in);
+        if (headerRead == 0)
+            break;
+
+        if (headerRead != sizeof(block) || block.rawSize > LZLOG_MAX_BLOCK_SIZE || block.storedSize > block.rawSize)
+        {
+            fprintf(stderr, "mpqlog-unpack: %s: truncated or damaged after %llu blocks\n",
+                    path, (unsigned long long)blocks);
+            intact = false;
+            break;
+        }
+
+        stored.resize(block.storedSize);
+        raw.resize(block.rawSize);
+        if (fread(stored.data(), 1, stored.size(), in) != stored.size())
+        {
+            fprintf(stderr, "mpqlog-unpack: %s: truncated after %llu blocks\n", path, (unsigned long long)blocks);
+            intact = false;
+            break;
+        }
+
+        bool decoded = block.storedSize == block.rawSize
+            ? (memcpy(raw.data(), stored.data(), raw.size()), true)
+            : LzDecompress(stored.data(), stored.size(), raw.data(), raw.size());
+        if (!decoded || LzChecksum(raw.data(), raw.size()) != block.checksum)
+        {
+            fprintf(stderr, "mpqlog-unpack: %s: block %llu is damaged\n", path, (unsigned long long)blocks);
+            intact = false;
+            break;
+        }
+
+        if (out && fwrite(raw.data(), 1, raw.size(), out) != raw.size())
+        {
+            fprintf(stderr, "mpqlog-unpack: cannot write output: %s\n", strerror(errno));
+            intact = false;
+            break;
+        }
+
+        blocks++;
+        totals.hasTrailer = EndsWithTrailer(raw);
+        totals.blocks++;
+        totals.rawBytes += block.rawSize;
+        totals.storedBytes += sizeof(block) + block.storedSize;
+    }
+
+    fclose(in);
+    return intact;
+}
+
+// Compress a text log the way the plugin does. Returns false on errors.
+static bool PackLog(const char* path, FILE* out, UnpackTotals& totals)
+{
+    FILE* in = fopen(path, "rb");
+    if (!in)
+    {
+        fprintf(stderr, "mpqlog-unpack: cannot read %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    LzLogHeader header = {};
+    memcpy(header.magic, LZLOG_MAGIC, sizeof(header.magic));
+    header.version = LZLOG_VERSION;
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+
+    std::vector<uint8_t> raw(LZLOG_BLOCK_SIZE);
+    std::vector<uint8_t> compressed(LzCompressBound(LZLOG_BLOCK_SIZE));
+    size_t size;
+    while (ok && (size = fread(raw.data(), 1, raw.size(), in)) > 0)
+    {
+        LzLogBlockHeader block = {};
+        block.rawSize = static_cast<uint32_t>(size);
+        block.checksum = LzChecksum(raw.data(), size);
+
+        size_t compressedSize = LzCompress(raw.data(), size, compressed.data());
+        const uint8_t* stored = compressed.data();
+        if (compressedSize >= size)
+        {
+            stored = raw.data();
+            compressedSize = size;
+        }
+        block.storedSize = static_cast<uint32_t>(compressedSize);
+
+        ok = fwrite(&block, sizeof(block), 1, out) == 1 && fwrite(stored, 1, compressedSize, out) == compressedSize;
+        totals.blocks++;
+        totals.rawBytes += size;
+        totals.storedBytes += sizeof(block) + compressedSize;
+    }
+
+    if (!ok)
+        fprintf(stderr, "mpqlog-unpack: cannot write output: %s\n", strerror(errno));
+    fclose(in);
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    const char* outputPath = nullptr;
+    bool stats = false;
+    bool pack = false;
+    std::vector<const char*> logs;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc)
+            outputPath = argv[++i];
+        else if (arg == "--stats")
+            stats = true;
+        else if (arg == "--pack")
+            pack = true;
+        else if (arg == "-h" || arg == "--help")
+        {
+            PrintUsage();
+            return 0;
+        }
+        else
+            logs.push_back(argv[i]);
+    }
+
+    if (logs.empty() || (pack && (stats || logs.size() != 1)))
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    // A missing input ends the run before the output is created, with
+    // nothing else to report
+    for (const char* log : logs)
+    {
+        FILE* in = fopen(log, "rb");
+        if (!in)
+        {
+            fprintf(stderr, "mpqlog-unpack: cannot read %s: %s\n", log, strerror(errno));
+            return 1;
+        }
+        fclose(in);
+    }
+
+    FILE* out = stdout;
+    if (outputPath && !stats)
+    {
+        out = fopen(outputPath, "wb");
+        if (!out)
+        {
+            fprintf(stderr, "mpqlog-unpack: cannot write %s: %s\n", outputPath, strerror(errno));
+            return 1;
+        }
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    UnpackTotals totals;
+    bool ok = true;
+
+    if (pack)
+    {
+        ok = PackLog(logs[0], out, totals);
+    }
+    else
+    {
+        for (const char* log : logs)
+        {
+            UnpackTotals logTotals;
+            ok = UnpackLog(log, stats ? nullptr : out, logTotals) && ok;
+            if (stats)
+            {
+                printf("%s\t%llu blocks\t%llu bytes\t%llu stored\t%.1f%%\t%s\n", log,
+                       (unsigned long long)logTotals.blocks, (unsigned long long)logTotals.rawBytes,
+                       (unsigned long long)logTotals.storedBytes,
+                       logTotals.rawBytes ? 100.0 * logTotals.storedBytes / logTotals.rawBytes : 0.0,
+                       logTotals.hasTrailer ? "trailer" : "no trailer");
+            }
+            totals.hasTrailer = logTotals.hasTrailer;
+            totals.blocks += logTotals.blocks;
+            totals.rawBytes += logTotals.rawBytes;
+            totals.storedBytes += logTotals.storedBytes;
+        }
+    }
+
+    // Parts before the last end mid-session; only the last has the trailer
+    if (!pack && !totals.hasTrailer)
+        fprintf(stderr, "mpqlog-unpack: %s does not end with the trailer; the session did not end cleanly\n",
+                logs.back());
+
+    if (out != stdout && fclose(out) != 0)
+    {
+        fprintf(stderr, "mpqlog-unpack: cannot write %s: %s\n", outputPath, strerror(errno));
+        ok = false;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    fprintf(stderr, "%llu blocks, %llu bytes of text, %llu stored (%.1f%%) in %.2f s (%.0f MB/s of text)\n",
+            (unsigned long long)totals.blocks, (unsigned long long)totals.rawBytes,
+            (unsigned long long)totals.storedBytes,
+            totals.rawBytes ? 100.0 * totals.storedBytes / totals.rawBytes : 0.0, seconds,
+            seconds > 0 ? totals.rawBytes / seconds / (1024 * 1024) : 0.0);
+    return ok ? 0 : 1;
+}
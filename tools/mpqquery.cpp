@@ -0,0 +1,177 @@
+/*
+    mpqquery - Query an index built by mpqindex
+
+    Usage:
+        mpqquery [--prefix] [--from ms] [--to ms] [--count] <index> [<name>]
+        mpqquery --sessions <index>
+
+    With a name, lists every access to it: the session (log) it was logged
+    in, its timestamp and the name. --prefix matches every name that starts
+    with the given one, such as "unit\zerg\". Names are compared the way
+    Storm compares them. Without a name, lists every access in the time
+    range. --from and --to limit the accesses to a time range (inclusive),
+    in milliseconds: epoch time for text logs, session time for traces.
+    --count prints the number of accesses and sessions per name instead.
+
+    Output lines are: <session log> <tab> <timestamp ms> <tab> <name>
+*/
+
+#include "LogIndex.h"
+#include "StormName.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static void PrintUsage()
+{
+    fprintf(stderr,
+        "Usage: mpqquery [--prefix] [--from ms] [--to ms] [--count] <index> [<name>]\n"
+        "       mpqquery --sessions <index>\n");
+}
+
+static void PrintRecord(const LogIndexReader& index, const LogIndexRecord& record)
+{
+    std::string_view path = index.SessionPath(record.session);
+    std::string_view name = index.NameSpelling(record.name);
+    printf("%.*s\t%llu.%03llu\t%.*s\n", static_cast<int>(path.size()), path.data(),
+           (unsigned long long)(record.timestamp / 1000), (unsigned long long)(record.timestamp % 1000),
+           static_cast<int>(name.size()), name.data());
+}
+
+int main(int argc, char** argv)
+{
+    bool prefix = false;
+    bool count = false;
+    bool listSessions = false;
+    uint64_t from = 0;
+    uint64_t to = UINT64_MAX;
+    bool hasTimeRange = false;
+    std::vector<std::string> positional;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--prefix")
+            prefix = true;
+        else if (arg == "--count")
+            count = true;
+        else if (arg == "--sessions")
+            listSessions = true;
+        else if (arg == "--from" && i + 1 < argc)
+        {
+            from = strtoull(argv[++i], nullptr, 10) * 1000;
+            hasTimeRange = true;
+        }
+        else if (arg == "--to" && i + 1 < argc)
+        {
+            to = strtoull(argv[++i], nullptr, 10) * 1000 + 999;
+            hasTimeRange = true;
+        }
+        else if (arg == "-h" || arg == "--help")
+        {
+            PrintUsage();
+            return 0;
+        }
+        else
+            positional.push_back(arg);
+    }
+
+    if (positional.empty() || positional.size() > 2 || (positional.size() == 1 && !hasTimeRange && !listSessions))
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    LogIndexReader index;
+    if (!index.Open(positional[0]))
+    {
+        fprintf(stderr, "mpqquery: cannot read %s: %s\n", positional[0].c_str(), index.Error().c_str());
+        return 1;
+    }
+
+    if (listSessions)
+    {
+        for (uint32_t s = 0; s < index.SessionCount(); s++)
+        {
+            const LogIndexSession& session = index.Session(s);
+            std::string_view path = index.SessionPath(s);
+            printf("%.*s\t%llu records\t%llu - %llu ms\n", static_cast<int>(path.size()), path.data(),
+                   (unsigned long long)session.recordCount, (unsigned long long)(session.firstTimestamp / 1000),
+                   (unsigned long long)(session.lastTimestamp / 1000));
+        }
+        return 0;
+    }
+
+    uint64_t matches = 0;
+    bool intact = true;
+
+    if (positional.size() == 2)
+    {
+        std::string key = NormalizeStormName(positional[1]);
+        std::pair<uint32_t, uint32_t> range;
+        if (prefix)
+        {
+            range = index.FindPrefix(key);
+        }
+        else
+        {
+            uint32_t name = index.FindName(key);
+            range = name == UINT32_MAX ? std::make_pair(0u, 0u) : std::make_pair(name, name + 1);
+        }
+
+        for (uint32_t name = range.first; name < range.second && intact; name++)
+        {
+            uint64_t nameMatches = 0;
+            uint32_t sessions = 0;
+            uint32_t lastSession = UINT32_MAX;
+            intact = index.ForEachPosting(name, [&](const LogIndexRecord& record)
+            {
+                if (record.timestamp < from || record.timestamp > to)
+                    return;
+                nameMatches++;
+                if (record.session != lastSession)
+                {
+                    sessions++;
+                    lastSession = record.session;
+                }
+                if (!count)
+                    PrintRecord(index, record);
+            });
+
+            if (count && nameMatches > 0)
+            {
+                std::string_view spelling = index.NameSpelling(name);
+                printf("%llu\t%u\t%.*s\n", (unsigned long long)nameMatches, sessions,
+                       static_cast<int>(spelling.size()), spelling.data());
+            }
+            matches += nameMatches;
+        }
+    }
+    else
+    {
+        intact = index.ForEachInTimeRange(from, to, [&](const LogIndexRecord& record)
+        {
+            matches++;
+            if (!count)
+                PrintRecord(index, record);
+        });
+        if (count)
+            printf("%llu\n", (unsigned long long)matches);
+    }
+
+    if (!intact)
+    {
+        fprintf(stderr, "mpqquery: %s is damaged\n", positional[0].c_str());
+        return 1;
+    }
+
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    fprintf(stderr, "%llu accesses in %.3f ms (%u names, %u sessions, %llu records indexed)\n",
+            (unsigned long long)matches, milliseconds, index.NameCount(), index.SessionCount(),
+            (unsigned long long)index.RecordCount());
+    return 0;
+}
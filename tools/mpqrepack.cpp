@@ -0,0 +1,449 @@
+/*
+    mpqrepack - Lay out an MPQ's files in the order the game loads them
+
+    Usage:
+        mpqrepack [-l listfile] -o <output> <archive> -- <log> [<log> ...]
+        mpqrepack --replay <archive> [<archive> ...] -- <log> [<log> ...]
+
+    The logs (any LogFormat; timestamps are not required) give the order in
+    which each session first opened its files. Their consensus order (see
+    AccessOrder.h) becomes the order of the files in the new archive; files
+    no log opened follow in their original order. The hash and block tables
+    are rewritten after the file data.
+
+    Block indices do not change, only file positions, so (attributes) - which
+    is indexed by block - stays valid. Files encrypted with a key that
+    depends on their position are re-encrypted; their names must be known,
+    from the logs or a listfile (-l). Data before the MPQ header (such as an
+    executable stub) is not copied.
+
+    --replay reads the files of every log in first-access order from each
+    given archive, like a loading screen would, after asking the kernel to
+    drop the archive from the page cache. Run it on the original and the
+    repacked archive to compare cold loads.
+*/
+
+#include "AccessOrder.h"
+#include "LogParser.h"
+#include "MappedFile.h"
+#include "MpqArchive.h"
+#include "StormHash.h"
+#include "StormName.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static const uint32_t MPQ_HEADER_ID = 0x1A51504D;
+static const uint32_t MPQ_HEADER_V0_SIZE = 0x20;
+static const uint32_t MPQ_HEADER_V1_SIZE = 0x2C;
+
+static void PrintUsage()
+{
+    fprintf(stderr,
+        "Usage: mpqrepack [-l listfile] -o <output> <archive> -- <log> [<log> ...]\n"
+        "       mpqrepack --replay <archive> [<archive> ...] -- <log> [<log> ...]\n");
+}
+
+static bool ReadAccessOrders(const std::vector<std::string>& logPaths, std::vector<std::vector<std::string>>& orders)
+{
+    for (const std::string& path : logPaths)
+    {
+        MappedFile log;
+        if (!log.Open(path))
+        {
+            fprintf(stderr, "mpqrepack: cannot read %s: %s\n", path.c_str(), strerror(errno));
+            return false;
+        }
+        orders.push_back(GetFirstAccessOrder(log.Data(), log.Size()));
+    }
+    return true;
+}
+
+static void WriteUInt32(char* p, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+// Decrypt a range with one key and encrypt it with another. Storm leaves
+// the last length % 4 bytes unencrypted.
+static void RekeyRange(char* data, size_t length, uint32_t oldKey, uint32_t newKey)
+{
+    std::vector<uint32_t> values(length / 4);
+    memcpy(values.data(), data, values.size() * 4);
+    DecryptStormBlock(values.data(), values.size(), oldKey);
+    EncryptStormBlock(values.data(), values.size(), newKey);
+    memcpy(data, values.data(), values.size() * 4);
+}
+
+// Re-encrypt a file whose key depends on its position. Returns false if
+// its sector table does not make sense with the old key.
+static bool RekeyFile(std::vector<char>& data, const MpqBlockEntry& block, uint32_t sectorSize,
+                      uint32_t oldKey, uint32_t newKey)
+{
+    if (block.flags & MPQ_FILE_SINGLE_UNIT)
+    {
+        RekeyRange(data.data(), data.size(), oldKey, newKey);
+        return true;
+    }
+
+    size_t sectors = (block.fileSize + sectorSize - 1) / sectorSize;
+    if ((block.flags & (MPQ_FILE_COMPRESS | MPQ_FILE_IMPLODE)) == 0)
+    {
+        for (size_t i = 0; i < sectors; i++)
+        {
+            size_t start = i * sectorSize;
+            if (start >= data.size())
+                break;
+            size_t length = std::min<size_t>(sectorSize, data.size() - start);
+            RekeyRange(data.data() + start, length, oldKey + static_cast<uint32_t>(i), newKey + static_cast<uint32_t>(i));
+        }
+        return true;
+    }
+
+    // Compressed files start with a table of sector offsets, encrypted with key - 1
+    size_t entries = sectors + 1 + ((block.flags & MPQ_FILE_SECTOR_CRC) ? 1 : 0);
+    if (entries * 4 > data.size())
+        return false;
+    std::vector<uint32_t> offsets(entries);
+    memcpy(offsets.data(), data.data(), entries * 4);
+    DecryptStormBlock(offsets.data(), entries, oldKey - 1);
+    for (size_t i = 0; i < sectors; i++)
+    {
+        if (offsets[i] > offsets[i + 1] || offsets[i + 1] > data.size())
+            return false;
+    }
+
+    RekeyRange(data.data(), entries * 4, oldKey - 1, newKey - 1);
+    for (size_t i = 0; i < sectors; i++)
+        RekeyRange(data.data() + offsets[i], offsets[i + 1] - offsets[i],
+                   oldKey + static_cast<uint32_t>(i), newKey + static_cast<uint32_t>(i));
+    return true;
+}
+
+static int Repack(const std::string& archivePath, const std::string& outputPath,
+                  const std::string& listfilePath, const std::vector<std::string>& logPaths)
+{
+    MpqArchive archive;
+    if (!archive.Open(archivePath))
+    {
+        fprintf(stderr, "mpqrepack: cannot read %s: %s\n", archivePath.c_str(), archive.Error().c_str());
+        return 1;
+    }
+    if (archive.FormatVersion() > 1 || archive.HiBlockTablePos() != 0)
+    {
+        fprintf(stderr, "mpqrepack: %s: only archives of format version 0 and 1 under 4 GB are supported\n",
+                archivePath.c_str());
+        return 1;
+    }
+
+    std::vector<std::vector<std::string>> orders;
+    if (!ReadAccessOrders(logPaths, orders))
+        return 1;
+    std::vector<std::string> consensus = GetConsensusOrder(orders);
+
+    const auto& hashTable = archive.HashTable();
+    const auto& blockTable = archive.BlockTable();
+
+    // A name for every block that has one, for re-encryption
+    std::vector<std::string> blockNames(blockTable.size());
+    auto nameBlocks = [&](const std::string& name, auto&& onBlock)
+    {
+        archive.ForEachHashEntry(HashStormName(name), [&](size_t index)
+        {
+            if (!archive.IsFileEntry(hashTable[index]))
+                return;
+            uint32_t block = hashTable[index].blockIndex;
+            if (blockNames[block].empty())
+                blockNames[block] = name;
+            onBlock(block);
+        });
+    };
+
+    if (!listfilePath.empty())
+    {
+        MappedFile listfile;
+        if (!listfile.Open(listfilePath))
+        {
+            fprintf(stderr, "mpqrepack: cannot read %s: %s\n", listfilePath.c_str(), strerror(errno));
+            return 1;
+        }
+        ForEachLogRecord(listfile.Data(), listfile.Size(), [&](const LogRecord& record)
+        {
+            nameBlocks(std::string(record.fileName), [](uint32_t) {});
+        });
+    }
+
+    // New layout: accessed files first, in consensus order (every locale of
+    // a name together), then the rest in their original order
+    std::vector<uint32_t> layout;
+    std::vector<bool> placed(blockTable.size());
+    for (const std::string& name : consensus)
+    {
+        nameBlocks(name, [&](uint32_t block)
+        {
+            if (!placed[block])
+            {
+                placed[block] = true;
+                layout.push_back(block);
+            }
+        });
+    }
+    size_t accessedBlocks = layout.size();
+
+    std::vector<uint32_t> rest;
+    for (uint32_t block = 0; block < blockTable.size(); block++)
+    {
+        if (!placed[block] && (blockTable[block].flags & MPQ_FILE_EXISTS))
+            rest.push_back(block);
+    }
+    std::sort(rest.begin(), rest.end(), [&blockTable](uint32_t a, uint32_t b)
+    {
+        return blockTable[a].filePos < blockTable[b].filePos;
+    });
+    layout.insert(layout.end(), rest.begin(), rest.end());
+
+    uint32_t headerSize = archive.FormatVersion() >= 1 ? MPQ_HEADER_V1_SIZE : MPQ_HEADER_V0_SIZE;
+    std::vector<MpqBlockEntry> newBlocks = blockTable;
+    uint64_t position = headerSize;
+    uint64_t accessedBytes = 0;
+    for (size_t i = 0; i < layout.size(); i++)
+    {
+        const MpqBlockEntry& block = blockTable[layout[i]];
+        if (!archive.GetBlockData(block))
+        {
+            fprintf(stderr, "mpqrepack: %s: block %u lies outside the archive\n", archivePath.c_str(), layout[i]);
+            return 1;
+        }
+        newBlocks[layout[i]].filePos = static_cast<uint32_t>(position);
+        position += block.compressedSize;
+        if (i < accessedBlocks)
+            accessedBytes += block.compressedSize;
+    }
+
+    // Blocks that hold no file keep no space
+    for (uint32_t block = 0; block < blockTable.size(); block++)
+    {
+        if ((blockTable[block].flags & MPQ_FILE_EXISTS) == 0)
+            newBlocks[block] = MpqBlockEntry{0, 0, 0, 0};
+    }
+
+    uint64_t hashTablePos = position;
+    uint64_t blockTablePos = hashTablePos + hashTable.size() * sizeof(MpqHashEntry);
+    uint64_t archiveSize = blockTablePos + newBlocks.size() * sizeof(MpqBlockEntry);
+    if (archiveSize > UINT32_MAX)
+    {
+        fprintf(stderr, "mpqrepack: the repacked archive would exceed 4 GB\n");
+        return 1;
+    }
+
+    FILE* out = fopen(outputPath.c_str(), "wb");
+    if (!out)
+    {
+        fprintf(stderr, "mpqrepack: cannot write %s: %s\n", outputPath.c_str(), strerror(errno));
+        return 1;
+    }
+
+    char header[MPQ_HEADER_V1_SIZE] = {};
+    WriteUInt32(header + 0x00, MPQ_HEADER_ID);
+    WriteUInt32(header + 0x04, headerSize);
+    WriteUInt32(header + 0x08, static_cast<uint32_t>(archiveSize));
+    WriteUInt32(header + 0x0C, archive.FormatVersion() | (static_cast<uint32_t>(__builtin_ctz(archive.SectorSize() / 0x200)) << 16));
+    WriteUInt32(header + 0x10, static_cast<uint32_t>(hashTablePos));
+    WriteUInt32(header + 0x14, static_cast<uint32_t>(blockTablePos));
+    WriteUInt32(header + 0x18, static_cast<uint32_t>(hashTable.size()));
+    WriteUInt32(header + 0x1C, static_cast<uint32_t>(newBlocks.size()));
+    fwrite(header, 1, headerSize, out);
+
+    size_t rekeyed = 0;
+    std::vector<char> buffer;
+    for (uint32_t index : layout)
+    {
+        const MpqBlockEntry& block = blockTable[index];
+        const char* data = archive.GetBlockData(block);
+        bool moves = newBlocks[index].filePos != block.filePos;
+        if ((block.flags & MPQ_FILE_ENCRYPTED) && (block.flags & MPQ_FILE_FIX_KEY) && moves)
+        {
+            if (blockNames[index].empty())
+            {
+                fprintf(stderr, "mpqrepack: block %u is encrypted with a position-dependent key and has no known name; "
+                                "add its name with -l\n", index);
+                fclose(out);
+                remove(outputPath.c_str());
+                return 1;
+            }
+
+            buffer.assign(data, data + block.compressedSize);
+            if (!RekeyFile(buffer, block, archive.SectorSize(), MpqArchive::GetFileKey(blockNames[index], block),
+                           MpqArchive::GetFileKey(blockNames[index], newBlocks[index])))
+            {
+                fprintf(stderr, "mpqrepack: cannot re-encrypt %s\n", blockNames[index].c_str());
+                fclose(out);
+                remove(outputPath.c_str());
+                return 1;
+            }
+            fwrite(buffer.data(), 1, buffer.size(), out);
+            rekeyed++;
+        }
+        else
+            fwrite(data, 1, block.compressedSize, out);
+    }
+
+    std::vector<MpqHashEntry> newHashes = hashTable;
+    EncryptStormBlock(reinterpret_cast<uint32_t*>(newHashes.data()), newHashes.size() * 4,
+                      HashStormString("(hash table)", StormHashType::FILE_KEY));
+    EncryptStormBlock(reinterpret_cast<uint32_t*>(newBlocks.data()), newBlocks.size() * 4,
+                      HashStormString("(block table)", StormHashType::FILE_KEY));
+    fwrite(newHashes.data(), sizeof(MpqHashEntry), newHashes.size(), out);
+    fwrite(newBlocks.data(), sizeof(MpqBlockEntry), newBlocks.size(), out);
+
+    bool ok = ferror(out) == 0;
+    if (fclose(out) != 0 || !ok)
+    {
+        fprintf(stderr, "mpqrepack: cannot write %s\n", outputPath.c_str());
+        return 1;
+    }
+
+    printf("%zu logs, %zu names in consensus order\n"
+           "%zu of %zu files in access order (%.1f MB), %zu re-encrypted; %s is %.1f MB\n",
+           logPaths.size(), consensus.size(), accessedBlocks, layout.size(), accessedBytes / 1e6,
+           rekeyed, outputPath.c_str(), archiveSize / 1e6);
+    return 0;
+}
+
+// One file read of a replay: position in the archive file, and size
+struct ReplayRead
+{
+    uint64_t offset;
+    uint32_t size;
+};
+
+static int Replay(const std::vector<std::string>& archivePaths, const std::vector<std::string>& logPaths)
+{
+    std::vector<std::vector<std::string>> orders;
+    if (!ReadAccessOrders(logPaths, orders))
+        return 1;
+
+    printf("%-24s %8s %10s %8s %10s %10s\n", "archive", "files", "MB", "seeks", "ms", "MB/s");
+    for (const std::string& path : archivePaths)
+    {
+        // Plan the reads, then unmap the archive so its pages can be dropped
+        std::vector<std::vector<ReplayRead>> sessions;
+        {
+            MpqArchive archive;
+            if (!archive.Open(path))
+            {
+                fprintf(stderr, "mpqrepack: cannot read %s: %s\n", path.c_str(), archive.Error().c_str());
+                return 1;
+            }
+            for (const auto& order : orders)
+            {
+                std::vector<ReplayRead> reads;
+                for (const std::string& name : order)
+                {
+                    int64_t index = archive.FindHashEntry(HashStormName(name));
+                    if (index < 0 || !archive.IsFileEntry(archive.HashTable()[static_cast<size_t>(index)]))
+                        continue;
+                    const MpqBlockEntry& block = archive.BlockTable()[archive.HashTable()[static_cast<size_t>(index)].blockIndex];
+                    reads.push_back(ReplayRead{archive.HeaderOffset() + block.filePos, block.compressedSize});
+                }
+                sessions.push_back(std::move(reads));
+            }
+        }
+
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            fprintf(stderr, "mpqrepack: cannot read %s: %s\n", path.c_str(), strerror(errno));
+            return 1;
+        }
+
+        uint64_t files = 0, bytes = 0, seeks = 0;
+        double seconds = 0;
+        std::vector<char> buffer;
+        for (const auto& reads : sessions)
+        {
+            // Cold start: drop the archive's cached pages. This cannot clear
+            // caches below the kernel, such as the drive's own.
+            fdatasync(fd);
+            if (posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) != 0)
+                fprintf(stderr, "mpqrepack: %s: cannot drop cached pages; the replay is warm\n", path.c_str());
+
+            uint64_t expected = UINT64_MAX;
+            auto start = std::chrono::steady_clock::now();
+            for (const ReplayRead& read : reads)
+            {
+                buffer.resize(read.size);
+                if (pread(fd, buffer.data(), read.size, static_cast<off_t>(read.offset)) < 0)
+                {
+                    fprintf(stderr, "mpqrepack: cannot read %s: %s\n", path.c_str(), strerror(errno));
+                    close(fd);
+                    return 1;
+                }
+                if (read.offset != expected)
+                    seeks++;
+                expected = read.offset + read.size;
+                files++;
+                bytes += read.size;
+            }
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        close(fd);
+
+        std::string name = path.substr(path.find_last_of('/') + 1);
+        printf("%-24s %8llu %10.1f %8llu %10.1f %10.1f\n", name.c_str(),
+               (unsigned long long)files, bytes / 1e6, (unsigned long long)seeks,
+               seconds * 1000, seconds > 0 ? bytes / 1e6 / seconds : 0.0);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    bool replay = false;
+    std::string outputPath;
+    std::string listfilePath;
+    std::vector<std::string> archivePaths;
+    std::vector<std::string> logPaths;
+    bool readingLogs = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (readingLogs)
+            logPaths.push_back(arg);
+        else if (arg == "--")
+            readingLogs = true;
+        else if (arg == "--replay")
+            replay = true;
+        else if (arg == "-o" && i + 1 < argc)
+            outputPath = argv[++i];
+        else if (arg == "-l" && i + 1 < argc)
+            listfilePath = argv[++i];
+        else if (arg == "-h" || arg == "--help")
+        {
+            PrintUsage();
+            return 0;
+        }
+        else
+            archivePaths.push_back(arg);
+    }
+
+    if (archivePaths.empty() || logPaths.empty() ||
+        (!replay && (outputPath.empty() || archivePaths.size() != 1)))
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    if (replay)
+        return Replay(archivePaths, logPaths);
+    return Repack(archivePaths[0], outputPath, listfilePath, logPaths);
+}
@@ -0,0 +1,498 @@
+/*
+    mpqseek - How far the game seeks in its archives while it loads
+
+    Usage:
+        mpqseek [-j threads] [--seek-ms ms] [--rate MB/s] [--window KB] [-o reads]
+                <archive> [<archive> ...] -- <log> [<log> ...]
+
+    Every logged open is mapped to the block it reads: its position and
+    stored (compressed) size in the archive, from the archive's block table.
+    Archives are given highest priority first, as for mpqshadow; an open is
+    placed in the archive its log line names if that archive has the file,
+    and otherwise in the first archive that has it, as Storm would.
+
+    Each log is a session, walked in time order (log order without
+    timestamps). Within a session, only the first read of a block goes to
+    the disk; later opens of the same block are taken as cached. For every
+    archive, the distance from the end of the previous read to the start of
+    the next one is collected into a histogram, forward and backward, and a
+    read that starts where the previous one ended is sequential.
+
+    The cold-cache cost is estimated with a simple disk model: reading costs
+    bytes / --rate (120 MB/s); a read that does not start within --window KB
+    (128) after the previous one costs a seek of --seek-ms (8, a hard disk;
+    use about 0.1 for an SSD); a forward gap within the window is read
+    through. The same reads in one contiguous run would cost one seek and
+    the bytes, which is what a perfect layout could reach.
+
+    With -o, every disk read is written as well:
+        <session> <tab> <archive> <tab> <name> <tab> <offset> <tab> <size> <tab> <distance>
+    with "-" as the distance of a session's first read from an archive.
+*/
+
+#include "LogParser.h"
+#include "MappedFile.h"
+#include "MpqArchive.h"
+#include "StormHash.h"
+#include "StormName.h"
+#include "StringTable.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Names hashed and looked up per task
+static const size_t NAMES_PER_BATCH = 4096;
+
+static const uint32_t NO_ARCHIVE = UINT32_MAX;
+static const int64_t NO_DISTANCE = INT64_MIN;
+
+// Upper bounds of the distance histogram's buckets, after "sequential"
+static const uint64_t DISTANCE_BUCKETS[] =
+{
+    4ull << 10, 64ull << 10, 1ull << 20, 16ull << 20, 256ull << 20, UINT64_MAX
+};
+static const char* DISTANCE_BUCKET_NAMES[] =
+{
+    "<= 4 KB", "<= 64 KB", "<= 1 MB", "<= 16 MB", "<= 256 MB", "> 256 MB"
+};
+static const size_t DISTANCE_BUCKET_COUNT = sizeof(DISTANCE_BUCKETS) / sizeof(DISTANCE_BUCKETS[0]);
+
+struct DiskModel
+{
+    double seekMs = 8;
+    double bytesPerMs = 120e6 / 1000;
+    uint64_t window = 128 << 10;
+};
+
+// An open of a log, with names local to the log
+struct LoggedOpen
+{
+    uint32_t name;
+    uint32_t archive;           // Index into the given archives of the logged archive, or NO_ARCHIVE
+    uint64_t time;
+};
+
+struct LogResult
+{
+    StringTable names;                      // Normalized
+    std::vector<std::string> spellings;
+    std::vector<LoggedOpen> opens;
+    std::vector<uint32_t> globalNames;
+    bool hasTimestamps = true;
+};
+
+// Where a name is in one archive
+struct NameLocation
+{
+    uint64_t offset = 0;        // In the archive file
+    uint32_t size = 0;
+    uint32_t block = 0;
+    bool found = false;
+};
+
+struct ArchiveStats
+{
+    uint64_t opens = 0;
+    uint64_t cachedOpens = 0;   // Repeated opens of a block in a session
+    uint64_t reads = 0;
+    uint64_t bytes = 0;
+    uint64_t sequential = 0;
+    uint64_t seeks = 0;         // Reads the disk model charges a seek for
+    uint64_t readThroughBytes = 0;
+    uint64_t forward[DISTANCE_BUCKET_COUNT] = {};
+    uint64_t backward[DISTANCE_BUCKET_COUNT] = {};
+    uint64_t sessionsWithReads = 0;
+
+    void Add(const ArchiveStats& other)
+    {
+        opens += other.opens;
+        cachedOpens += other.cachedOpens;
+        reads += other.reads;
+        bytes += other.bytes;
+        sequential += other.sequential;
+        seeks += other.seeks;
+        readThroughBytes += other.readThroughBytes;
+        sessionsWithReads += other.sessionsWithReads;
+        for (size_t b = 0; b < DISTANCE_BUCKET_COUNT; b++)
+        {
+            forward[b] += other.forward[b];
+            backward[b] += other.backward[b];
+        }
+    }
+
+    double ColdMs(const DiskModel& model) const
+    {
+        return seeks * model.seekMs + (bytes + readThroughBytes) / model.bytesPerMs;
+    }
+
+    // One seek per session, then every byte in one run
+    double ContiguousMs(const DiskModel& model) const
+    {
+        return sessionsWithReads * model.seekMs + bytes / model.bytesPerMs;
+    }
+};
+
+// A disk read of a session, for the -o report
+struct DiskRead
+{
+    uint32_t archive;
+    uint32_t name;
+    uint64_t offset;
+    uint32_t size;
+    int64_t distance;
+};
+
+static void PrintUsage()
+{
+    fprintf(stderr,
+        "Usage: mpqseek [-j threads] [--seek-ms ms] [--rate MB/s] [--window KB] [-o reads]\n"
+        "               <archive> [<archive> ...] -- <log> [<log> ...]\n");
+}
+
+static size_t GetDistanceBucket(uint64_t distance)
+{
+    size_t bucket = 0;
+    while (distance > DISTANCE_BUCKETS[bucket])
+        bucket++;
+    return bucket;
+}
+
+// Walk one session's opens in time order
+static void WalkSession(LogResult& log, const std::vector<MpqArchive>& archives,
+                        const std::vector<NameLocation>& locations, const std::vector<uint32_t>& servingArchives,
+                        const DiskModel& model, std::vector<ArchiveStats>& stats, std::vector<DiskRead>* reads)
+{
+    if (log.hasTimestamps)
+    {
+        std::stable_sort(log.opens.begin(), log.opens.end(), [](const LoggedOpen& a, const LoggedOpen& b)
+        {
+            return a.time < b.time;
+        });
+    }
+
+    size_t archiveCount = archives.size();
+    stats.assign(archiveCount, ArchiveStats());
+    std::vector<uint64_t> position(archiveCount, UINT64_MAX);
+    std::vector<std::vector<bool>> read(archiveCount);
+
+    for (const LoggedOpen& open : log.opens)
+    {
+        uint32_t name = log.globalNames[open.name];
+        uint32_t archive = servingArchives[name];
+        if (open.archive != NO_ARCHIVE && locations[name * archiveCount + open.archive].found)
+            archive = open.archive;
+        if (archive == NO_ARCHIVE)
+            continue;
+
+        ArchiveStats& archiveStats = stats[archive];
+        archiveStats.opens++;
+        // Names can share a block
+        const NameLocation& location = locations[name * archiveCount + archive];
+        if (read[archive].empty())
+            read[archive].resize(archives[archive].BlockTable().size());
+        if (read[archive][location.block])
+        {
+            archiveStats.cachedOpens++;
+            continue;
+        }
+        read[archive][location.block] = true;
+
+        int64_t distance = NO_DISTANCE;
+        if (position[archive] == UINT64_MAX)
+        {
+            // The first read of the session always seeks
+            archiveStats.sessionsWithReads++;
+            archiveStats.seeks++;
+        }
+        else
+        {
+            distance = static_cast<int64_t>(location.offset - position[archive]);
+            if (distance == 0)
+            {
+                archiveStats.sequential++;
+            }
+            else
+            {
+                uint64_t magnitude = distance > 0 ? static_cast<uint64_t>(distance) : static_cast<uint64_t>(-distance);
+                size_t bucket = GetDistanceBucket(magnitude);
+                if (distance > 0)
+                    archiveStats.forward[bucket]++;
+                else
+                    archiveStats.backward[bucket]++;
+
+                if (distance > 0 && magnitude <= model.window)
+                    archiveStats.readThroughBytes += magnitude;
+                else
+                    archiveStats.seeks++;
+            }
+        }
+
+        archiveStats.reads++;
+        archiveStats.bytes += location.size;
+        position[archive] = location.offset + location.size;
+        if (reads)
+            reads->push_back(DiskRead{archive, name, location.offset, location.size, distance});
+    }
+}
+
+static void PrintArchive(const char* name, const ArchiveStats& stats, const DiskModel& model)
+{
+    printf("%s: %llu opens, %llu disk reads (%llu cached), %.1f MB, %.1f%% sequential, %llu seeks\n", name,
+           (unsigned long long)stats.opens, (unsigned long long)stats.reads, (unsigned long long)stats.cachedOpens,
+           stats.bytes / 1e6, stats.reads ? 100.0 * stats.sequential / stats.reads : 0.0,
+           (unsigned long long)stats.seeks);
+    printf("    cold-cache estimate %.1f ms, contiguous %.1f ms\n", stats.ColdMs(model), stats.ContiguousMs(model));
+    printf("    %-14s %10s %10s\n", "Distance", "Forward", "Backward");
+    printf("    %-14s %10llu %10s\n", "sequential", (unsigned long long)stats.sequential, "");
+    for (size_t b = 0; b < DISTANCE_BUCKET_COUNT; b++)
+    {
+        printf("    %-14s %10llu %10llu\n", DISTANCE_BUCKET_NAMES[b], (unsigned long long)stats.forward[b],
+               (unsigned long long)stats.backward[b]);
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+    unsigned threads = 0;
+    DiskModel model;
+    std::string reportPath;
+    std::vector<std::string> archivePaths;
+    std::vector<std::string> logPaths;
+    bool readingLogs = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (readingLogs)
+            logPaths.push_back(arg);
+        else if (arg == "--")
+            readingLogs = true;
+        else if (arg == "-j" && i + 1 < argc)
+            threads = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--seek-ms" && i + 1 < argc)
+            model.seekMs = atof(argv[++i]);
+        else if (arg == "--rate" && i + 1 < argc)
+            model.bytesPerMs = atof(argv[++i]) * 1e6 / 1000;
+        else if (arg == "--window" && i + 1 < argc)
+            model.window = strtoull(argv[++i], nullptr, 10) << 10;
+        else if (arg == "-o" && i + 1 < argc)
+            reportPath = argv[++i];
+        else if (arg == "-h" || arg == "--help")
+        {
+            PrintUsage();
+            return 0;
+        }
+        else
+            archivePaths.push_back(arg);
+    }
+
+    if (archivePaths.empty() || logPaths.empty() || model.bytesPerMs <= 0 || model.seekMs < 0)
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    std::vector<MpqArchive> archives(archivePaths.size());
+    std::vector<std::string> archiveNames(archivePaths.size());
+    std::vector<std::string> normalizedArchiveNames(archivePaths.size());
+    for (size_t i = 0; i < archivePaths.size(); i++)
+    {
+        if (!archives[i].Open(archivePaths[i]))
+        {
+            fprintf(stderr, "mpqseek: cannot read %s: %s\n", archivePaths[i].c_str(), archives[i].Error().c_str());
+            return 1;
+        }
+        archiveNames[i] = std::filesystem::path(archivePaths[i]).filename().string();
+        normalizedArchiveNames[i] = NormalizeArchiveName(archiveNames[i]);
+    }
+    size_t archiveCount = archives.size();
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    // Parse every log in parallel, each with its own dictionary
+    std::vector<LogResult> logs(logPaths.size());
+    std::vector<std::string> errors(logPaths.size());
+    WorkStealingPool pool(threads);
+    ParallelFor(pool, logs.size(), [&](size_t l)
+    {
+        MappedFile file;
+        if (!file.Open(logPaths[l]))
+        {
+            errors[l] = "cannot read " + logPaths[l] + ": " + strerror(errno);
+            return;
+        }
+
+        LogResult& log = logs[l];
+        std::string key;
+        std::string archiveKey;
+        ForEachLogRecord(file.Data(), file.Size(), [&](const LogRecord& record)
+        {
+            key.resize(record.fileName.size());
+            for (size_t i = 0; i < record.fileName.size(); i++)
+                key[i] = NormalizeStormChar(record.fileName[i]);
+            auto [index, inserted] = log.names.Insert(key, HashBytes(key));
+            if (inserted)
+            {
+                log.spellings.emplace_back(record.fileName);
+                std::replace(log.spellings.back().begin(), log.spellings.back().end(), '/', '\\');
+            }
+
+            uint32_t archive = NO_ARCHIVE;
+            if (!record.archive.empty())
+            {
+                archiveKey = NormalizeArchiveName(record.archive);
+                for (size_t a = 0; a < archiveCount && archive == NO_ARCHIVE; a++)
+                {
+                    if (archiveKey == normalizedArchiveNames[a])
+                        archive = static_cast<uint32_t>(a);
+                }
+            }
+
+            log.hasTimestamps = log.hasTimestamps && record.hasTimestamp;
+            log.opens.push_back(LoggedOpen{index, archive, record.timestampMicros});
+        });
+    });
+    for (const std::string& error : errors)
+    {
+        if (!error.empty())
+        {
+            fprintf(stderr, "mpqseek: %s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    // Merge the dictionaries
+    StringTable names;
+    std::vector<std::string> spellings;
+    for (LogResult& log : logs)
+    {
+        log.globalNames.resize(log.names.Size());
+        for (uint32_t i = 0; i < log.names.Size(); i++)
+        {
+            auto [index, inserted] = names.Insert(log.names.Get(i), log.names.HashOf(i));
+            if (inserted)
+                spellings.push_back(std::move(log.spellings[i]));
+            log.globalNames[i] = index;
+        }
+        log.names.Clear();
+        log.spellings.clear();
+    }
+    size_t nameCount = names.Size();
+
+    // Look every name up in every archive
+    std::vector<std::string_view> views(nameCount);
+    for (size_t i = 0; i < nameCount; i++)
+        views[i] = names.Get(static_cast<uint32_t>(i));
+    std::vector<StormNameHashes> hashes(nameCount);
+    std::vector<NameLocation> locations(nameCount * archiveCount);
+    std::vector<uint32_t> servingArchives(nameCount, NO_ARCHIVE);
+    size_t batches = (nameCount + NAMES_PER_BATCH - 1) / NAMES_PER_BATCH;
+    ParallelFor(pool, batches, [&](size_t batch)
+    {
+        size_t first = batch * NAMES_PER_BATCH;
+        size_t last = std::min(first + NAMES_PER_BATCH, nameCount);
+        HashStormNames(views.data() + first, last - first, hashes.data() + first);
+
+        for (size_t i = first; i < last; i++)
+        {
+            for (size_t a = 0; a < archiveCount; a++)
+            {
+                int64_t index = archives[a].FindHashEntry(hashes[i]);
+                if (index < 0)
+                    continue;
+                const MpqHashEntry& entry = archives[a].HashTable()[static_cast<size_t>(index)];
+                if (!archives[a].IsFileEntry(entry))
+                    continue;
+
+                const MpqBlockEntry& block = archives[a].BlockTable()[entry.blockIndex];
+                NameLocation& location = locations[i * archiveCount + a];
+                location.offset = archives[a].HeaderOffset() + block.filePos;
+                location.size = block.compressedSize;
+                location.block = entry.blockIndex;
+                location.found = true;
+                if (servingArchives[i] == NO_ARCHIVE)
+                    servingArchives[i] = static_cast<uint32_t>(a);
+            }
+        }
+    });
+
+    // Walk the sessions
+    std::vector<std::vector<ArchiveStats>> sessionStats(logs.size());
+    std::vector<std::vector<DiskRead>> sessionReads(reportPath.empty() ? 0 : logs.size());
+    ParallelFor(pool, logs.size(), [&](size_t l)
+    {
+        WalkSession(logs[l], archives, locations, servingArchives, model, sessionStats[l],
+                    reportPath.empty() ? nullptr : &sessionReads[l]);
+        std::vector<LoggedOpen>().swap(logs[l].opens);
+    });
+
+    auto endTime = std::chrono::steady_clock::now();
+
+    std::vector<ArchiveStats> totals(archiveCount);
+    ArchiveStats all;
+    for (const auto& stats : sessionStats)
+    {
+        for (size_t a = 0; a < archiveCount; a++)
+            totals[a].Add(stats[a]);
+    }
+    for (const ArchiveStats& stats : totals)
+        all.Add(stats);
+
+    uint64_t missing = 0;
+    for (uint32_t archive : servingArchives)
+        missing += archive == NO_ARCHIVE ? 1 : 0;
+
+    bool untimed = false;
+    for (const LogResult& log : logs)
+        untimed = untimed || !log.hasTimestamps;
+
+    printf("%zu sessions, %zu names (%llu in no archive)%s\n", logs.size(), nameCount,
+           (unsigned long long)missing, untimed ? "; logs without timestamps are walked in log order" : "");
+    printf("Disk model: %.2f ms per seek, %.0f MB/s, gaps up to %llu KB read through\n\n", model.seekMs,
+           model.bytesPerMs * 1000 / 1e6, (unsigned long long)(model.window >> 10));
+    for (size_t a = 0; a < archiveCount; a++)
+        PrintArchive(archiveNames[a].c_str(), totals[a], model);
+    if (archiveCount > 1)
+        PrintArchive("All archives", all, model);
+
+    if (!reportPath.empty())
+    {
+        FILE* report = fopen(reportPath.c_str(), "wb");
+        if (!report)
+        {
+            fprintf(stderr, "mpqseek: cannot write %s: %s\n", reportPath.c_str(), strerror(errno));
+            return 1;
+        }
+        for (size_t l = 0; l < sessionReads.size(); l++)
+        {
+            for (const DiskRead& read : sessionReads[l])
+            {
+                fprintf(report, "%zu\t%s\t%s\t%llu\t%u\t", l + 1, archiveNames[read.archive].c_str(),
+                        spellings[read.name].c_str(), (unsigned long long)read.offset, read.size);
+                if (read.distance == NO_DISTANCE)
+                    fprintf(report, "-\n");
+                else
+                    fprintf(report, "%lld\n", (long long)read.distance);
+            }
+        }
+        bool ok = ferror(report) == 0;
+        if (fclose(report) != 0 || !ok)
+        {
+            fprintf(stderr, "mpqseek: cannot write %s\n", reportPath.c_str());
+            return 1;
+        }
+    }
+
+    fprintf(stderr, "read %zu logs and looked up %zu names in %zu archives in %.3f s on %zu threads\n",
+            logs.size(), nameCount, archiveCount, std::chrono::duration<double>(endTime - startTime).count(),
+            pool.ThreadCount());
+    return 0;
+}
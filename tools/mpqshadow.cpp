@@ -0,0 +1,314 @@
+/*
+    mpqshadow - Report which archives shadow each other for logged names
+
+    Storm searches its open archives in priority order and serves a file from
+    the first archive that has it. Copies of the file in archives further
+    down the chain are never read. Given the logged names and the game's
+    archives, highest priority first, this reports for every name which
+    archives contain it, which one serves it and how many bytes the other
+    copies take up.
+
+    Usage:
+        mpqshadow [-j threads] [-o report] <archive> [<archive> ...] -- <log> [<log> ...]
+
+    Archives are given highest priority first (for StarCraft: the mod or
+    patch archives, then patch_rt.mpq, BrooDat.mpq, StarDat.mpq). The summary
+    per archive goes to standard output. With -o, one line per name is
+    written as well, most shadowed bytes first:
+        <name> <tab> <serving archive> <tab> <shadowed bytes> <tab> <archive>:<stored bytes> ...
+
+    Names whose log line says they were served by another archive than the
+    first one in the chain are counted as mismatches; usually the priority
+    order or the set of archives given is not the one the game used.
+*/
+
+#include "LogParser.h"
+#include "MappedFile.h"
+#include "MpqArchive.h"
+#include "StormHash.h"
+#include "StormName.h"
+#include "StringTable.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Names hashed and looked up per task
+static const size_t NAMES_PER_BATCH = 4096;
+
+// Archives are tracked in a bit mask per name
+static const size_t MAX_ARCHIVES = 64;
+
+static const uint8_t NO_ARCHIVE = 0xFF;
+
+// Per archive totals
+struct ArchiveSummary
+{
+    uint64_t served = 0;            // Names served from this archive
+    uint64_t servedBytes = 0;
+    uint64_t shadowed = 0;          // Names this archive has but a higher one serves
+    uint64_t shadowedBytes = 0;
+};
+
+// Per name result of the lookup pass
+struct NameResult
+{
+    uint64_t archives = 0;          // Bit i: archive i contains the name
+    uint64_t shadowedBytes = 0;
+    uint8_t winner = NO_ARCHIVE;
+};
+
+static void PrintUsage()
+{
+    fprintf(stderr,
+        "Usage: mpqshadow [-j threads] [-o report] <archive> [<archive> ...] -- <log> [<log> ...]\n");
+}
+
+// Bytes a file takes up in the archive
+static uint64_t GetStoredSize(const MpqArchive& archive, int64_t hashIndex)
+{
+    const MpqHashEntry& entry = archive.HashTable()[static_cast<size_t>(hashIndex)];
+    if (!archive.IsFileEntry(entry))
+        return 0;
+    return archive.BlockTable()[entry.blockIndex].compressedSize;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned threads = 0;
+    std::string reportPath;
+    std::vector<std::string> archivePaths;
+    std::vector<std::string> logPaths;
+    bool readingLogs = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (readingLogs)
+            logPaths.push_back(arg);
+        else if (arg == "--")
+            readingLogs = true;
+        else if (arg == "-j" && i + 1 < argc)
+            threads = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "-o" && i + 1 < argc)
+            reportPath = argv[++i];
+        else if (arg == "-h" || arg == "--help")
+        {
+            PrintUsage();
+            return 0;
+        }
+        else
+            archivePaths.push_back(arg);
+    }
+
+    if (archivePaths.empty() || logPaths.empty())
+    {
+        PrintUsage();
+        return 2;
+    }
+    if (archivePaths.size() > MAX_ARCHIVES)
+    {
+        fprintf(stderr, "mpqshadow: at most %zu archives are supported\n", MAX_ARCHIVES);
+        return 2;
+    }
+
+    std::vector<MpqArchive> archives(archivePaths.size());
+    std::vector<std::string> archiveNames(archivePaths.size());
+    for (size_t i = 0; i < archivePaths.size(); i++)
+    {
+        if (!archives[i].Open(archivePaths[i]))
+        {
+            fprintf(stderr, "mpqshadow: cannot read %s: %s\n", archivePaths[i].c_str(), archives[i].Error().c_str());
+            return 1;
+        }
+        archiveNames[i] = std::filesystem::path(archivePaths[i]).filename().string();
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    // Unique names, with the archive the first log line for each named
+    StringTable uniqueNames;
+    std::vector<std::string> spellings;
+    std::vector<std::string> loggedArchives;
+    std::string key;
+    for (const std::string& logPath : logPaths)
+    {
+        MappedFile log;
+        if (!log.Open(logPath))
+        {
+            fprintf(stderr, "mpqshadow: cannot read %s: %s\n", logPath.c_str(), strerror(errno));
+            return 1;
+        }
+
+        ForEachLogRecord(log.Data(), log.Size(), [&](const LogRecord& record)
+        {
+            key.resize(record.fileName.size());
+            for (size_t i = 0; i < record.fileName.size(); i++)
+                key[i] = NormalizeStormChar(record.fileName[i]);
+            if (!uniqueNames.Insert(key, HashBytes(key)).second)
+                return;
+
+            std::string spelling(record.fileName);
+            std::replace(spelling.begin(), spelling.end(), '/', '\\');
+            spellings.push_back(std::move(spelling));
+            loggedArchives.push_back(NormalizeArchiveName(record.archive));
+        });
+    }
+
+    // One pass: hash each batch of names once, then look it up in every
+    // archive. Each batch writes only its own names' slots.
+    size_t nameCount = uniqueNames.Size();
+    size_t archiveCount = archives.size();
+    std::vector<std::string_view> views(nameCount);
+    for (size_t i = 0; i < nameCount; i++)
+        views[i] = uniqueNames.Get(static_cast<uint32_t>(i));
+    std::vector<StormNameHashes> hashes(nameCount);
+    std::vector<NameResult> results(nameCount);
+    std::vector<uint64_t> storedSizes(nameCount * archiveCount);
+    size_t batches = (nameCount + NAMES_PER_BATCH - 1) / NAMES_PER_BATCH;
+
+    WorkStealingPool pool(threads);
+    ParallelFor(pool, batches, [&](size_t batch)
+    {
+        size_t first = batch * NAMES_PER_BATCH;
+        size_t last = std::min(first + NAMES_PER_BATCH, nameCount);
+        HashStormNames(views.data() + first, last - first, hashes.data() + first);
+
+        for (size_t i = first; i < last; i++)
+        {
+            NameResult& result = results[i];
+            for (size_t a = 0; a < archiveCount; a++)
+            {
+                int64_t index = archives[a].FindHashEntry(hashes[i]);
+                if (index < 0 || !archives[a].IsFileEntry(archives[a].HashTable()[static_cast<size_t>(index)]))
+                    continue;
+
+                uint64_t size = GetStoredSize(archives[a], index);
+                storedSizes[i * archiveCount + a] = size;
+                result.archives |= uint64_t(1) << a;
+                if (result.winner == NO_ARCHIVE)
+                    result.winner = static_cast<uint8_t>(a);
+                else
+                    result.shadowedBytes += size;
+            }
+        }
+    });
+
+    auto lookupTime = std::chrono::steady_clock::now();
+
+    // Totals per archive, and names served from another archive than logged
+    std::vector<ArchiveSummary> summaries(archiveCount);
+    std::vector<std::string> normalizedArchiveNames(archiveCount);
+    for (size_t a = 0; a < archiveCount; a++)
+        normalizedArchiveNames[a] = NormalizeArchiveName(archiveNames[a]);
+
+    uint64_t missing = 0;
+    uint64_t shadowedNames = 0;
+    uint64_t shadowedBytes = 0;
+    uint64_t mismatches = 0;
+    for (size_t i = 0; i < nameCount; i++)
+    {
+        const NameResult& result = results[i];
+        if (result.winner == NO_ARCHIVE)
+        {
+            missing++;
+            continue;
+        }
+
+        for (size_t a = 0; a < archiveCount; a++)
+        {
+            if ((result.archives & (uint64_t(1) << a)) == 0)
+                continue;
+            uint64_t size = storedSizes[i * archiveCount + a];
+            if (a == result.winner)
+            {
+                summaries[a].served++;
+                summaries[a].servedBytes += size;
+            }
+            else
+            {
+                summaries[a].shadowed++;
+                summaries[a].shadowedBytes += size;
+            }
+        }
+
+        // More than one archive has it
+        if ((result.archives & (result.archives - 1)) != 0)
+        {
+            shadowedNames++;
+            shadowedBytes += result.shadowedBytes;
+        }
+        if (!loggedArchives[i].empty() && loggedArchives[i] != normalizedArchiveNames[result.winner])
+            mismatches++;
+    }
+
+    printf("%-24s %10s %14s %10s %14s\n", "archive", "served", "served bytes", "shadowed", "shadowed bytes");
+    for (size_t a = 0; a < archiveCount; a++)
+    {
+        printf("%-24s %10llu %14llu %10llu %14llu\n", archiveNames[a].c_str(),
+               (unsigned long long)summaries[a].served, (unsigned long long)summaries[a].servedBytes,
+               (unsigned long long)summaries[a].shadowed, (unsigned long long)summaries[a].shadowedBytes);
+    }
+    printf("%zu names: %llu in several archives (%llu bytes shadowed), %llu in none",
+           nameCount, (unsigned long long)shadowedNames, (unsigned long long)shadowedBytes,
+           (unsigned long long)missing);
+    if (mismatches)
+        printf(", %llu served by another archive than logged", (unsigned long long)mismatches);
+    printf("\n");
+
+    if (!reportPath.empty())
+    {
+        std::vector<size_t> order;
+        for (size_t i = 0; i < nameCount; i++)
+        {
+            if (results[i].winner != NO_ARCHIVE)
+                order.push_back(i);
+        }
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+        {
+            if (results[a].shadowedBytes != results[b].shadowedBytes)
+                return results[a].shadowedBytes > results[b].shadowedBytes;
+            return spellings[a] < spellings[b];
+        });
+
+        FILE* report = fopen(reportPath.c_str(), "wb");
+        if (!report)
+        {
+            fprintf(stderr, "mpqshadow: cannot write %s: %s\n", reportPath.c_str(), strerror(errno));
+            return 1;
+        }
+        for (size_t i : order)
+        {
+            const NameResult& result = results[i];
+            fprintf(report, "%s\t%s\t%llu\t", spellings[i].c_str(), archiveNames[result.winner].c_str(),
+                    (unsigned long long)result.shadowedBytes);
+            const char* separator = "";
+            for (size_t a = 0; a < archiveCount; a++)
+            {
+                if ((result.archives & (uint64_t(1) << a)) == 0)
+                    continue;
+                fprintf(report, "%s%s:%llu", separator, archiveNames[a].c_str(),
+                        (unsigned long long)storedSizes[i * archiveCount + a]);
+                separator = " ";
+            }
+            fputc('\n', report);
+        }
+        bool ok = ferror(report) == 0;
+        if (fclose(report) != 0 || !ok)
+        {
+            fprintf(stderr, "mpqshadow: cannot write %s\n", reportPath.c_str());
+            return 1;
+        }
+    }
+
+    double lookupSeconds = std::chrono::duration<double>(lookupTime - startTime).count();
+    fprintf(stderr, "read and looked up %zu names in %zu archives in %.3f s on %zu threads\n",
+            nameCount, archiveCount, lookupSeconds, pool.ThreadCount());
+    return 0;
+}
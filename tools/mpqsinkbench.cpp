@@ -0,0 +1,287 @@
+/*
+    mpqsinkbench - Benchmark the record pipeline against writing every sink in the hook
+
+    Usage:
+        mpqsinkbench [--threads n] [--records n] [--rate n] [--queue n] [-o directory]
+
+    Game threads (--threads, 4) each log --records (20000) synthetic file
+    accesses at --rate accesses per second (20000, 0 for as fast as they
+    can), first with no sinks and then adding a text, binary, trace and
+    stats sink one at a time. Every configuration is run twice:
+
+        queued  as the plugin does with sinks: the hook copies the access
+                into the record queue (--queue records, 4096), and one
+                thread hands it to the sinks
+        inline  every sink is written in the hook, under a lock
+
+    and the time the hook takes per access is reported (mean, median and
+    99th percentile), with how often a full queue made it wait. The queued
+    cost should stay the same as sinks are added, as long as the sink
+    thread keeps up with the rate. Sink output goes to files in --output
+    (the system's temporary directory), which are removed afterwards.
+*/
+
+#include "RecordSinks.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using BenchClock = std::chrono::steady_clock;
+
+static const char* SINK_SPECS[] =
+{
+    "text,mpqsinkbench.txt,format=0,threadId=1",
+    "binary,mpqsinkbench.bin",
+    "trace,mpqsinkbench.json",
+    "stats,mpqsinkbench.stats.txt"
+};
+static const size_t SINK_COUNT = sizeof(SINK_SPECS) / sizeof(SINK_SPECS[0]);
+
+struct BenchOptions
+{
+    unsigned threads = 4;
+    unsigned records = 20000;
+    unsigned rate = 20000;
+    unsigned queue = 4096;
+    std::filesystem::path directory;
+};
+
+struct BenchResult
+{
+    double meanNs = 0;
+    double medianNs = 0;
+    double p99Ns = 0;
+    uint64_t stalls = 0;
+    double seconds = 0;
+};
+
+static void PrintUsage()
+{
+    fprintf(stderr, "Usage: mpqsinkbench [--threads n] [--records n] [--rate n] [--queue n] [-o directory]\n");
+}
+
+static std::vector<std::unique_ptr<IRecordSink>> CreateSinks(const BenchOptions& options, size_t count)
+{
+    std::vector<std::unique_ptr<IRecordSink>> sinks;
+    for (size_t i = 0; i < count; i++)
+    {
+        RecordSinkSpec spec;
+        std::string error;
+        std::unique_ptr<IRecordSink> sink;
+        if (ParseRecordSinkSpec(SINK_SPECS[i], spec, error))
+        {
+            spec.path = (options.directory / spec.path).string();
+            sink = CreateRecordSink(spec, 4711, "mpqsinkbench", error);
+        }
+        if (!sink)
+        {
+            fprintf(stderr, "mpqsinkbench: %s\n", error.c_str());
+            exit(1);
+        }
+        sinks.push_back(std::move(sink));
+    }
+    return sinks;
+}
+
+// What the hook fills in for every access
+static void CaptureAccess(AccessRecord& record, const std::string& archive, const std::string& fileName,
+                          uint32_t threadId, uint64_t startMicros)
+{
+    record.startMicros = startMicros;
+    record.stormMicros = 40;
+    record.timestampMs = 1734512345678 + startMicros / 1000;
+    record.function = "SFileOpenFileEx";
+    record.threadId = threadId;
+    SetRecordNames(record, archive.data(), archive.size(), fileName.c_str());
+}
+
+// Run the game threads, calling hook(threadIndex, record index) for every access.
+// Returns the time of every call.
+template <typename Hook>
+static std::vector<uint64_t> RunGameThreads(const BenchOptions& options, Hook&& hook)
+{
+    std::vector<std::vector<uint64_t>> times(options.threads);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < options.threads; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            times[t].reserve(options.records);
+            BenchClock::time_point next = BenchClock::now();
+            auto period = options.rate ? std::chrono::nanoseconds(1000000000ull / options.rate)
+                                       : std::chrono::nanoseconds(0);
+            for (unsigned i = 0; i < options.records; i++)
+            {
+                if (options.rate)
+                {
+                    next += period;
+                    while (BenchClock::now() < next)
+                        std::this_thread::yield();
+                }
+
+                BenchClock::time_point start = BenchClock::now();
+                hook(t, i);
+                times[t].push_back(static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - start).count()));
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    std::vector<uint64_t> all;
+    for (const auto& threadTimes : times)
+        all.insert(all.end(), threadTimes.begin(), threadTimes.end());
+    return all;
+}
+
+static void Summarize(std::vector<uint64_t>& times, BenchResult& result)
+{
+    if (times.empty())
+        return;
+    std::sort(times.begin(), times.end());
+    uint64_t total = 0;
+    for (uint64_t time : times)
+        total += time;
+    result.meanNs = static_cast<double>(total) / times.size();
+    result.medianNs = static_cast<double>(times[times.size() / 2]);
+    result.p99Ns = static_cast<double>(times[times.size() * 99 / 100]);
+}
+
+static BenchResult RunQueued(const BenchOptions& options, const std::vector<std::string>& names, size_t sinkCount)
+{
+    RecordQueue queue(options.queue);
+    CRecordDispatcher dispatcher;
+    for (auto& sink : CreateSinks(options, sinkCount))
+        dispatcher.AddSink(std::move(sink));
+
+    // The sink thread, polling as the plugin's does when the game is busy
+    std::atomic<bool> stop{false};
+    std::thread consumer([&]()
+    {
+        while (!stop)
+        {
+            if (dispatcher.Dispatch(queue, queue.Capacity()) == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        while (dispatcher.Dispatch(queue, queue.Capacity()) > 0)
+        {
+        }
+        dispatcher.Close();
+    });
+
+    std::atomic<uint64_t> stalls{0};
+    BenchResult result;
+    BenchClock::time_point start = BenchClock::now();
+    std::vector<uint64_t> times = RunGameThreads(options, [&](unsigned thread, unsigned i)
+    {
+        AccessRecord* record;
+        while (!(record = queue.BeginPush()))
+        {
+            stalls.fetch_add(1, std::memory_order_relaxed);
+            std::this_thread::yield();
+        }
+        CaptureAccess(*record, "patch_rt.mpq", names[i % names.size()], 5000 + thread, i);
+        queue.CommitPush(record);
+    });
+    stop = true;
+    consumer.join();
+    result.seconds = std::chrono::duration<double>(BenchClock::now() - start).count();
+
+    Summarize(times, result);
+    result.stalls = stalls;
+    return result;
+}
+
+static BenchResult RunInline(const BenchOptions& options, const std::vector<std::string>& names, size_t sinkCount)
+{
+    std::vector<std::unique_ptr<IRecordSink>> sinks = CreateSinks(options, sinkCount);
+    std::mutex sinkMutex;
+
+    BenchResult result;
+    BenchClock::time_point start = BenchClock::now();
+    std::vector<uint64_t> times = RunGameThreads(options, [&](unsigned thread, unsigned i)
+    {
+        AccessRecord record;
+        CaptureAccess(record, "patch_rt.mpq", names[i % names.size()], 5000 + thread, i);
+        std::lock_guard<std::mutex> lock(sinkMutex);
+        for (const auto& sink : sinks)
+            sink->Write(record);
+    });
+    sinks.clear();
+    result.seconds = std::chrono::duration<double>(BenchClock::now() - start).count();
+
+    Summarize(times, result);
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    options.directory = std::filesystem::temp_directory_path();
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc)
+            options.threads = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--records" && i + 1 < argc)
+            options.records = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--rate" && i + 1 < argc)
+            options.rate = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--queue" && i + 1 < argc)
+            options.queue = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "-o" && i + 1 < argc)
+            options.directory = argv[++i];
+        else
+        {
+            PrintUsage();
+            return arg == "-h" || arg == "--help" ? 0 : 2;
+        }
+    }
+    if (options.threads == 0 || options.records == 0 || options.queue == 0)
+    {
+        PrintUsage();
+        return 2;
+    }
+
+    // Names of typical length and shape
+    std::vector<std::string> names;
+    for (unsigned i = 0; i < 1000; i++)
+        names.push_back("unit\\protoss\\building" + std::to_string(i) + "\\shadow.grp");
+
+    printf("%u threads, %u accesses each, %s, queue of %u records\n\n", options.threads, options.records,
+           options.rate ? (std::to_string(options.rate) + " per second per thread").c_str() : "unpaced",
+           options.queue);
+    printf("%-6s %-7s %10s %10s %10s %10s %9s\n", "Sinks", "Mode", "Mean ns", "Median ns", "p99 ns",
+           "Stalls", "Seconds");
+
+    for (size_t sinkCount = 0; sinkCount <= SINK_COUNT; sinkCount++)
+    {
+        BenchResult queued = RunQueued(options, names, sinkCount);
+        BenchResult direct = RunInline(options, names, sinkCount);
+        printf("%-6zu %-7s %10.0f %10.0f %10.0f %10llu %9.2f\n", sinkCount, "queued", queued.meanNs,
+               queued.medianNs, queued.p99Ns, (unsigned long long)queued.stalls, queued.seconds);
+        printf("%-6zu %-7s %10.0f %10.0f %10.0f %10s %9.2f\n", sinkCount, "inline", direct.meanNs,
+               direct.medianNs, direct.p99Ns, "-", direct.seconds);
+    }
+
+    for (const char* spec : SINK_SPECS)
+    {
+        RecordSinkSpec parsed;
+        std::string error;
+        if (ParseRecordSinkSpec(spec, parsed, error))
+        {
+            std::error_code ignored;
+            std::filesystem::remove(options.directory / parsed.path, ignored);
+        }
+    }
+    return 0;
+}
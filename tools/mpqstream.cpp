@@ -0,0 +1,350 @@
+/*
+    mpqstream - Read the access records a stream sink sends
+
+    Usage:
+        mpqstream [--quiet] <name>
+        mpqstream --test [--seconds n] [--reader-delay us] [--batch KB] [--backlog KB]
+
+    Connects to the stream sink configured as Sink<n>=stream,<name> (waiting
+    for the game to open it) and prints every record as a line of text, as
+    a reference for readers of the format in RecordStream.h. Once a second,
+    the records per second and the records dropped so far are written to
+    stderr. --quiet prints only those.
+
+    --test runs the stream sink against a stand-in reader in this process
+    for --seconds (3), writing records as fast as it can, as the pipeline
+    thread would with a game far busier than any real one. The reader sleeps
+    --reader-delay microseconds after every frame (runs with 0 and 2000
+    without it), to stand in for a slow one. It reports the records sent,
+    received and dropped, the throughput, and the time the sink took per
+    record, and checks that every record arrived in order or was counted as
+    dropped.
+*/
+
+#include "RecordSinks.h"
+#include "RecordStream.h"
+#include "RecordCodec.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using StreamClock = std::chrono::steady_clock;
+
+static void PrintUsage()
+{
+    fprintf(stderr,
+        "Usage: mpqstream [--quiet] <name>\n"
+        "       mpqstream --test [--seconds n] [--reader-delay us] [--batch KB] [--backlog KB]\n");
+}
+
+// Read a frame into data. Returns false when the stream ends.
+static bool ReadFrame(CRecordStreamClient& client, RecordStreamFrame& frame, std::vector<char>& data)
+{
+    if (!client.ReadAll(reinterpret_cast<char*>(&frame), sizeof(frame)))
+        return false;
+    data.resize(frame.size);
+    return frame.size == 0 || client.ReadAll(data.data(), data.size());
+}
+
+static bool ReadHeader(CRecordStreamClient& client)
+{
+    RecordLogHeader header;
+    if (!client.ReadAll(reinterpret_cast<char*>(&header), sizeof(header)))
+        return false;
+    if (memcmp(header.magic, RECORD_MAGIC, sizeof(header.magic)) != 0 || header.version != RECORD_VERSION)
+    {
+        fprintf(stderr, "mpqstream: not a record stream, or an unsupported version\n");
+        return false;
+    }
+    return true;
+}
+
+static int ReadStream(const std::string& name, bool quiet)
+{
+    CRecordStreamClient client;
+    bool waiting = false;
+    while (!client.Connect(name))
+    {
+        if (!waiting)
+            fprintf(stderr, "mpqstream: waiting for %s\n", GetRecordStreamPath(name).c_str());
+        waiting = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+    if (!ReadHeader(client))
+        return 1;
+
+    RecordStreamFrame frame;
+    std::vector<char> data;
+    uint64_t records = 0;
+    uint64_t dropped = 0;
+    uint64_t lastRecords = 0;
+    StreamClock::time_point lastReport = StreamClock::now();
+    std::string line;
+
+    while (ReadFrame(client, frame, data))
+    {
+        dropped = frame.dropped;
+        size_t offset = 0;
+        RecordFields fields;
+        size_t size;
+        while (offset < data.size() && (size = DecodeRecord(data.data() + offset, data.size() - offset, fields)) > 0)
+        {
+            offset += size;
+            records++;
+            if (quiet)
+                continue;
+
+            line.clear();
+            line += std::to_string(fields.timestampMs);
+            line += " [";
+            line += std::to_string(fields.threadId);
+            line += "] ";
+            if (!fields.archive.empty())
+            {
+                line.append(fields.archive);
+                line += ": ";
+            }
+            line.append(fields.fileName);
+            line += '\n';
+            fwrite(line.data(), 1, line.size(), stdout);
+        }
+        if (offset != data.size())
+        {
+            fprintf(stderr, "mpqstream: damaged frame\n");
+            return 1;
+        }
+
+        double seconds = std::chrono::duration<double>(StreamClock::now() - lastReport).count();
+        if (seconds >= 1.0)
+        {
+            fflush(stdout);
+            fprintf(stderr, "%.0f records/s, %llu records, %llu dropped\n", (records - lastRecords) / seconds,
+                    (unsigned long long)records, (unsigned long long)dropped);
+            lastRecords = records;
+            lastReport = StreamClock::now();
+        }
+    }
+
+    fflush(stdout);
+    fprintf(stderr, "Stream ended: %llu records, %llu dropped\n", (unsigned long long)records,
+            (unsigned long long)dropped);
+    return 0;
+}
+
+struct TestOptions
+{
+    double seconds = 3;
+    unsigned batchKB = 16;
+    unsigned backlogKB = 1024;
+};
+
+// Records, dropped and connected are watched by the writer while the reader runs
+struct ReaderResult
+{
+    std::atomic<uint64_t> records{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> connected{false};
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t outOfOrder = 0;
+};
+
+// The stand-in reader. Record i of the test has startMicros i, so every
+// frame must carry on from the records received and dropped before it.
+static void RunReader(const std::string& name, unsigned delayMicros, ReaderResult& result)
+{
+    CRecordStreamClient client;
+    StreamClock::time_point deadline = StreamClock::now() + std::chrono::seconds(5);
+    while (!client.Connect(name))
+    {
+        if (StreamClock::now() > deadline)
+            return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (!ReadHeader(client))
+        return;
+    result.connected = true;
+
+    RecordStreamFrame frame;
+    std::vector<char> data;
+    while (ReadFrame(client, frame, data))
+    {
+        result.frames++;
+        result.bytes += sizeof(frame) + data.size();
+        result.dropped = frame.dropped;
+
+        uint64_t expected = result.records + frame.dropped;
+        size_t offset = 0;
+        RecordFields fields;
+        size_t size;
+        while (offset < data.size() && (size = DecodeRecord(data.data() + offset, data.size() - offset, fields)) > 0)
+        {
+            offset += size;
+            if (fields.startMicros != expected)
+                result.outOfOrder++;
+            expected = fields.startMicros + 1;
+            result.records++;
+        }
+        if (offset != data.size())
+            result.outOfOrder++;
+
+        if (delayMicros > 0)
+            std::this_thread::sleep_for(std::chrono::microseconds(delayMicros));
+    }
+}
+
+static bool RunTest(const TestOptions& options, unsigned delayMicros)
+{
+    std::string name = "mpqstream-test-" + std::to_string(getpid());
+    std::string specText = "stream," + name + ",batchKB=" + std::to_string(options.batchKB) +
+                           ",backlogKB=" + std::to_string(options.backlogKB);
+
+    RecordSinkSpec spec;
+    std::string error;
+    std::unique_ptr<IRecordSink> sink;
+    if (ParseRecordSinkSpec(specText, spec, error))
+        sink = CreateRecordSink(spec, 4711, "mpqstream", error);
+    if (!sink)
+    {
+        fprintf(stderr, "mpqstream: %s\n", error.c_str());
+        return false;
+    }
+
+    ReaderResult reader;
+    std::thread readerThread(RunReader, name, delayMicros, std::ref(reader));
+
+    // Wait for the reader, as records written before it connects are dropped
+    StreamClock::time_point deadline = StreamClock::now() + std::chrono::seconds(5);
+    AccessRecord record;
+    record.stormMicros = 40;
+    record.function = "SFileOpenFileEx";
+    record.threadId = 5000;
+    uint64_t sent = 0;
+    while (!reader.connected && StreamClock::now() < deadline)
+    {
+        sink->Poll();
+        std::this_thread::yield();
+    }
+
+    // The pipeline thread: Write for every record, and Poll between batches
+    std::vector<std::string> names;
+    for (unsigned i = 0; i < 1000; i++)
+        names.push_back("unit\\protoss\\building" + std::to_string(i) + "\\shadow.grp");
+
+    StreamClock::time_point start = StreamClock::now();
+    StreamClock::time_point end = start + std::chrono::duration_cast<StreamClock::duration>(
+                                              std::chrono::duration<double>(options.seconds));
+    StreamClock::time_point now = start;
+    while (now < end)
+    {
+        for (unsigned i = 0; i < 256; i++, sent++)
+        {
+            record.startMicros = sent;
+            record.timestampMs = 1734512345678 + sent / 1000;
+            const std::string& fileName = names[sent % names.size()];
+            SetRecordNames(record, "patch_rt.mpq", 12, fileName.c_str());
+            sink->Write(record);
+        }
+        sink->Poll();
+        now = StreamClock::now();
+    }
+    double seconds = std::chrono::duration<double>(now - start).count();
+
+    // Let the reader catch up on the backlog before the sink closes
+    sink->Flush();
+    deadline = StreamClock::now() + std::chrono::seconds(5);
+    while (reader.connected && StreamClock::now() < deadline)
+    {
+        sink->Poll();
+        if (reader.records + reader.dropped >= sent)
+            break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    sink.reset();
+    readerThread.join();
+
+    uint64_t unaccounted = sent - std::min(sent, reader.records + reader.dropped);
+    bool ok = reader.connected && reader.outOfOrder == 0 && unaccounted == 0;
+    printf("%-9u %12llu %12llu %12llu %10.2f %10.1f %9.0f %10llu  %s\n", delayMicros, (unsigned long long)sent,
+           (unsigned long long)reader.records.load(), (unsigned long long)reader.dropped.load(),
+           reader.records / seconds / 1e6, reader.bytes / seconds / (1024 * 1024),
+           sent ? seconds * 1e9 / sent : 0.0, (unsigned long long)reader.frames,
+           ok ? "ok" : (reader.connected ? "MISMATCH" : "NO READER"));
+    if (reader.outOfOrder || unaccounted)
+        fprintf(stderr, "mpqstream: %llu records out of order, %llu neither received nor counted as dropped\n",
+                (unsigned long long)reader.outOfOrder, (unsigned long long)unaccounted);
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    bool test = false;
+    bool quiet = false;
+    TestOptions options;
+    std::vector<unsigned> delays;
+    std::string name;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--test")
+            test = true;
+        else if (arg == "--quiet")
+            quiet = true;
+        else if (arg == "--seconds" && i + 1 < argc)
+            options.seconds = atof(argv[++i]);
+        else if (arg == "--reader-delay" && i + 1 < argc)
+            delays.push_back(static_cast<unsigned>(strtoul(argv[++i], nullptr, 10)));
+        else if (arg == "--batch" && i + 1 < argc)
+            options.batchKB = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--backlog" && i + 1 < argc)
+            options.backlogKB = static_cast<unsigned>(strtoul(argv[++i], nullptr, 10));
+        else if (arg == "-h" || arg == "--help")
+        {
+            PrintUsage();
+            return 0;
+        }
+        else if (name.empty() && arg[0] != '-')
+            name = arg;
+        else
+        {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    if (!test)
+    {
+        if (name.empty())
+        {
+            PrintUsage();
+            return 2;
+        }
+        return ReadStream(name, quiet);
+    }
+
+    if (options.seconds <= 0)
+    {
+        PrintUsage();
+        return 2;
+    }
+    if (delays.empty())
+        delays = { 0, 2000 };
+
+    printf("Batches of %u KB, backlog of %u KB, %.1f s per run\n\n", options.batchKB, options.backlogKB,
+           options.seconds);
+    printf("%-9s %12s %12s %12s %10s %10s %9s %10s\n", "Delay us", "Sent", "Received", "Dropped",
+           "M rec/s", "MB/s", "ns/rec", "Frames");
+    bool ok = true;
+    for (unsigned delay : delays)
+        ok = RunTest(options, delay) && ok;
+    return ok ? 0 : 1;
+}